@@ -1,7 +1,10 @@
 #include "epd_driver.h"
+#include "font.h"
 #include "esp_assert.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #if ESP_IDF_VERSION < (4, 0, 0) || ARDUINO_ARCH_ESP32
 #include "rom/miniz.h"
 #else
@@ -19,6 +22,18 @@ typedef struct {
   int bits_stored; /* the number of bits from the codepoint that fits in char */
 } utf_t;
 
+// Largest decompressed glyph that fits the static scratch buffer, bigger
+// glyphs fall back to a heap allocation.
+#define GLYPH_BUFFER_SIZE 2048
+
+// The decompressor is ~11KB so it and the glyph scratch are allocated once
+// instead of per character. Text can be drawn from multiple tasks, so both
+// are guarded by glyph_mutex.
+static tinfl_decompressor decomp;
+static uint8_t glyph_buffer[GLYPH_BUFFER_SIZE];
+static StaticSemaphore_t glyph_mutex_buffer;
+static SemaphoreHandle_t glyph_mutex;
+
 /*
  * UTF-8 decode inspired from rosetta code
  * https://rosettacode.org/wiki/UTF-8_encode_and_decode#C
@@ -88,21 +103,24 @@ const EpdGlyph* epd_get_glyph(const EpdFont *font, uint32_t code_point) {
   return NULL;
 }
 
+void epd_font_init() {
+  glyph_mutex = xSemaphoreCreateMutexStatic(&glyph_mutex_buffer);
+  assert(glyph_mutex != NULL);
+}
+
+size_t epd_font_static_bytes() {
+  return sizeof(decomp) + sizeof(glyph_buffer);
+}
+
+// Caller must hold glyph_mutex.
 static int uncompress(uint8_t *dest, size_t uncompressed_size, const uint8_t *source, size_t source_size) {
-    tinfl_decompressor *decomp;
     if (uncompressed_size == 0 || dest == NULL || source_size == 0 || source == NULL) {
         return -1;
     }
-    decomp = malloc(sizeof(tinfl_decompressor));
-    if (!decomp) {
-        // Out of memory
-        return -1;
-    }
-    tinfl_init(decomp);
+    tinfl_init(&decomp);
 
     // we know everything will fit into the buffer.
-    tinfl_status decomp_status = tinfl_decompress(decomp, source, &source_size, dest, dest, &uncompressed_size, TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
-    free(decomp);
+    tinfl_status decomp_status = tinfl_decompress(&decomp, source, &source_size, dest, dest, &uncompressed_size, TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
     if (decomp_status != TINFL_STATUS_DONE) {
         return decomp_status;
     }
@@ -134,12 +152,17 @@ static enum EpdDrawError IRAM_ATTR draw_char(const EpdFont *font, uint8_t *buffe
   int byte_width = (width / 2 + width % 2);
   unsigned long bitmap_size = byte_width * height;
   const uint8_t *bitmap = NULL;
-  if (bitmap_size > 0 && font->compressed) {
-    uint8_t* tmp_bitmap = (uint8_t *)malloc(bitmap_size);
-    if (tmp_bitmap == NULL && bitmap_size) {
-      ESP_LOGE("font", "malloc failed.");
-      return EPD_DRAW_FAILED_ALLOC;
+  const bool decompress = bitmap_size > 0 && font->compressed;
+  if (decompress) {
+    uint8_t* tmp_bitmap = glyph_buffer;
+    if (bitmap_size > sizeof(glyph_buffer)) {
+      tmp_bitmap = (uint8_t *)malloc(bitmap_size);
+      if (tmp_bitmap == NULL) {
+        ESP_LOGE("font", "malloc failed.");
+        return EPD_DRAW_FAILED_ALLOC;
+      }
     }
+    xSemaphoreTake(glyph_mutex, portMAX_DELAY);
     uncompress(tmp_bitmap, bitmap_size, &font->bitmap[offset],
                glyph->compressed_size);
     bitmap = tmp_bitmap;
@@ -177,8 +200,11 @@ static enum EpdDrawError IRAM_ATTR draw_char(const EpdFont *font, uint8_t *buffe
       x++;
     }
   }
-  if (bitmap_size > 0 && font->compressed) {
-    free((uint8_t*)bitmap);
+  if (decompress) {
+    if (bitmap != glyph_buffer) {
+      free((uint8_t*)bitmap);
+    }
+    xSemaphoreGive(glyph_mutex);
   }
   *cursor_x += glyph->advance_x;
   return EPD_DRAW_SUCCESS;
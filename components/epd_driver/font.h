@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Set up the shared glyph decompression state. Must be called before drawing
+ * any text with a compressed font.
+ */
+void epd_font_init();
+
+/**
+ * Bytes taken by the shared glyph decompression state.
+ */
+size_t epd_font_static_bytes();
@@ -9,6 +9,7 @@ extern "C" {
 #pragma once
 #include "esp_attr.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "epd_internals.h"
 #include "epd_board.h"
@@ -186,9 +187,22 @@ typedef struct {
   enum EpdFontFlags flags;
 } EpdFontProperties;
 
+/// Sizes of the driver state that is statically allocated, for memory accounting.
+typedef struct {
+  /// Line queue between the fetch and feed tasks.
+  size_t output_queue;
+  /// Stacks of both output tasks.
+  size_t output_task_stacks;
+  /// Shared glyph decompressor and its scratch buffer.
+  size_t glyph_decompressor;
+} EpdStaticMemory;
+
 /** Initialize the ePaper display */
 void epd_init(enum EpdInitOptions options);
 
+/** Get the sizes of the driver's statically allocated buffers */
+EpdStaticMemory epd_static_memory();
+
 /** Set the board hardware definition. This must be called before epd_init() */
 void epd_set_board(const EpdBoardDefinition *board);
 
@@ -499,6 +513,20 @@ EpdRect epd_difference_image_cropped(
  */
 EpdRect epd_difference_image(const uint8_t* to, const uint8_t* from, uint8_t* interlaced, bool* dirty_lines);
 
+/**
+ * Build the pixel conversion lookup table for the first frame of a draw,
+ * the same way the output task does before every frame.
+ * Only meant for benchmarking / debugging, the draw functions handle this.
+ *
+ * @param mode: Draw mode, only the waveform mode bits are used.
+ * @param temperature: Temperature in °C to select the waveform range.
+ * @param waveform: The waveform to use.
+ * @param lut: Destination buffer of `lut_size` bytes.
+ * @param lut_size: Size of the lookup table, usually `1 << 10`.
+ * @returns `EPD_DRAW_SUCCESS` on success, otherwise the error.
+ */
+enum EpdDrawError epd_build_lut(enum EpdDrawMode mode, int temperature, const EpdWaveform* waveform, uint8_t* lut, size_t lut_size);
+
 /**
  * Return the pixel color of a 4 bit image array
  * x,y coordinates of the image pixel
@@ -487,7 +487,7 @@ static void IRAM_ATTR mask_line_buffer(int xmin, int xmax) {
 
 void IRAM_ATTR busy_delay(uint32_t cycles);
 
-static enum EpdDrawError calculate_lut(OutputParams *params) {
+enum EpdDrawError calculate_lut(OutputParams *params) {
 
   enum EpdDrawMode mode = params->mode;
   enum EpdDrawMode selected_mode = mode & 0x3F;
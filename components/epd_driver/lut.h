@@ -49,6 +49,11 @@ typedef struct {
 void feed_display(OutputParams *params);
 void provide_out(OutputParams *params);
 
+/*
+ * Fill `params->conversion_lut` for the current mode, waveform and frame.
+ */
+enum EpdDrawError calculate_lut(OutputParams *params);
+
 
 void write_row(uint32_t output_time_dus);
 void skip_row(uint8_t pipeline_finish_time);
@@ -1,5 +1,6 @@
 #include "epd_temperature.h"
 #include "display_ops.h"
+#include "font.h"
 #include "epd_driver.h"
 #include "include/epd_driver.h"
 #include "include/epd_internals.h"
@@ -33,8 +34,24 @@ const int DEFAULT_FRAME_TIME = 120;
 #define CLEAR_BYTE 0B10101010
 #define DARK_BYTE 0B01010101
 
+#define OUTPUT_TASK_STACK_SIZE (1 << 12)
+#define OUTPUT_QUEUE_MAX_LEN 32
+
 // Queue of input data lines
 static QueueHandle_t output_queue;
+static StaticQueue_t output_queue_buffer;
+static uint8_t output_queue_storage[OUTPUT_QUEUE_MAX_LEN * EPD_WIDTH];
+
+// The output tasks live for as long as the driver does, so their stacks,
+// TCBs and semaphores are static rather than taken from the heap.
+static StaticTask_t fetch_task_buffer;
+static StackType_t fetch_task_stack[OUTPUT_TASK_STACK_SIZE];
+static StaticTask_t feed_task_buffer;
+static StackType_t feed_task_stack[OUTPUT_TASK_STACK_SIZE];
+static StaticSemaphore_t fetch_done_smphr_buffer;
+static StaticSemaphore_t fetch_start_smphr_buffer;
+static StaticSemaphore_t feed_done_smphr_buffer;
+static StaticSemaphore_t feed_start_smphr_buffer;
 
 static OutputParams fetch_params;
 static OutputParams feed_params;
@@ -116,6 +133,33 @@ static int get_waveform_index(const EpdWaveform* waveform, enum EpdDrawMode mode
     return -1;
 }
 
+enum EpdDrawError epd_build_lut(enum EpdDrawMode mode,
+                                int temperature,
+                                const EpdWaveform *waveform,
+                                uint8_t *lut,
+                                size_t lut_size) {
+  int waveform_range = waveform_temp_range_index(waveform, temperature);
+  if (waveform_range < 0) {
+    return EPD_DRAW_NO_PHASES_AVAILABLE;
+  }
+
+  int waveform_index = get_waveform_index(waveform, mode);
+  if (waveform_index < 0) {
+    return EPD_DRAW_MODE_NOT_FOUND;
+  }
+
+  OutputParams params = {
+    .frame = 0,
+    .waveform_index = waveform_index,
+    .waveform_range = waveform_range,
+    .waveform = waveform,
+    .mode = (mode & 0x3F) | MODE_PACKING_1PPB_DIFFERENCE,
+    .conversion_lut_size = lut_size,
+    .conversion_lut = lut,
+  };
+  return calculate_lut(&params);
+}
+
 enum EpdDrawError IRAM_ATTR epd_draw_base(EpdRect area,
                             const uint8_t *data,
                             EpdRect crop_to,
@@ -273,30 +317,43 @@ void epd_init(enum EpdInitOptions options) {
   feed_params.conversion_lut = conversion_lut;
   feed_params.conversion_lut_size = lut_size;
 
-  fetch_params.done_smphr = xSemaphoreCreateBinary();
-  fetch_params.start_smphr = xSemaphoreCreateBinary();
+  fetch_params.done_smphr = xSemaphoreCreateBinaryStatic(&fetch_done_smphr_buffer);
+  fetch_params.start_smphr = xSemaphoreCreateBinaryStatic(&fetch_start_smphr_buffer);
 
-  feed_params.done_smphr = xSemaphoreCreateBinary();
-  feed_params.start_smphr = xSemaphoreCreateBinary();
+  feed_params.done_smphr = xSemaphoreCreateBinaryStatic(&feed_done_smphr_buffer);
+  feed_params.start_smphr = xSemaphoreCreateBinaryStatic(&feed_start_smphr_buffer);
 
-  RTOS_ERROR_CHECK(xTaskCreatePinnedToCore((void (*)(void *))provide_out,
-                                           "epd_fetch", (1 << 12), &fetch_params, 5,
-                                           NULL, 0));
+  epd_font_init();
 
-  RTOS_ERROR_CHECK(xTaskCreatePinnedToCore((void (*)(void *))feed_display,
-                                           "epd_feed", 1 << 12, &feed_params,
-                                           5, NULL, 1));
+  TaskHandle_t fetch_task = xTaskCreateStaticPinnedToCore((void (*)(void *))provide_out,
+                                                          "epd_fetch", OUTPUT_TASK_STACK_SIZE, &fetch_params, 5,
+                                                          fetch_task_stack, &fetch_task_buffer, 0);
+  assert(fetch_task != NULL);
+
+  TaskHandle_t feed_task = xTaskCreateStaticPinnedToCore((void (*)(void *))feed_display,
+                                                         "epd_feed", OUTPUT_TASK_STACK_SIZE, &feed_params,
+                                                         5, feed_task_stack, &feed_task_buffer, 1);
+  assert(feed_task != NULL);
 
   //conversion_lut = (uint8_t *)heap_caps_malloc(1 << 16, MALLOC_CAP_8BIT);
   //assert(conversion_lut != NULL);
-  int queue_len = 32;
+  int queue_len = OUTPUT_QUEUE_MAX_LEN;
   if (options & EPD_FEED_QUEUE_32) {
     queue_len = 32;
   } else if (options & EPD_FEED_QUEUE_8) {
     queue_len = 8;
   }
-  output_queue = xQueueCreate(queue_len, EPD_WIDTH);
+  output_queue = xQueueCreateStatic(queue_len, EPD_WIDTH, output_queue_storage, &output_queue_buffer);
+
+}
 
+EpdStaticMemory epd_static_memory() {
+  EpdStaticMemory mem = {
+    .output_queue = sizeof(output_queue_storage),
+    .output_task_stacks = sizeof(fetch_task_stack) + sizeof(feed_task_stack),
+    .glyph_decompressor = epd_font_static_bytes(),
+  };
+  return mem;
 }
 
 EpdRect epd_difference_image_base(
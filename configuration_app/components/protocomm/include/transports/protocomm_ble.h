@@ -97,6 +97,13 @@ typedef struct protocomm_ble_config {
  * Initialize and start required BLE service for provisioning. This includes
  * the initialization for characteristics/service for BLE.
  *
+ * @note    With NimBLE every endpoint characteristic also supports
+ *          notifications. A client that subscribes to one gets each response
+ *          pushed as soon as its write completes instead of reading it back:
+ *          the response is sent as a 2 byte little endian length followed by
+ *          the data, cut into fragments that fill a notification at the
+ *          negotiated MTU. Clients that don't subscribe keep using reads.
+ *
  * @param[in] pc        Protocomm instance pointer obtained from protocomm_new()
  * @param[in] config    Pointer to config structure for initializing BLE
  *
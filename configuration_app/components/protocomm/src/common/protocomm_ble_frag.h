@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ATT opcode + attribute handle in front of every notification */
+#define PROTOCOMM_BLE_NOTIFY_HDR_LEN    3
+/* Total response length, little endian, in front of the first fragment */
+#define PROTOCOMM_BLE_FRAG_LEN_HDR      2
+/* Largest response that fits the length header */
+#define PROTOCOMM_BLE_FRAG_MAX_LEN      UINT16_MAX
+/* Largest ATT MTU a client can negotiate */
+#define PROTOCOMM_BLE_ATT_MTU_MAX       517
+
+/**
+ * @brief   Splits a response into notifications for a subscribed client
+ *
+ * The response is sent as the stream [len_lo, len_hi, data...] cut into
+ * fragments that fill a notification at the connection's ATT MTU, so the
+ * client reassembles by appending fragments until it has len bytes after the
+ * header. Fragments are only consumed with protocomm_ble_frag_advance() once
+ * the stack has accepted them, so a send that fails for lack of buffers can be
+ * retried with the same fragment.
+ */
+typedef struct {
+    const uint8_t *data;
+    uint16_t len;
+    size_t sent;    /* Bytes of the stream, header included, already sent */
+} protocomm_ble_frag_t;
+
+void protocomm_ble_frag_init(protocomm_ble_frag_t *frag, const uint8_t *data, uint16_t len);
+
+/* Copies the next fragment for the given MTU into out, returns its length or 0 once everything is sent */
+size_t protocomm_ble_frag_fill(const protocomm_ble_frag_t *frag, uint16_t mtu, uint8_t *out, size_t out_size);
+
+void protocomm_ble_frag_advance(protocomm_ble_frag_t *frag, size_t fragment_len);
+
+bool protocomm_ble_frag_done(const protocomm_ble_frag_t *frag);
+
+/* Number of notifications a response of len bytes takes at the given MTU */
+size_t protocomm_ble_frag_count(size_t len, uint16_t mtu);
+
+/* Hands one fragment to the transport. ESP_ERR_NO_MEM means it's out of
+ * buffers for now, anything else but ESP_OK ends the response.
+ */
+typedef esp_err_t (*protocomm_ble_notify_send_t)(const uint8_t *data, size_t len, void *priv);
+
+/**
+ * @brief   Pushes a response to a subscribed client as notifications
+ *
+ * Hands the transport as many fragments as it has buffers for in one go so
+ * they share connection events. Once it runs out with notifications still in
+ * flight, the response is picked up again from protocomm_ble_notify_tx_done()
+ * as those are reported sent.
+ */
+typedef struct {
+    bool active;
+    protocomm_ble_frag_t frag;
+    uint16_t mtu;
+    /* Notifications handed to the transport and not yet reported sent */
+    int in_flight;
+    protocomm_ble_notify_send_t send;
+    void *priv;
+    uint8_t buf[PROTOCOMM_BLE_ATT_MTU_MAX - PROTOCOMM_BLE_NOTIFY_HDR_LEN];
+} protocomm_ble_notify_t;
+
+void protocomm_ble_notify_init(protocomm_ble_notify_t *notify, protocomm_ble_notify_send_t send, void *priv);
+
+/* Data has to stay valid until the response is done or cancelled */
+void protocomm_ble_notify_start(protocomm_ble_notify_t *notify, const uint8_t *data, uint16_t len, uint16_t mtu);
+
+/* Sends until done or out of buffers, returns the send error that ended the response early */
+esp_err_t protocomm_ble_notify_continue(protocomm_ble_notify_t *notify);
+
+/* One notification was sent, resumes the response if it was waiting on a buffer */
+esp_err_t protocomm_ble_notify_tx_done(protocomm_ble_notify_t *notify);
+
+/* Stops the response, notifications already in flight are still counted */
+void protocomm_ble_notify_cancel(protocomm_ble_notify_t *notify);
+
+/* Forgets everything in flight, for when the connection goes away */
+void protocomm_ble_notify_reset(protocomm_ble_notify_t *notify);
+
+#ifdef __cplusplus
+}
+#endif
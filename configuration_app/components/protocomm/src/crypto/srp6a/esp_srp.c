@@ -15,6 +15,9 @@
 
 #define SHA512_HASH_SZ      64
 
+/* Size of the private value b */
+#define SRP_PRIV_KEY_BITS   256
+
 static const char *TAG = "srp6a";
 
 static void hexdump_mpi(const char *name, esp_mpi_t *bn)
@@ -58,6 +61,59 @@ static const char N_3072[] = {
 
 static const char g_3072[] = { 5 };
 
+/* Shared by every handle between esp_srp_precompute() and esp_srp_precompute_free() */
+static struct {
+    int refs;
+    /* R^2 mod N, the Montgomery constant mbedtls_mpi_exp_mod() otherwise works out per handle */
+    esp_mpi_t rr;
+} s_precomp_3072;
+
+esp_err_t esp_srp_precompute(esp_ng_type_t ng)
+{
+    if (ng != ESP_NG_3072) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_precomp_3072.refs > 0) {
+        s_precomp_3072.refs++;
+        return ESP_OK;
+    }
+
+    esp_err_t ret = ESP_FAIL;
+    esp_mpi_t *n = esp_mpi_new_from_bin(N_3072, sizeof(N_3072));
+    esp_mpi_t *g = esp_mpi_new_from_bin(g_3072, sizeof(g_3072));
+    if (!n || !g) {
+        goto exit;
+    }
+
+    /* Any exponentiation mod N fills in rr */
+    mbedtls_mpi_init(&s_precomp_3072.rr);
+    esp_mpi_t *gg = esp_mpi_new();
+    if (!gg || esp_mpi_a_exp_b_mod_c(gg, g, g, n, &s_precomp_3072.rr) != 0) {
+        esp_mpi_free(gg);
+        mbedtls_mpi_free(&s_precomp_3072.rr);
+        goto exit;
+    }
+    esp_mpi_free(gg);
+
+    s_precomp_3072.refs = 1;
+    ret = ESP_OK;
+exit:
+    esp_mpi_free(n);
+    esp_mpi_free(g);
+    return ret;
+}
+
+void esp_srp_precompute_free(esp_ng_type_t ng)
+{
+    if (ng != ESP_NG_3072 || s_precomp_3072.refs == 0) {
+        return;
+    }
+    if (--s_precomp_3072.refs > 0) {
+        return;
+    }
+
+    mbedtls_mpi_free(&s_precomp_3072.rr);
+}
 
 esp_err_t esp_srp_init(esp_srp_handle_t *hd, esp_ng_type_t ng)
 {
@@ -75,6 +131,9 @@ esp_err_t esp_srp_init(esp_srp_handle_t *hd, esp_ng_type_t ng)
     if (ng != ESP_NG_3072) {
         goto error;
     }
+    if (s_precomp_3072.refs > 0 && mbedtls_mpi_copy(hd->ctx, &s_precomp_3072.rr) != 0) {
+        goto error;
+    }
 
     hd->n = esp_mpi_new_from_bin(N_3072, sizeof(N_3072));
     hd->bytes_n = N_3072;
@@ -89,6 +148,15 @@ esp_err_t esp_srp_init(esp_srp_handle_t *hd, esp_ng_type_t ng)
     if (! hd->g) {
         goto error;
     }
+
+    hd->k = esp_mpi_new();
+    hd->u = esp_mpi_new();
+    hd->tmp1 = esp_mpi_new();
+    hd->tmp2 = esp_mpi_new();
+    hd->tmp3 = esp_mpi_new();
+    if (!hd->k || !hd->u || !hd->tmp1 || !hd->tmp2 || !hd->tmp3) {
+        goto error;
+    }
     hd->type = ng;
     return ESP_OK;
 error:
@@ -138,10 +206,15 @@ void esp_srp_free(esp_srp_handle_t *hd)
     if (hd->session_key) {
         free(hd->session_key);
     }
+    esp_mpi_free(hd->k);
+    esp_mpi_free(hd->u);
+    esp_mpi_free(hd->tmp1);
+    esp_mpi_free(hd->tmp2);
+    esp_mpi_free(hd->tmp3);
     memset(hd, 0, sizeof(*hd));
 }
 
-static esp_mpi_t *calculate_x(char *bytes_salt, int salt_len, const char *username, int username_len, const char *pass, int pass_len)
+static int calculate_x(esp_mpi_t *x, char *bytes_salt, int salt_len, const char *username, int username_len, const char *pass, int pass_len)
 {
     unsigned char digest[SHA512_HASH_SZ];
     mbedtls_sha512_context ctx;
@@ -160,10 +233,10 @@ static esp_mpi_t *calculate_x(char *bytes_salt, int salt_len, const char *userna
     mbedtls_sha512_finish(&ctx, digest);
     mbedtls_sha512_free(&ctx);
 
-    return esp_mpi_new_from_bin((char *)digest, sizeof(digest));
+    return mbedtls_mpi_read_binary(x, digest, sizeof(digest));
 }
 
-static esp_mpi_t *calculate_padded_hash(esp_srp_handle_t *hd, const char *a, int len_a, const char *b, int len_b)
+static int calculate_padded_hash(esp_srp_handle_t *hd, esp_mpi_t *result, const char *a, int len_a, const char *b, int len_b)
 {
     unsigned char digest[SHA512_HASH_SZ];
     mbedtls_sha512_context ctx;
@@ -206,68 +279,59 @@ static esp_mpi_t *calculate_padded_hash(esp_srp_handle_t *hd, const char *a, int
         free(s);
     }
 
-    return esp_mpi_new_from_bin((char *)digest, sizeof(digest));
+    return mbedtls_mpi_read_binary(result, digest, sizeof(digest));
 }
 
 /* k = SHA (N, PAD(g))
  *
  * https://tools.ietf.org/html/draft-ietf-tls-srp-08
  */
-static esp_mpi_t *calculate_k(esp_srp_handle_t *hd)
+static int calculate_k(esp_srp_handle_t *hd)
 {
-    return calculate_padded_hash(hd, hd->bytes_n, hd->len_n, hd->bytes_g, hd->len_g);
+    return calculate_padded_hash(hd, hd->k, hd->bytes_n, hd->len_n, hd->bytes_g, hd->len_g);
 }
 
-static esp_mpi_t *calculate_u(esp_srp_handle_t *hd, char *A, int len_A)
+static int calculate_u(esp_srp_handle_t *hd, char *A, int len_A)
 {
-    return calculate_padded_hash(hd, A, len_A, hd->bytes_B, hd->len_B);
+    return calculate_padded_hash(hd, hd->u, A, len_A, hd->bytes_B, hd->len_B);
 }
 
 esp_err_t __esp_srp_srv_pubkey(esp_srp_handle_t *hd, char **bytes_B, int *len_B)
 {
-    esp_mpi_t *k = calculate_k(hd);
-    esp_mpi_t *kv = NULL;
-    esp_mpi_t *gb = NULL;
-    if (!k) {
+    esp_mpi_t *kv = hd->tmp1;
+    esp_mpi_t *gb = hd->tmp2;
+
+    if (calculate_k(hd) != 0) {
         goto error;
     }
-    hexdump_mpi("k", k);
+    hexdump_mpi("k", hd->k);
 
     hd->b = esp_mpi_new();
     if (!hd->b) {
         goto error;
     }
-    esp_mpi_get_rand(hd->b, 256, -1, 0);
+    esp_mpi_get_rand(hd->b, SRP_PRIV_KEY_BITS, -1, 0);
     hexdump_mpi("b", hd->b);
 
     /* B = kv + g^b */
-    kv = esp_mpi_new();
-    gb = esp_mpi_new();
     hd->B = esp_mpi_new();
-    if (!kv || !gb || ! hd->B) {
+    if (! hd->B) {
+        goto error;
+    }
+    if (esp_mpi_a_mul_b_mod_c(kv, hd->k, hd->v, hd->n, hd->ctx) != 0 ||
+            esp_mpi_a_exp_b_mod_c(gb, hd->g, hd->b, hd->n, hd->ctx) != 0 ||
+            esp_mpi_a_add_b_mod_c(hd->B, kv, gb, hd->n, hd->ctx) != 0) {
         goto error;
     }
-    esp_mpi_a_mul_b_mod_c(kv, k, hd->v, hd->n, hd->ctx);
-    esp_mpi_a_exp_b_mod_c(gb, hd->g, hd->b, hd->n, hd->ctx);
-    esp_mpi_a_add_b_mod_c(hd->B, kv, gb, hd->n, hd->ctx);
     hd->bytes_B = esp_mpi_to_bin(hd->B, len_B);
+    if (!hd->bytes_B) {
+        goto error;
+    }
     hd->len_B = *len_B;
     *bytes_B = hd->bytes_B;
 
-    esp_mpi_free(k);
-    esp_mpi_free(kv);
-    esp_mpi_free(gb);
     return ESP_OK;
 error:
-    if (k) {
-        esp_mpi_free(k);
-    }
-    if (kv) {
-        esp_mpi_free(kv);
-    }
-    if (gb) {
-        esp_mpi_free(gb);
-    }
     if (hd->B) {
         esp_mpi_free(hd->B);
         hd->B = NULL;
@@ -284,7 +348,7 @@ esp_err_t esp_srp_srv_pubkey(esp_srp_handle_t *hd, const char *username, int use
 {
     /* Get Salt */
     int str_salt_len;
-    esp_mpi_t *x = NULL;
+    esp_mpi_t *x = hd->tmp1;
     hd->s = esp_mpi_new();
     if (! hd->s) {
         goto error;
@@ -302,8 +366,7 @@ esp_err_t esp_srp_srv_pubkey(esp_srp_handle_t *hd, const char *username, int use
     ESP_LOG_BUFFER_HEX_LEVEL(TAG, *bytes_salt, str_salt_len, ESP_LOG_DEBUG);
 
     /* Calculate X which is simply a hash for all these things */
-    x = calculate_x(*bytes_salt, str_salt_len, username, username_len, pass, pass_len);
-    if (! x) {
+    if (calculate_x(x, *bytes_salt, str_salt_len, username, username_len, pass, pass_len) != 0) {
         goto error;
     }
     hexdump_mpi("x", x);
@@ -313,14 +376,15 @@ esp_err_t esp_srp_srv_pubkey(esp_srp_handle_t *hd, const char *username, int use
     if (! hd->v) {
         goto error;
     }
-    esp_mpi_a_exp_b_mod_c(hd->v, hd->g, x, hd->n, hd->ctx);
+    if (esp_mpi_a_exp_b_mod_c(hd->v, hd->g, x, hd->n, hd->ctx) != 0) {
+        goto error;
+    }
     hexdump_mpi("Verifier", hd->v);
 
     if (__esp_srp_srv_pubkey(hd, bytes_B, len_B) < 0 ) {
         goto error;
     }
 
-    esp_mpi_free(x);
     return ESP_OK;
 
 error:
@@ -334,10 +398,6 @@ error:
         hd->bytes_s = NULL;
         hd->len_s = 0;
     }
-    if (x) {
-        esp_mpi_free(x);
-        x = NULL;
-    }
     if (hd->v) {
         esp_mpi_free(hd->v);
         hd->v = NULL;
@@ -390,17 +450,13 @@ error:
 
 esp_err_t esp_srp_get_session_key(esp_srp_handle_t *hd, char *bytes_A, int len_A, char **bytes_key, uint16_t *len_key)
 {
-    esp_mpi_t *u = NULL;
-    esp_mpi_t *vu = NULL;
-    esp_mpi_t *avu = NULL;
-    esp_mpi_t *S = NULL;
+    esp_mpi_t *vu = hd->tmp1;
+    esp_mpi_t *avu = hd->tmp2;
+    esp_mpi_t *S = hd->tmp3;
 
-    char *bytes_S;
+    char *bytes_S = NULL;
     int len_S;
 
-    u = vu = avu = S = NULL;
-    bytes_S = NULL;
-
     hd->bytes_A = malloc(len_A);
     if (! hd->bytes_A) {
         goto error;
@@ -412,23 +468,17 @@ esp_err_t esp_srp_get_session_key(esp_srp_handle_t *hd, char *bytes_A, int len_A
     if (! hd->A) {
         goto error;
     }
-    u = calculate_u(hd, bytes_A, len_A);
-    if (! u) {
+    if (calculate_u(hd, bytes_A, len_A) != 0) {
         goto error;
     }
-    hexdump_mpi("u", u);
+    hexdump_mpi("u", hd->u);
 
     /* S = (A v^u)^b */
-    vu = esp_mpi_new();
-    avu = esp_mpi_new();
-    S = esp_mpi_new();
-    if (!vu || !avu || !S ) {
+    if (esp_mpi_a_exp_b_mod_c(vu, hd->v, hd->u, hd->n, hd->ctx) != 0 ||
+            esp_mpi_a_mul_b_mod_c(avu, hd->A, vu, hd->n, hd->ctx) != 0 ||
+            esp_mpi_a_exp_b_mod_c(S, avu, hd->b, hd->n, hd->ctx) != 0) {
         goto error;
     }
-
-    esp_mpi_a_exp_b_mod_c(vu, hd->v, u, hd->n, hd->ctx);
-    esp_mpi_a_mul_b_mod_c(avu, hd->A, vu, hd->n, hd->ctx);
-    esp_mpi_a_exp_b_mod_c(S, avu, hd->b, hd->n, hd->ctx);
     hexdump_mpi("S", S);
 
     bytes_S = esp_mpi_to_bin(S, &len_S);
@@ -442,27 +492,11 @@ esp_err_t esp_srp_get_session_key(esp_srp_handle_t *hd, char *bytes_A, int len_A
     *len_key = SHA512_HASH_SZ;
 
     free(bytes_S);
-    esp_mpi_free(vu);
-    esp_mpi_free(avu);
-    esp_mpi_free(S);
-    esp_mpi_free(u);
     return ESP_OK;
 error:
     if (bytes_S) {
         free(bytes_S);
     }
-    if (vu) {
-        esp_mpi_free(vu);
-    }
-    if (avu) {
-        esp_mpi_free(avu);
-    }
-    if (S) {
-        esp_mpi_free(S);
-    }
-    if (u) {
-        esp_mpi_free(u);
-    }
     if (hd->session_key) {
         free(hd->session_key);
         hd->session_key = NULL;
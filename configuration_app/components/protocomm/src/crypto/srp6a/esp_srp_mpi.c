@@ -111,19 +111,19 @@ int esp_mpi_a_mul_b_mod_c(esp_mpi_t *result, esp_mpi_t *a, esp_mpi_t *b, esp_mpi
 {
     (void) ctx;
     int res;
-    mbedtls_mpi t;
-    mbedtls_mpi_init(&t);
-    res = mbedtls_mpi_mul_mpi(&t, a, b);
+
+    /* mbedtls handles result aliasing a or b, so the product is built in place
+     * rather than in a temporary that has to be allocated and freed every call */
+    res = mbedtls_mpi_mul_mpi(result, a, b);
     if (res != 0) {
         printf("mbedtls_mpi_mul_mpi(), returned %x\n", res);
         return res;
     }
-    res = mbedtls_mpi_mod_mpi(result, &t, c);
+    res = mbedtls_mpi_mod_mpi(result, result, c);
     if (res != 0) {
         printf("mbedtls_mpi_mod_mpi() failed, returned %x\n", res);
         return res;
     }
-    mbedtls_mpi_free(&t);
 
     return res;
 }
@@ -132,20 +132,17 @@ int esp_mpi_a_add_b_mod_c(esp_mpi_t *result, esp_mpi_t *a, esp_mpi_t *b, esp_mpi
 {
     (void) ctx;
     int res;
-    mbedtls_mpi t;
 
-    mbedtls_mpi_init(&t);
-    res = mbedtls_mpi_add_mpi(&t, a, b);
+    res = mbedtls_mpi_add_mpi(result, a, b);
     if (res != 0) {
         printf("mbedtls_mpi_add_mpi() failed, returned %x\n", res);
         return res;
     }
-    res = mbedtls_mpi_mod_mpi(result, &t, c);
+    res = mbedtls_mpi_mod_mpi(result, result, c);
     if (res != 0) {
         printf("mbedtls_mpi_mod_mpi(), returned %x\n", res);
         return res;
     }
-    mbedtls_mpi_free(&t);
 
     return res;
 }
@@ -56,8 +56,29 @@ typedef struct esp_srp_handle {
     int      len_A;
     /* K - session key*/
     char *session_key;
+
+    /* Workspace for k, u and the intermediates of B and S, allocated once in
+     * esp_srp_init() and reused for every step of the exchange
+     */
+    esp_mpi_t *k;
+    esp_mpi_t *u;
+    esp_mpi_t *tmp1;
+    esp_mpi_t *tmp2;
+    esp_mpi_t *tmp3;
 } esp_srp_handle_t;
 
+/* Precompute the Montgomery constant R^2 mod N of the given group. Handles
+ * initialized afterwards start with a copy of it, so none of the modular
+ * exponentiations in the exchange has to work it out again. The exponentiations
+ * themselves stay on mbedtls_mpi_exp_mod(), which handles the secret b.
+ *
+ * Meant to be called when the service starts, before any client connects. Calls
+ * nest, the constant is released by the matching last esp_srp_precompute_free().
+ */
+esp_err_t esp_srp_precompute(esp_ng_type_t ng);
+
+void esp_srp_precompute_free(esp_ng_type_t ng);
+
 int esp_srp_init(esp_srp_handle_t *hd, esp_ng_type_t ng);
 
 void esp_srp_free(esp_srp_handle_t *hd);
@@ -54,6 +54,7 @@ typedef struct session {
     /* mbedtls context data for AES-GCM */
     mbedtls_gcm_context ctx_gcm;
     esp_srp_handle_t *srp_hd;
+    bool srp_precomputed;
 } session_t;
 
 static void hexdump(const char *msg, char *buf, int len)
@@ -386,6 +387,15 @@ static esp_err_t sec2_init(protocomm_security_handle_t *handle)
         return ESP_ERR_NO_MEM;
     }
     cur_session->id = -1;
+
+    /* Work out the Montgomery constant for N now rather than in every client's
+     * handshake. Sessions still work without it, just slower. */
+    if (esp_srp_precompute(ESP_NG_3072) != ESP_OK) {
+        ESP_LOGW(TAG, "SRP precompute failed, computing it per session");
+    } else {
+        cur_session->srp_precomputed = true;
+    }
+
     *handle = (protocomm_security_handle_t) cur_session;
     return ESP_OK;
 }
@@ -395,6 +405,9 @@ static esp_err_t sec2_cleanup(protocomm_security_handle_t handle)
     session_t *cur_session = (session_t *) handle;
     if (cur_session) {
         sec2_close_session(handle, cur_session->id);
+        if (cur_session->srp_precomputed) {
+            esp_srp_precompute_free(ESP_NG_3072);
+        }
     }
     free(handle);
     return ESP_OK;
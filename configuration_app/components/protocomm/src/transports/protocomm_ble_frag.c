@@ -0,0 +1,113 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "protocomm_ble_frag.h"
+
+static size_t frag_payload_len(uint16_t mtu)
+{
+    return mtu > PROTOCOMM_BLE_NOTIFY_HDR_LEN ? mtu - PROTOCOMM_BLE_NOTIFY_HDR_LEN : 0;
+}
+
+void protocomm_ble_frag_init(protocomm_ble_frag_t *frag, const uint8_t *data, uint16_t len)
+{
+    frag->data = data;
+    frag->len = len;
+    frag->sent = 0;
+}
+
+size_t protocomm_ble_frag_fill(const protocomm_ble_frag_t *frag, uint16_t mtu, uint8_t *out, size_t out_size)
+{
+    size_t total = PROTOCOMM_BLE_FRAG_LEN_HDR + frag->len;
+    size_t n = MIN(MIN(frag_payload_len(mtu), out_size), total - frag->sent);
+
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = frag->sent + i;
+        if (pos < PROTOCOMM_BLE_FRAG_LEN_HDR) {
+            out[i] = (uint8_t)(frag->len >> (8 * pos));
+        } else {
+            /* Rest of the fragment is contiguous response data */
+            memcpy(&out[i], &frag->data[pos - PROTOCOMM_BLE_FRAG_LEN_HDR], n - i);
+            break;
+        }
+    }
+    return n;
+}
+
+void protocomm_ble_frag_advance(protocomm_ble_frag_t *frag, size_t fragment_len)
+{
+    frag->sent = MIN(frag->sent + fragment_len, PROTOCOMM_BLE_FRAG_LEN_HDR + (size_t)frag->len);
+}
+
+bool protocomm_ble_frag_done(const protocomm_ble_frag_t *frag)
+{
+    return frag->sent >= PROTOCOMM_BLE_FRAG_LEN_HDR + (size_t)frag->len;
+}
+
+size_t protocomm_ble_frag_count(size_t len, uint16_t mtu)
+{
+    size_t payload = frag_payload_len(mtu);
+    if (payload == 0) {
+        return 0;
+    }
+    return (PROTOCOMM_BLE_FRAG_LEN_HDR + len + payload - 1) / payload;
+}
+
+void protocomm_ble_notify_init(protocomm_ble_notify_t *notify, protocomm_ble_notify_send_t send, void *priv)
+{
+    memset(notify, 0, sizeof(*notify));
+    notify->send = send;
+    notify->priv = priv;
+}
+
+void protocomm_ble_notify_start(protocomm_ble_notify_t *notify, const uint8_t *data, uint16_t len, uint16_t mtu)
+{
+    protocomm_ble_frag_init(&notify->frag, data, len);
+    notify->mtu = mtu;
+    notify->active = true;
+}
+
+esp_err_t protocomm_ble_notify_continue(protocomm_ble_notify_t *notify)
+{
+    while (notify->active && !protocomm_ble_frag_done(&notify->frag)) {
+        size_t len = protocomm_ble_frag_fill(&notify->frag, notify->mtu, notify->buf, sizeof(notify->buf));
+        esp_err_t err = notify->send(notify->buf, len, notify->priv);
+        if (err == ESP_ERR_NO_MEM && notify->in_flight > 0) {
+            /* Same fragment goes again once one in flight frees its buffer */
+            return ESP_OK;
+        }
+        if (err != ESP_OK) {
+            notify->active = false;
+            return err;
+        }
+        notify->in_flight++;
+        protocomm_ble_frag_advance(&notify->frag, len);
+    }
+    notify->active = false;
+    return ESP_OK;
+}
+
+esp_err_t protocomm_ble_notify_tx_done(protocomm_ble_notify_t *notify)
+{
+    if (notify->in_flight == 0) {
+        return ESP_OK;
+    }
+    notify->in_flight--;
+    return notify->active ? protocomm_ble_notify_continue(notify) : ESP_OK;
+}
+
+void protocomm_ble_notify_cancel(protocomm_ble_notify_t *notify)
+{
+    notify->active = false;
+}
+
+void protocomm_ble_notify_reset(protocomm_ble_notify_t *notify)
+{
+    notify->active = false;
+    notify->in_flight = 0;
+}
@@ -11,6 +11,7 @@
 #include <protocomm.h>
 #include <protocomm_ble.h>
 #include "protocomm_priv.h"
+#include "protocomm_ble_frag.h"
 
 /* NimBLE */
 #include "nimble/nimble_port.h"
@@ -30,6 +31,18 @@ static uint16_t s_cached_conn_handle;
 /*  Standard 16 bit UUID for characteristic User Description*/
 #define BLE_GATT_UUID_CHAR_DSC              0x2901
 
+/* Largest LL payload and the time it takes at 1M PHY, so each ATT PDU goes out
+ * in a single link layer packet instead of 27 byte pieces */
+#define PROTOCOMM_BLE_DLE_TX_OCTETS         251
+#define PROTOCOMM_BLE_DLE_TX_TIME           2120
+
+/* Connection interval asked for while provisioning, in 1.25ms units. 15-30ms
+ * is the fastest range iOS accepts from a peripheral */
+#define PROTOCOMM_BLE_CONN_ITVL_MIN         12
+#define PROTOCOMM_BLE_CONN_ITVL_MAX         24
+/* Supervision timeout in 10ms units */
+#define PROTOCOMM_BLE_CONN_SUPERVISION_TMO  400
+
 /********************************************************
 *       Maintain database for Attribute specific data   *
 ********************************************************/
@@ -38,6 +51,8 @@ struct data_mbuf {
     uint8_t *outbuf;
     ssize_t outlen;
     uint16_t attr_handle;
+    /* Client subscribed, responses get pushed as notifications */
+    bool notify;
 };
 
 static SLIST_HEAD(data_mbuf_head, data_mbuf) data_mbuf_list =
@@ -53,6 +68,30 @@ static struct data_mbuf *find_attr_with_handle(uint16_t attr_handle)
     }
     return NULL;
 }
+
+static struct data_mbuf *find_or_add_attr_with_handle(uint16_t attr_handle)
+{
+    struct data_mbuf *attr_mbuf = find_attr_with_handle(attr_handle);
+    if (!attr_mbuf) {
+        attr_mbuf = calloc(1, sizeof(struct data_mbuf));
+        if (!attr_mbuf) {
+            return NULL;
+        }
+        SLIST_INSERT_HEAD(&data_mbuf_list, attr_mbuf, node);
+        attr_mbuf->attr_handle = attr_handle;
+    }
+    return attr_mbuf;
+}
+
+/********************************************************
+*   Response being pushed to a subscribed client        *
+********************************************************/
+/* Points into the attribute's outbuf, cancelled before that is replaced */
+static protocomm_ble_notify_t s_notify;
+static uint16_t s_notify_conn_handle;
+static uint16_t s_notify_attr_handle;
+
+static struct ble_npl_event s_notify_ev;
 /**************************************************************
 *         Initialize GAP, protocomm parameters                *
 **************************************************************/
@@ -134,18 +173,16 @@ static simple_ble_cfg_t *ble_cfg_p;
 static int simple_ble_gatts_set_attr_value(uint16_t attr_handle, ssize_t outlen,
         uint8_t *outbuf)
 {
-    struct data_mbuf *attr_mbuf = find_attr_with_handle(attr_handle);
+    struct data_mbuf *attr_mbuf = find_or_add_attr_with_handle(attr_handle);
     if (!attr_mbuf) {
-        attr_mbuf = calloc(1, sizeof(struct data_mbuf));
-        if (!attr_mbuf) {
-            ESP_LOGE(TAG, "Failed to allocate memory for storing outbuf and outlen");
-            return ESP_ERR_NO_MEM;
-        }
-        SLIST_INSERT_HEAD(&data_mbuf_list, attr_mbuf, node);
-        attr_mbuf->attr_handle = attr_handle;
-    } else {
-        free(attr_mbuf->outbuf);
+        ESP_LOGE(TAG, "Failed to allocate memory for storing outbuf and outlen");
+        return ESP_ERR_NO_MEM;
     }
+    if (s_notify.active && s_notify_attr_handle == attr_handle) {
+        /* Client moved on to its next request before the last response finished */
+        protocomm_ble_notify_cancel(&s_notify);
+    }
+    free(attr_mbuf->outbuf);
     attr_mbuf->outbuf = outbuf;
     attr_mbuf->outlen = outlen;
     return ESP_OK;
@@ -164,6 +201,62 @@ static int simple_ble_gatts_get_attr_value(uint16_t attr_handle, ssize_t
     return ESP_OK;
 }
 
+static void simple_ble_gatts_set_notify(uint16_t attr_handle, bool notify)
+{
+    struct data_mbuf *attr_mbuf = notify ? find_or_add_attr_with_handle(attr_handle) :
+                                  find_attr_with_handle(attr_handle);
+    if (attr_mbuf) {
+        attr_mbuf->notify = notify;
+    }
+}
+
+static esp_err_t simple_ble_notify_send(const uint8_t *data, size_t len, void *priv)
+{
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+    int rc = om ? ble_gattc_notify_custom(s_notify_conn_handle, s_notify_attr_handle, om) : BLE_HS_ENOMEM;
+    if (rc == BLE_HS_ENOMEM) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (rc != 0) {
+        ESP_LOGW(TAG, "ble_gattc_notify_custom failed on attr_handle = %d; rc = %d", s_notify_attr_handle, rc);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Runs on the host task, and again from BLE_GAP_EVENT_NOTIFY_TX whenever the
+ * stack runs out of buffers partway through.
+ */
+static void simple_ble_notify_continue(struct ble_npl_event *ev)
+{
+    if (protoble_internal == NULL) {
+        protocomm_ble_notify_cancel(&s_notify);
+        return;
+    }
+
+    if (protocomm_ble_notify_continue(&s_notify) != ESP_OK) {
+        /* Response is still there for a regular read */
+        ESP_LOGW(TAG, "Failed to notify response on attr_handle = %d", s_notify_attr_handle);
+    }
+}
+
+static void simple_ble_notify_start(uint16_t conn_handle, uint16_t attr_handle, const uint8_t *outbuf, ssize_t outlen)
+{
+    if (outlen > PROTOCOMM_BLE_FRAG_MAX_LEN) {
+        ESP_LOGW(TAG, "Response too long to notify (%d bytes), client has to read it", outlen);
+        return;
+    }
+
+    s_notify_conn_handle = conn_handle;
+    s_notify_attr_handle = attr_handle;
+    protocomm_ble_notify_start(&s_notify, outbuf, outlen, protoble_internal->gatt_mtu);
+    ESP_LOGD(TAG, "Notifying %d byte response in %d fragments", outlen,
+             protocomm_ble_frag_count(outlen, protoble_internal->gatt_mtu));
+
+    /* Queued behind this write's response rather than sent from inside the access callback */
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &s_notify_ev);
+}
+
 /*****************************************************************************************/
 /*                             SIMPLE BLE INTEGRATION                                    */
 /*****************************************************************************************/
@@ -210,6 +303,37 @@ simple_ble_advertise(void)
              esp_get_minimum_free_heap_size(), esp_get_free_heap_size());
 }
 
+/* Don't wait on the client to negotiate: ask for the largest ATT MTU and LL
+ * payload, and a short connection interval, as soon as it connects. Every
+ * request and response fragment otherwise costs its own connection event.
+ */
+static void
+simple_ble_tune_connection(uint16_t conn_handle)
+{
+    int rc;
+
+    rc = ble_gattc_exchange_mtu(conn_handle, NULL, NULL);
+    if (rc != 0) {
+        ESP_LOGD(TAG, "Error starting MTU exchange; rc = %d", rc);
+    }
+
+    rc = ble_gap_set_data_len(conn_handle, PROTOCOMM_BLE_DLE_TX_OCTETS, PROTOCOMM_BLE_DLE_TX_TIME);
+    if (rc != 0) {
+        ESP_LOGD(TAG, "Error setting data length; rc = %d", rc);
+    }
+
+    struct ble_gap_upd_params params = {
+        .itvl_min = PROTOCOMM_BLE_CONN_ITVL_MIN,
+        .itvl_max = PROTOCOMM_BLE_CONN_ITVL_MAX,
+        .latency = 0,
+        .supervision_timeout = PROTOCOMM_BLE_CONN_SUPERVISION_TMO,
+    };
+    rc = ble_gap_update_params(conn_handle, &params);
+    if (rc != 0) {
+        ESP_LOGD(TAG, "Error requesting connection parameters; rc = %d", rc);
+    }
+}
+
 static int
 simple_ble_gap_event(struct ble_gap_event *event, void *arg)
 {
@@ -227,6 +351,7 @@ simple_ble_gap_event(struct ble_gap_event *event, void *arg)
                 return rc;
             }
 	    s_cached_conn_handle = event->connect.conn_handle;
+            simple_ble_tune_connection(event->connect.conn_handle);
         } else {
             /* Connection failed; resume advertising. */
             simple_ble_advertise();
@@ -252,6 +377,21 @@ simple_ble_gap_event(struct ble_gap_event *event, void *arg)
                  event->mtu.value);
         transport_simple_ble_set_mtu(event, arg);
         return 0;
+
+    case BLE_GAP_EVENT_SUBSCRIBE:
+        ESP_LOGD(TAG, "subscribe event; attr_handle=%d notify=%d",
+                 event->subscribe.attr_handle, event->subscribe.cur_notify);
+        simple_ble_gatts_set_notify(event->subscribe.attr_handle, event->subscribe.cur_notify);
+        return 0;
+
+    case BLE_GAP_EVENT_NOTIFY_TX:
+        if (event->notify_tx.indication) {
+            return 0;
+        }
+        if (protocomm_ble_notify_tx_done(&s_notify) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to notify response on attr_handle = %d", s_notify_attr_handle);
+        }
+        return 0;
     }
     return 0;
 }
@@ -375,8 +515,13 @@ gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                 ESP_LOGE(TAG, "Failed to set outbuf for characteristic with attr_handle = %d",
                          attr_handle);
                 free(temp_outbuf);
+                return rc;
             }
 
+            struct data_mbuf *attr_mbuf = find_attr_with_handle(attr_handle);
+            if (attr_mbuf->notify) {
+                simple_ble_notify_start(conn_handle, attr_handle, temp_outbuf, temp_outlen);
+            }
             return rc;
         } else {
             ESP_LOGE(TAG, "Invalid content received, killing connection");
@@ -505,6 +650,14 @@ static int simple_ble_start(const simple_ble_cfg_t *cfg)
         return rc;
     }
 
+    rc = ble_att_set_preferred_mtu(BLE_ATT_MTU_MAX);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Error setting preferred MTU");
+        return rc;
+    }
+    ble_npl_event_init(&s_notify_ev, simple_ble_notify_continue, NULL);
+    protocomm_ble_notify_init(&s_notify, simple_ble_notify_send, NULL);
+
     /* Set device name, configure response data to be sent while advertising */
     rc = ble_svc_gap_device_name_set(cfg->device_name);
     if (rc != 0) {
@@ -555,6 +708,13 @@ static void transport_simple_ble_disconnect(struct ble_gap_event *event, void *a
         }
     }
     protoble_internal->gatt_mtu = BLE_ATT_MTU_DFLT;
+
+    /* Subscriptions don't outlive the connection */
+    protocomm_ble_notify_reset(&s_notify);
+    struct data_mbuf *cur;
+    SLIST_FOREACH(cur, &data_mbuf_list, node) {
+        cur->notify = false;
+    }
 }
 
 static void transport_simple_ble_connect(struct ble_gap_event *event, void *arg)
@@ -645,7 +805,8 @@ ble_gatt_add_characteristics(struct ble_gatt_chr_def *characteristics, int idx)
     memcpy(&temp_uuid128_name.value[12], &protoble_internal->g_nu_lookup[idx].uuid, 2);
 
     (characteristics + idx)->flags = BLE_GATT_CHR_F_READ |
-                                     BLE_GATT_CHR_F_WRITE ;
+                                     BLE_GATT_CHR_F_WRITE |
+                                     BLE_GATT_CHR_F_NOTIFY;
 
 #if defined(CONFIG_WIFI_PROV_BLE_FORCE_ENCRYPTION)
     (characteristics + idx)->flags |= BLE_GATT_CHR_F_READ_ENC |
@@ -745,6 +906,8 @@ populate_gatt_db(struct ble_gatt_svc_def **gatt_db_svcs, const protocomm_ble_con
 
 static void protocomm_ble_cleanup(void)
 {
+    protocomm_ble_notify_reset(&s_notify);
+
     if (protoble_internal) {
         if (protoble_internal->g_nu_lookup) {
             for (unsigned i = 0; i < protoble_internal->g_nu_lookup_count; i++) {
@@ -0,0 +1,258 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <unity.h>
+
+#include <protocomm.h>
+#include "protocomm_ble_frag.h"
+
+/* BLE provisioning responses pushed through the same notification pump the
+ * NimBLE transport runs, with the stack stubbed out: the stub stands in for
+ * ble_gattc_notify_custom() with a fixed number of tx buffers, and for
+ * BLE_GAP_EVENT_NOTIFY_TX by reporting everything it queued as sent once per
+ * connection event.
+ */
+
+#define LOOPBACK_EP             "prov-scan"
+#define LOOPBACK_SESSION_ID     1
+#define LOOPBACK_ROUNDS         10
+#define LOOPBACK_REQ_LEN        64
+/* About what a page of scan results with full SSIDs comes to */
+#define LOOPBACK_RESP_LEN       1200
+
+#define ATT_MTU_DFLT            23
+#define ATT_MTU_MAX             PROTOCOMM_BLE_ATT_MTU_MAX
+
+static const char *TAG = "test_protocomm_ble";
+
+typedef struct {
+    uint16_t mtu;
+    /* Notifications the stack can hold before it returns ENOMEM */
+    int tx_bufs;
+    /* Fail the send with this index, -1 for never */
+    int fail_at;
+    int queued;
+    uint32_t sends;
+    uint32_t conn_events;
+    uint8_t stream[PROTOCOMM_BLE_FRAG_LEN_HDR + LOOPBACK_RESP_LEN];
+    size_t received;
+    bool overflow;
+} stub_stack_t;
+
+static uint8_t resp_byte(size_t i, uint8_t seed)
+{
+    return (uint8_t)(i * 31 + seed);
+}
+
+static esp_err_t loopback_handler(uint32_t session_id,
+                                  const uint8_t *inbuf, ssize_t inlen,
+                                  uint8_t **outbuf, ssize_t *outlen,
+                                  void *priv_data)
+{
+    if (inlen != LOOPBACK_REQ_LEN) {
+        return ESP_FAIL;
+    }
+
+    *outbuf = malloc(LOOPBACK_RESP_LEN);
+    if (!*outbuf) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < LOOPBACK_RESP_LEN; i++) {
+        (*outbuf)[i] = resp_byte(i, inbuf[0]);
+    }
+    *outlen = LOOPBACK_RESP_LEN;
+    return ESP_OK;
+}
+
+/* Stands in for ble_hs_mbuf_from_flat() + ble_gattc_notify_custom() */
+static esp_err_t stub_notify_send(const uint8_t *data, size_t len, void *priv)
+{
+    stub_stack_t *stack = priv;
+
+    if (stack->fail_at >= 0 && stack->sends == stack->fail_at) {
+        return ESP_FAIL;
+    }
+    if (stack->queued == stack->tx_bufs) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (len == 0 || len > stack->mtu - PROTOCOMM_BLE_NOTIFY_HDR_LEN ||
+            stack->received + len > sizeof(stack->stream)) {
+        stack->overflow = true;
+        return ESP_FAIL;
+    }
+    memcpy(&stack->stream[stack->received], data, len);
+    stack->received += len;
+    stack->queued++;
+    stack->sends++;
+    return ESP_OK;
+}
+
+static void stub_stack_init(stub_stack_t *stack, uint16_t mtu, int tx_bufs)
+{
+    memset(stack, 0, sizeof(*stack));
+    stack->mtu = mtu;
+    stack->tx_bufs = tx_bufs;
+    stack->fail_at = -1;
+}
+
+/* Starts a response the way a write to a subscribed characteristic does and
+ * runs connection events until the stack has nothing left queued. Each event
+ * sends everything queued and reports it one BLE_GAP_EVENT_NOTIFY_TX at a
+ * time, and what the pump refills goes out in the next one.
+ */
+static esp_err_t stub_stack_push(stub_stack_t *stack, protocomm_ble_notify_t *notify,
+                                 const uint8_t *data, uint16_t len)
+{
+    protocomm_ble_notify_start(notify, data, len, stack->mtu);
+    esp_err_t err = protocomm_ble_notify_continue(notify);
+
+    while (stack->queued > 0) {
+        int sent = stack->queued;
+        stack->queued = 0;
+        stack->conn_events++;
+        for (int i = 0; i < sent; i++) {
+            esp_err_t tx_err = protocomm_ble_notify_tx_done(notify);
+            if (err == ESP_OK) {
+                err = tx_err;
+            }
+        }
+    }
+    return err;
+}
+
+/* Client side of the notification framing, returns the reassembled length or -1 */
+static ssize_t stub_stack_reassemble(const stub_stack_t *stack, uint8_t *out, size_t out_size)
+{
+    if (stack->overflow || stack->received < PROTOCOMM_BLE_FRAG_LEN_HDR) {
+        return -1;
+    }
+    size_t total = stack->stream[0] | (stack->stream[1] << 8);
+    if (total != stack->received - PROTOCOMM_BLE_FRAG_LEN_HDR || total > out_size) {
+        return -1;
+    }
+    memcpy(out, &stack->stream[PROTOCOMM_BLE_FRAG_LEN_HDR], total);
+    return total;
+}
+
+TEST_CASE("ble notification fragments reassemble", "[PROTOCOMM]")
+{
+    static const size_t lens[] = { 0, 1, 17, 18, 19, 20, 21, 512, 513, 514, 1200 };
+    static const uint16_t mtus[] = { ATT_MTU_DFLT, 185, ATT_MTU_MAX };
+    static const int tx_bufs[] = { 1, 3, 8 };
+    uint8_t data[LOOPBACK_RESP_LEN];
+    uint8_t out[LOOPBACK_RESP_LEN];
+    static stub_stack_t stack;
+    static protocomm_ble_notify_t notify;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = resp_byte(i, 0x5A);
+    }
+
+    for (int m = 0; m < sizeof(mtus) / sizeof(mtus[0]); m++) {
+        for (int b = 0; b < sizeof(tx_bufs) / sizeof(tx_bufs[0]); b++) {
+            for (int l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+                size_t count = protocomm_ble_frag_count(lens[l], mtus[m]);
+
+                stub_stack_init(&stack, mtus[m], tx_bufs[b]);
+                protocomm_ble_notify_init(&notify, stub_notify_send, &stack);
+                TEST_ASSERT_EQUAL(ESP_OK, stub_stack_push(&stack, &notify, data, lens[l]));
+                TEST_ASSERT_FALSE(notify.active);
+                TEST_ASSERT_EQUAL(0, notify.in_flight);
+                TEST_ASSERT_EQUAL(count, stack.sends);
+                /* Every event but the last goes out with all of the stack's buffers full */
+                TEST_ASSERT_EQUAL((count + tx_bufs[b] - 1) / tx_bufs[b], stack.conn_events);
+                TEST_ASSERT_EQUAL(lens[l], stub_stack_reassemble(&stack, out, sizeof(out)));
+                TEST_ASSERT_EQUAL(0, memcmp(data, out, lens[l]));
+            }
+        }
+    }
+}
+
+TEST_CASE("ble notification stops on send failure", "[PROTOCOMM]")
+{
+    uint8_t data[LOOPBACK_RESP_LEN] = { 0 };
+    static stub_stack_t stack;
+    static protocomm_ble_notify_t notify;
+
+    /* Fails partway through, after the pump already had to wait on buffers */
+    stub_stack_init(&stack, ATT_MTU_DFLT, 2);
+    stack.fail_at = 5;
+    protocomm_ble_notify_init(&notify, stub_notify_send, &stack);
+    TEST_ASSERT_EQUAL(ESP_FAIL, stub_stack_push(&stack, &notify, data, sizeof(data)));
+    TEST_ASSERT_FALSE(notify.active);
+    TEST_ASSERT_EQUAL(0, notify.in_flight);
+    TEST_ASSERT_EQUAL(5, stack.sends);
+
+    /* Out of buffers with nothing in flight to free one is a failure, not a wait */
+    stub_stack_init(&stack, ATT_MTU_DFLT, 0);
+    protocomm_ble_notify_init(&notify, stub_notify_send, &stack);
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, stub_stack_push(&stack, &notify, data, sizeof(data)));
+    TEST_ASSERT_FALSE(notify.active);
+    TEST_ASSERT_EQUAL(0, stack.sends);
+
+    /* A cancelled response sends nothing more as the in flight ones complete */
+    stub_stack_init(&stack, ATT_MTU_DFLT, 2);
+    protocomm_ble_notify_init(&notify, stub_notify_send, &stack);
+    protocomm_ble_notify_start(&notify, data, sizeof(data), stack.mtu);
+    TEST_ASSERT_EQUAL(ESP_OK, protocomm_ble_notify_continue(&notify));
+    TEST_ASSERT_TRUE(notify.active);
+    protocomm_ble_notify_cancel(&notify);
+    TEST_ASSERT_EQUAL(ESP_OK, protocomm_ble_notify_tx_done(&notify));
+    TEST_ASSERT_EQUAL(ESP_OK, protocomm_ble_notify_tx_done(&notify));
+    TEST_ASSERT_EQUAL(0, notify.in_flight);
+    TEST_ASSERT_EQUAL(2, stack.sends);
+}
+
+TEST_CASE("ble provisioning loopback over notifications", "[PROTOCOMM]")
+{
+    static const uint16_t mtus[] = { ATT_MTU_DFLT, ATT_MTU_MAX };
+    /* Few enough that every response has to wait on BLE_GAP_EVENT_NOTIFY_TX */
+    static const int tx_bufs = 4;
+    uint8_t req[LOOPBACK_REQ_LEN];
+    uint8_t resp[LOOPBACK_RESP_LEN];
+    static stub_stack_t stack;
+    static protocomm_ble_notify_t notify;
+
+    protocomm_t *pc = protocomm_new();
+    TEST_ASSERT_NOT_NULL(pc);
+    TEST_ASSERT_EQUAL(ESP_OK, protocomm_add_endpoint(pc, LOOPBACK_EP, loopback_handler, NULL));
+
+    for (int m = 0; m < sizeof(mtus) / sizeof(mtus[0]); m++) {
+        uint32_t conn_events = 0;
+        int64_t start = esp_timer_get_time();
+
+        for (int round = 0; round < LOOPBACK_ROUNDS; round++) {
+            memset(req, round, sizeof(req));
+
+            uint8_t *outbuf = NULL;
+            ssize_t outlen = 0;
+            TEST_ASSERT_EQUAL(ESP_OK, protocomm_req_handle(pc, LOOPBACK_EP, LOOPBACK_SESSION_ID,
+                                                           req, sizeof(req), &outbuf, &outlen));
+            TEST_ASSERT_EQUAL(LOOPBACK_RESP_LEN, outlen);
+
+            stub_stack_init(&stack, mtus[m], tx_bufs);
+            protocomm_ble_notify_init(&notify, stub_notify_send, &stack);
+            TEST_ASSERT_EQUAL(ESP_OK, stub_stack_push(&stack, &notify, outbuf, outlen));
+            TEST_ASSERT_EQUAL(outlen, stub_stack_reassemble(&stack, resp, sizeof(resp)));
+            conn_events += stack.conn_events;
+            free(outbuf);
+
+            for (size_t i = 0; i < LOOPBACK_RESP_LEN; i++) {
+                TEST_ASSERT_EQUAL(resp_byte(i, round), resp[i]);
+            }
+        }
+
+        ESP_LOGI(TAG, "mtu %u: %u connection events for %d responses, %lld us in loopback",
+                 mtus[m], conn_events, LOOPBACK_ROUNDS, esp_timer_get_time() - start);
+    }
+
+    protocomm_delete(pc);
+}
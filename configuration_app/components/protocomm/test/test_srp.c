@@ -0,0 +1,115 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <unity.h>
+
+#include "sdkconfig.h"
+
+#if CONFIG_ESP_PROTOCOMM_SUPPORT_SECURITY_VERSION_2
+
+#include "esp_srp.h"
+
+#define SRP_BENCH_ITERATIONS    5
+#define SRP_SALT_LEN            16
+#define SRP_PUBKEY_LEN          384
+
+static const char *TAG = "test_srp";
+
+static const char *username = "wifiprov";
+static const char *password = "abcd1234";
+
+/* B = k * v + g^b, recomputed the long way from what the handle kept */
+static void check_srv_pubkey(esp_srp_handle_t *hd)
+{
+    esp_mpi_t expected, gb;
+    mbedtls_mpi_init(&expected);
+    mbedtls_mpi_init(&gb);
+
+    TEST_ASSERT_EQUAL(0, esp_mpi_a_mul_b_mod_c(&expected, hd->k, hd->v, hd->n, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_mpi_exp_mod(&gb, hd->g, hd->b, hd->n, NULL));
+    TEST_ASSERT_EQUAL(0, esp_mpi_a_add_b_mod_c(&expected, &expected, &gb, hd->n, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_mpi_cmp_mpi(&expected, hd->B));
+
+    mbedtls_mpi_free(&expected);
+    mbedtls_mpi_free(&gb);
+}
+
+/* Times esp_srp_srv_pubkey_from_salt_verifier() and esp_srp_get_session_key() the
+ * way security2 calls them, averaged over a few sessions
+ */
+static void bench_handshake(const char *label, const char *salt, const char *verifier, int verifier_len)
+{
+    char client_pubkey[SRP_PUBKEY_LEN];
+    int64_t pubkey_us = 0;
+    int64_t session_key_us = 0;
+
+    esp_fill_random(client_pubkey, sizeof(client_pubkey));
+    client_pubkey[0] &= 0x7F;
+
+    for (int i = 0; i < SRP_BENCH_ITERATIONS; i++) {
+        esp_srp_handle_t hd = { 0 };
+        char *bytes_B;
+        int len_B;
+        char *key;
+        uint16_t len_key;
+
+        TEST_ASSERT_EQUAL(ESP_OK, esp_srp_init(&hd, ESP_NG_3072));
+        TEST_ASSERT_EQUAL(ESP_OK, esp_srp_set_salt_verifier(&hd, salt, SRP_SALT_LEN, verifier, verifier_len));
+
+        int64_t start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, esp_srp_srv_pubkey_from_salt_verifier(&hd, &bytes_B, &len_B));
+        int64_t mid = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, esp_srp_get_session_key(&hd, client_pubkey, sizeof(client_pubkey), &key, &len_key));
+        int64_t end = esp_timer_get_time();
+
+        check_srv_pubkey(&hd);
+        pubkey_us += mid - start;
+        session_key_us += end - mid;
+        esp_srp_free(&hd);
+    }
+
+    ESP_LOGI(TAG, "%s: srv_pubkey %lld us, get_session_key %lld us (avg of %d)", label,
+             pubkey_us / SRP_BENCH_ITERATIONS, session_key_us / SRP_BENCH_ITERATIONS, SRP_BENCH_ITERATIONS);
+}
+
+TEST_CASE("srp handshake benchmark", "[srp6a]")
+{
+    esp_srp_handle_t hd = { 0 };
+    char *bytes_B;
+    int len_B;
+    char *bytes_salt;
+    char salt[SRP_SALT_LEN];
+    char *verifier;
+    int verifier_len;
+
+    /* Salt and verifier the way the provisioning tools generate them */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_srp_init(&hd, ESP_NG_3072));
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_srp_srv_pubkey(&hd, username, strlen(username), password, strlen(password),
+                                                 SRP_SALT_LEN, &bytes_B, &len_B, &bytes_salt));
+    ESP_LOGI(TAG, "srv_pubkey with password: %lld us", esp_timer_get_time() - start);
+    memcpy(salt, bytes_salt, SRP_SALT_LEN);
+    verifier = esp_mpi_to_bin(hd.v, &verifier_len);
+    TEST_ASSERT_NOT_NULL(verifier);
+    esp_srp_free(&hd);
+
+    bench_handshake("generic", salt, verifier, verifier_len);
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_srp_precompute(ESP_NG_3072));
+    ESP_LOGI(TAG, "precompute: %lld us", esp_timer_get_time() - start);
+    bench_handshake("cached RR", salt, verifier, verifier_len);
+    esp_srp_precompute_free(ESP_NG_3072);
+
+    free(verifier);
+}
+
+#endif /* CONFIG_ESP_PROTOCOMM_SUPPORT_SECURITY_VERSION_2 */
@@ -144,6 +144,15 @@ typedef struct wifi_prov_scan_handlers {
                              wifi_prov_scan_result_t *result,
                              wifi_prov_scan_ctx_t **ctx);
 
+    /**
+     * Optional handler returning a number that changes whenever the
+     * results returned by scan_result change. When set, serialized
+     * result pages are kept and sent again as is for repeated requests
+     * until the generation moves on. Leave NULL to build every page
+     * from scan_result.
+     */
+    uint32_t (*scan_generation)(wifi_prov_scan_ctx_t **ctx);
+
     /**
      * Context pointer to be passed to above handler functions upon invocation
      */
@@ -174,23 +174,28 @@ static esp_err_t scan_result(uint16_t result_index,
                              wifi_prov_scan_result_t *result,
                              wifi_prov_scan_ctx_t **ctx)
 {
-    const wifi_ap_record_t *record = wifi_prov_mgr_wifi_scan_result(result_index);
-    if (!record) {
+    wifi_ap_record_t record;
+    if (wifi_prov_mgr_wifi_scan_result(result_index, &record) != ESP_OK) {
         return ESP_FAIL;
     }
 
     /* Compile time check ensures memory safety in case SSID length in
      * record / result structure definition changes in future */
-    _Static_assert(sizeof(result->ssid) == sizeof(record->ssid),
+    _Static_assert(sizeof(result->ssid) == sizeof(record.ssid),
                    "source and destination should be of same size");
-    memcpy(result->ssid, record->ssid, sizeof(record->ssid));
-    memcpy(result->bssid, record->bssid, sizeof(record->bssid));
-    result->channel = record->primary;
-    result->rssi = record->rssi;
-    result->auth = record->authmode;
+    memcpy(result->ssid, record.ssid, sizeof(record.ssid));
+    memcpy(result->bssid, record.bssid, sizeof(record.bssid));
+    result->channel = record.primary;
+    result->rssi = record.rssi;
+    result->auth = record.authmode;
     return ESP_OK;
 }
 
+static uint32_t scan_generation(wifi_prov_scan_ctx_t **ctx)
+{
+    return wifi_prov_mgr_wifi_scan_generation();
+}
+
 esp_err_t get_wifi_scan_handlers(wifi_prov_scan_handlers_t *ptr)
 {
     if (!ptr) {
@@ -199,6 +204,7 @@ esp_err_t get_wifi_scan_handlers(wifi_prov_scan_handlers_t *ptr)
     ptr->scan_start  = scan_start;
     ptr->scan_status = scan_status;
     ptr->scan_result = scan_result;
+    ptr->scan_generation = scan_generation;
     ptr->ctx = NULL;
     return ESP_OK;
 }
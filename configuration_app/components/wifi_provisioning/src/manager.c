@@ -29,6 +29,7 @@
 #define WIFI_PROV_STORAGE_BIT       BIT0
 #define WIFI_PROV_SETTING_BIT       BIT1
 #define MAX_SCAN_RESULTS           CONFIG_WIFI_PROV_SCAN_MAX_ENTRIES
+#define SCAN_CACHE_TTL_US          (CONFIG_WIFI_PROV_SCAN_CACHE_TTL * 1000000LL)
 
 #define ACQUIRE_LOCK(mux)     assert(xSemaphoreTake(mux, portMAX_DELAY) == pdTRUE)
 #define RELEASE_LOCK(mux)     assert(xSemaphoreGive(mux) == pdTRUE)
@@ -133,6 +134,15 @@ struct wifi_prov_mgr_ctx {
     wifi_ap_record_t *ap_list[14];
     wifi_ap_record_t *ap_list_sorted[MAX_SCAN_RESULTS];
     wifi_scan_config_t scan_cfg;
+
+    /* Results of the last scan as served to clients. A scan started while
+     * these are still valid runs in the background and only replaces them
+     * once it completes, so clients never wait on the radio for a list */
+    bool scan_background;
+    int64_t scan_cache_us;      // Time last full pass completed, 0 if none
+    uint32_t scan_generation;   // Bumped every time the served results change
+    uint16_t scan_cache_count;
+    wifi_ap_record_t scan_cache[MAX_SCAN_RESULTS];
 };
 
 /* Mutex to lock/unlock access to provisioning singleton
@@ -511,6 +521,7 @@ static void prov_stop_task(void *arg)
     free(prov_ctx->wifi_scan_handlers->ctx);
     free(prov_ctx->wifi_scan_handlers);
     prov_ctx->wifi_scan_handlers = NULL;
+    wifi_prov_scan_page_cache_clear();
 
     /* Switch device to Wi-Fi STA mode irrespective of
      * whether provisioning was completed or not */
@@ -619,6 +630,10 @@ static bool wifi_prov_mgr_stop_service(bool blocking)
     for (uint8_t i = 0; i < MAX_SCAN_RESULTS; i++) {
         prov_ctx->ap_list_sorted[i] = NULL;
     }
+    prov_ctx->scan_background = false;
+    prov_ctx->scan_cache_us = 0;
+    prov_ctx->scan_cache_count = 0;
+    prov_ctx->scan_generation++;
 
     /* Remove event handler */
     esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID,
@@ -699,6 +714,18 @@ esp_err_t wifi_prov_mgr_done(void)
     return ESP_OK;
 }
 
+/* Copy the working sorted list over the results served to clients */
+static void publish_wifi_scan_results(void)
+{
+    uint16_t count = 0;
+    while (count < MAX_SCAN_RESULTS && prov_ctx->ap_list_sorted[count]) {
+        prov_ctx->scan_cache[count] = *prov_ctx->ap_list_sorted[count];
+        count++;
+    }
+    prov_ctx->scan_cache_count = count;
+    prov_ctx->scan_generation++;
+}
+
 static esp_err_t update_wifi_scan_results(void)
 {
     if (!prov_ctx->scanning) {
@@ -811,6 +838,19 @@ static esp_err_t update_wifi_scan_results(void)
 
     final:
 
+    /* A first scan shows results as each channel group comes in, same as
+     * before caching. Background rescans swap in only once the full pass
+     * succeeds so a client paging through the list sees a stable order */
+    if (!prov_ctx->scanning && ret == ESP_OK) {
+        publish_wifi_scan_results();
+        prov_ctx->scan_cache_us = esp_timer_get_time();
+        prov_ctx->scan_background = false;
+    } else if (!prov_ctx->scan_background) {
+        publish_wifi_scan_results();
+    } else if (!prov_ctx->scanning) {
+        ESP_LOGW(TAG, "Background rescan failed, keeping cached results");
+        prov_ctx->scan_background = false;
+    }
     return ret;
 }
 
@@ -931,6 +971,15 @@ esp_err_t wifi_prov_mgr_wifi_scan_start(bool blocking, bool passive,
         return ESP_OK;
     }
 
+    /* Recent enough results are served as is without touching the radio.
+     * Older ones are still served right away while a rescan refreshes them */
+    bool cached = prov_ctx->scan_cache_us != 0;
+    if (cached && esp_timer_get_time() - prov_ctx->scan_cache_us < SCAN_CACHE_TTL_US) {
+        ESP_LOGD(TAG, "Serving cached scan results");
+        RELEASE_LOCK(prov_ctx_lock);
+        return ESP_OK;
+    }
+
     /* Clear sorted list for new entries */
     for (uint8_t i = 0; i < MAX_SCAN_RESULTS; i++) {
         prov_ctx->ap_list_sorted[i] = NULL;
@@ -968,11 +1017,13 @@ esp_err_t wifi_prov_mgr_wifi_scan_start(bool blocking, bool passive,
 
     ESP_LOGD(TAG, "Scan started");
     prov_ctx->scanning = true;
+    prov_ctx->scan_background = cached;
     prov_ctx->curr_channel = prov_ctx->scan_cfg.channel;
     RELEASE_LOCK(prov_ctx_lock);
 
-    /* If scan is to be non-blocking, return immediately */
-    if (!blocking) {
+    /* If scan is to be non-blocking, or there are cached
+     * results to serve meanwhile, return immediately */
+    if (!blocking || cached) {
         return ESP_OK;
     }
 
@@ -1004,7 +1055,8 @@ bool wifi_prov_mgr_wifi_scan_finished(void)
         return scan_finished;
     }
 
-    scan_finished = !prov_ctx->scanning;
+    /* A background rescan doesn't hold clients up, cached results stand in */
+    scan_finished = !prov_ctx->scanning || prov_ctx->scan_background;
     RELEASE_LOCK(prov_ctx_lock);
     return scan_finished;
 }
@@ -1024,33 +1076,46 @@ uint16_t wifi_prov_mgr_wifi_scan_result_count(void)
         return rval;
     }
 
-    while (rval < MAX_SCAN_RESULTS) {
-        if (!prov_ctx->ap_list_sorted[rval]) {
-            break;
-        }
-        rval++;
-    }
+    rval = prov_ctx->scan_cache_count;
     RELEASE_LOCK(prov_ctx_lock);
     return rval;
 }
 
-const wifi_ap_record_t *wifi_prov_mgr_wifi_scan_result(uint16_t index)
+esp_err_t wifi_prov_mgr_wifi_scan_result(uint16_t index, wifi_ap_record_t *record)
 {
-    const wifi_ap_record_t *rval = NULL;
     if (!prov_ctx_lock) {
         ESP_LOGE(TAG, "Provisioning manager not initialized");
-        return rval;
+        return ESP_ERR_INVALID_STATE;
     }
 
     ACQUIRE_LOCK(prov_ctx_lock);
     if (!prov_ctx) {
         ESP_LOGE(TAG, "Provisioning manager not initialized");
         RELEASE_LOCK(prov_ctx_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Copied out under the lock since a rescan can republish at any time */
+    if (index >= prov_ctx->scan_cache_count) {
+        RELEASE_LOCK(prov_ctx_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    *record = prov_ctx->scan_cache[index];
+    RELEASE_LOCK(prov_ctx_lock);
+    return ESP_OK;
+}
+
+uint32_t wifi_prov_mgr_wifi_scan_generation(void)
+{
+    uint32_t rval = 0;
+    if (!prov_ctx_lock) {
+        ESP_LOGE(TAG, "Provisioning manager not initialized");
         return rval;
     }
 
-    if (index < MAX_SCAN_RESULTS) {
-        rval = prov_ctx->ap_list_sorted[index];
+    ACQUIRE_LOCK(prov_ctx_lock);
+    if (prov_ctx) {
+        rval = prov_ctx->scan_generation;
     }
     RELEASE_LOCK(prov_ctx_lock);
     return rval;
@@ -72,12 +72,29 @@ uint16_t wifi_prov_mgr_wifi_scan_result_count(void);
 /**
  * @brief   Get AP record for a particular index in the scan list result
  *
- * @param[out] index  Index of the result to fetch
+ * Results are those of the last scan served to clients, which stay in
+ * place while a background rescan is running.
+ *
+ * @param[in]  index   Index of the result to fetch
+ * @param[out] record  Copy of the Access Point record
  *
  * @return
- *  - result : Pointer to Access Point record
+ *  - ESP_OK                : Success
+ *  - ESP_ERR_NOT_FOUND     : Index past the end of the results
+ *  - ESP_ERR_INVALID_STATE : Manager not initialized
  */
-const wifi_ap_record_t *wifi_prov_mgr_wifi_scan_result(uint16_t index);
+esp_err_t wifi_prov_mgr_wifi_scan_result(uint16_t index, wifi_ap_record_t *record);
+
+/**
+ * @brief   Get the generation of the scan results
+ *
+ * Changes every time the results returned by wifi_prov_mgr_wifi_scan_result()
+ * change, so anything derived from them can be cached against it.
+ *
+ * @return
+ *  - generation : Current generation of the scan results
+ */
+uint32_t wifi_prov_mgr_wifi_scan_generation(void);
 
 /**
  * @brief   Get protocomm handlers for wifi_config provisioning endpoint
@@ -100,3 +117,10 @@ esp_err_t get_wifi_prov_handlers(wifi_prov_config_handlers_t *ptr);
  *  - ESP_ERR_INVALID_ARG : null argument
  */
 esp_err_t get_wifi_scan_handlers(wifi_prov_scan_handlers_t *ptr);
+
+/**
+ * @brief   Free the serialized scan result pages kept by the scan endpoint
+ *
+ * Called once the scan endpoint has been removed at the end of provisioning.
+ */
+void wifi_prov_scan_page_cache_clear(void);
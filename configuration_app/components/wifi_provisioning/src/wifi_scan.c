@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <esp_log.h>
 #include <string.h>
 #include <esp_err.h>
@@ -21,9 +22,25 @@
 #include "wifi_scan.pb-c.h"
 
 #include <wifi_provisioning/wifi_scan.h>
+#include "wifi_provisioning_priv.h"
+
+/* Number of serialized result pages kept for repeat requests */
+#define SCAN_PAGE_CACHE_SLOTS 4
 
 static const char *TAG = "proto_wifi_scan";
 
+typedef struct wifi_prov_scan_page {
+    uint32_t generation;
+    uint32_t start_index;
+    uint32_t count;
+    uint8_t *data;
+    ssize_t len;
+} wifi_prov_scan_page_t;
+
+/* Only ever touched from the protocomm transport's request context */
+static wifi_prov_scan_page_t scan_page_cache[SCAN_PAGE_CACHE_SLOTS];
+static uint8_t scan_page_cache_next;
+
 typedef struct wifi_prov_scan_cmd {
     int cmd_num;
     esp_err_t (*command_handler)(WiFiScanPayload *req,
@@ -187,6 +204,69 @@ static esp_err_t cmd_scan_result_handler(WiFiScanPayload *req,
 }
 
 
+void wifi_prov_scan_page_cache_clear(void)
+{
+    for (uint8_t i = 0; i < SCAN_PAGE_CACHE_SLOTS; i++) {
+        free(scan_page_cache[i].data);
+        scan_page_cache[i].data = NULL;
+        scan_page_cache[i].len = 0;
+    }
+    scan_page_cache_next = 0;
+}
+
+/* Sends back a copy of an already serialized response to the same result
+ * page request, if the results it was built from haven't changed since.
+ * Pages from older generations are dropped on the way */
+static bool scan_page_cache_get(uint32_t generation, const CmdScanResult *req,
+                                uint8_t **outbuf, ssize_t *outlen)
+{
+    for (uint8_t i = 0; i < SCAN_PAGE_CACHE_SLOTS; i++) {
+        wifi_prov_scan_page_t *page = &scan_page_cache[i];
+        if (!page->data) {
+            continue;
+        }
+        if (page->generation != generation) {
+            free(page->data);
+            page->data = NULL;
+            continue;
+        }
+        if (page->start_index != req->start_index || page->count != req->count) {
+            continue;
+        }
+
+        *outbuf = (uint8_t *) malloc(page->len);
+        if (!*outbuf) {
+            return false;
+        }
+        memcpy(*outbuf, page->data, page->len);
+        *outlen = page->len;
+        ESP_LOGD(TAG, "Sending cached result page %" PRIu32 "+%" PRIu32,
+                 req->start_index, req->count);
+        return true;
+    }
+    return false;
+}
+
+static void scan_page_cache_put(uint32_t generation, const CmdScanResult *req,
+                                const uint8_t *buf, ssize_t len)
+{
+    uint8_t *data = (uint8_t *) malloc(len);
+    if (!data) {
+        /* Only costs the next request a rebuild */
+        return;
+    }
+    memcpy(data, buf, len);
+
+    wifi_prov_scan_page_t *page = &scan_page_cache[scan_page_cache_next];
+    scan_page_cache_next = (scan_page_cache_next + 1) % SCAN_PAGE_CACHE_SLOTS;
+    free(page->data);
+    page->generation = generation;
+    page->start_index = req->start_index;
+    page->count = req->count;
+    page->data = data;
+    page->len = len;
+}
+
 static int lookup_cmd_handler(int cmd_id)
 {
     for (size_t i = 0; i < sizeof(cmd_table)/sizeof(wifi_prov_scan_cmd_t); i++) {
@@ -261,6 +341,9 @@ esp_err_t wifi_prov_scan_handler(uint32_t session_id, const uint8_t *inbuf, ssiz
     WiFiScanPayload *req;
     WiFiScanPayload resp;
     esp_err_t ret = ESP_OK;
+    wifi_prov_scan_handlers_t *h = (wifi_prov_scan_handlers_t *) priv_data;
+    bool cacheable = false;
+    uint32_t generation = 0;
 
     req = wi_fi_scan_payload__unpack(NULL, inlen, inbuf);
     if (!req) {
@@ -268,6 +351,19 @@ esp_err_t wifi_prov_scan_handler(uint32_t session_id, const uint8_t *inbuf, ssiz
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Generation is read before the page is built, so a page that raced
+     * with new results is filed under the old one and never served */
+    if (h && h->scan_generation &&
+            req->msg == WI_FI_SCAN_MSG_TYPE__TypeCmdScanResult &&
+            req->payload_case == WI_FI_SCAN_PAYLOAD__PAYLOAD_CMD_SCAN_RESULT) {
+        cacheable = true;
+        generation = h->scan_generation(&h->ctx);
+        if (scan_page_cache_get(generation, req->cmd_scan_result, outbuf, outlen)) {
+            wi_fi_scan_payload__free_unpacked(req, NULL);
+            return ESP_OK;
+        }
+    }
+
     wi_fi_scan_payload__init(&resp);
     ret = wifi_prov_scan_cmd_dispatcher(req, &resp, priv_data);
     if (ret != ESP_OK) {
@@ -292,6 +388,9 @@ esp_err_t wifi_prov_scan_handler(uint32_t session_id, const uint8_t *inbuf, ssiz
     }
     wi_fi_scan_payload__pack(&resp, *outbuf);
     ESP_LOGD(TAG, "Response packet size : %d", *outlen);
+    if (cacheable && resp.status == STATUS__Success) {
+        scan_page_cache_put(generation, req->cmd_scan_result, *outbuf, *outlen);
+    }
     exit:
 
     wi_fi_scan_payload__free_unpacked(req, NULL);
@@ -1,13 +1,18 @@
 import os
 import sys
 import asyncio
+import argparse
+import functools
 import requests
 import sqlite3
 import urllib.parse
 import json
 import socket
 
-from time import sleep
+from concurrent.futures import ThreadPoolExecutor
+from time import sleep, monotonic
+from zeroconf import IPVersion, ServiceStateChange
+from zeroconf.asyncio import AsyncServiceBrowser, AsyncServiceInfo, AsyncZeroconf
 
 # Manually bundle everything the scripts need from esp-idf into the correct components/tools paths stemming from here
 os.environ['IDF_PATH'] = "."
@@ -27,12 +32,87 @@ banner = """
         |_|
 """
 
+SPOT_CHECK_SERVICE_TYPE = "_spot-check._tcp.local."
+DEFAULT_BROWSE_SECS = 3
+DEFAULT_BULK_CONCURRENCY = 16
+BULK_REQUEST_TIMEOUT_SECS = 5.0
+BULK_ATTEMPTS = 3
+BULK_RETRY_BACKOFF_SECS = 2
+
+async def browse_spot_check_devices(browse_secs):
+    """
+    Lists every device advertising the _spot-check service. Each one has its own instance name
+    ("Spot Check <serial>") so they can all answer at once even though they share a hostname.
+    """
+    names = set()
+
+    def on_service_state_change(zeroconf, service_type, name, state_change):
+        if state_change is not ServiceStateChange.Removed:
+            names.add(name)
+
+    aiozc = AsyncZeroconf(ip_version=IPVersion.V4Only)
+    browser = AsyncServiceBrowser(aiozc.zeroconf, [SPOT_CHECK_SERVICE_TYPE], handlers=[on_service_state_change])
+    await asyncio.sleep(browse_secs)
+
+    async def resolve(name):
+        info = AsyncServiceInfo(SPOT_CHECK_SERVICE_TYPE, name)
+        if not await info.async_request(aiozc.zeroconf, 3000):
+            return None
+
+        addresses = info.parsed_addresses(IPVersion.V4Only)
+        if not addresses:
+            return None
+
+        props = {k.decode(): (v.decode() if v else "") for k, v in info.properties.items()}
+        http_port = props.get("http_port") or "80"
+        return {
+            "name": name.removesuffix("." + SPOT_CHECK_SERVICE_TYPE),
+            "serial": props.get("serial", ""),
+            "fw": props.get("fw", ""),
+            # Devices from before the txt record was added only ever served http on 80
+            "host": addresses[0] if http_port == "80" else f"{addresses[0]}:{http_port}",
+        }
+
+    try:
+        devices = await asyncio.gather(*[resolve(name) for name in sorted(names)])
+    finally:
+        await browser.async_cancel()
+        await aiozc.async_close()
+
+    return [device for device in devices if device]
+
+
+def choose_spot_check_device(devices):
+    if len(devices) == 1:
+        return devices[0]["host"]
+
+    print(f"Found {len(devices)} Spot Check devices:")
+    for i, device in enumerate(devices):
+        print(f"{i + 1}) {device['name']} ({device['host']})")
+
+    while True:
+        choice = input(f"Device to configure (1-{len(devices)}): ")
+        if choice.isdigit() and 1 <= int(choice) <= len(devices):
+            return devices[int(choice) - 1]["host"]
+
+
 def find_spot_check_device(max_attempts):
     print("Searching for Spot Check device on the network...")
 
     success = False
     ip = ""
     attempts = 1
+
+    try:
+        devices = asyncio.run(browse_spot_check_devices(DEFAULT_BROWSE_SECS))
+    except Exception as e:
+        print(f"Could not browse for devices ({e}), falling back to looking up spot-check.local")
+        devices = []
+
+    if devices:
+        ip = choose_spot_check_device(devices)
+        success = True
+
     while not success:
         try:
             # Resolve mDNS to IP first, it's massively faster for further requests
@@ -170,6 +250,16 @@ def configure_custom_mode(current_config):
     else:
         custom_screen_url = temp_custom_screen_url
 
+    current_push_url = current_config.get("custom_push_url", "")
+    print()
+    print("Optionally enter a long-poll URL the device can hold open to be told about new images right away instead of waiting for the interval (enter '-' to disable)")
+    temp_custom_push_url = input(f"Push URL (press enter to keep as '{current_push_url}'): ")
+    if not temp_custom_push_url:
+        custom_push_url = current_push_url
+    elif temp_custom_push_url == "-":
+        custom_push_url = ""
+    else:
+        custom_push_url = temp_custom_push_url
 
     # num repr. of interval secs param for ease of reuse
     current_update_interval_secs_num = int(current_config["custom_update_interval_secs"])
@@ -191,6 +281,7 @@ def configure_custom_mode(current_config):
 
     return {
         "custom_screen_url": custom_screen_url,
+        "custom_push_url": custom_push_url,
         "custom_update_interval_secs": custom_update_interval_secs_str,
     }
 
@@ -226,6 +317,7 @@ def configure():
         print(f"Chart 2: {current_config['active_chart_2']}")
     elif current_config['operating_mode'] == "custom":
         print(f"Custom external URL: {current_config['custom_screen_url']}")
+        print(f"Push URL: {current_config.get('custom_push_url') or 'disabled'}")
         print(f"Screen update interval (seconds): {int(current_config['custom_update_interval_secs'])}")
     else:
         assert 0
@@ -289,7 +381,7 @@ def configure():
     success = False
     while not success:
         try:
-            res = requests.post("http://spot-check.local./configure", data=json.dumps(body), headers={"Content-type": "application/json"}, timeout=0.2)
+            res = requests.post(f"http://{ip}/configure", data=json.dumps(body), headers={"Content-type": "application/json"}, timeout=0.2)
             res.raise_for_status()
             success = True
         except Exception as e:
@@ -333,25 +425,146 @@ def clear_nvs():
         params = {
             "key": "sekrit", # :)
         }
-        res = requests.post("http://spot-check.local./clear_nvs", params=params, headers={"Content-type": "application/json"}, timeout=0.2)
+        res = requests.post(f"http://{ip}/clear_nvs", params=params, headers={"Content-type": "application/json"}, timeout=0.2)
         res.raise_for_status()
     except Exception as e:
         raise e
     print("Success!")
 
 
+def load_bulk_config(path):
+    with open(path) as f:
+        body = json.load(f)
+
+    if not isinstance(body, dict) or body.get("operating_mode") not in ("weather", "custom"):
+        raise ValueError(f"{path} must hold a json object with operating_mode of 'weather' or 'custom', same as the /configure body")
+    for key in ("tz_str", "tz_display_name"):
+        if key not in body:
+            raise ValueError(f"{path} is missing '{key}'")
+
+    # Device parses every field as a json string and silently falls back to its default for anything else, so send
+    # json numbers by string same as the interactive flow does
+    if "custom_update_interval_secs" in body:
+        interval = body["custom_update_interval_secs"]
+        if isinstance(interval, bool) or not isinstance(interval, (int, str)) or not str(interval).isdigit():
+            raise ValueError(f"{path} custom_update_interval_secs must be a whole number of seconds, got {interval!r}")
+        if not 15 * 60 <= int(interval) <= 4320 * 60:
+            raise ValueError(f"{path} custom_update_interval_secs must be between 900 (15 min.) and 259200 (3 days)")
+        body["custom_update_interval_secs"] = str(int(interval))
+    for key in ("spot_lat", "spot_lon"):
+        if isinstance(body.get(key), (int, float)) and not isinstance(body[key], bool):
+            body[key] = str(body[key])
+
+    return body
+
+
+async def push_config(executor, device, body):
+    """
+    Posts the config to one device, retrying with backoff. Requests run on the executor so a slow device only ties up
+    its own thread, and the backoff sleeps don't tie up any.
+    """
+    loop = asyncio.get_running_loop()
+    post = functools.partial(
+        requests.post,
+        f"http://{device['host']}/configure",
+        data=json.dumps(body),
+        headers={"Content-type": "application/json"},
+        timeout=BULK_REQUEST_TIMEOUT_SECS,
+    )
+
+    # Latency runs from when the first request actually goes out, not counting time queued for a free thread
+    start = None
+
+    def timed_post():
+        nonlocal start
+        if start is None:
+            start = monotonic()
+        return post()
+
+    error = ""
+    for attempt in range(1, BULK_ATTEMPTS + 1):
+        try:
+            res = await loop.run_in_executor(executor, timed_post)
+            res.raise_for_status()
+            return {**device, "ok": True, "attempts": attempt, "latency": monotonic() - start, "error": ""}
+        except Exception as e:
+            error = str(e)
+            if attempt < BULK_ATTEMPTS:
+                await asyncio.sleep(BULK_RETRY_BACKOFF_SECS * attempt)
+
+    return {**device, "ok": False, "attempts": BULK_ATTEMPTS, "latency": monotonic() - start, "error": error}
+
+
+async def bulk_configure_devices(body, devices, concurrency):
+    with ThreadPoolExecutor(max_workers=concurrency) as executor:
+        return await asyncio.gather(*[push_config(executor, device, body) for device in devices])
+
+
+def print_bulk_report(results, total_secs):
+    print()
+    print(f"{'Device':<32} {'Host':<21} {'Result':<7} {'Tries':>5} {'Latency':>9}")
+    for result in sorted(results, key=lambda r: (r["ok"], r["name"])):
+        status = "ok" if result["ok"] else "FAILED"
+        print(f"{result['name']:<32} {result['host']:<21} {status:<7} {result['attempts']:>5} {result['latency'] * 1000:>7.0f}ms")
+        if not result["ok"]:
+            print(f"    {result['error']}")
+
+    ok = [r["latency"] for r in results if r["ok"]]
+    print()
+    print(f"Configured {len(ok)}/{len(results)} devices in {total_secs:.1f} seconds")
+    if ok:
+        ok.sort()
+        print(f"Latency median {ok[len(ok) // 2] * 1000:.0f}ms, max {ok[-1] * 1000:.0f}ms")
+
+
+def bulk_configure(config_path, concurrency, browse_secs, confirm):
+    body = load_bulk_config(config_path)
+
+    print(f"Browsing for Spot Check devices for {browse_secs} seconds...")
+    devices = asyncio.run(browse_spot_check_devices(browse_secs))
+    if not devices:
+        print("Could not find any Spot Check devices. Have they been set up on this network with option 1) of the main menu?")
+        return False
+
+    print(f"Found {len(devices)} devices:")
+    for device in devices:
+        print(f"  {device['name']} ({device['host']}, fw {device['fw'] or 'unknown'})")
+    print()
+
+    if confirm and input(f"Push configuration from {config_path} to all {len(devices)} devices? (y/n): ") != "y":
+        return False
+
+    print(f"Pushing configuration to {len(devices)} devices, {concurrency} at a time...")
+    start = monotonic()
+    results = asyncio.run(bulk_configure_devices(body, devices, concurrency))
+    print_bulk_report(results, monotonic() - start)
+
+    return all(result["ok"] for result in results)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Set up and configure Spot Check devices. Runs the interactive menu when given no arguments.")
+    parser.add_argument("--bulk", metavar="CONFIG_JSON", help="push the /configure body in this file to every Spot Check device found on the network")
+    parser.add_argument("--concurrency", type=int, default=DEFAULT_BULK_CONCURRENCY, help=f"devices to configure at once in bulk mode (default {DEFAULT_BULK_CONCURRENCY})")
+    parser.add_argument("--browse-secs", type=float, default=DEFAULT_BROWSE_SECS, help=f"how long to listen for devices before configuring (default {DEFAULT_BROWSE_SECS})")
+    return parser.parse_args()
 
 
 if __name__ == "__main__":
+    args = parse_args()
+    if args.bulk:
+        sys.exit(0 if bulk_configure(args.bulk, max(1, args.concurrency), args.browse_secs, confirm=False) else 1)
+
     print(banner)
     print("Welcome to device configuration. Choose an option.")
 
     choice = None
-    while choice != "1" and choice != "2" and choice != "3":
+    while choice != "1" and choice != "2" and choice != "3" and choice != "4":
         print("1) Set up Spot Check device wifi connection")
         print("2) Configure Spot Check device settings")
         print("3) Reset device to factory defaults")
-        choice = input("(1/2/3): ")
+        print("4) Configure all Spot Check devices on the network from a config file")
+        choice = input("(1/2/3/4): ")
         print()
 
     if choice == "1":
@@ -360,4 +573,7 @@ if __name__ == "__main__":
         configure()
     elif choice == "3":
         clear_nvs()
+    elif choice == "4":
+        config_path = input("Path to a json file with the configuration to push (same fields as option 2 sends): ")
+        bulk_configure(config_path, DEFAULT_BULK_CONCURRENCY, DEFAULT_BROWSE_SECS * 2, confirm=True)
 
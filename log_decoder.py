@@ -0,0 +1,246 @@
+#! /usr/bin/env python3
+#
+# Decodes tokenized log output (menuconfig LOG_TOKENIZED or 'log format token' from the CLI) back into the normal text
+# log lines. Frames carry the address of the format string instead of the string itself, so this needs the exact ELF
+# that's running on the device. Anything that isn't a valid frame (CLI echo, boot rom output, etc) is passed through.
+#
+# usage:
+#   python3 log_decoder.py build/spot-check-firmware.elf --port /dev/cu.usbserial-0001
+#   python3 log_decoder.py build/spot-check-firmware.elf --file captured_log.bin
+#   curl http://spot-check.local/logs | python3 log_decoder.py build/spot-check-firmware.elf --file -
+#   python3 log_decoder.py build/spot-check-firmware.elf --file cli_capture.txt --hex   (output of 'log persist')
+#   python3 log_decoder.py build/spot-check-firmware.elf --port /dev/cu.usbserial-0001 --tz-offset=-08:00
+#
+# Timestamps are rendered in UTC unless --tz-offset gives the device's offset, never in the host's timezone.
+#
+# Needs pyelftools and pyserial, both come with the esp-idf python env.
+
+import argparse
+import os
+import re
+import struct
+import sys
+import time
+
+from elftools.elf.constants import SH_FLAGS
+from elftools.elf.elffile import ELFFile
+
+# Must match log.c
+SYNC = b"\xa5\x5a"
+HEADER_BYTES = 3
+FIXED_BYTES = 9
+PREFIX_ARG_COUNT = 2
+LEVEL_COLORS = ["\033[0;31m", "\033[0;33m", "\033[0;30m", "\033[0;30m"]
+LEVEL_PREFIXES = ["[ERR]", "[WRN]", "[INF]", "[DBG]"]
+
+# Same parse rules as log_parse_spec in log.c
+SPEC_REGEX = re.compile(r"%([-+ #0]*)([0-9*.]*)([hlzjtL]*)(.?)")
+
+# Arg sizes on the esp32 (xtensa, 32 bit long/size_t/pointers, 64 bit double)
+INT_CONVERSIONS = "diuxXoc"
+FLOAT_CONVERSIONS = "fFeEgGaA"
+
+
+def load_tag_strs():
+    constants_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "main", "include", "constants.h")
+    with open(constants_path) as f:
+        contents = f.read()
+
+    # tag_strs uses designated initializers, so map them back through the sc_tag_t enum order
+    enum_body = re.search(r"typedef enum\s*\{([^}]*)\}\s*sc_tag_t;", contents)
+    array_body = re.search(r"tag_strs\[[^\]]*\]\s*=\s*\{(.*?)\};", contents, re.DOTALL)
+    if enum_body is None or array_body is None:
+        return []
+
+    tag_names = re.findall(r"(SC_TAG_\w+)", enum_body.group(1))
+    tag_map = dict(re.findall(r'\[(SC_TAG_\w+)\]\s*=\s*"([^"]*)"', array_body.group(1)))
+    return [tag_map.get(name, "[%s]" % name) for name in tag_names if name != "SC_TAG_COUNT"]
+
+
+class ElfStrings:
+    def __init__(self, elf_path):
+        self.sections = []
+        self.cache = {}
+        with open(elf_path, "rb") as f:
+            elf = ELFFile(f)
+            for section in elf.iter_sections():
+                if not section["sh_flags"] & SH_FLAGS.SHF_ALLOC or section["sh_type"] == "SHT_NOBITS":
+                    continue
+                self.sections.append((section["sh_addr"], section.data()))
+
+    def get(self, addr):
+        if addr in self.cache:
+            return self.cache[addr]
+
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.index(b"\x00", addr - base)
+                fmt = data[addr - base:end].decode("utf-8", errors="replace")
+                self.cache[addr] = fmt
+                return fmt
+
+        return None
+
+
+def unpack_next(args, offset, conversion, length_mod):
+    if conversion == "s":
+        end = args.index(b"\x00", offset) if b"\x00" in args[offset:] else len(args)
+        return args[offset:end].decode("utf-8", errors="replace"), end + 1
+
+    if conversion in FLOAT_CONVERSIONS:
+        return struct.unpack_from("<d", args, offset)[0], offset + 8
+
+    if conversion == "p":
+        return struct.unpack_from("<I", args, offset)[0], offset + 4
+
+    signed = conversion in "di"
+    if length_mod.count("l") >= 2 or "j" in length_mod:
+        return struct.unpack_from("<q" if signed else "<Q", args, offset)[0], offset + 8
+
+    return struct.unpack_from("<i" if signed else "<I", args, offset)[0], offset + 4
+
+
+def parse_tz_offset(offset_str):
+    match = re.fullmatch(r"([+-])(\d{1,2})(?::?(\d{2}))?", offset_str)
+    if match is None:
+        raise argparse.ArgumentTypeError("expected [+-]HH[:MM], got '%s'" % offset_str)
+    sign, hours, minutes = match.groups()
+    secs = int(hours) * 3600 + int(minutes or 0) * 60
+    return -secs if sign == "-" else secs
+
+
+def format_record(fmt, timestamp, tz_offset_secs, tag_str, args):
+    out = []
+    pos = 0
+    offset = 0
+    arg_idx = 0
+    prefix_args = [time.strftime("%H:%M", time.gmtime(timestamp + tz_offset_secs)), tag_str]
+    try:
+        for match in SPEC_REGEX.finditer(fmt):
+            out.append(fmt[pos:match.start()])
+            pos = match.end()
+            flags, width, length_mod, conversion = match.groups()
+
+            if conversion == "%":
+                out.append("%")
+                continue
+
+            if conversion not in INT_CONVERSIONS + FLOAT_CONVERSIONS + "ps":
+                continue
+
+            if arg_idx < PREFIX_ARG_COUNT:
+                out.append(prefix_args[arg_idx])
+                arg_idx += 1
+                continue
+            arg_idx += 1
+
+            while "*" in width:
+                star_val, offset = struct.unpack_from("<i", args, offset)[0], offset + 4
+                width = width.replace("*", str(star_val), 1)
+
+            val, offset = unpack_next(args, offset, conversion, length_mod)
+            if conversion == "p":
+                out.append("0x%x" % val)
+            elif conversion == "c":
+                out.append(chr(val & 0xFF))
+            elif conversion in "aA":
+                out.append(float.hex(val))
+            else:
+                py_conversion = "d" if conversion == "u" else conversion
+                out.append(("%" + flags + width + py_conversion) % val)
+    except (struct.error, ValueError):
+        # Record was truncated on device, same marker log.c uses
+        out.append("[...]\033[0m\n")
+        return "".join(out)
+
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def decode_stream(read_bytes, elf_strings, tag_strs, tz_offset_secs, out):
+    buffer = b""
+    while True:
+        chunk = read_bytes()
+        if chunk is None:
+            break
+        buffer += chunk
+
+        while True:
+            sync_idx = buffer.find(SYNC)
+            if sync_idx < 0:
+                # Keep a possible partial sync byte around for the next chunk
+                keep = 1 if buffer.endswith(SYNC[:1]) else 0
+                out.write(buffer[:len(buffer) - keep].decode("utf-8", errors="replace"))
+                buffer = buffer[len(buffer) - keep:]
+                break
+
+            out.write(buffer[:sync_idx].decode("utf-8", errors="replace"))
+            buffer = buffer[sync_idx:]
+            if len(buffer) < HEADER_BYTES:
+                break
+
+            payload_len = buffer[2]
+            frame_len = HEADER_BYTES + payload_len + 1
+            if len(buffer) < frame_len:
+                break
+
+            payload = buffer[HEADER_BYTES:HEADER_BYTES + payload_len]
+            checksum = buffer[frame_len - 1]
+            if payload_len < FIXED_BYTES or sum(payload) & 0xFF != checksum:
+                # Not a real frame, pass the first sync byte through as text and resync after it
+                out.write(buffer[:1].decode("utf-8", errors="replace"))
+                buffer = buffer[1:]
+                continue
+
+            fmt_addr, timestamp, tag_level = struct.unpack_from("<IIB", payload, 0)
+            tag = tag_level & 0x3F
+            level = tag_level >> 6
+            tag_str = tag_strs[tag] if tag < len(tag_strs) else "[tag-%d]" % tag
+            fmt = elf_strings.get(fmt_addr)
+            if fmt is None:
+                out.write("%s%s %s <unknown token 0x%08x, wrong ELF?>\033[0m\n" %
+                          (LEVEL_COLORS[level], tag_str, LEVEL_PREFIXES[level], fmt_addr))
+            else:
+                out.write(format_record(fmt, timestamp, tz_offset_secs, tag_str, payload[FIXED_BYTES:]))
+
+            buffer = buffer[frame_len:]
+
+        out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode Spot Check tokenized log output")
+    parser.add_argument("elf", help="ELF file matching the FW running on the device")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port to read from")
+    source.add_argument("--file", help="captured raw log file to decode, '-' for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--hex", action="store_true", help="input is captured 'log persist' CLI output")
+    parser.add_argument("--tz-offset", type=parse_tz_offset, default=0,
+                        help="device's UTC offset as [+-]HH[:MM] for timestamps, UTC if not given")
+    args = parser.parse_args()
+
+    elf_strings = ElfStrings(args.elf)
+    tag_strs = load_tag_strs()
+
+    if args.hex:
+        f = sys.stdin if args.file == "-" else open(args.file)
+        dump = bytes.fromhex("".join(re.findall(r"logdump ([0-9a-f]+)", f.read())))
+        chunks = iter([dump])
+        read_bytes = lambda: next(chunks, None)
+    elif args.port:
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+        read_bytes = lambda: port.read(256)
+    else:
+        f = sys.stdin.buffer if args.file == "-" else open(args.file, "rb")
+        read_bytes = lambda: f.read(4096) or None
+
+    try:
+        decode_stream(read_bytes, elf_strings, tag_strs, args.tz_offset, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
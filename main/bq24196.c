@@ -8,6 +8,8 @@
 // #define BQ24196_SLAVE_ADDR (0x08)
 #define BQ24196_SLAVE_ADDR (0x6B)
 
+#define BQ24196_STATUS_PG_STAT_BIT (1 << 2)
+
 // TDOD : remove once we have a function using this (along with void cast in init func)
 static esp_err_t bq24196_write_reg(uint8_t reg, uint8_t byte);
 
@@ -159,3 +161,18 @@ esp_err_t bq24196_disable_charging() {
     assert(reg_val == new_reg_val);
     return err;
 }
+
+/*
+ * Sets on_battery if there's no good input source (usb/adapter) and we're running off the battery. The charger has no
+ * ADC or fuel gauge, so this is all it can tell us about the battery.
+ */
+esp_err_t bq24196_read_on_battery(bool *on_battery) {
+    uint8_t   reg_val;
+    esp_err_t err = bq24196_read_reg(BQ24196_REG_STATUS, &reg_val);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    *on_battery = !(reg_val & BQ24196_STATUS_PG_STAT_BIT);
+    return ESP_OK;
+}
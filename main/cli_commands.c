@@ -22,14 +22,18 @@
 #include "flash_partition.h"
 #include "http_client.h"
 #include "log.h"
+#include "log_persist.h"
 #include "memfault_interface.h"
+#include "memory_budget.h"
 #include "nvs.h"
 #include "ota_task.h"
+#include "perf.h"
 #include "scheduler_task.h"
 #include "screen_img_handler.h"
 #include "sleep_handler.h"
 #include "sntp_time.h"
 #include "spot_check.h"
+#include "uart_xfer.h"
 
 #define TAG SC_TAG_CLI_CMD
 
@@ -358,7 +362,7 @@ static BaseType_t cli_command_partition(char *write_buffer, size_t write_buffer_
         char msg[60];
         if ((part_label_len == 3 && strcmp(part_label, "nvs") == 0) ||
             (part_label_len == 10 && strcmp(part_label, SCREEN_IMG_PARTITION_LABEL) == 0)) {
-            esp_partition_erase_range(part, 0x0, part->size);
+            flash_partition_erase_range(part, 0x0, part->size);
             sprintf(msg, "Successfully erased '%s' partition", part->label);
             strcpy(write_buffer, msg);
         } else {
@@ -627,11 +631,40 @@ BaseType_t cli_command_sntp(char *write_buffer, size_t write_buffer_size, const
     return pdFALSE;
 }
 
+/*
+ * Multi-call hex dump of the persisted post-mortem log, one line per call. Decode with log_decoder.py --hex from a
+ * capture of the output.
+ */
+static BaseType_t cli_command_log_persist_dump(char *write_buffer) {
+    static size_t offset = 0;
+    uint8_t       chunk[32];
+
+    // Make sure the previous line is out of the log ring before queueing another one, otherwise a big dump overruns it
+    // and drops lines
+    log_wait_until_all_tx();
+
+    size_t read = log_persist_read(offset, chunk, sizeof(chunk));
+    if (read == 0) {
+        sprintf(write_buffer, "logdump end, %u bytes", offset);
+        offset = 0;
+        return pdFALSE;
+    }
+
+    int idx = sprintf(write_buffer, "logdump ");
+    for (size_t i = 0; i < read; i++) {
+        idx += sprintf(&write_buffer[idx], "%02x", chunk[i]);
+    }
+
+    offset += read;
+    return pdTRUE;
+}
+
 BaseType_t cli_command_log(char *write_buffer, size_t write_buffer_size, const char *cmd_str) {
     BaseType_t  action_len;
     const char *action = FreeRTOS_CLIGetParameter(cmd_str, 1, &action_len);
     if (action == NULL) {
-        strcpy(write_buffer, "Error: usage is 'log <action> [arg]' where action is 'level|hide|show'");
+        strcpy(write_buffer,
+               "Error: usage is 'log <action> [arg]' where action is 'level|hide|show|list|format|persist'");
         return pdFALSE;
     }
 
@@ -660,6 +693,9 @@ BaseType_t cli_command_log(char *write_buffer, size_t write_buffer_size, const c
         }
 
         log_set_max_log_level(new_level);
+        if (new_level > LOG_COMPILE_MAX_LEVEL) {
+            sprintf(write_buffer, "OK, but levels above %d are compiled out of this FW", LOG_COMPILE_MAX_LEVEL);
+        }
     } else if (action_len == 4 && strncmp(action, "show", action_len) == 0) {
         if (arg == NULL) {
             log_show_all_tags();
@@ -700,11 +736,33 @@ BaseType_t cli_command_log(char *write_buffer, size_t write_buffer_size, const c
         char     tag_blacklist_str[33];
         uint32_t tag_blacklist = log_get_tag_blacklist();
         for (int i = 0; i < 32; i++) {
-            tag_blacklist_str[i] = (tag_blacklist & (1 << (31 - i)) ? '1' : '0');
+            tag_blacklist_str[i] = (tag_blacklist & (1UL << (31 - i)) ? '1' : '0');
         }
         tag_blacklist_str[32] = '\0';
 
         strcpy(write_buffer, tag_blacklist_str);
+    } else if (action_len == 7 && strncmp(action, "persist", action_len) == 0) {
+        if (arg == NULL) {
+            return cli_command_log_persist_dump(write_buffer);
+        } else if (arg_len == 5 && strncmp(arg, "clear", arg_len) == 0) {
+            log_persist_clear();
+            strcpy(write_buffer, "OK");
+        } else {
+            strcpy(write_buffer, "Error: usage is 'log persist [clear]'");
+        }
+    } else if (action_len == 6 && strncmp(action, "format", action_len) == 0) {
+        if (arg == NULL) {
+            strcpy(write_buffer, log_get_tokenized() ? "token" : "text");
+        } else if (arg_len == 4 && strncmp(arg, "text", arg_len) == 0) {
+            log_set_tokenized(false);
+            strcpy(write_buffer, "OK");
+        } else if (arg_len == 5 && strncmp(arg, "token", arg_len) == 0) {
+            // This response will already go out tokenized, use log_decoder.py from here on
+            log_set_tokenized(true);
+            strcpy(write_buffer, "OK");
+        } else {
+            strcpy(write_buffer, "Error: usage is 'log format [text|token]'");
+        }
     } else {
         strcpy(write_buffer, "Unknown log command");
     }
@@ -780,7 +838,7 @@ BaseType_t cli_command_mem(char *write_buffer, size_t write_buffer_size, const c
     BaseType_t  action_len;
     const char *action = FreeRTOS_CLIGetParameter(cmd_str, 1, &action_len);
     if (action == NULL) {
-        strcpy(write_buffer, "Error: usage is 'mem <action>' where action is 'heap|stack'");
+        strcpy(write_buffer, "Error: usage is 'mem <action>' where action is 'heap|stack|map'");
         return pdFALSE;
     }
 
@@ -850,7 +908,7 @@ BaseType_t cli_command_mem(char *write_buffer, size_t write_buffer_size, const c
             sprintf(out_str,
                     "%-16s: %lu",
                     task_statuses[output_idx].pcTaskName,
-                    task_statuses[output_idx].usStackHighWaterMark * sizeof(uint32_t));
+                    task_statuses[output_idx].usStackHighWaterMark);
             output_idx++;
             retval = pdTRUE;
 
@@ -863,6 +921,9 @@ BaseType_t cli_command_mem(char *write_buffer, size_t write_buffer_size, const c
         }
 
         strcpy(write_buffer, out_str);
+    } else if (action_len == 3 && strncmp(action, "map", action_len) == 0) {
+        memory_budget_print_report();
+        strcpy(write_buffer, "Printed memory map to log");
     } else {
         strcpy(write_buffer, "Unknown mem command");
     }
@@ -870,6 +931,102 @@ BaseType_t cli_command_mem(char *write_buffer, size_t write_buffer_size, const c
     return retval;
 }
 
+static void cli_command_perf_format_result(char *write_buffer, perf_bench_t bench, perf_result_t *result) {
+    if (!result->ran) {
+        sprintf(write_buffer, "%-6s: skipped (see log)", perf_bench_to_string(bench));
+        return;
+    }
+
+    sprintf(write_buffer,
+            "%-6s: %lu iters, avg %lu us (%lu cycles), min %lu us, max %lu us",
+            perf_bench_to_string(bench),
+            result->iterations,
+            result->avg_us,
+            result->avg_cycles,
+            result->min_us,
+            result->max_us);
+}
+
+static BaseType_t cli_command_perf(char *write_buffer, size_t write_buffer_size, const char *cmd_str) {
+    // Only used when running all benchmarks, one result line is printed per call so output isn't held until the end
+    static perf_bench_t next_bench = 0;
+
+    BaseType_t  bench_len;
+    const char *bench_str = FreeRTOS_CLIGetParameter(cmd_str, 1, &bench_len);
+    BaseType_t  iterations_len;
+    const char *iterations_str = FreeRTOS_CLIGetParameter(cmd_str, 2, &iterations_len);
+
+    uint32_t iterations = 0;
+    if (iterations_str) {
+        iterations = strtoul(iterations_str, NULL, 10);
+    }
+
+    memset(write_buffer, 0x0, write_buffer_size);
+    perf_result_t result;
+    if (bench_str == NULL || (bench_len == 3 && strncmp(bench_str, "all", bench_len) == 0)) {
+        perf_bench_t bench = next_bench;
+        perf_run(bench, iterations, &result);
+        cli_command_perf_format_result(write_buffer, bench, &result);
+
+        next_bench++;
+        if (next_bench == PERF_BENCH_COUNT) {
+            next_bench = 0;
+            return pdFALSE;
+        }
+
+        return pdTRUE;
+    }
+
+    perf_bench_t bench;
+    if (!perf_string_to_bench(bench_str, bench_len, &bench)) {
+        strcpy(write_buffer,
+               "Error: usage is 'perf [all|fb|lut|glyph|chart|gc16p|gc16|nvs|flash|tls] [<iterations>]'");
+        return pdFALSE;
+    }
+
+    perf_run(bench, iterations, &result);
+    cli_command_perf_format_result(write_buffer, bench, &result);
+    return pdFALSE;
+}
+
+static BaseType_t cli_command_xfer(char *write_buffer, size_t write_buffer_size, const char *cmd_str) {
+    BaseType_t  label_len;
+    const char *label_str = FreeRTOS_CLIGetParameter(cmd_str, 1, &label_len);
+    BaseType_t  param_len;
+    const char *offset_str = FreeRTOS_CLIGetParameter(cmd_str, 2, &param_len);
+    const char *len_str    = FreeRTOS_CLIGetParameter(cmd_str, 3, &param_len);
+    const char *crc_str    = FreeRTOS_CLIGetParameter(cmd_str, 4, &param_len);
+    const char *baud_str   = FreeRTOS_CLIGetParameter(cmd_str, 5, &param_len);
+
+    memset(write_buffer, 0x0, write_buffer_size);
+    if (label_str == NULL || offset_str == NULL || len_str == NULL || crc_str == NULL) {
+        strcpy(write_buffer, "Error: usage is 'xfer <partition label> <offset> <len> <crc32> [<baud>]'");
+        return pdFALSE;
+    }
+
+    // Partition labels max out at 16 chars
+    char label[17];
+    if ((size_t)label_len >= sizeof(label)) {
+        strcpy(write_buffer, "Error: partition label too long");
+        return pdFALSE;
+    }
+    strncpy(label, label_str, label_len);
+    label[label_len] = '\0';
+
+    // strtoul stops at the space before the next param so no need to copy/null-term these. Base 0 so hex works too
+    uint32_t offset = strtoul(offset_str, NULL, 0);
+    uint32_t len    = strtoul(len_str, NULL, 0);
+    uint32_t crc32  = strtoul(crc_str, NULL, 0);
+    uint32_t baud   = baud_str ? strtoul(baud_str, NULL, 0) : UART_XFER_DEFAULT_BAUD;
+
+    // Ready line is logged from inside the start func, any output after that is at the xfer baud so keep it empty
+    if (!uart_xfer_start(label, offset, len, crc32, baud)) {
+        strcpy(write_buffer, "Failed to start xfer, see log for reason");
+    }
+
+    return pdFALSE;
+}
+
 void cli_command_register_all() {
     num_tasks_created = 0;
     task_statuses     = NULL;
@@ -971,7 +1128,8 @@ void cli_command_register_all() {
         .pcCommand = "log",
         .pcHelpString =
             "log:\n\tlevel: set max log level output\n\thide [tag]: hide tag, or all "
-            "tags if empty\n\tshow [tag]: show tag, or all tags if empty\n\tlist: log blacklist",
+            "tags if empty\n\tshow [tag]: show tag, or all tags if empty\n\tlist: log blacklist\n\tformat "
+            "[text|token]: get or set log output format\n\tpersist [clear]: hex dump or clear post-mortem log",
         .pxCommandInterpreter        = cli_command_log,
         .cExpectedNumberOfParameters = -1,
     };
@@ -1004,12 +1162,34 @@ void cli_command_register_all() {
     };
 
     static const CLI_Command_Definition_t mem_cmd = {
-        .pcCommand    = "mem",
-        .pcHelpString = "mem:\n\theap: print info on all heap allocations\n\tstack: print info on all task stacks",
+        .pcCommand = "mem",
+        .pcHelpString =
+            "mem:\n\theap: print info on all heap allocations\n\tstack: print info on all task stacks\n\tmap: print "
+            "static memory budget and heap usage",
         .pxCommandInterpreter        = cli_command_mem,
         .cExpectedNumberOfParameters = 1,
     };
 
+    static const CLI_Command_Definition_t perf_cmd = {
+        .pcCommand = "perf",
+        .pcHelpString =
+            "perf [<bench>] [<iterations>]: time on-device benchmarks, all if no bench given\n\tfb: framebuffer "
+            "diff\n\tlut: GC16 LUT build\n\tglyph: draw test string\n\tchart: mmap + blit 70KB chart\n\tgc16p: "
+            "partial GC16 refresh\n\tgc16: full GC16 refresh\n\tnvs: load config from NVS\n\tflash: erase + write "
+            "64KB\n\ttls: TLS handshake with API",
+        .pxCommandInterpreter        = cli_command_perf,
+        .cExpectedNumberOfParameters = -1,
+    };
+
+    static const CLI_Command_Definition_t xfer_cmd = {
+        .pcCommand = "xfer",
+        .pcHelpString =
+            "xfer <label> <offset> <len> <crc32> [<baud>]: receive framed binary data at a raised baud straight into a "
+            "partition at a 4k aligned offset. Use uart_xfer.py on the host side",
+        .pxCommandInterpreter        = cli_command_xfer,
+        .cExpectedNumberOfParameters = -1,
+    };
+
     FreeRTOS_CLIRegisterCommand(&info_cmd);
     FreeRTOS_CLIRegisterCommand(&reset_cmd);
     FreeRTOS_CLIRegisterCommand(&bq_cmd);
@@ -1026,4 +1206,6 @@ void cli_command_register_all() {
     FreeRTOS_CLIRegisterCommand(&event_cmd);
     FreeRTOS_CLIRegisterCommand(&memfault_cmd);
     FreeRTOS_CLIRegisterCommand(&mem_cmd);
+    FreeRTOS_CLIRegisterCommand(&perf_cmd);
+    FreeRTOS_CLIRegisterCommand(&xfer_cmd);
 }
@@ -10,6 +10,7 @@
 #include "FreeRTOS_CLI.h"
 #include "cli_task.h"
 #include "constants.h"
+#include "memory_budget.h"
 #include "uart.h"
 
 #include "log.h"
@@ -24,58 +25,148 @@
 #define CLI_COMMAND_QUEUE_SIZE (12)
 #define CLI_COMMAND_PROCESS_OUT_BUFFER_BYTES (256)
 
+// How long rx will wait for the process task to free up a command buffer before dropping the line. Pasted scripts sit in
+// the uart driver rx ring in the meantime.
+#define CLI_COMMAND_POOL_WAIT_MS (10 * MS_PER_SEC)
+
+#define CLI_ECHO_BUFFER_BYTES (128)
+// Longest single echo sequence (backspace, space, backspace)
+#define CLI_ECHO_MAX_SEQUENCE_BYTES (3)
+
 typedef struct {
-    char  *cmd;
-    size_t len;
+    uint8_t pool_idx;
+    size_t  len;
 } cli_command_t;
 
 static TaskHandle_t   cli_task_handle;
+static TaskHandle_t   cli_rx_task_handle;
 static uart_handle_t *handle;
-static char          *command_buffer;
+static char           command_buffer[CLI_COMMAND_BUFFER_BYTES];
 static uint8_t        command_char_idx;
+static bool           command_overflow;
+static char           last_char;
+
+static char echo_buffer[CLI_ECHO_BUFFER_BYTES];
+
+// Fixed pool of command buffers, one per command queue slot. Indices of free buffers live in the free queue. rx task
+// takes one, fills it, and passes ownership through the command queue. Process task gives it back when done.
+static char          command_pool[CLI_COMMAND_QUEUE_SIZE][CLI_COMMAND_BUFFER_BYTES];
+static QueueHandle_t free_queue_handle;
+static StaticQueue_t free_queue_buffer;
+static uint8_t       free_queue_data_buffer[CLI_COMMAND_QUEUE_SIZE * sizeof(uint8_t)];
 
 static QueueHandle_t queue_handle;
 static StaticQueue_t queue_buffer;
-static uint8_t      *queue_data_buffer;
-static char         *command_processing_out;
-
-static void cli_process_char(char c) {
-    // TODO :: handle backspace
-    if (c == 0x08) {
-        command_buffer[--command_char_idx] = 0x00;
-        // Echo out a backspace to move the cursor back, a space to cover up the old char, then another backspace to
-        // remove the space. Don't put any of it in our buffer because we dgaf about those shenanigans to make it look
-        // good to the user.
-        uart_write_bytes(handle->port, "\x08\x20\x08", 3);
-    } else {
-        // Add to buffer and echo back
-        command_buffer[command_char_idx++] = c;
-        uart_write_bytes(handle->port, &c, 1);
+static uint8_t       queue_data_buffer[CLI_COMMAND_QUEUE_SIZE * sizeof(cli_command_t)];
+static char          command_processing_out[CLI_COMMAND_PROCESS_OUT_BUFFER_BYTES];
+
+static StaticTask_t cli_rx_task_buffer;
+static StackType_t  cli_rx_task_stack[MEMORY_BUDGET_CLI_RX_STACK_BYTES];
+static StaticTask_t cli_task_buffer;
+static StackType_t  cli_task_stack[MEMORY_BUDGET_CLI_PROCESS_STACK_BYTES];
+
+static void cli_submit_command() {
+    if (command_overflow) {
+        log_printf(LOG_LEVEL_ERROR, "CLI command longer than %d bytes, dropping it", CLI_COMMAND_BUFFER_BYTES - 1);
+        return;
     }
 
-    if (c == '\n' || c == '\r') {
-        // Overwrite newline with null term FreeRTOS+CLI to be able to process it
-        // This is assuming that we're only getting a single CR or LF - if we get two this will break command parsing
-        command_char_idx--;
-        command_buffer[command_char_idx] = 0x00;
-
-        uart_write_bytes(handle->port, "\r\n", 2);
-
-        // Either free on failure here or dequeuer responsible for freeing
-        char *cmd_copy = pvPortMalloc((command_char_idx + 1) * sizeof(char));
-        memcpy(cmd_copy, command_buffer, command_char_idx + 1);
-        cli_command_t cmd = {
-            .cmd = cmd_copy,
-            .len = command_char_idx * sizeof(char),
-        };
-
-        // Queue will copy cmd struct values to internal queue items, no need to malloc it
-        BaseType_t rval = xQueueSendToBack(queue_handle, &cmd, pdMS_TO_TICKS(10));
-        if (!rval) {
-            vPortFree(cmd_copy);
+    if (command_char_idx == 0) {
+        return;
+    }
+
+    uint8_t pool_idx;
+    if (!xQueueReceive(free_queue_handle, &pool_idx, pdMS_TO_TICKS(CLI_COMMAND_POOL_WAIT_MS))) {
+        log_printf(LOG_LEVEL_ERROR, "No free CLI command buffers after %dms, dropping command", CLI_COMMAND_POOL_WAIT_MS);
+        return;
+    }
+
+    memcpy(command_pool[pool_idx], command_buffer, command_char_idx + 1);
+    cli_command_t cmd = {
+        .pool_idx = pool_idx,
+        .len      = command_char_idx * sizeof(char),
+    };
+
+    // Can't fail, there's one queue slot per pool buffer and we're holding one of those buffers
+    BaseType_t rval = xQueueSendToBack(queue_handle, &cmd, 0);
+    MEMFAULT_ASSERT(rval);
+}
+
+/*
+ * Handles a full chunk of rx bytes at once, building up the line buffer and submitting each full line as a command.
+ * All echo for the chunk is batched into a single uart write at the end instead of one per char.
+ */
+static void cli_process_bytes(const uint8_t *bytes, size_t len) {
+    size_t echo_len = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = bytes[i];
+
+        if (echo_len > CLI_ECHO_BUFFER_BYTES - CLI_ECHO_MAX_SEQUENCE_BYTES) {
+            uart_write_bytes(handle->port, echo_buffer, echo_len);
+            echo_len = 0;
         }
 
-        command_char_idx = 0;
+        if (c == 0x08 || c == 0x7F) {
+            if (command_char_idx > 0) {
+                command_buffer[--command_char_idx] = 0x00;
+                // Echo out a backspace to move the cursor back, a space to cover up the old char, then another
+                // backspace to remove the space. Don't put any of it in our buffer because we dgaf about those
+                // shenanigans to make it look good to the user.
+                memcpy(&echo_buffer[echo_len], "\x08\x20\x08", 3);
+                echo_len += 3;
+            }
+        } else if (c == '\n' || c == '\r') {
+            // Treat CRLF as a single line end so pasted scripts from any OS work
+            if (!(c == '\n' && last_char == '\r')) {
+                memcpy(&echo_buffer[echo_len], "\r\n", 2);
+                echo_len += 2;
+
+                // Null term for FreeRTOS+CLI to be able to process it
+                command_buffer[command_char_idx] = 0x00;
+
+                // Flush echo before submitting, rx can block below if the process task is behind
+                uart_write_bytes(handle->port, echo_buffer, echo_len);
+                echo_len = 0;
+
+                cli_submit_command();
+                command_char_idx = 0;
+                command_overflow = false;
+            }
+        } else if (command_char_idx < CLI_COMMAND_BUFFER_BYTES - 1) {
+            // Add to buffer and echo back
+            command_buffer[command_char_idx++] = c;
+            echo_buffer[echo_len++]            = c;
+        } else {
+            command_overflow = true;
+        }
+
+        last_char = c;
+    }
+
+    if (echo_len > 0) {
+        uart_write_bytes(handle->port, echo_buffer, echo_len);
+    }
+}
+
+/*
+ * Command output can be much longer than a single log record holds (help text, tables), so log it one line at a time
+ * and hard split any line that still doesn't fit. Each piece gets its own prefix but nothing is cut off.
+ */
+static void cli_log_output(const char *out) {
+    char chunk[LOG_RECORD_ARG_BYTES];
+    while (*out) {
+        const char *newline = strchr(out, '\n');
+        size_t      len     = newline ? (size_t)(newline - out) : strlen(out);
+        len                 = MIN(len, sizeof(chunk) - 1);
+
+        memcpy(chunk, out, len);
+        chunk[len] = '\0';
+        log_printf(LOG_LEVEL_INFO, "%s", chunk);
+
+        out += len;
+        if (*out == '\n') {
+            out++;
+        }
     }
 }
 
@@ -93,13 +184,15 @@ static void cli_process_command(void *args) {
         assert(rval);
 
         do {
-            more_data =
-                FreeRTOS_CLIProcessCommand(cmd.cmd, command_processing_out, CLI_COMMAND_PROCESS_OUT_BUFFER_BYTES);
-            log_printf(LOG_LEVEL_INFO, "%s", command_processing_out);
+            more_data = FreeRTOS_CLIProcessCommand(command_pool[cmd.pool_idx],
+                                                   command_processing_out,
+                                                   CLI_COMMAND_PROCESS_OUT_BUFFER_BYTES);
+            cli_log_output(command_processing_out);
         } while (more_data);
 
-        // Free the string malloced by uart rx task
-        // vPortFree(cmd.cmd);
+        // Hand the command buffer back to the rx task
+        rval = xQueueSendToBack(free_queue_handle, &cmd.pool_idx, 0);
+        MEMFAULT_ASSERT(rval);
     }
 }
 
@@ -115,33 +208,46 @@ void cli_task_init(uart_handle_t *uart_handle) {
     // Weird situation where this uart is already fully inited since we need to do it first thing to log out init
     // sequence. For other uart users, they'd probably init the entire uart_handle_t with uart_init themselves.
     // Instead we just assign the callback here and drop any received chars that happen in init sequence
-    handle->process_char = cli_process_char;
+    handle->process_bytes = cli_process_bytes;
 
-    command_buffer = pvPortMalloc(CLI_COMMAND_BUFFER_BYTES * sizeof(char));
-    assert(command_buffer);
     command_char_idx = 0;
+    command_overflow = false;
+    last_char        = 0x00;
+
+    free_queue_handle =
+        xQueueCreateStatic(CLI_COMMAND_QUEUE_SIZE, sizeof(uint8_t), free_queue_data_buffer, &free_queue_buffer);
+    assert(free_queue_handle);
+    for (uint8_t i = 0; i < CLI_COMMAND_QUEUE_SIZE; i++) {
+        xQueueSendToBack(free_queue_handle, &i, 0);
+    }
 
-    queue_data_buffer = pvPortMalloc(CLI_COMMAND_QUEUE_SIZE * sizeof(cli_command_t));
-    assert(queue_data_buffer);
     queue_handle = xQueueCreateStatic(CLI_COMMAND_QUEUE_SIZE, sizeof(cli_command_t), queue_data_buffer, &queue_buffer);
     assert(queue_handle);
-    command_processing_out = pvPortMalloc(CLI_COMMAND_PROCESS_OUT_BUFFER_BYTES * sizeof(char));
-    assert(command_processing_out);
+
+    memory_budget_register_buffer("cli command", sizeof(command_buffer));
+    memory_budget_register_buffer("cli command pool", sizeof(command_pool));
+    memory_budget_register_buffer("cli queues", sizeof(free_queue_data_buffer) + sizeof(queue_data_buffer));
+    memory_budget_register_buffer("cli out", sizeof(command_processing_out) + sizeof(echo_buffer));
+    memory_budget_register_stack("cli rx", sizeof(cli_rx_task_stack), &cli_rx_task_handle);
+    memory_budget_register_stack("cli process", sizeof(cli_task_stack), &cli_task_handle);
 }
 
 void cli_task_start() {
-    BaseType_t rval = xTaskCreate(uart_generic_rx_task,
-                                  "CLI UART RX",
-                                  SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 2,
-                                  handle,
-                                  CLI_TASK_PRIORITY,
-                                  NULL);
-    assert(rval);
-
-    rval = xTaskCreate(cli_process_command,
-                       "CLI cmd process",
-                       SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 5,
-                       queue_handle,
-                       CLI_CMD_PROCESS_TASK_PRIORITY,
-                       &cli_task_handle);
+    cli_rx_task_handle = xTaskCreateStatic(uart_generic_rx_task,
+                                           "CLI UART RX",
+                                           sizeof(cli_rx_task_stack),
+                                           handle,
+                                           CLI_TASK_PRIORITY,
+                                           cli_rx_task_stack,
+                                           &cli_rx_task_buffer);
+    assert(cli_rx_task_handle);
+
+    cli_task_handle = xTaskCreateStatic(cli_process_command,
+                                        "CLI cmd process",
+                                        sizeof(cli_task_stack),
+                                        queue_handle,
+                                        CLI_CMD_PROCESS_TASK_PRIORITY,
+                                        cli_task_stack,
+                                        &cli_task_buffer);
+    assert(cli_task_handle);
 }
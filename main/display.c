@@ -1,6 +1,11 @@
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
+#include "memfault/metrics/metrics.h"
 #include "memfault/panics/assert.h"
 
 #include "constants.h"
@@ -13,6 +18,10 @@
 #include "firasans_40.h"
 #include "flash_partition.h"
 #include "log.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "packbits.h"
+#include "screen_img_handler.h"
 
 #define TAG SC_TAG_DISPLAY
 
@@ -24,11 +33,60 @@
 #define ED060SC4_WIDTH_PX 800
 #define ED060SC4_HEIGHT_PX 600
 
+#define DISPLAY_FB_BYTES (EPD_WIDTH / 2 * EPD_HEIGHT)
+
+#define DISPLAY_SNAPSHOT_MAGIC (0x5CFB5A9E)
+// The time redraws every minute, so without a cap the sectors under the snapshot would be erased ~1400 times a day.
+// Hourly keeps them well inside flash endurance, at the cost of the snapshot lagging the panel by up to this long if
+// power is cut.
+#define DISPLAY_SNAPSHOT_MIN_INTERVAL_US (60 * SECS_PER_MIN * MS_PER_SEC * 1000LL)
+#define DISPLAY_SNAPSHOT_READ_CHUNK_BYTES (256)
+#define DISPLAY_PANEL_STATE_MAGIC (0x5CFB57A7)
+
+// Locked draws from other tasks can land while a full render holds the lock, which takes longer than the 500ms
+// render_acquire_lock gives up after
+#define DISPLAY_LOCKED_DRAW_WAIT_MS (3000)
+
+/*
+ * Stored at SCREEN_IMG_FB_SNAPSHOT_OFFSET, followed by the packbits encoded back framebuffer. Written last so a
+ * snapshot torn by a reset fails the magic check instead of being restored.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t fb_crc;  // of the decoded framebuffer
+    uint32_t encoded_len;
+    uint32_t reserved;
+} display_snapshot_header_t;
+
+/*
+ * Kept in RTC memory so it survives every reset but a power cut. Lets restore tell that the panel was driven after the
+ * last snapshot was saved (throttled saves, a reset right after a render) and the snapshot no longer matches it.
+ */
+typedef struct {
+    uint32_t magic;
+    bool     snapshot_stale;
+} display_panel_state_t;
+
+typedef struct {
+    uint8_t *buffer;  // NULL for a sizing pass
+    size_t   len;
+    size_t   max_len;
+} display_snapshot_io_t;
+
 static EpdiyHighlevelState hl;
 static uint32_t            display_height;
 static uint32_t            display_width;
 static SemaphoreHandle_t   render_lock;
 
+static bool     panel_state_restored;  // framebuffers hold what last boot left on the panel, nothing rendered since
+static bool     snapshot_saving;
+static uint32_t snapshot_crc;       // crc of the framebuffer in the saved snapshot, 0 if there isn't one
+static int64_t  snapshot_saved_us;  // 0 until the first save this boot
+static uint32_t panel_drive_count;  // bumped on every panel update so a save can tell if one landed while it wrote
+
+// Not zeroed on boot, validated by the magic instead
+static RTC_NOINIT_ATTR display_panel_state_t panel_state;
+
 static enum EpdFontFlags display_get_epd_font_flags_enum(display_font_align_t alignment) {
     MEMFAULT_ASSERT(alignment < DISPLAY_FONT_ALIGN_COUNT);
 
@@ -110,19 +168,251 @@ static void render_release_lock() {
     log_printf(LOG_LEVEL_DEBUG, "released lock");
 }
 
+/*
+ * Wrap every epd_poweron/off pair so panel drive time is tracked. Only called with the render lock held so the timer
+ * is never started twice.
+ */
+static void display_panel_power_on() {
+    panel_drive_count++;
+    panel_state.magic          = DISPLAY_PANEL_STATE_MAGIC;
+    panel_state.snapshot_stale = true;
+    memfault_metrics_heartbeat_timer_start(MEMFAULT_METRICS_KEY(panel_drive_time_ms));
+    epd_poweron();
+}
+
+static void display_panel_power_off() {
+    epd_poweroff();
+    memfault_metrics_heartbeat_timer_stop(MEMFAULT_METRICS_KEY(panel_drive_time_ms));
+}
+
+/*
+ * Every panel update counts as a render, split into full and partial by how much of the panel it drove.
+ */
+static void display_record_refresh(bool full) {
+    memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(render_count), 1);
+    if (full) {
+        memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(full_refresh_count), 1);
+    } else {
+        memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(partial_refresh_count), 1);
+    }
+}
+
+/*
+ * Number of rows the last epd_hl_update_screen/area found changed and drove. epdiy skips clean rows entirely, so this
+ * is what the update actually cost, 0 means the panel wasn't touched at all.
+ */
+static uint32_t display_last_update_dirty_lines() {
+    uint32_t dirty_lines = 0;
+    for (int i = 0; i < EPD_HEIGHT; i++) {
+        if (hl.dirty_lines[i]) {
+            dirty_lines++;
+        }
+    }
+
+    return dirty_lines;
+}
+
+static bool display_snapshot_output(const uint8_t *bytes, size_t len, void *ctx) {
+    display_snapshot_io_t *io = (display_snapshot_io_t *)ctx;
+    if (io->buffer != NULL) {
+        if (io->len + len > io->max_len) {
+            return false;
+        }
+        memcpy(&io->buffer[io->len], bytes, len);
+    }
+
+    io->len += len;
+    return true;
+}
+
+/*
+ * Erasing takes out the old header first, and the new one goes in last, so anything failing partway leaves no snapshot
+ * rather than a bad one
+ */
+static esp_err_t display_snapshot_write(const display_snapshot_header_t *header, const uint8_t *encoded) {
+    const esp_partition_t *part      = flash_partition_get_screen_img_partition();
+    size_t                 erase_len = (sizeof(*header) + header->encoded_len + 4095) & ~4095;
+    if (erase_len > SCREEN_IMG_FB_SNAPSHOT_MAX_BYTES || SCREEN_IMG_FB_SNAPSHOT_OFFSET + erase_len > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    snapshot_crc  = 0;
+    esp_err_t err = flash_partition_erase_range(part, SCREEN_IMG_FB_SNAPSHOT_OFFSET, erase_len);
+    if (err == ESP_OK) {
+        size_t data_offset = SCREEN_IMG_FB_SNAPSHOT_OFFSET + sizeof(*header);
+        err                = flash_partition_write(part, data_offset, encoded, header->encoded_len);
+    }
+    if (err == ESP_OK) {
+        err = flash_partition_write(part, SCREEN_IMG_FB_SNAPSHOT_OFFSET, header, sizeof(*header));
+    }
+
+    return err;
+}
+
+/*
+ * Saves what's now on the panel (back_fb, after an update) so the next boot can pick up from it instead of clearing.
+ * Framebuffer is only encoded with the render lock held, erasing and writing flash happens after it's released so
+ * renders aren't held up.
+ */
+static void display_snapshot_save() {
+    if (!render_acquire_lock(__func__, __LINE__)) {
+        return;
+    }
+
+    int64_t  now_us      = esp_timer_get_time();
+    uint32_t crc         = esp_rom_crc32_le(0, hl.back_fb, DISPLAY_FB_BYTES);
+    uint32_t drive_count = panel_drive_count;
+    if (crc == snapshot_crc && !snapshot_saving) {
+        // Panel ended up back on what's already saved
+        panel_state.snapshot_stale = false;
+        render_release_lock();
+        return;
+    }
+    if (snapshot_saving ||
+        (snapshot_saved_us != 0 && now_us - snapshot_saved_us < DISPLAY_SNAPSHOT_MIN_INTERVAL_US)) {
+        render_release_lock();
+        return;
+    }
+
+    // Sizing pass first so the buffer and the erase are only as big as they need to be
+    display_snapshot_io_t io = {0};
+    packbits_encode(hl.back_fb, DISPLAY_FB_BYTES, display_snapshot_output, &io);
+    if (sizeof(display_snapshot_header_t) + io.len > SCREEN_IMG_FB_SNAPSHOT_MAX_BYTES) {
+        render_release_lock();
+        log_printf(LOG_LEVEL_DEBUG, "Framebuffer only packs down to %u bytes, too big to snapshot", io.len);
+
+        // Whatever was saved no longer matches the panel, drop it so next boot clears instead. Retried on the usual
+        // interval rather than re-encoding after every render.
+        if (snapshot_crc != 0 &&
+            flash_partition_erase_range(flash_partition_get_screen_img_partition(),
+                                        SCREEN_IMG_FB_SNAPSHOT_OFFSET,
+                                        4096) == ESP_OK) {
+            snapshot_crc = 0;
+        }
+        snapshot_saved_us = now_us;
+        return;
+    }
+
+    io.max_len = io.len;
+    io.len     = 0;
+    io.buffer  = heap_caps_malloc(io.max_len, MALLOC_CAP_SPIRAM);
+    if (io.buffer == NULL) {
+        render_release_lock();
+        log_printf(LOG_LEVEL_WARN, "Couldn't alloc %u bytes to snapshot framebuffer", io.max_len);
+        return;
+    }
+    packbits_encode(hl.back_fb, DISPLAY_FB_BYTES, display_snapshot_output, &io);
+    snapshot_saving = true;
+    render_release_lock();
+
+    display_snapshot_header_t header = {.magic = DISPLAY_SNAPSHOT_MAGIC, .fb_crc = crc, .encoded_len = io.len};
+    esp_err_t                 err    = display_snapshot_write(&header, io.buffer);
+    free(io.buffer);
+    snapshot_saving = false;
+
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error saving framebuffer snapshot: %s", esp_err_to_name(err));
+        return;
+    }
+
+    snapshot_crc      = crc;
+    snapshot_saved_us = now_us;
+    if (panel_drive_count == drive_count) {
+        panel_state.snapshot_stale = false;
+    }
+    log_printf(LOG_LEVEL_DEBUG,
+               "Saved %u byte framebuffer snapshot in %lldms",
+               io.len,
+               (esp_timer_get_time() - now_us) / 1000);
+}
+
+static bool display_snapshot_decode_output(const uint8_t *bytes, size_t len, void *ctx) {
+    size_t *decoded = (size_t *)ctx;
+    if (*decoded + len > DISPLAY_FB_BYTES) {
+        return false;
+    }
+
+    memcpy(&hl.back_fb[*decoded], bytes, len);
+    *decoded += len;
+    return true;
+}
+
+/*
+ * Loads the snapshot of what was on the panel at the end of last boot into both framebuffers. Returns false and leaves
+ * the back framebuffer white if there isn't a valid one.
+ */
+static bool display_snapshot_restore() {
+    // Only known after a reset that kept RTC memory. After a power cut the snapshot can still lag the panel by up to
+    // DISPLAY_SNAPSHOT_MIN_INTERVAL_US, there's nothing left to tell.
+    if (panel_state.magic == DISPLAY_PANEL_STATE_MAGIC && panel_state.snapshot_stale) {
+        log_printf(LOG_LEVEL_INFO, "Panel was updated after the last framebuffer snapshot, ignoring it");
+        return false;
+    }
+
+    const esp_partition_t    *part = flash_partition_get_screen_img_partition();
+    display_snapshot_header_t header;
+    esp_err_t err = esp_partition_read(part, SCREEN_IMG_FB_SNAPSHOT_OFFSET, &header, sizeof(header));
+    if (err != ESP_OK || header.magic != DISPLAY_SNAPSHOT_MAGIC ||
+        header.encoded_len > SCREEN_IMG_FB_SNAPSHOT_MAX_BYTES - sizeof(header)) {
+        log_printf(LOG_LEVEL_INFO, "No framebuffer snapshot saved");
+        return false;
+    }
+
+    int64_t            start_us = esp_timer_get_time();
+    size_t             decoded  = 0;
+    packbits_decoder_t decoder;
+    packbits_decoder_init(&decoder, display_snapshot_decode_output, &decoded);
+
+    uint8_t chunk[DISPLAY_SNAPSHOT_READ_CHUNK_BYTES];
+    for (size_t offset = 0; offset < header.encoded_len && err == ESP_OK; offset += sizeof(chunk)) {
+        size_t len = MIN(sizeof(chunk), header.encoded_len - offset);
+        err        = esp_partition_read(part, SCREEN_IMG_FB_SNAPSHOT_OFFSET + sizeof(header) + offset, chunk, len);
+        if (err == ESP_OK && !packbits_decode(&decoder, chunk, len)) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    if (err != ESP_OK || !packbits_decoder_is_complete(&decoder) || decoded != DISPLAY_FB_BYTES ||
+        esp_rom_crc32_le(0, hl.back_fb, DISPLAY_FB_BYTES) != header.fb_crc) {
+        log_printf(LOG_LEVEL_WARN, "Framebuffer snapshot is corrupt, ignoring it");
+        memset(hl.back_fb, 0xFF, DISPLAY_FB_BYTES);
+        return false;
+    }
+
+    memcpy(hl.front_fb, hl.back_fb, DISPLAY_FB_BYTES);
+    snapshot_crc               = header.fb_crc;
+    panel_state.magic          = DISPLAY_PANEL_STATE_MAGIC;
+    panel_state.snapshot_stale = false;
+    log_printf(LOG_LEVEL_INFO,
+               "Restored framebuffer snapshot (%lu bytes) in %lldms",
+               header.encoded_len,
+               (esp_timer_get_time() - start_us) / 1000);
+    return true;
+}
+
 static void display_render_mode(enum EpdDrawMode mode) {
     if (!render_acquire_lock(__func__, __LINE__)) {
         return;
     }
 
-    epd_poweron();
+    int64_t start_us = esp_timer_get_time();
+    display_panel_power_on();
     vTaskDelay(pdMS_TO_TICKS(20));
     enum EpdDrawError err = epd_hl_update_screen(&hl, mode, 25);
     (void)err;
     // TODO :: error check
-    epd_poweroff();
+    display_panel_power_off();
 
+    uint32_t dirty_lines = display_last_update_dirty_lines();
+    panel_state_restored = false;
     render_release_lock();
+    metrics_record_duration(METRICS_DURATION_RENDER, (esp_timer_get_time() - start_us) / 1000);
+
+    if (dirty_lines > 0) {
+        display_record_refresh(dirty_lines == EPD_HEIGHT);
+    }
+
+    display_snapshot_save();
 }
 
 void display_init() {
@@ -133,6 +423,11 @@ void display_init() {
 
     render_lock = xSemaphoreCreateMutex();
 
+    EpdStaticMemory epd_mem = epd_static_memory();
+    memory_budget_register_buffer("epd line queue", epd_mem.output_queue);
+    memory_budget_register_buffer("epd output stacks", epd_mem.output_task_stacks);
+    memory_budget_register_buffer("epd glyph decomp", epd_mem.glyph_decompressor);
+
     display_width  = epd_rotated_display_width();
     display_height = epd_rotated_display_height();
     log_printf(LOG_LEVEL_DEBUG, "Display dimensions,  width: %dpx height: %dpx", display_width, display_height);
@@ -141,6 +436,13 @@ void display_init() {
 void display_start() {
     MEMFAULT_ASSERT(hl.front_fb && hl.back_fb);
 
+    // Panel still shows whatever the snapshot has, so epdiy can diff against it and the first render only drives what
+    // changed. No clearing or splash screen needed.
+    if (display_snapshot_restore()) {
+        panel_state_restored = true;
+        return;
+    }
+
     //  We need at least 3 because there is no memory of what is displayed on screen from last run, so the diffing
     //  internal to epdiy won't run to help the  clearing process.
     display_full_clear_cycles(3);
@@ -150,20 +452,48 @@ void display_render() {
     display_render_mode(MODE_GC16);
 }
 
+/*
+ * Direct update waveform, a handful of phases instead of GC16's 30. Only drives pixels to black or white so it's meant
+ * for small text-only changes, anything gray comes out hard edged until the next GC16 render over it.
+ */
+void display_render_fast() {
+    display_render_mode(MODE_DU);
+}
+
 void display_full_clear_cycles(uint8_t cycles) {
     if (!render_acquire_lock(__func__, __LINE__)) {
         return;
     }
 
-    epd_poweron();
+    display_panel_power_on();
     epd_hl_set_all_white(&hl);
     enum EpdDrawError err = epd_hl_update_screen(&hl, MODE_GC16, 25);
     (void)err;
     vTaskDelay(pdMS_TO_TICKS(20));
     epd_clear_area_cycles(epd_full_screen(), cycles, 12);
-    epd_poweroff();
+    display_panel_power_off();
 
+    panel_state_restored = false;
     render_release_lock();
+    display_record_refresh(true);
+
+    display_snapshot_save();
+}
+
+/*
+ * True from a boot that restored the framebuffer snapshot up until the first render or clear. Callers can skip boot
+ * screens and full clears while it's set, drawing straight over the restored content and rendering once.
+ */
+bool display_panel_state_restored() {
+    return panel_state_restored;
+}
+
+/*
+ * Whites out the framebuffer without touching the panel. The next render takes the panel straight from what's there to
+ * whatever gets drawn.
+ */
+void display_clear_framebuffer() {
+    epd_hl_set_all_white(&hl);
 }
 
 /*
@@ -207,14 +537,15 @@ void display_clear_area(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
         rect.height += 2;
     }
 
-    epd_poweron();
+    display_panel_power_on();
     epd_hl_update_area(&hl, MODE_GC16, 18, rect);
     vTaskDelay(pdMS_TO_TICKS(40));
     epd_clear_area_cycles(rect, 1, 12);
     vTaskDelay(pdMS_TO_TICKS(40));
-    epd_poweroff();
+    display_panel_power_off();
 
     render_release_lock();
+    display_record_refresh(rect.width >= ED060SC4_WIDTH_PX && rect.height >= ED060SC4_HEIGHT_PX);
 
     log_printf(LOG_LEVEL_DEBUG, "Cleared %uw %uh rect at (%u, %u)", width, height, x, y);
 }
@@ -257,6 +588,27 @@ void display_draw_text(char                *text,
                        uint32_t             y_coord,
                        display_font_size_t  size,
                        display_font_align_t alignment) {
+    log_printf(LOG_LEVEL_DEBUG,
+               "Rendering %s, %s-aligned text at (%u, %u): '%s'",
+               display_get_epd_font_enum_string(size),
+               display_get_epd_font_flags_enum_string(alignment),
+               x_coord,
+               y_coord,
+               text);
+
+    display_draw_text_to_fb(epd_hl_get_framebuffer(&hl), text, x_coord, y_coord, size, alignment);
+}
+
+/*
+ * Same as display_draw_text but into a caller-owned 4bpp framebuffer (EPD_WIDTH / 2 * EPD_HEIGHT bytes) instead of the
+ * one backing the display. No logging so it can be used to time glyph rendering on its own.
+ */
+void display_draw_text_to_fb(uint8_t             *fb,
+                             char                *text,
+                             uint32_t             x_coord,
+                             uint32_t             y_coord,
+                             display_font_size_t  size,
+                             display_font_align_t alignment) {
     MEMFAULT_ASSERT(x_coord < ED060SC4_WIDTH_PX);
     MEMFAULT_ASSERT(y_coord < ED060SC4_HEIGHT_PX);
 
@@ -266,15 +618,6 @@ void display_draw_text(char                *text,
     EpdFontProperties font_props = epd_font_properties_default();
     font_props.flags             = display_get_epd_font_flags_enum(alignment);
     const EpdFont *font          = display_get_epd_font_enum(size);
-    uint8_t       *fb            = epd_hl_get_framebuffer(&hl);
-
-    log_printf(LOG_LEVEL_DEBUG,
-               "Rendering %s, %s-aligned text at (%u, %u): '%s'",
-               display_get_epd_font_enum_string(size),
-               display_get_epd_font_flags_enum_string(alignment),
-               x,
-               y,
-               text);
 
     epd_write_string(font, text, &x, &y, fb, &font_props);
 }
@@ -334,6 +677,27 @@ void display_draw_image(uint8_t *image_buffer,
     epd_copy_to_framebuffer(rect, image_buffer, fb);
 }
 
+/*
+ * display_draw_image for callers outside the scheduler task. Holds the render lock for the copy so it can't land
+ * halfway through a scheduler render diffing the framebuffer. Returns false if the lock couldn't be taken and nothing
+ * was drawn.
+ */
+bool display_draw_image_locked(uint8_t *image_buffer,
+                               size_t   width_px,
+                               size_t   height_px,
+                               uint8_t  bytes_per_px,
+                               uint32_t screen_x,
+                               uint32_t screen_y) {
+    if (!xSemaphoreTake(render_lock, pdMS_TO_TICKS(DISPLAY_LOCKED_DRAW_WAIT_MS))) {
+        log_printf(LOG_LEVEL_ERROR, "Couldn't acquire render lock for draw after %dms", DISPLAY_LOCKED_DRAW_WAIT_MS);
+        return false;
+    }
+
+    display_draw_image(image_buffer, width_px, height_px, bytes_per_px, screen_x, screen_y);
+    xSemaphoreGive(render_lock);
+    return true;
+}
+
 void display_draw_rect(uint32_t x, uint32_t y, uint32_t width_px, uint32_t height_px) {
     // Limit these bounds to be w/in the framebuffer, epdiy will happily buffer overflow it
     MEMFAULT_ASSERT(x + width_px <= ED060SC4_WIDTH_PX);
@@ -1,14 +1,58 @@
+#include <stdatomic.h>
+
+#include "esp_timer.h"
 #include "memfault/panics/assert.h"
 
 #include "constants.h"
 #include "flash_partition.h"
+#include "log_persist.h"
 #include "screen_img_handler.h"
 
 #define TAG SC_TAG_PART
 
+// Accumulated here instead of straight into the heartbeat since log_persist spills to flash from log_init, before
+// memfault_boot. Collected and reset every heartbeat by flash_partition_take_timing.
+static atomic_uint erase_us;
+static atomic_uint write_us;
+
 const esp_partition_t *flash_partition_get_screen_img_partition() {
     const esp_partition_t *screen_img_partition =
         esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SCREEN_IMG_PARTITION_LABEL);
     MEMFAULT_ASSERT(screen_img_partition);
     return screen_img_partition;
 }
+
+/*
+ * Optional partition, only exists on devices flashed with newer partition tables. Returns NULL if not found.
+ */
+const esp_partition_t *flash_partition_get_log_partition() {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, LOG_PERSIST_PARTITION_LABEL);
+}
+
+/*
+ * esp_partition_erase_range that also tracks time spent erasing for the heartbeat
+ */
+esp_err_t flash_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    int64_t   start_us = esp_timer_get_time();
+    esp_err_t err      = esp_partition_erase_range(partition, offset, size);
+    atomic_fetch_add(&erase_us, (unsigned int)(esp_timer_get_time() - start_us));
+    return err;
+}
+
+/*
+ * esp_partition_write that also tracks time spent writing for the heartbeat
+ */
+esp_err_t flash_partition_write(const esp_partition_t *partition, size_t offset, const void *data, size_t size) {
+    int64_t   start_us = esp_timer_get_time();
+    esp_err_t err      = esp_partition_write(partition, offset, data, size);
+    atomic_fetch_add(&write_us, (unsigned int)(esp_timer_get_time() - start_us));
+    return err;
+}
+
+/*
+ * Returns total time spent in erases and writes since the last call and resets both
+ */
+void flash_partition_take_timing(uint32_t *erase_total_us, uint32_t *write_total_us) {
+    *erase_total_us = atomic_exchange(&erase_us, 0);
+    *write_total_us = atomic_exchange(&write_us, 0);
+}
@@ -2,13 +2,16 @@
 
 #include "esp_crt_bundle.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "memfault/metrics/metrics.h"
 #include "memfault/panics/assert.h"
 
 #include "constants.h"
+#include "flash_partition.h"
 #include "http_client.h"
+#include "memory_budget.h"
 #include "scheduler_task.h"
 #include "spot_check.h"
 #include "wifi.h"
@@ -21,10 +24,91 @@
 #define MAX_QUERY_PARAM_LENGTH 15
 #define MAX_READ_BUFFER_SIZE 1024
 
+#define HTTP_ENDPOINT_KEYS(name)                                   \
+    ((http_endpoint_keys_t){                                       \
+        .count      = MEMFAULT_METRICS_KEY(http_##name##_count),      \
+        .latency_ms = MEMFAULT_METRICS_KEY(http_##name##_latency_ms), \
+        .bytes      = MEMFAULT_METRICS_KEY(http_##name##_bytes),      \
+    })
+
+// Endpoints that get their own heartbeat metrics, everything else is lumped into other
+typedef enum {
+    HTTP_ENDPOINT_CONDITIONS,
+    HTTP_ENDPOINT_TIDES_CHART,
+    HTTP_ENDPOINT_SWELL_CHART,
+    HTTP_ENDPOINT_WIND_CHART,
+    HTTP_ENDPOINT_CUSTOM_SCREEN,
+    HTTP_ENDPOINT_OTHER,
+} http_endpoint_t;
+
+typedef struct {
+    MemfaultMetricId count;
+    MemfaultMetricId latency_ms;
+    MemfaultMetricId bytes;
+} http_endpoint_keys_t;
+
 static SemaphoreHandle_t request_lock;
 static uint16_t          failed_http_perform_reqs;
 static uint16_t          failed_http_perform_posts;
 
+// Chunk buffer for streaming responses into flash. Only screen image downloads use it, which all run from the scheduler
+// task one at a time.
+static uint8_t flash_read_buffer[MAX_READ_BUFFER_SIZE];
+
+/*
+ * The only external GET we make is a user's custom screen url, external POSTs are uploads (memfault)
+ */
+static http_endpoint_t http_client_get_endpoint(const http_request_t *request_obj) {
+    size_t base_len = strlen(URL_BASE);
+    if (strncmp(request_obj->url, URL_BASE, base_len) != 0) {
+        return request_obj->req_type == HTTP_REQ_TYPE_GET ? HTTP_ENDPOINT_CUSTOM_SCREEN : HTTP_ENDPOINT_OTHER;
+    }
+
+    const char *endpoint = request_obj->url + base_len;
+    if (strcmp(endpoint, "conditions") == 0) {
+        return HTTP_ENDPOINT_CONDITIONS;
+    } else if (strcmp(endpoint, "tides_chart") == 0) {
+        return HTTP_ENDPOINT_TIDES_CHART;
+    } else if (strcmp(endpoint, "swell_chart") == 0) {
+        return HTTP_ENDPOINT_SWELL_CHART;
+    } else if (strcmp(endpoint, "wind_chart") == 0) {
+        return HTTP_ENDPOINT_WIND_CHART;
+    }
+
+    return HTTP_ENDPOINT_OTHER;
+}
+
+static http_endpoint_keys_t http_client_get_endpoint_keys(http_endpoint_t endpoint) {
+    switch (endpoint) {
+        case HTTP_ENDPOINT_CONDITIONS:
+            return HTTP_ENDPOINT_KEYS(conditions);
+        case HTTP_ENDPOINT_TIDES_CHART:
+            return HTTP_ENDPOINT_KEYS(tides_chart);
+        case HTTP_ENDPOINT_SWELL_CHART:
+            return HTTP_ENDPOINT_KEYS(swell_chart);
+        case HTTP_ENDPOINT_WIND_CHART:
+            return HTTP_ENDPOINT_KEYS(wind_chart);
+        case HTTP_ENDPOINT_CUSTOM_SCREEN:
+            return HTTP_ENDPOINT_KEYS(custom_screen);
+        default:
+            return HTTP_ENDPOINT_KEYS(other);
+    }
+}
+
+/*
+ * Endpoint is stashed in the client's user data at init so the read functions can attribute bytes without the caller
+ * passing the request back in
+ */
+static void http_client_add_bytes_metric(esp_http_client_handle_t client, size_t bytes) {
+    void *user_data = NULL;
+    if (esp_http_client_get_user_data(client, &user_data) != ESP_OK) {
+        return;
+    }
+
+    http_endpoint_keys_t keys = http_client_get_endpoint_keys((http_endpoint_t)(intptr_t)user_data);
+    memfault_metrics_heartbeat_add(keys.bytes, bytes);
+}
+
 /* Technically unnecessary, should be stubbed out for non-debug build */
 esp_err_t http_event_handler(esp_http_client_event_t *event) {
     switch (event->event_id) {
@@ -76,19 +160,19 @@ static bool http_client_perform(http_request_t *request_obj, esp_http_client_han
     char                     req_type_str[5];
     uint16_t                *failed_error_ptr = NULL;
     esp_http_client_method_t method;
-    char                     content_type[17];
+    const char              *content_type;
     MemfaultMetricId         memfault_key;
     switch (request_obj->req_type) {
         case HTTP_REQ_TYPE_GET:
             strcpy(req_type_str, "GET");
-            strcpy(content_type, "text/html");
+            content_type     = "text/html";
             memfault_key     = MEMFAULT_METRICS_KEY(failed_http_reqs);
             failed_error_ptr = &failed_http_perform_reqs;
             method           = HTTP_METHOD_GET;
             break;
         case HTTP_REQ_TYPE_POST:
             strcpy(req_type_str, "POST");
-            strcpy(content_type, "application/json");
+            content_type     = "application/json";
             memfault_key     = MEMFAULT_METRICS_KEY(failed_http_posts);
             failed_error_ptr = &failed_http_perform_posts;
             method           = HTTP_METHOD_POST;
@@ -97,6 +181,10 @@ static bool http_client_perform(http_request_t *request_obj, esp_http_client_han
             MEMFAULT_ASSERT(0);
     }
 
+    if (request_obj->content_type) {
+        content_type = request_obj->content_type;
+    }
+
     if (!wifi_is_connected_to_network()) {
         log_printf(LOG_LEVEL_INFO,
                    "Attempted to make %s request, not connected to any wifi network yet so bailing",
@@ -128,6 +216,7 @@ static bool http_client_perform(http_request_t *request_obj, esp_http_client_han
         .buffer_size       = MAX_READ_BUFFER_SIZE,
         .transport_type    = HTTP_TRANSPORT_OVER_SSL,
         .crt_bundle_attach = esp_crt_bundle_attach,
+        .user_data         = (void *)(intptr_t)http_client_get_endpoint(request_obj),
     };
 
     BaseType_t lock_success = xSemaphoreTake(request_lock, pdMS_TO_TICKS(5000));
@@ -156,6 +245,10 @@ static bool http_client_perform(http_request_t *request_obj, esp_http_client_han
             size_t open_data_size = 0;
             ESP_ERROR_CHECK(esp_http_client_set_method(*client, method));
             ESP_ERROR_CHECK(esp_http_client_set_header(*client, "Content-Type", content_type));
+            for (uint8_t i = 0; i < request_obj->num_headers; i++) {
+                ESP_ERROR_CHECK(
+                    esp_http_client_set_header(*client, request_obj->headers[i].key, request_obj->headers[i].value));
+            }
             if (request_obj->req_type == HTTP_REQ_TYPE_POST) {
                 ESP_ERROR_CHECK(esp_http_client_set_post_field(*client,
                                                                request_obj->post_args.post_data,
@@ -286,6 +379,7 @@ bool http_client_perform_with_retries(http_request_t           *request_obj,
                                       int                      *content_length) {
     uint8_t attempts = 0;
     bool    success  = false;
+    int64_t start_us = esp_timer_get_time();
     while ((attempts <= additional_retries) && !success) {
         // This typically succeeds even with no internet connection, I think it only fails if there's no network
         // connection period
@@ -302,11 +396,17 @@ bool http_client_perform_with_retries(http_request_t           *request_obj,
         attempts++;
     }
 
+    if (success) {
+        http_endpoint_keys_t keys = http_client_get_endpoint_keys(http_client_get_endpoint(request_obj));
+        memfault_metrics_heartbeat_add(keys.count, 1);
+        memfault_metrics_heartbeat_add(keys.latency_ms, (esp_timer_get_time() - start_us) / 1000);
+    }
+
     // Only Kick into offline mode if this is not a network request associated with boot (so for now just healthcheck).
     // This allows init logic in main.c to render the proper info screens based on logic surrounding different possible
     // states with or without prov info, network connection, and internet connection
     // TODO :: scheduler shouldn't be a dependency in here, so theoretically this logic should be somewhere else
-    if (!success && scheduler_get_mode() != SCHEDULER_MODE_INIT) {
+    if (!success && !request_obj->best_effort && scheduler_get_mode() != SCHEDULER_MODE_INIT) {
         spot_check_set_offline_mode();
     }
 
@@ -406,6 +506,26 @@ http_request_t http_client_build_post_request(char *endpoint, char *url_buf, cha
     return req;
 }
 
+/*
+ * POST to a full url on a server that isn't ours. Caller owns the url buffer. Failures won't kick the scheduler
+ * offline since another service being down says nothing about our connection.
+ */
+http_request_t http_client_build_external_post_request(char *url, char *post_data, size_t post_data_size) {
+    http_post_args_t post_args = {
+        .post_data      = post_data,
+        .post_data_size = post_data_size,
+    };
+
+    http_request_t req = {
+        .req_type    = HTTP_REQ_TYPE_POST,
+        .url         = url,
+        .best_effort = true,
+        .post_args   = post_args,
+    };
+
+    return req;
+}
+
 /*
  * Read response from http requeste into caller-supplied buffer. Assumed that response has been checked before this with
  * http_client_check_response! Caller responsible for freeing malloced buffer saved in response_data pointer if return
@@ -443,6 +563,7 @@ esp_err_t http_client_read_response_to_buffer(esp_http_client_handle_t *client,
                 (*response_data)[length_received] = '\0';
                 bytes_received                    = length_received + 1;
                 err                               = ESP_OK;
+                http_client_add_bytes_metric(*client, length_received);
                 log_printf(LOG_LEVEL_DEBUG, "Rcvd %zu bytes of response data: %s", bytes_received, *response_data);
             }
         } else {
@@ -500,12 +621,7 @@ esp_err_t http_client_read_response_to_flash(esp_http_client_handle_t *client,
 
         uint32_t moving_screen_img_addr = offset_into_partition;
         int      length_received        = 0;
-        uint8_t *response_data          = malloc(MAX_READ_BUFFER_SIZE);
-        if (!response_data) {
-            log_printf(LOG_LEVEL_ERROR, "Malloc of %u bytes failed for http response!", content_length + 1);
-            break;
-        }
-
+        uint8_t *response_data          = flash_read_buffer;
         do {
             // Pull in chunk and immediately write to flash
             length_received = esp_http_client_read(*client, (char *)response_data, MAX_READ_BUFFER_SIZE);
@@ -519,7 +635,7 @@ esp_err_t http_client_read_response_to_flash(esp_http_client_handle_t *client,
                                partition->size);
                     break;
                 }
-                esp_partition_write(partition, moving_screen_img_addr, response_data, length_received);
+                flash_partition_write(partition, moving_screen_img_addr, response_data, length_received);
                 log_printf(LOG_LEVEL_DEBUG,
                            "Wrote %d bytes to screen image partition at offset %d",
                            length_received,
@@ -529,10 +645,6 @@ esp_err_t http_client_read_response_to_flash(esp_http_client_handle_t *client,
             }
         } while (length_received > 0);
 
-        if (response_data) {
-            free(response_data);
-        }
-
         if (length_received < 0) {
             // NVS has already been marked as invalid at time of flash erase, so just return error
             log_printf(LOG_LEVEL_ERROR, "Error reading response after successful http client request");
@@ -540,6 +652,7 @@ esp_err_t http_client_read_response_to_flash(esp_http_client_handle_t *client,
         } else {
             log_printf(LOG_LEVEL_DEBUG, "Rcvd %zu bytes total of response data and saved to flash", bytes_received);
             err = ESP_OK;
+            http_client_add_bytes_metric(*client, bytes_received);
         }
     } while (0);
 
@@ -550,8 +663,8 @@ esp_err_t http_client_read_response_to_flash(esp_http_client_handle_t *client,
     if (cleanup_err != ESP_OK) {
         err = cleanup_err;
         log_printf(LOG_LEVEL_ERROR,
-                   "Call to esp_http_client_cleanup after reading response to flash failed with err: %s. Malloced buff "
-                   "already freed so not altering bytes_received returned to caller",
+                   "Call to esp_http_client_cleanup after reading response to flash failed with err: %s. Not altering "
+                   "bytes_received returned to caller",
                    esp_err_to_name(cleanup_err));
     }
 
@@ -559,6 +672,121 @@ esp_err_t http_client_read_response_to_flash(esp_http_client_handle_t *client,
     return err;
 }
 
+/*
+ * Init a keep-alive client for a run of POSTs to the same external url (memfault chunks), so the TLS handshake is paid
+ * once per upload instead of once per POST. Headers are set once and reused for every POST. Caller posts with
+ * http_client_upload and must finish with http_client_close_upload. Returns NULL on failure.
+ */
+esp_http_client_handle_t http_client_open_upload(char        *url,
+                                                 const char  *content_type,
+                                                 query_param *headers,
+                                                 uint8_t      num_headers) {
+    MEMFAULT_ASSERT(url);
+
+    if (!wifi_is_connected_to_network()) {
+        log_printf(LOG_LEVEL_INFO, "Attempted to open upload, not connected to any wifi network yet so bailing");
+        return NULL;
+    }
+
+    esp_http_client_config_t http_config = {
+        .url               = url,
+        .method            = HTTP_METHOD_POST,
+        .event_handler     = http_event_handler,
+        .buffer_size       = MAX_READ_BUFFER_SIZE,
+        .transport_type    = HTTP_TRANSPORT_OVER_SSL,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .keep_alive_enable = true,
+        .user_data         = (void *)(intptr_t)HTTP_ENDPOINT_OTHER,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if (!client) {
+        log_printf(LOG_LEVEL_ERROR, "Error initing http client for upload to '%s'", url);
+        failed_http_perform_posts++;
+        memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(failed_http_posts), 1);
+        return NULL;
+    }
+
+    ESP_ERROR_CHECK(esp_http_client_set_header(client, "Content-Type", content_type));
+    for (uint8_t i = 0; i < num_headers; i++) {
+        ESP_ERROR_CHECK(esp_http_client_set_header(client, headers[i].key, headers[i].value));
+    }
+
+    return client;
+}
+
+/*
+ * POST one body over a client from http_client_open_upload and drain the response so the connection can carry the next
+ * one. The connection only gets re-established if the server or a failure closed it. Retried once on a fresh
+ * connection. Failures never kick to offline mode since uploads only go to external servers. Returns success.
+ */
+bool http_client_upload(esp_http_client_handle_t client, const char *data, size_t data_size) {
+    MEMFAULT_ASSERT(client);
+    MEMFAULT_ASSERT(data);
+
+    int64_t start_us = esp_timer_get_time();
+    bool    success  = false;
+    for (uint8_t attempts = 0; attempts < 2 && !success; attempts++) {
+        if (xSemaphoreTake(request_lock, pdMS_TO_TICKS(5000)) == pdFALSE) {
+            log_printf(LOG_LEVEL_ERROR, "Failed to take http req lock in timeout, skipping upload attempt");
+            continue;
+        }
+
+        do {
+            esp_err_t err = esp_http_client_open(client, data_size);
+            if (err != ESP_OK) {
+                log_printf(LOG_LEVEL_ERROR, "Error opening upload connection, error: %s", esp_err_to_name(err));
+                break;
+            }
+
+            if (esp_http_client_write(client, data, data_size) < 0) {
+                log_printf(LOG_LEVEL_ERROR, "Error writing %u byte upload body", data_size);
+                break;
+            }
+
+            int content_length = esp_http_client_fetch_headers(client);
+            int status         = esp_http_client_get_status_code(client);
+            if (content_length < 0 || status < 200 || status > 299) {
+                log_printf(LOG_LEVEL_INFO, "Upload failed: status=%d, Content-length=%d", status, content_length);
+                break;
+            }
+
+            // Body is just an ack, but it has to be read out before the connection can be reused
+            int flushed = 0;
+            esp_http_client_flush_response(client, &flushed);
+            http_client_add_bytes_metric(client, flushed);
+            success = true;
+        } while (0);
+
+        if (!success) {
+            // Drop the connection so the retry (or next upload) starts from a clean one
+            esp_http_client_close(client);
+        }
+
+        xSemaphoreGive(request_lock);
+    }
+
+    http_endpoint_keys_t keys = http_client_get_endpoint_keys(HTTP_ENDPOINT_OTHER);
+    if (success) {
+        memfault_metrics_heartbeat_add(keys.count, 1);
+        memfault_metrics_heartbeat_add(keys.latency_ms, (esp_timer_get_time() - start_us) / 1000);
+    } else {
+        failed_http_perform_posts++;
+        memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(failed_http_posts), 1);
+    }
+
+    return success;
+}
+
+void http_client_close_upload(esp_http_client_handle_t client) {
+    esp_err_t err = esp_http_client_cleanup(client);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Call to esp_http_client_cleanup after upload failed with err: %s",
+                   esp_err_to_name(err));
+    }
+}
+
 /*
  * Perform a test query to make sure we actually have an active internet connection. NOTE: blocking, so make sure
  * whatever is calling can wait
@@ -601,4 +829,6 @@ void http_client_init() {
 
     failed_http_perform_reqs  = 0;
     failed_http_perform_posts = 0;
+
+    memory_budget_register_buffer("http flash read", sizeof(flash_read_buffer));
 }
@@ -2,23 +2,86 @@
 
 #include <esp_http_server.h>
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <log.h>
 #include <sys/param.h>
 
 #include "memfault/panics/assert.h"
 
 #include "constants.h"
+#include "display.h"
 #include "http_client.h"
 #include "http_server.h"
 #include "json.h"
+#include "json_stream.h"
+#include "log_persist.h"
+#include "metrics.h"
 #include "nvs.h"
+#include "packbits.h"
+#include "power_policy.h"
 #include "scheduler_task.h"
 #include "screen_img_handler.h"
+#include "sleep_handler.h"
 #include "sntp_time.h"
 #include "spot_check.h"
 
 #define TAG SC_TAG_HTTP_SERVER
 
+#define HTTP_SERVER_RX_CHUNK_BYTES (1024)
+#define HTTP_SERVER_MAX_RX_TIMEOUTS (3)
+#define SCREEN_PUSH_WIDTH_PX (800)
+#define SCREEN_PUSH_HEIGHT_PX (600)
+
+typedef enum {
+    SCREEN_PUSH_DEST_FLASH,
+    SCREEN_PUSH_DEST_FRAMEBUFFER,
+} screen_push_dest_t;
+
+typedef enum {
+    CONFIGURE_FIELD_TZ_STR,
+    CONFIGURE_FIELD_TZ_DISPLAY_NAME,
+    CONFIGURE_FIELD_OPERATING_MODE,
+    CONFIGURE_FIELD_SPOT_NAME,
+    CONFIGURE_FIELD_SPOT_LAT,
+    CONFIGURE_FIELD_SPOT_LON,
+    CONFIGURE_FIELD_SPOT_UID,
+    CONFIGURE_FIELD_ACTIVE_CHART_1,
+    CONFIGURE_FIELD_ACTIVE_CHART_2,
+    CONFIGURE_FIELD_CUSTOM_SCREEN_URL,
+    CONFIGURE_FIELD_CUSTOM_PUSH_URL,
+    CONFIGURE_FIELD_CUSTOM_UPDATE_INTERVAL_SECS,
+    CONFIGURE_FIELD_COUNT,
+} configure_field_t;
+
+// Staged /configure values, the json parser writes each param straight into its buffer here
+typedef struct {
+    char tz_str[MAX_LENGTH_TZ_STR_PARAM + 1];
+    char tz_display_name[MAX_LENGTH_TZ_DISPLAY_NAME_PARAM + 1];
+    char operating_mode[MAX_LENGTH_OPERATING_MODE_PARAM + 1];
+    char spot_name[MAX_LENGTH_SPOT_NAME_PARAM + 1];
+    char spot_lat[MAX_LENGTH_SPOT_LAT_PARAM + 1];
+    char spot_lon[MAX_LENGTH_SPOT_LON_PARAM + 1];
+    char spot_uid[MAX_LENGTH_SPOT_UID_PARAM + 1];
+    char active_chart_1[MAX_LENGTH_ACTIVE_CHART_PARAM + 1];
+    char active_chart_2[MAX_LENGTH_ACTIVE_CHART_PARAM + 1];
+    char custom_screen_url[MAX_LENGTH_CUSTOM_SCREEN_URL_PARAM + 1];
+    char custom_push_url[MAX_LENGTH_CUSTOM_PUSH_URL_PARAM + 1];
+    char custom_update_interval_secs[MAX_LENGTH_CUSTOM_UPDATE_INTERVAL_SECS_PARAM + 1];
+} configure_staged_t;
+
+// State for one POST /screen body as it's decoded, shared between the raw and packbits paths
+typedef struct {
+    screen_push_dest_t dest;
+    uint32_t           x;
+    uint32_t           y;
+    uint32_t           width;
+    uint32_t           height;
+    uint32_t           expected_bytes;
+    uint32_t           decoded_bytes;
+    uint32_t           row_bytes;
+    uint32_t           row_fill;
+} screen_push_t;
+
 static httpd_handle_t server_handle = NULL;
 
 static esp_err_t health_get_handler(httpd_req_t *req);
@@ -26,6 +89,9 @@ static esp_err_t configure_post_handler(httpd_req_t *req);
 static esp_err_t current_config_get_handler(httpd_req_t *req);
 static esp_err_t clear_nvs_post_handler(httpd_req_t *req);
 static esp_err_t set_time_post_handler(httpd_req_t *req);
+static esp_err_t logs_get_handler(httpd_req_t *req);
+static esp_err_t metrics_get_handler(httpd_req_t *req);
+static esp_err_t screen_post_handler(httpd_req_t *req);
 
 static const httpd_uri_t health_uri = {.uri      = "/health",
                                        .method   = HTTP_GET,
@@ -52,42 +118,60 @@ static const httpd_uri_t set_time_uri = {.uri      = "/set_time",
                                          .handler  = set_time_post_handler,
                                          .user_ctx = NULL};
 
+static const httpd_uri_t logs_uri = {.uri      = "/logs",
+                                     .method   = HTTP_GET,
+                                     .handler  = logs_get_handler,
+                                     .user_ctx = NULL};
+
+static const httpd_uri_t metrics_uri = {.uri      = "/metrics",
+                                        .method   = HTTP_GET,
+                                        .handler  = metrics_get_handler,
+                                        .user_ctx = NULL};
+
+static const httpd_uri_t screen_uri = {.uri      = "/screen",
+                                       .method   = HTTP_POST,
+                                       .handler  = screen_post_handler,
+                                       .user_ctx = NULL};
+
+// httpd runs every handler from its one task so these don't need to live on its (small) stack
+static uint8_t            http_server_rx_buf[HTTP_SERVER_RX_CHUNK_BYTES];
+static uint8_t            screen_push_row_buf[SCREEN_PUSH_WIDTH_PX / 2];
+static configure_staged_t configure_staged;
+
 /*
- * Caller responsible for deleting malloced cJSON payload with cJSON_Delete!
+ * Streams the request body through the json parser in rx buf sized chunks, values land directly in each field's buffer
+ * so body size isn't limited by any buffer here. Sends the error response itself on failure.
  */
-static bool http_server_parse_post_body(httpd_req_t *req, cJSON **payload) {
-    const int rx_buf_size = 300;
-    char      buf[rx_buf_size];
-
-    if (req->content_len > rx_buf_size) {
-        log_printf(LOG_LEVEL_ERROR, "Payload is too big (%d bytes), bailing out", req->content_len);
-        httpd_resp_send(req, "err", HTTPD_RESP_USE_STRLEN);
-        return false;
-    }
+static bool http_server_parse_post_body(httpd_req_t *req, json_stream_field_t *fields, size_t num_fields) {
+    json_stream_t stream;
+    json_stream_init(&stream, fields, num_fields);
+
+    size_t  remaining = req->content_len;
+    uint8_t timeouts  = 0;
+    while (remaining > 0) {
+        int received = httpd_req_recv(req, (char *)http_server_rx_buf, MIN(remaining, sizeof(http_server_rx_buf)));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < HTTP_SERVER_MAX_RX_TIMEOUTS) {
+            continue;
+        }
+        if (received <= 0) {
+            log_printf(LOG_LEVEL_ERROR, "Error receiving post body (%d), %u bytes left", received, remaining);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body incomplete");
+            return false;
+        }
 
-    int bytes_received = httpd_req_recv(req, buf, MIN(req->content_len, rx_buf_size));
-    if (bytes_received <= 0) {
-        if (bytes_received == HTTPD_SOCK_ERR_TIMEOUT) {
-            /* Retry receiving if timeout occurred */
-            // continue;
-            log_printf(LOG_LEVEL_ERROR, "Received timeout, bailing out (could retry though)");
-            httpd_resp_send(req, "err", HTTPD_RESP_USE_STRLEN);
-            return ESP_FAIL;
+        log_printf(LOG_LEVEL_DEBUG, "%.*s", received, http_server_rx_buf);
+        remaining -= received;
+        if (!json_stream_parse(&stream, (const char *)http_server_rx_buf, received)) {
+            // No point draining the rest, httpd closes the socket when the handler returns ESP_FAIL
+            log_printf(LOG_LEVEL_ERROR, "Couldn't parse json body, %u bytes left unread", remaining);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid json");
+            return false;
         }
-        return false;
     }
 
-    /* Log data received */
-    log_printf(LOG_LEVEL_INFO, "=========== RECEIVED DATA ==========");
-    log_printf(LOG_LEVEL_INFO, "%.*s", bytes_received, buf);
-    log_printf(LOG_LEVEL_INFO, "====================================");
-
-    // Should really be parsing this with prealloced buf. If user sends fat payload
-    // we'll crash from heap overflow
-    *payload = parse_json(buf);
-    if (payload == NULL) {
-        log_printf(LOG_LEVEL_ERROR, "Couldn't parse json (TODO return the right code");
-        httpd_resp_send(req, "err", HTTPD_RESP_USE_STRLEN);
+    if (!json_stream_is_complete(&stream)) {
+        log_printf(LOG_LEVEL_ERROR, "Json body ended before closing brace");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid json");
         return false;
     }
 
@@ -95,37 +179,27 @@ static bool http_server_parse_post_body(httpd_req_t *req, cJSON **payload) {
 }
 
 /*
- * Generic function for parsing out a string value from a json key with built-in error handling and fallback value. It
- * does not COPY the value into the field_to_set arg, but assigns the original arg pointer (by the deref of ptr to a
- * ptr) to the available/alloced string. This avoids an extra buffer declaration, because the value to set (either
- * what's in the json object or the fallback string) is already declared and will persist. Caller must ensure that the
- * json object's string and the fallback must remain alloced until whatever has used their values is done with them
- * (i.e. config object is saved)!
+ * Returns the parsed value for the field if it came through valid, otherwise logs why and returns the fallback. Either
+ * way the pointer stays valid until the staged buffers are reused by the next request, so it can go straight into the
+ * config passed to nvs_save_config.
  */
-static void http_server_parse_json_string(cJSON *payload,
-                                          char  *json_key,
-                                          char **field_to_set,
-                                          size_t max_field_length,
-                                          char  *fallback) {
-    cJSON *json_obj = cJSON_GetObjectItem(payload, json_key);
-    if (cJSON_IsString(json_obj)) {
-        char *rx_strvalue = cJSON_GetStringValue(json_obj);
-
-        if (strlen(rx_strvalue) > max_field_length) {
+static char *http_server_field_or_default(json_stream_field_t *field, char *fallback) {
+    switch (field->status) {
+        case JSON_STREAM_FIELD_OK:
+            return field->value;
+        case JSON_STREAM_FIELD_TOO_LONG:
             log_printf(LOG_LEVEL_INFO,
-                       "Received value '%s' > %d chars, invalid. Defaulting to '%s'",
-                       rx_strvalue,
-                       max_field_length,
+                       "Received value for '%s' > %u chars, invalid. Defaulting to '%s'",
+                       field->key,
+                       field->max_len,
                        fallback);
-            *field_to_set = fallback;
-        } else {
-            // rx_strvalue is the char pointer held within the cjson object, so it will be a valid pointer until json
-            // object is freed and is not tied to the local scope here
-            *field_to_set = rx_strvalue;
-        }
-    } else {
-        log_printf(LOG_LEVEL_WARN, "Unable to parse param, defaulting to '%s'", fallback);
-        *field_to_set = fallback;
+            return fallback;
+        case JSON_STREAM_FIELD_WRONG_TYPE:
+            log_printf(LOG_LEVEL_WARN, "Param '%s' was the wrong type, defaulting to '%s'", field->key, fallback);
+            return fallback;
+        default:
+            log_printf(LOG_LEVEL_WARN, "Unable to parse param '%s', defaulting to '%s'", field->key, fallback);
+            return fallback;
     }
 }
 
@@ -134,33 +208,47 @@ static esp_err_t health_get_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// All /configure params are strings (numbers included), each parsed into its own buffer in configure_staged
+#define CONFIGURE_FIELD(field, name, max_length)                         \
+    [CONFIGURE_FIELD_##field] = {.key     = #name,                       \
+                                 .type    = JSON_STREAM_TYPE_STRING,     \
+                                 .value   = configure_staged.name,       \
+                                 .max_len = MAX_LENGTH_##max_length##_PARAM}
+
 static esp_err_t configure_post_handler(httpd_req_t *req) {
-    cJSON *payload;
-    MEMFAULT_ASSERT(http_server_parse_post_body(req, &payload));
+    // Every field is parsed regardless of mode, only the ones for the received mode are used below
+    json_stream_field_t fields[CONFIGURE_FIELD_COUNT] = {
+        CONFIGURE_FIELD(TZ_STR, tz_str, TZ_STR),
+        CONFIGURE_FIELD(TZ_DISPLAY_NAME, tz_display_name, TZ_DISPLAY_NAME),
+        CONFIGURE_FIELD(OPERATING_MODE, operating_mode, OPERATING_MODE),
+        CONFIGURE_FIELD(SPOT_NAME, spot_name, SPOT_NAME),
+        CONFIGURE_FIELD(SPOT_LAT, spot_lat, SPOT_LAT),
+        CONFIGURE_FIELD(SPOT_LON, spot_lon, SPOT_LON),
+        CONFIGURE_FIELD(SPOT_UID, spot_uid, SPOT_UID),
+        CONFIGURE_FIELD(ACTIVE_CHART_1, active_chart_1, ACTIVE_CHART),
+        CONFIGURE_FIELD(ACTIVE_CHART_2, active_chart_2, ACTIVE_CHART),
+        CONFIGURE_FIELD(CUSTOM_SCREEN_URL, custom_screen_url, CUSTOM_SCREEN_URL),
+        CONFIGURE_FIELD(CUSTOM_PUSH_URL, custom_push_url, CUSTOM_PUSH_URL),
+        CONFIGURE_FIELD(CUSTOM_UPDATE_INTERVAL_SECS, custom_update_interval_secs, CUSTOM_UPDATE_INTERVAL_SECS),
+    };
+    if (!http_server_parse_post_body(req, fields, CONFIGURE_FIELD_COUNT)) {
+        return ESP_FAIL;
+    }
     vTaskDelay(pdMS_TO_TICKS(400));
 
-    // Load all our values into here to save to nvs. No need to alloc
-    // any more memory than the json takes because nvs will use those
-    // pointers to write directly to flash
+    // Load all our values into here to save to nvs. Strings point either into the staged buffers the parser wrote to
+    // or the defaults, nvs will use those pointers to write directly to flash
     spot_check_config_t config                  = {0};
     char               *default_tz_str          = "CET-1CEST,M3.4.0/2,M10.4.0/2";
     char               *default_tz_display_name = "Europe/Berlin";
     char               *default_mode            = (char *)spot_check_mode_to_string(SPOT_CHECK_MODE_WEATHER);
 
-    // Parse default fields first which are always included, then parse specific fields based on rxd mode
-    http_server_parse_json_string(payload, "tz_str", &config.tz_str, MAX_LENGTH_TZ_STR_PARAM, default_tz_str);
-    http_server_parse_json_string(payload,
-                                  "tz_display_name",
-                                  &config.tz_display_name,
-                                  MAX_LENGTH_TZ_DISPLAY_NAME_PARAM,
-                                  default_tz_display_name);
-    char *temp_mode_str;
-    http_server_parse_json_string(payload,
-                                  "operating_mode",
-                                  &temp_mode_str,
-                                  MAX_LENGTH_OPERATING_MODE_PARAM,
-                                  default_mode);
-    config.operating_mode = spot_check_string_to_mode(temp_mode_str);
+    // Default fields first which are always included, then specific fields based on rxd mode
+    config.tz_str          = http_server_field_or_default(&fields[CONFIGURE_FIELD_TZ_STR], default_tz_str);
+    config.tz_display_name = http_server_field_or_default(&fields[CONFIGURE_FIELD_TZ_DISPLAY_NAME],
+                                                          default_tz_display_name);
+    config.operating_mode  = spot_check_string_to_mode(
+        http_server_field_or_default(&fields[CONFIGURE_FIELD_OPERATING_MODE], default_mode));
 
     switch (config.operating_mode) {
         case SPOT_CHECK_MODE_WEATHER: {
@@ -169,61 +257,34 @@ static esp_err_t configure_post_handler(httpd_req_t *req) {
             char *default_spot_lon     = "-117.8819918632";
             char *default_spot_uid     = "5842041f4e65fad6a770882b";
             char *default_active_chart = "tide";
-            char *temp_active_chart;
-
-            http_server_parse_json_string(payload,
-                                          "spot_name",
-                                          &config.spot_name,
-                                          MAX_LENGTH_SPOT_NAME_PARAM,
-                                          default_spot_name);
-            http_server_parse_json_string(payload,
-                                          "spot_lat",
-                                          &config.spot_lat,
-                                          MAX_LENGTH_SPOT_LAT_PARAM,
-                                          default_spot_lat);
-            http_server_parse_json_string(payload,
-                                          "spot_lon",
-                                          &config.spot_lon,
-                                          MAX_LENGTH_SPOT_LON_PARAM,
-                                          default_spot_lon);
-            http_server_parse_json_string(payload,
-                                          "spot_uid",
-                                          &config.spot_uid,
-                                          MAX_LENGTH_SPOT_UID_PARAM,
-                                          default_spot_uid);
-            http_server_parse_json_string(payload,
-                                          "active_chart_1",
-                                          &temp_active_chart,
-                                          MAX_LENGTH_ACTIVE_CHART_PARAM,
-                                          default_active_chart);
-            MEMFAULT_ASSERT(nvs_chart_string_to_enum(temp_active_chart, &config.active_chart_1));
-
-            http_server_parse_json_string(payload,
-                                          "active_chart_2",
-                                          &temp_active_chart,
-                                          MAX_LENGTH_ACTIVE_CHART_PARAM,
-                                          default_active_chart);
-            MEMFAULT_ASSERT(nvs_chart_string_to_enum(temp_active_chart, &config.active_chart_2));
+
+            config.spot_name = http_server_field_or_default(&fields[CONFIGURE_FIELD_SPOT_NAME], default_spot_name);
+            config.spot_lat  = http_server_field_or_default(&fields[CONFIGURE_FIELD_SPOT_LAT], default_spot_lat);
+            config.spot_lon  = http_server_field_or_default(&fields[CONFIGURE_FIELD_SPOT_LON], default_spot_lon);
+            config.spot_uid  = http_server_field_or_default(&fields[CONFIGURE_FIELD_SPOT_UID], default_spot_uid);
+            MEMFAULT_ASSERT(nvs_chart_string_to_enum(
+                http_server_field_or_default(&fields[CONFIGURE_FIELD_ACTIVE_CHART_1], default_active_chart),
+                &config.active_chart_1));
+            MEMFAULT_ASSERT(nvs_chart_string_to_enum(
+                http_server_field_or_default(&fields[CONFIGURE_FIELD_ACTIVE_CHART_2], default_active_chart),
+                &config.active_chart_2));
             break;
         }
         case SPOT_CHECK_MODE_CUSTOM: {
             // Example default image already on server, default update interval 1 hour
             char *default_custom_screen_url           = URL_BASE "custom_screen_test_image";
             char *default_custom_update_interval_secs = "3600";
-            http_server_parse_json_string(payload,
-                                          "custom_screen_url",
-                                          &config.custom_screen_url,
-                                          MAX_LENGTH_CUSTOM_SCREEN_URL_PARAM,
-                                          default_custom_screen_url);
+            config.custom_screen_url = http_server_field_or_default(&fields[CONFIGURE_FIELD_CUSTOM_SCREEN_URL],
+                                                                    default_custom_screen_url);
             log_printf(LOG_LEVEL_WARN, "config custm val: %s", config.custom_screen_url);
 
-            char *temp_interval_str;
-            http_server_parse_json_string(payload,
-                                          "custom_update_interval_secs",
-                                          &temp_interval_str,
-                                          MAX_LENGTH_CUSTOM_UPDATE_INTERVAL_SECS_PARAM,
-                                          default_custom_update_interval_secs);
-            uint32_t temp_interval = strtoul(temp_interval_str, NULL, 10);
+            // Optional, empty leaves the push channel off and the device only polls on the interval
+            config.custom_push_url = http_server_field_or_default(&fields[CONFIGURE_FIELD_CUSTOM_PUSH_URL], "");
+
+            json_stream_field_t *interval_field    = &fields[CONFIGURE_FIELD_CUSTOM_UPDATE_INTERVAL_SECS];
+            char                *temp_interval_str = http_server_field_or_default(interval_field,
+                                                                                  default_custom_update_interval_secs);
+            uint32_t             temp_interval     = strtoul(temp_interval_str, NULL, 10);
             if (temp_interval < 900) {
                 log_printf(LOG_LEVEL_WARN,
                            "Attempt to set custom_update_interval_secs to a value too low (%u) - defaulting to 900 "
@@ -243,7 +304,6 @@ static esp_err_t configure_post_handler(httpd_req_t *req) {
     }
 
     // Release client before we do time-intensive stuff with flash
-    cJSON_Delete(payload);
     httpd_resp_send(req, NULL, 0);
 
     nvs_save_config(&config);
@@ -273,6 +333,7 @@ static esp_err_t current_config_get_handler(httpd_req_t *req) {
     cJSON *tz_display_name_json        = cJSON_CreateString(current_config->tz_display_name);
     cJSON *operating_mode              = cJSON_CreateString(spot_check_mode_to_string(current_config->operating_mode));
     cJSON *custom_screen_url           = cJSON_CreateString(current_config->custom_screen_url);
+    cJSON *custom_push_url             = cJSON_CreateString(current_config->custom_push_url);
     cJSON *custom_update_interval_secs = cJSON_CreateNumber(current_config->custom_update_interval_secs);
 
     char temp_chart_str[10];
@@ -289,6 +350,7 @@ static esp_err_t current_config_get_handler(httpd_req_t *req) {
     cJSON_AddItemToObject(root, "tz_display_name", tz_display_name_json);
     cJSON_AddItemToObject(root, "operating_mode", operating_mode);
     cJSON_AddItemToObject(root, "custom_screen_url", custom_screen_url);
+    cJSON_AddItemToObject(root, "custom_push_url", custom_push_url);
     cJSON_AddItemToObject(root, "custom_update_interval_secs", custom_update_interval_secs);
     cJSON_AddItemToObject(root, "active_chart_1", active_chart_1);
     cJSON_AddItemToObject(root, "active_chart_2", active_chart_2);
@@ -339,15 +401,19 @@ static esp_err_t clear_nvs_post_handler(httpd_req_t *req) {
 }
 
 static esp_err_t set_time_post_handler(httpd_req_t *req) {
-    cJSON *payload;
-    MEMFAULT_ASSERT(http_server_parse_post_body(req, &payload));
+    char                epoch_secs_str[11];  // fits UINT32_MAX
+    json_stream_field_t fields[] = {
+        {.key = "epoch_secs", .type = JSON_STREAM_TYPE_NUMBER, .value = epoch_secs_str, .max_len = 10},
+    };
+    if (!http_server_parse_post_body(req, fields, sizeof(fields) / sizeof(json_stream_field_t))) {
+        return ESP_FAIL;
+    }
 
     // TODO :: this appears to only work with GMT time, then SNTP internally converts it to local time based on internal
     // tz_str already set
-    cJSON *json_epoch_secs = cJSON_GetObjectItem(payload, "epoch_secs");
-    if (cJSON_IsNumber(json_epoch_secs)) {
+    if (fields[0].status == JSON_STREAM_FIELD_OK) {
         // Set time and de-init sntp to keep user's manual time set
-        uint32_t epoch_secs = cJSON_GetNumberValue(json_epoch_secs);
+        uint32_t epoch_secs = strtoul(epoch_secs_str, NULL, 10);
         sntp_set_time(epoch_secs);
         sntp_time_stop();
     } else {
@@ -355,11 +421,234 @@ static esp_err_t set_time_post_handler(httpd_req_t *req) {
     }
 
     // End response
-    cJSON_Delete(payload);
     httpd_resp_send(req, NULL, 0);
     return ESP_OK;
 }
 
+/*
+ * Streams the persisted post-mortem log out as raw tokenized frames. Decode on host with log_decoder.py --file.
+ */
+static esp_err_t logs_get_handler(httpd_req_t *req) {
+    uint8_t chunk[512];
+    size_t  offset = 0;
+    size_t  read   = 0;
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    while ((read = log_persist_read(offset, chunk, sizeof(chunk))) > 0) {
+        esp_err_t err = httpd_resp_send_chunk(req, (const char *)chunk, read);
+        if (err != ESP_OK) {
+            log_printf(LOG_LEVEL_ERROR, "Error sending persisted log chunk: %s", esp_err_to_name(err));
+            return err;
+        }
+        offset += read;
+    }
+
+    // Zero length chunk ends the response
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+    return metrics_send_prometheus(req);
+}
+
+/*
+ * Reads an optional unsigned int query param. Returns false only if the key is present but isn't a valid number.
+ */
+static bool http_server_parse_query_uint(const char *query, const char *key, uint32_t *value) {
+    char value_str[12];
+    if (httpd_query_key_value(query, key, value_str, sizeof(value_str)) != ESP_OK) {
+        return true;
+    }
+
+    char *end;
+    *value = strtoul(value_str, &end, 10);
+    return end != value_str && *end == '\0';
+}
+
+/*
+ * Sink for decoded image bytes. Full screen pushes in custom mode go straight to flash so they persist like a
+ * downloaded custom screen, everything else is copied into the framebuffer a row at a time.
+ */
+static bool screen_push_output(const uint8_t *bytes, size_t len, void *ctx) {
+    screen_push_t *push = (screen_push_t *)ctx;
+    if (push->decoded_bytes + len > push->expected_bytes) {
+        log_printf(LOG_LEVEL_ERROR, "Pushed image decoded past its %lu expected bytes", push->expected_bytes);
+        return false;
+    }
+
+    if (push->dest == SCREEN_PUSH_DEST_FLASH) {
+        if (!screen_img_handler_stream_write(bytes, len)) {
+            return false;
+        }
+        push->decoded_bytes += len;
+        return true;
+    }
+
+    while (len > 0) {
+        size_t copy_len = MIN(len, push->row_bytes - push->row_fill);
+        memcpy(&screen_push_row_buf[push->row_fill], bytes, copy_len);
+        push->row_fill += copy_len;
+        push->decoded_bytes += copy_len;
+        bytes += copy_len;
+        len -= copy_len;
+
+        if (push->row_fill == push->row_bytes) {
+            uint32_t row = (push->decoded_bytes / push->row_bytes) - 1;
+            // Row at a time so a render in the scheduler only ever waits on one row copy
+            if (!display_draw_image_locked(screen_push_row_buf, push->width, 1, 1, push->x, push->y + row)) {
+                return false;
+            }
+            push->row_fill = 0;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Local push of a 4bpp (2 pixels per byte, same as downloaded screen imgs) image straight from the LAN. Query params:
+ *   x, y, w, h     optional region, defaults to the full 800x600 screen. x and w must be even.
+ *   encoding       'raw' (default) or 'packbits', see packbits.h
+ * Body is decoded as it's received so the full image is never buffered. Render happens in the scheduler once the whole
+ * body is in.
+ */
+static esp_err_t screen_post_handler(httpd_req_t *req) {
+    screen_push_t push = {
+        .x      = 0,
+        .y      = 0,
+        .width  = SCREEN_PUSH_WIDTH_PX,
+        .height = SCREEN_PUSH_HEIGHT_PX,
+    };
+    bool packbits = false;
+
+    char query_buf[80];
+    int  actual_query_len = httpd_req_get_url_query_len(req) + 1;
+    if (actual_query_len > (int)sizeof(query_buf)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Query string too long");
+        return ESP_OK;
+    }
+
+    if (actual_query_len > 1 && httpd_req_get_url_query_str(req, query_buf, actual_query_len) == ESP_OK) {
+        char encoding[10];
+        if (httpd_query_key_value(query_buf, "encoding", encoding, sizeof(encoding)) == ESP_OK) {
+            if (strcmp(encoding, "packbits") == 0) {
+                packbits = true;
+            } else if (strcmp(encoding, "raw") != 0) {
+                httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unsupported encoding");
+                return ESP_OK;
+            }
+        }
+
+        if (!http_server_parse_query_uint(query_buf, "x", &push.x) ||
+            !http_server_parse_query_uint(query_buf, "y", &push.y) ||
+            !http_server_parse_query_uint(query_buf, "w", &push.width) ||
+            !http_server_parse_query_uint(query_buf, "h", &push.height)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid region");
+            return ESP_OK;
+        }
+    }
+
+    if (push.width == 0 || push.height == 0 || push.width > SCREEN_PUSH_WIDTH_PX ||
+        push.height > SCREEN_PUSH_HEIGHT_PX || push.x > SCREEN_PUSH_WIDTH_PX - push.width ||
+        push.y > SCREEN_PUSH_HEIGHT_PX - push.height || (push.x % 2) || (push.width % 2)) {
+        log_printf(LOG_LEVEL_INFO,
+                   "Invalid screen push region %lux%lu at (%lu, %lu)",
+                   push.width,
+                   push.height,
+                   push.x,
+                   push.y);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid region");
+        return ESP_OK;
+    }
+
+    push.row_bytes      = push.width / 2;
+    push.expected_bytes = push.row_bytes * push.height;
+    if (!packbits && req->content_len != push.expected_bytes) {
+        log_printf(LOG_LEVEL_INFO,
+                   "Raw screen push body is %u bytes, expected %lu",
+                   req->content_len,
+                   push.expected_bytes);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body size doesn't match region");
+        return ESP_OK;
+    }
+
+    bool full_screen = push.width == SCREEN_PUSH_WIDTH_PX && push.height == SCREEN_PUSH_HEIGHT_PX;
+    push.dest        = (full_screen && nvs_get_config()->operating_mode == SPOT_CHECK_MODE_CUSTOM)
+                           ? SCREEN_PUSH_DEST_FLASH
+                           : SCREEN_PUSH_DEST_FRAMEBUFFER;
+
+    sleep_handler_set_busy(SYSTEM_IDLE_SCREEN_PUSH_BIT);
+    if (push.dest == SCREEN_PUSH_DEST_FLASH &&
+        !screen_img_handler_stream_begin(SCREEN_IMG_CUSTOM_SCREEN, push.width, push.height)) {
+        sleep_handler_set_idle(SYSTEM_IDLE_SCREEN_PUSH_BIT);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Couldn't prepare flash for image");
+        return ESP_OK;
+    }
+
+    packbits_decoder_t decoder;
+    packbits_decoder_init(&decoder, screen_push_output, &push);
+
+    // Full screen bodies are a few hundred KB raw, don't make them wait on modem sleep wakeups
+    power_policy_radio_acquire();
+
+    int64_t start_us  = esp_timer_get_time();
+    size_t  remaining = req->content_len;
+    uint8_t timeouts  = 0;
+    bool    success   = true;
+    while (remaining > 0 && success) {
+        int received = httpd_req_recv(req, (char *)http_server_rx_buf, MIN(remaining, sizeof(http_server_rx_buf)));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < HTTP_SERVER_MAX_RX_TIMEOUTS) {
+            continue;
+        }
+        if (received <= 0) {
+            log_printf(LOG_LEVEL_ERROR, "Error receiving screen push body (%d), %u bytes left", received, remaining);
+            success = false;
+            break;
+        }
+
+        remaining -= received;
+        success = packbits ? packbits_decode(&decoder, http_server_rx_buf, received)
+                           : screen_push_output(http_server_rx_buf, received, &push);
+    }
+
+    power_policy_radio_release();
+    success = success && push.decoded_bytes == push.expected_bytes && packbits_decoder_is_complete(&decoder);
+    if (push.dest == SCREEN_PUSH_DEST_FLASH) {
+        success = screen_img_handler_stream_end(success) && success;
+    }
+    sleep_handler_set_idle(SYSTEM_IDLE_SCREEN_PUSH_BIT);
+
+    if (!success) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Screen push failed after decoding %lu / %lu bytes",
+                   push.decoded_bytes,
+                   push.expected_bytes);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image body incomplete or invalid");
+        return remaining > 0 ? ESP_FAIL : ESP_OK;
+    }
+
+    log_printf(LOG_LEVEL_INFO,
+               "Received %lux%lu screen push at (%lu, %lu) to %s in %lldms",
+               push.width,
+               push.height,
+               push.x,
+               push.y,
+               push.dest == SCREEN_PUSH_DEST_FLASH ? "flash" : "framebuffer",
+               (esp_timer_get_time() - start_us) / 1000);
+
+    httpd_resp_send(req, NULL, 0);
+
+    if (push.dest == SCREEN_PUSH_DEST_FLASH) {
+        scheduler_schedule_custom_screen_redraw();
+    } else {
+        scheduler_schedule_pushed_image_render();
+    }
+    scheduler_trigger();
+
+    return ESP_OK;
+}
+
 void http_server_start() {
     if (server_handle) {
         log_printf(LOG_LEVEL_WARN, "http_server already started and http_server_start called, ignoring and bailing");
@@ -368,6 +657,8 @@ void http_server_start() {
 
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    // Default only leaves room for 8
+    config.max_uri_handlers = 12;
 
     log_printf(LOG_LEVEL_INFO, "Starting server on port: '%d'", 80);
     esp_err_t err;
@@ -387,6 +678,9 @@ void http_server_start() {
     httpd_register_uri_handler(server, &current_config_uri);
     httpd_register_uri_handler(server, &clear_nvs_uri);
     httpd_register_uri_handler(server, &set_time_uri);
+    httpd_register_uri_handler(server, &logs_uri);
+    httpd_register_uri_handler(server, &metrics_uri);
+    httpd_register_uri_handler(server, &screen_uri);
 
     server_handle = server;
 }
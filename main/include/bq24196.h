@@ -27,3 +27,4 @@ uint8_t   bq24196_read_status_reg();
 uint8_t   bq24196_read_fault_reg();
 esp_err_t bq24196_disable_charging();
 esp_err_t bq24196_disable_watchdog();
+esp_err_t bq24196_read_on_battery(bool *on_battery);
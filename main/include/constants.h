@@ -42,6 +42,12 @@ typedef enum {
     SC_TAG_SPOT_CHECK,
     SC_TAG_MFLT_INTRFC,
     SC_TAG_MFLT_PORT,
+    SC_TAG_LOG_PERSIST,
+    SC_TAG_PERF,
+    SC_TAG_UART_XFER,
+    SC_TAG_METRICS,
+    SC_TAG_PUSH,
+    SC_TAG_POWER,
     SC_TAG_COUNT,
     // Canot go above 32 elements, used as a bitmask in log.c for faster lookup in blacklist
 } sc_tag_t;
@@ -73,6 +79,12 @@ static const char* const tag_strs[SC_TAG_COUNT] = {
     [SC_TAG_SPOT_CHECK]         = "[sc-spot-check]",
     [SC_TAG_MFLT_INTRFC]        = "[sc-mflt-intrfc]",
     [SC_TAG_MFLT_PORT]          = "[sc-mflt-port]",
+    [SC_TAG_LOG_PERSIST]        = "[sc-log-persist]",
+    [SC_TAG_PERF]               = "[sc-perf]",
+    [SC_TAG_UART_XFER]          = "[sc-uart-xfer]",
+    [SC_TAG_METRICS]            = "[sc-metrics]",
+    [SC_TAG_PUSH]               = "[sc-push]",
+    [SC_TAG_POWER]              = "[sc-power]",
 };
 
 #endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -25,8 +26,11 @@ typedef enum {
 void display_init();
 void display_start();
 void display_render();
+void display_render_fast();
 void display_full_clear_cycles(uint8_t cycles);
 void display_full_clear();
+bool display_panel_state_restored();
+void display_clear_framebuffer();
 void display_clear_area(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 void display_render_splash_screen(char *fw_version, char *hw_version);
 void display_draw_text(char                *text,
@@ -34,6 +38,12 @@ void display_draw_text(char                *text,
                        uint32_t             y_coord,
                        display_font_size_t  size,
                        display_font_align_t alignment);
+void display_draw_text_to_fb(uint8_t             *fb,
+                             char                *text,
+                             uint32_t             x_coord,
+                             uint32_t             y_coord,
+                             display_font_size_t  size,
+                             display_font_align_t alignment);
 void display_invert_text(char                *text,
                          uint32_t             x_coord,
                          uint32_t             y_coord,
@@ -45,6 +55,12 @@ void display_draw_image(uint8_t *image_buffer,
                         uint8_t  bytes_per_px,
                         uint32_t screen_x,
                         uint32_t screen_y);
+bool display_draw_image_locked(uint8_t *image_buffer,
+                               size_t   width_px,
+                               size_t   height_px,
+                               uint8_t  bytes_per_px,
+                               uint32_t screen_x,
+                               uint32_t screen_y);
 void display_draw_rect(uint32_t x, uint32_t y, uint32_t width_px, uint32_t height_px);
 void display_draw_image_fullscreen(uint8_t *image_buffer, uint8_t bytes_per_px);
 void display_get_text_bounds(char                *text,
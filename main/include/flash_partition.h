@@ -5,3 +5,10 @@
 #include "esp_partition.h"
 
 const esp_partition_t *flash_partition_get_screen_img_partition();
+const esp_partition_t *flash_partition_get_log_partition();
+esp_err_t              flash_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+esp_err_t              flash_partition_write(const esp_partition_t *partition,
+                                             size_t                 offset,
+                                             const void            *data,
+                                             size_t                 size);
+void                   flash_partition_take_timing(uint32_t *erase_total_us, uint32_t *write_total_us);
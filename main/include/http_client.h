@@ -1,6 +1,7 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "esp_err.h"
@@ -37,6 +38,10 @@ typedef struct {
 typedef struct {
     char           *url;
     http_req_type_t req_type;
+    const char     *content_type;  // NULL for the default of the req_type
+    query_param    *headers;       // extra headers, NULL if none
+    uint8_t         num_headers;
+    bool            best_effort;   // failure doesn't kick scheduler offline, for servers other than ours
     union {
         http_get_args_t  get_args;
         http_post_args_t post_args;
@@ -53,6 +58,7 @@ http_request_t http_client_build_get_request(char                *endpoint,
                                              uint8_t              num_params);
 http_request_t http_client_build_external_get_request(char *custom_url, char *url_buf, size_t url_buf_size_bytes);
 http_request_t http_client_build_post_request(char *endpoint, char *url_buf, char *post_data, size_t post_data_size);
+http_request_t http_client_build_external_post_request(char *url, char *post_data, size_t post_data_size);
 bool           http_client_perform_with_retries(http_request_t           *request_obj,
                                                 uint8_t                   additional_retries,
                                                 esp_http_client_handle_t *client,
@@ -68,6 +74,14 @@ esp_err_t      http_client_read_response_to_flash(esp_http_client_handle_t *clie
                                                   size_t                   *bytes_saved_size);
 bool           http_client_check_internet();
 
+// Keep-alive client for a run of POSTs to one external url
+esp_http_client_handle_t http_client_open_upload(char        *url,
+                                                 const char  *content_type,
+                                                 query_param *headers,
+                                                 uint8_t      num_headers);
+bool                     http_client_upload(esp_http_client_handle_t client, const char *data, size_t data_size);
+void                     http_client_close_upload(esp_http_client_handle_t client);
+
 // This is for debugging with cli, isn't necessary long term
 void http_client_get_failures(uint16_t *get_failures, uint16_t *post_failures);
 #endif
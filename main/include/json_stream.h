@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Incremental parser for flat json objects, e.g. the /configure body. Caller lists the keys it cares about up front
+ * each with its own buffer, and values are written straight into those buffers as bytes come in so there's no limit on
+ * total body size and nothing gets malloced. Unknown keys are skipped, and nested objects/arrays under any key are
+ * skipped as well. Input can be split at any byte boundary.
+ *
+ * Values for JSON_STREAM_TYPE_NUMBER fields are left as their text so caller can strtoul/strtod with whatever range
+ * checking they need.
+ */
+
+typedef enum {
+    JSON_STREAM_TYPE_STRING,
+    JSON_STREAM_TYPE_NUMBER,
+} json_stream_type_t;
+
+typedef enum {
+    JSON_STREAM_FIELD_MISSING,
+    JSON_STREAM_FIELD_OK,
+    JSON_STREAM_FIELD_TOO_LONG,
+    JSON_STREAM_FIELD_WRONG_TYPE,
+} json_stream_field_status_t;
+
+typedef struct {
+    const char                *key;
+    json_stream_type_t         type;
+    char                      *value;    // must be at least max_len + 1 to fit null term
+    size_t                     max_len;  // does not include null term
+    json_stream_field_status_t status;   // set by parser, only valid to read value if JSON_STREAM_FIELD_OK
+} json_stream_field_t;
+
+// Long enough for every key we look up, anything longer can't match so it's skipped
+#define JSON_STREAM_MAX_KEY_LEN (32)
+
+typedef struct {
+    json_stream_field_t *fields;
+    size_t               num_fields;
+    uint8_t              state;
+    bool                 in_key;
+    bool                 value_is_string;
+    bool                 overflowed;
+    uint8_t              unicode_digits;
+    uint16_t             unicode_value;
+    uint16_t             skip_depth;
+    bool                 skip_in_string;
+    bool                 skip_escape;
+    json_stream_field_t *field;  // field the current value is being written into, NULL if skipping
+    char                 key[JSON_STREAM_MAX_KEY_LEN + 1];
+    size_t               len;
+} json_stream_t;
+
+void json_stream_init(json_stream_t *stream, json_stream_field_t *fields, size_t num_fields);
+bool json_stream_parse(json_stream_t *stream, const char *bytes, size_t len);
+bool json_stream_is_complete(json_stream_t *stream);
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "esp_log.h"
+#include "sdkconfig.h"
 
 #include "constants.h"
 #include "uart.h"
@@ -13,9 +16,11 @@ typedef enum {
 } log_level_t;
 
 void     log_init(uart_handle_t *console_handle);
-void     log_log_line(sc_tag_t tag, log_level_t level, char *fmt, ...);
+void     log_log_line(sc_tag_t tag, log_level_t level, const char *fmt, ...);
 void     log_wait_until_all_tx();
 void     log_set_max_log_level(log_level_t level);
+void     log_set_tokenized(bool enabled);
+bool     log_get_tokenized();
 void     log_hide_tag(sc_tag_t tag);
 void     log_show_tag(sc_tag_t tag);
 void     log_show_all_tags();
@@ -23,6 +28,22 @@ void     log_hide_all_tags();
 uint32_t log_get_tag_blacklist();
 char    *log_get_time_str();
 
+// Packed arg space per record. Strings are copied in here too since the caller's buffer is long gone by the time the
+// logger task formats the line. Anything that doesn't fit is truncated, so longer output has to be split by the caller.
+#define LOG_RECORD_ARG_BYTES (160)
+
+// Compile-time filters from menuconfig, can be overridden per-build with -D
+#ifndef LOG_COMPILE_MAX_LEVEL
+#define LOG_COMPILE_MAX_LEVEL (CONFIG_LOG_COMPILE_MAX_LEVEL)
+#endif
+
+#ifndef LOG_COMPILE_TAG_MASK
+#define LOG_COMPILE_TAG_MASK (CONFIG_LOG_COMPILE_TAG_MASK)
+#endif
+
+#define LOG_COMPILE_ENABLED(_tag_, _level_) \
+    ((_level_) <= LOG_COMPILE_MAX_LEVEL && ((uint32_t)(LOG_COMPILE_TAG_MASK) & (1UL << (_tag_))))
+
 // Uses esp idf ansi color code macros
 #define LOG_LEVEL_DEBUG_COLOR LOG_COLOR(LOG_COLOR_BLACK)
 #define LOG_LEVEL_INFO_COLOR LOG_COLOR(LOG_COLOR_BLACK)
@@ -34,16 +55,25 @@ char    *log_get_time_str();
 #define LOG_LEVEL_INFO_PREFIX "[INF]"
 #define LOG_LEVEL_DEBUG_PREFIX "[DBG]"
 
-// Builds colored log line with preprocessor to avoid manual runtime str manipulation. Hardcoded %s here will be filled
-// by the tag_strs[TAG] arg in the main log macro so the var args always have at least the tag passed as an arg.
+// Builds colored log line with preprocessor to avoid manual runtime str manipulation. Hardcoded %s's here will be
+// filled with the time and tag_strs[TAG] by the logger task when the record is formatted.
 // Should not be called externally.
 // example literal output: \033[0;31m%s [ERR] example log from app %s %d %u\033[0;30m\n
 #define BUILD_LOG_LINE(_level_, _caller_format_) \
     "[%s] " _level_##_COLOR "%s " _level_##_PREFIX " " _caller_format_ LOG_RESET_COLOR "\n"
 
 // Main log macro - this is the only thing that should be called externally
-// Don't need to error check TAG existence because it will error on compile if calling file hasn't defined it. Must pass
-// the tag string as arg before optional var args as hardcoded %s in built log str will blow up in vsnprintf if not
-// included
-#define log_printf(_level_, _fmt_, ...) \
-    log_log_line(TAG, _level_, BUILD_LOG_LINE(_level_, _fmt_), log_get_time_str(), tag_strs[TAG], ##__VA_ARGS__)
+// Don't need to error check TAG existence because it will error on compile if calling file hasn't defined it. The two
+// hardcoded %s's in the built log str (time and tag) are filled in by the logger task from the queued record, so the
+// caller only passes its own var args. Formatting is deferred, so the format string must be a literal (it always is
+// through this macro).
+//
+// Compile-time level and tag filters are constant expressions so the whole call (including evaluation of its args)
+// gets dropped by the compiler when disabled, but args are still type-checked and count as used so toggling them never
+// causes unused var warnings. Enabled calls still go through the runtime level / blacklist filter in log_log_line.
+#define log_printf(_level_, _fmt_, ...)                                                \
+    do {                                                                               \
+        if (LOG_COMPILE_ENABLED(TAG, _level_)) {                                       \
+            log_log_line(TAG, _level_, BUILD_LOG_LINE(_level_, _fmt_), ##__VA_ARGS__); \
+        }                                                                              \
+    } while (0)
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_PERSIST_PARTITION_LABEL "log"
+
+void   log_persist_init();
+void   log_persist_append(const uint8_t *frame, size_t len);
+size_t log_persist_get_size();
+size_t log_persist_read(size_t offset, uint8_t *buffer, size_t len);
+void   log_persist_clear();
@@ -2,4 +2,5 @@
 
 #include <stdbool.h>
 
+void memfault_interface_init();
 bool memfault_interface_post_data();
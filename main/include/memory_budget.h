@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "constants.h"
+
+/*
+ * Fixed memory budget for everything that lives for the whole runtime. Task stacks and long-lived buffers are static
+ * at these sizes so they're accounted for at link time and never come out of (or fragment) the heap. The boot report
+ * and stack heartbeat metrics show how much of each stack is actually used before shrinking any further.
+ *
+ * All of it is .bss in internal DRAM, which esp-idf caps at 160KB of static allocation on the ESP32 (the link fails
+ * past that). At EPD_WIDTH 800 it comes to roughly:
+ *   main stacks           24KB (below)
+ *   main buffers          15KB (log ring 5.8KB, memfault chunk 4KB, cli pool/queues/out 2.2KB, uart rx 1KB, http flash
+ *                               read 1KB, log out)
+ *   epd line queue        25KB (32 lines * EPD_WIDTH)
+ *   epd output stacks      8KB
+ *   epd glyph decomp      13KB (11KB tinfl_decompressor + 2KB glyph scratch)
+ * ~85KB, leaving the rest of the static region for esp-idf's own .bss (wifi, lwip). Everything but the epd line queue
+ * replaces an allocation that already came out of the internal heap at init (or for the glyph decompressor, on every
+ * character drawn). The line queue is kept internal on purpose since the feed task copies out of it while driving the
+ * panel. The .bss and heap lines of the report show the totals as linked.
+ *
+ * Not covered: perf benchmark task (debug only, torn down after each run), esp-idf driver internals (uart rings, wifi,
+ * lwip, mbedtls), and short-lived per-request allocations.
+ */
+
+/*
+ * A stack is sized as the deepest use recorded for its task (size minus uxTaskGetStackHighWaterMark, from the boot
+ * report run from the cli after the task's worst path, or the *_high_water_stack_bytes heartbeats) plus this much
+ * headroom for paths that weren't hit while recording. The report flags any stack that's eaten into it. Nothing gets
+ * shrunk without a recorded mark over the worst path, so until there is one these are the sizes that have run without
+ * overflowing:
+ *   ota           version_info POST, https image download, SHA-256 of the image, push_channel_pause
+ *   push channel  TLS handshake and long-poll read
+ */
+#define MEMORY_BUDGET_STACK_HEADROOM_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES)
+
+#define MEMORY_BUDGET_LOG_STACK_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 3)
+#define MEMORY_BUDGET_CLI_RX_STACK_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 2)
+#define MEMORY_BUDGET_CLI_PROCESS_STACK_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 5)
+#define MEMORY_BUDGET_SCHEDULER_STACK_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 4)
+#define MEMORY_BUDGET_OTA_STACK_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 5)
+#define MEMORY_BUDGET_PUSH_CHANNEL_STACK_BYTES (SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 5)
+
+// Max number of regions that can be registered for the report
+#define MEMORY_BUDGET_MAX_REGIONS (24)
+
+void memory_budget_register_buffer(const char *name, size_t bytes);
+void memory_budget_register_stack(const char *name, size_t bytes, TaskHandle_t *task_handle);
+void memory_budget_print_report();
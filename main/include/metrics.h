@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_http_server.h>
+
+typedef enum {
+    METRICS_DURATION_RENDER,
+    METRICS_DURATION_SCREEN_IMG_DOWNLOAD,
+    METRICS_DURATION_OTA_DOWNLOAD,
+    METRICS_DURATION_COUNT,
+} metrics_duration_t;
+
+void      metrics_record_duration(metrics_duration_t duration, uint32_t ms);
+esp_err_t metrics_send_prometheus(httpd_req_t *req);
@@ -19,6 +19,7 @@ typedef struct {
     char             *tz_display_name;
     spot_check_mode_t operating_mode;
     char             *custom_screen_url;
+    char             *custom_push_url;  // empty string if push channel disabled
     uint32_t          custom_update_interval_secs;
     screen_img_t      active_chart_1;
     screen_img_t      active_chart_2;
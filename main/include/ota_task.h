@@ -2,6 +2,7 @@
 #define OTA_TASK_H
 
 UBaseType_t ota_task_get_stack_high_water();
+void        ota_task_init();
 void        ota_task_start();
 
 #endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * PackBits RLE (same format as TIFF/Apple PackBits). Each run starts with a signed header byte n:
+ *   0 to 127     copy the next n + 1 bytes literally
+ *   -1 to -127   repeat the next byte -n + 1 times
+ *   -128         no-op, skipped
+ * 4bpp screen images are mostly long runs of the same two pixels so this gets most of what deflate would without the
+ * 32k window. Decoding is streaming, input can be split at any byte boundary. Encoding works on a whole buffer and
+ * streams its output the same way.
+ */
+
+// Return false to abort, packbits_decode/packbits_encode will return false as well
+typedef bool (*packbits_output_func)(const uint8_t *bytes, size_t len, void *ctx);
+
+typedef struct {
+    packbits_output_func output;
+    void                *ctx;
+    uint8_t              remaining;  // bytes left in the current run, 0 means next byte is a header
+    bool                 repeat;     // current run is a repeat run waiting on its value byte
+} packbits_decoder_t;
+
+void packbits_decoder_init(packbits_decoder_t *decoder, packbits_output_func output, void *ctx);
+bool packbits_decode(packbits_decoder_t *decoder, const uint8_t *bytes, size_t len);
+bool packbits_decoder_is_complete(packbits_decoder_t *decoder);
+bool packbits_encode(const uint8_t *bytes, size_t len, packbits_output_func output, void *ctx);
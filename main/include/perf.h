@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    PERF_BENCH_FB_DIFF,
+    PERF_BENCH_LUT_BUILD,
+    PERF_BENCH_GLYPH_DRAW,
+    PERF_BENCH_CHART_BLIT,
+    PERF_BENCH_GC16_PARTIAL,
+    PERF_BENCH_GC16_FULL,
+    PERF_BENCH_NVS_CONFIG_LOAD,
+    PERF_BENCH_FLASH_ERASE_WRITE,
+    PERF_BENCH_TLS_HANDSHAKE,
+    PERF_BENCH_COUNT,
+} perf_bench_t;
+
+typedef struct {
+    bool     ran;  // false if the benchmark was skipped or failed partway, rest of the fields are invalid
+    uint32_t iterations;
+    uint32_t avg_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t avg_cycles;
+} perf_result_t;
+
+const char *perf_bench_to_string(perf_bench_t bench);
+bool        perf_string_to_bench(const char *str, size_t len, perf_bench_t *bench_out);
+bool        perf_run(perf_bench_t bench, uint32_t iterations, perf_result_t *result);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Decides how much power the wifi radio gets based on what the rest of the system is doing:
+ *   idle         max modem sleep with the long listen interval, whenever nothing is holding the radio
+ *   performance  power save off while anything holds the radio (scheduler network updates, OTA, LAN screen pushes)
+ *   off          radio stopped between updates. Only on battery, only while the scheduler is online, and never with
+ *                the push channel configured since it needs to hold its connection open. The LAN http server is
+ *                unreachable while off.
+ * Acquire/release are refcounted so overlapping users (scheduler + async OTA task) work out.
+ *
+ * Separately tracks a power tier off the charger status that the scheduler and display use to budget everything else:
+ *   usb          full cadence
+ *   battery      stretched update intervals, OTA deferred until back on usb, memfault only rides along with other
+ *                requests, fast waveform for time-only renders
+ */
+
+typedef enum {
+    POWER_TIER_USB = 0,
+    POWER_TIER_BATTERY,
+
+    POWER_TIER_COUNT,
+} power_tier_t;
+
+void         power_policy_init();
+void         power_policy_radio_acquire();
+void         power_policy_radio_release();
+uint64_t     power_policy_get_radio_on_ms();
+bool         power_policy_update_tier();
+power_tier_t power_policy_get_tier();
+const char  *power_policy_tier_to_string(power_tier_t tier);
+uint8_t      power_policy_get_interval_multiplier();
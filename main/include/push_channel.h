@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+/*
+ * Optional long-poll channel for custom mode so the server can tell the device when there's a new custom screen
+ * instead of the device polling custom_screen_url every custom_update_interval_secs. Enabled by setting
+ * custom_push_url in the config.
+ *
+ * Device repeatedly sends:
+ *   GET <custom_push_url>?device_id=<serial>&version=<last version seen>&wait=<secs>
+ * and the server holds the request open for up to wait secs, responding with either:
+ *   200 + plain text body of the current version token (url-safe, max 64 chars) once it differs from the one sent
+ *   204 (or 304) if nothing changed before wait ran out
+ * The token is opaque to the device, a hash or timestamp of the image works. On a new token the scheduler downloads
+ * from custom_screen_url as usual. While the channel is up the interval poll is skipped, if it drops the interval poll
+ * takes back over until it reconnects.
+ */
+
+void        push_channel_init();
+void        push_channel_start();
+bool        push_channel_is_connected();
+void        push_channel_pause();
+void        push_channel_resume();
+UBaseType_t push_channel_get_stack_high_water();
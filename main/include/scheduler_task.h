@@ -1,7 +1,9 @@
 #ifndef SCHEDULER_TASK_H
 #define SCHEDULER_TASK_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 typedef enum {
     SCHEDULER_MODE_INIT,
@@ -24,6 +26,8 @@ void             scheduler_schedule_ota_check();
 void             scheduler_schedule_mflt_upload();
 void             scheduler_schedule_screen_dirty();
 void             scheduler_schedule_custom_screen_update();
+void             scheduler_schedule_custom_screen_redraw();
+void             scheduler_schedule_pushed_image_render();
 void             scheduler_block_until_system_idle();
 void             scheduler_set_busy(uint32_t system_idle_bitmask);
 void             scheduler_set_idle(uint32_t system_idle_bitmask);
@@ -31,7 +35,10 @@ void             scheduler_set_offline_mode();
 void             scheduler_set_ota_mode();
 void             scheduler_set_online_mode();
 scheduler_mode_t scheduler_get_mode();
+uint8_t          scheduler_get_update_count();
+bool             scheduler_get_update_last_executed(uint8_t index, const char **name, time_t *last_executed_epoch_secs);
 UBaseType_t      scheduler_task_get_stack_high_water();
+uint32_t         scheduler_task_take_loop_max_ms();
 void             scheduler_task_init();
 void             scheduler_task_start();
 
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 // Keys in NVS for the current number of bytes saved in the screen_img partition as a single image.
 // Saving the key separately in the NVS KVS avoids having to use a packed header prefix in the image data partition for
 // metadata
@@ -35,6 +39,16 @@
 // Allow the fullscreen custom screen image to occupy the same space as they'll never be used together
 #define SCREEN_IMG_CUSTOM_SCREEN_OFFSET 0x0
 
+// Packbits compressed copy of the last rendered framebuffer (see display.c), past the end of the largest image (a
+// fullscreen custom screen at 800 * 600 / 2 = 0x3A980 bytes). Runs up to the perf scratch area, a snapshot that
+// doesn't compress down to fit isn't saved.
+#define SCREEN_IMG_FB_SNAPSHOT_OFFSET 0x3B000
+#define SCREEN_IMG_FB_SNAPSHOT_MAX_BYTES (SCREEN_IMG_PERF_SCRATCH_OFFSET - SCREEN_IMG_FB_SNAPSHOT_OFFSET)
+
+// Last 64k of the 512k partition, erased and rewritten by the flash benchmark in perf.c. Nothing else may live here.
+#define SCREEN_IMG_PERF_SCRATCH_OFFSET 0x70000
+#define SCREEN_IMG_PERF_SCRATCH_BYTES 0x10000
+
 // Name of the NVS partition that the screen data bytes are saved. Generic since it holds multiple images
 #define SCREEN_IMG_PARTITION_LABEL "screen_img"
 
@@ -49,6 +63,9 @@ typedef enum {
 
 void screen_img_handler_init();
 bool screen_img_handler_download_and_save(screen_img_t screen_img);
+bool screen_img_handler_stream_begin(screen_img_t screen_img, uint32_t width, uint32_t height);
+bool screen_img_handler_stream_write(const uint8_t *data, size_t len);
+bool screen_img_handler_stream_end(bool commit);
 
 bool screen_img_handler_clear_screen_img(screen_img_t screen_img);
 bool screen_img_handler_clear_chart(screen_img_t screen_img);
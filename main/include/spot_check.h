@@ -57,6 +57,9 @@ void spot_check_draw_fetching_data_text();
  * Wrappers for different funcs so our logic modules can remain decoupled with only a dependency on the spot_check file
  */
 void spot_check_full_clear();
+bool spot_check_screen_restored();
+void spot_check_clear_framebuffer();
 void spot_check_mark_all_lines_dirty();
 void spot_check_render();
+void spot_check_render_fast();
 void spot_check_set_offline_mode();
@@ -5,29 +5,32 @@
 
 #include "driver/uart.h"
 
-// Positively SWIMMING in ram
-#define CLI_UART_RX_RING_BUFFER_BYTES (1024)
+// Positively SWIMMING in ram. RX ring has to hold a full window of in-flight uart_xfer frames
+#define CLI_UART_RX_RING_BUFFER_BYTES (4096)
 #define CLI_UART_TX_RING_BUFFER_BYTES (1024)
 #define CLI_UART_RX_BUFFER_BYTES (1024)
 #define CLI_UART_QUEUE_SIZE (10)
 
-typedef void (*process_char_func)(char c);
+// Called with whatever chunk of rx data is available. Also called with len 0 periodically when no data has come in so
+// the handler can track timeouts
+typedef void (*process_bytes_func)(const uint8_t *bytes, size_t len);
 
 typedef struct {
-    uart_port_t       port;
-    uart_config_t     config;
-    QueueHandle_t     queue;
-    char             *rx_buffer;
-    process_char_func process_char;
-
+    uart_port_t        port;
+    uart_config_t      config;
+    QueueHandle_t      queue;
+    char              *rx_buffer;
+    size_t             rx_buffer_size;
+    process_bytes_func process_bytes;
 } uart_handle_t;
 
-// Build out handle properties
-void uart_init(uart_port_t       port,
-               uint16_t          rx_ring_buffer_size,
-               uint16_t          tx_ring_buffer_size,
-               uint8_t           event_queue_size,
-               uint16_t          rx_buffer_size,
-               process_char_func process_char_cb,
-               uart_handle_t    *handle);
+// Build out handle properties. rx_buffer is owned by the caller and must outlive the handle.
+void uart_init(uart_port_t        port,
+               uint16_t           rx_ring_buffer_size,
+               uint16_t           tx_ring_buffer_size,
+               uint8_t            event_queue_size,
+               char              *rx_buffer,
+               uint16_t           rx_buffer_size,
+               process_bytes_func process_bytes_cb,
+               uart_handle_t     *handle);
 void uart_generic_rx_task(void *args);
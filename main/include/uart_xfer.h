@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "uart.h"
+
+/*
+ * Framed binary transfer over the CLI UART straight into a flash partition. Started with the 'xfer' CLI command, then
+ * the host (uart_xfer.py) streams data frames and the device acks each one. Host keeps up to UART_XFER_WINDOW_FRAMES
+ * unacked frames in flight and goes back to the NAKed seq on any error (go-back-N).
+ *
+ * Data frame (host -> device), all multi-byte fields little endian:
+ *   [sync 0xA5 0xC3][seq u16][len u16][payload, len bytes][crc32 over seq + len + payload]
+ *
+ * Ack frame (device -> host):
+ *   [sync 0x5A 0x3C][type u8][seq u16][status u8][crc32 over type + seq + status]
+ *   ACK/NAK seq is the next seq the device expects. DONE is sent once at the end, with the final status.
+ *
+ * Anything else on the line (log output, CLI echo) is not framed and can be ignored by the host.
+ */
+#define UART_XFER_DATA_SYNC_0 (0xA5)
+#define UART_XFER_DATA_SYNC_1 (0xC3)
+#define UART_XFER_ACK_SYNC_0 (0x5A)
+#define UART_XFER_ACK_SYNC_1 (0x3C)
+
+#define UART_XFER_MAX_PAYLOAD_BYTES (512)
+#define UART_XFER_WINDOW_FRAMES (4)
+#define UART_XFER_DEFAULT_BAUD (921600)
+
+typedef enum {
+    UART_XFER_ACK_TYPE_ACK  = 0x01,
+    UART_XFER_ACK_TYPE_NAK  = 0x02,
+    UART_XFER_ACK_TYPE_DONE = 0x03,
+} uart_xfer_ack_type_t;
+
+typedef enum {
+    UART_XFER_STATUS_OK         = 0x00,
+    UART_XFER_STATUS_CRC_ERR    = 0x01,
+    UART_XFER_STATUS_SEQ_ERR    = 0x02,
+    UART_XFER_STATUS_FLASH_ERR  = 0x03,
+    UART_XFER_STATUS_VERIFY_ERR = 0x04,
+    UART_XFER_STATUS_TIMEOUT    = 0x05,
+} uart_xfer_status_t;
+
+void uart_xfer_init(uart_handle_t *uart_handle);
+bool uart_xfer_start(const char *partition_label, uint32_t offset, uint32_t len, uint32_t crc32, uint32_t baud);
+bool uart_xfer_is_active();
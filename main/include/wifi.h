@@ -28,6 +28,11 @@ bool wifi_is_connected_to_network();
 /* Simply sets mode and starts, expects config to be done */
 void wifi_start_sta();
 
+/* Used by the power policy to take the radio down between updates on battery and bring it back for the next one */
+void wifi_radio_off();
+void wifi_radio_on();
+bool wifi_is_radio_on();
+
 /*
  * Inits config and event handler for provisioning. Supports being called
  * more than once
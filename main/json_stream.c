@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_stream.h"
+
+typedef enum {
+    JSON_STREAM_STATE_OBJECT_START,
+    JSON_STREAM_STATE_KEY_OR_END,  // right after '{', object could be empty
+    JSON_STREAM_STATE_KEY,         // right after ',', must be another key
+    JSON_STREAM_STATE_STRING,      // in a key or a string value depending on in_key
+    JSON_STREAM_STATE_ESCAPE,
+    JSON_STREAM_STATE_UNICODE,
+    JSON_STREAM_STATE_COLON,
+    JSON_STREAM_STATE_VALUE,
+    JSON_STREAM_STATE_BARE_VALUE,  // number, true, false, null
+    JSON_STREAM_STATE_SKIP,        // nested object or array
+    JSON_STREAM_STATE_COMMA_OR_END,
+    JSON_STREAM_STATE_DONE,
+    JSON_STREAM_STATE_ERROR,
+} json_stream_state_t;
+
+static bool json_stream_is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool json_stream_is_bare_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '+' ||
+           c == '.';
+}
+
+static int json_stream_hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Writes into the key buffer or the current field's value. Anything past the max just sets overflowed, we keep going
+ * so the rest of the body still parses.
+ */
+static void json_stream_append(json_stream_t *stream, char c) {
+    char  *buf     = stream->in_key ? stream->key : (stream->field ? stream->field->value : NULL);
+    size_t max_len = stream->in_key ? JSON_STREAM_MAX_KEY_LEN : (stream->field ? stream->field->max_len : 0);
+    if (buf == NULL) {
+        return;
+    }
+
+    if (stream->len < max_len) {
+        buf[stream->len++] = c;
+    } else {
+        stream->overflowed = true;
+    }
+}
+
+// Surrogate pairs aren't worth handling for config strings, they come out as '?'
+static void json_stream_append_unicode(json_stream_t *stream, uint16_t code_point) {
+    if (code_point < 0x80) {
+        json_stream_append(stream, code_point);
+    } else if (code_point < 0x800) {
+        json_stream_append(stream, 0xC0 | (code_point >> 6));
+        json_stream_append(stream, 0x80 | (code_point & 0x3F));
+    } else if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+        json_stream_append(stream, '?');
+    } else {
+        json_stream_append(stream, 0xE0 | (code_point >> 12));
+        json_stream_append(stream, 0x80 | ((code_point >> 6) & 0x3F));
+        json_stream_append(stream, 0x80 | (code_point & 0x3F));
+    }
+}
+
+static void json_stream_start_string(json_stream_t *stream, bool in_key) {
+    stream->in_key          = in_key;
+    stream->value_is_string = true;
+    stream->overflowed      = false;
+    stream->len             = 0;
+    stream->state           = JSON_STREAM_STATE_STRING;
+}
+
+static void json_stream_finish_key(json_stream_t *stream) {
+    stream->key[stream->len] = '\0';
+    stream->in_key           = false;
+    stream->field            = NULL;
+    stream->state            = JSON_STREAM_STATE_COLON;
+
+    if (stream->overflowed) {
+        return;
+    }
+
+    for (size_t i = 0; i < stream->num_fields; i++) {
+        if (strcmp(stream->fields[i].key, stream->key) == 0) {
+            stream->field = &stream->fields[i];
+            break;
+        }
+    }
+}
+
+/*
+ * Buffer is already filled as far as it'll go, just null term and decide whether the caller can use it. Repeated keys
+ * overwrite, last one wins.
+ */
+static void json_stream_finish_value(json_stream_t *stream) {
+    json_stream_field_t *field = stream->field;
+    stream->state              = JSON_STREAM_STATE_COMMA_OR_END;
+    stream->field              = NULL;
+    if (field == NULL) {
+        return;
+    }
+
+    field->value[stream->len] = '\0';
+    if (stream->value_is_string != (field->type == JSON_STREAM_TYPE_STRING)) {
+        field->status = JSON_STREAM_FIELD_WRONG_TYPE;
+    } else if (stream->overflowed) {
+        field->status = JSON_STREAM_FIELD_TOO_LONG;
+    } else if (field->type == JSON_STREAM_TYPE_NUMBER) {
+        // true/false/null land here too, strtod rejects them
+        char *end;
+        strtod(field->value, &end);
+        field->status = (stream->len > 0 && *end == '\0') ? JSON_STREAM_FIELD_OK : JSON_STREAM_FIELD_WRONG_TYPE;
+    } else {
+        field->status = JSON_STREAM_FIELD_OK;
+    }
+}
+
+static void json_stream_start_skip(json_stream_t *stream) {
+    if (stream->field) {
+        stream->field->status = JSON_STREAM_FIELD_WRONG_TYPE;
+        stream->field         = NULL;
+    }
+
+    stream->skip_depth     = 1;
+    stream->skip_in_string = false;
+    stream->skip_escape    = false;
+    stream->state          = JSON_STREAM_STATE_SKIP;
+}
+
+static void json_stream_skip(json_stream_t *stream, char c) {
+    if (stream->skip_in_string) {
+        if (stream->skip_escape) {
+            stream->skip_escape = false;
+        } else if (c == '\\') {
+            stream->skip_escape = true;
+        } else if (c == '"') {
+            stream->skip_in_string = false;
+        }
+        return;
+    }
+
+    if (c == '"') {
+        stream->skip_in_string = true;
+    } else if (c == '{' || c == '[') {
+        stream->skip_depth++;
+    } else if ((c == '}' || c == ']') && --stream->skip_depth == 0) {
+        stream->state = JSON_STREAM_STATE_COMMA_OR_END;
+    }
+}
+
+static void json_stream_escape(json_stream_t *stream, char c) {
+    stream->state = JSON_STREAM_STATE_STRING;
+    switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            json_stream_append(stream, c);
+            break;
+        case 'b':
+            json_stream_append(stream, '\b');
+            break;
+        case 'f':
+            json_stream_append(stream, '\f');
+            break;
+        case 'n':
+            json_stream_append(stream, '\n');
+            break;
+        case 'r':
+            json_stream_append(stream, '\r');
+            break;
+        case 't':
+            json_stream_append(stream, '\t');
+            break;
+        case 'u':
+            stream->unicode_digits = 0;
+            stream->unicode_value  = 0;
+            stream->state          = JSON_STREAM_STATE_UNICODE;
+            break;
+        default:
+            stream->state = JSON_STREAM_STATE_ERROR;
+    }
+}
+
+void json_stream_init(json_stream_t *stream, json_stream_field_t *fields, size_t num_fields) {
+    memset(stream, 0, sizeof(json_stream_t));
+    stream->fields     = fields;
+    stream->num_fields = num_fields;
+    stream->state      = JSON_STREAM_STATE_OBJECT_START;
+
+    for (size_t i = 0; i < num_fields; i++) {
+        fields[i].status = JSON_STREAM_FIELD_MISSING;
+    }
+}
+
+/*
+ * Returns false as soon as the input stops being valid json, caller should stop feeding it. Fields finished before the
+ * error keep their status.
+ */
+bool json_stream_parse(json_stream_t *stream, const char *bytes, size_t len) {
+    size_t i = 0;
+    while (i < len && stream->state != JSON_STREAM_STATE_ERROR) {
+        char c = bytes[i];
+
+        switch (stream->state) {
+            case JSON_STREAM_STATE_OBJECT_START:
+                if (c == '{') {
+                    stream->state = JSON_STREAM_STATE_KEY_OR_END;
+                } else if (!json_stream_is_whitespace(c)) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                }
+                break;
+            case JSON_STREAM_STATE_KEY_OR_END:
+            case JSON_STREAM_STATE_KEY:
+                if (c == '"') {
+                    json_stream_start_string(stream, true);
+                } else if (c == '}' && stream->state == JSON_STREAM_STATE_KEY_OR_END) {
+                    stream->state = JSON_STREAM_STATE_DONE;
+                } else if (!json_stream_is_whitespace(c)) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                }
+                break;
+            case JSON_STREAM_STATE_STRING:
+                if (c == '"') {
+                    if (stream->in_key) {
+                        json_stream_finish_key(stream);
+                    } else {
+                        json_stream_finish_value(stream);
+                    }
+                } else if (c == '\\') {
+                    stream->state = JSON_STREAM_STATE_ESCAPE;
+                } else if ((uint8_t)c < 0x20) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                } else {
+                    json_stream_append(stream, c);
+                }
+                break;
+            case JSON_STREAM_STATE_ESCAPE:
+                json_stream_escape(stream, c);
+                break;
+            case JSON_STREAM_STATE_UNICODE: {
+                int digit = json_stream_hex_value(c);
+                if (digit < 0) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                    break;
+                }
+
+                stream->unicode_value = (stream->unicode_value << 4) | digit;
+                if (++stream->unicode_digits == 4) {
+                    json_stream_append_unicode(stream, stream->unicode_value);
+                    stream->state = JSON_STREAM_STATE_STRING;
+                }
+                break;
+            }
+            case JSON_STREAM_STATE_COLON:
+                if (c == ':') {
+                    stream->state = JSON_STREAM_STATE_VALUE;
+                } else if (!json_stream_is_whitespace(c)) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                }
+                break;
+            case JSON_STREAM_STATE_VALUE:
+                if (c == '"') {
+                    json_stream_start_string(stream, false);
+                } else if (c == '{' || c == '[') {
+                    json_stream_start_skip(stream);
+                } else if (json_stream_is_bare_char(c)) {
+                    stream->value_is_string = false;
+                    stream->overflowed      = false;
+                    stream->len             = 0;
+                    stream->state           = JSON_STREAM_STATE_BARE_VALUE;
+                    json_stream_append(stream, c);
+                } else if (!json_stream_is_whitespace(c)) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                }
+                break;
+            case JSON_STREAM_STATE_BARE_VALUE:
+                if (json_stream_is_bare_char(c)) {
+                    json_stream_append(stream, c);
+                    break;
+                }
+
+                // Delimiter belongs to the next state, finish up and run this char through it without consuming
+                json_stream_finish_value(stream);
+                continue;
+            case JSON_STREAM_STATE_SKIP:
+                json_stream_skip(stream, c);
+                break;
+            case JSON_STREAM_STATE_COMMA_OR_END:
+                if (c == ',') {
+                    stream->state = JSON_STREAM_STATE_KEY;
+                } else if (c == '}') {
+                    stream->state = JSON_STREAM_STATE_DONE;
+                } else if (!json_stream_is_whitespace(c)) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                }
+                break;
+            case JSON_STREAM_STATE_DONE:
+                if (!json_stream_is_whitespace(c)) {
+                    stream->state = JSON_STREAM_STATE_ERROR;
+                }
+                break;
+            default:
+                stream->state = JSON_STREAM_STATE_ERROR;
+        }
+
+        i++;
+    }
+
+    return stream->state != JSON_STREAM_STATE_ERROR;
+}
+
+/*
+ * True once the closing brace of the top level object has been parsed
+ */
+bool json_stream_is_complete(json_stream_t *stream) {
+    return stream->state == JSON_STREAM_STATE_DONE;
+}
@@ -1,112 +1,684 @@
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include "freertos/task.h"
 
 #include "driver/uart.h"
 
 #include "log.h"
+#include "log_persist.h"
+#include "memory_budget.h"
 #include "sntp_time.h"
 
 // Should match CLI_UART_TX_BYTES probably
 #define LOG_OUT_BUFFER_BYTES (512)
 
-static uart_handle_t    *cli_uart_handle;
-static char             *log_out_buffer;
-static SemaphoreHandle_t mutex_handle;
-static StaticSemaphore_t mutex_buffer;
-static log_level_t       max_log_level;
-static uint32_t          tag_blacklist;
-static char              time_str_buffer[20];
+// Must be a power of 2 for index masking
+#define LOG_RING_SLOTS (32)
+#define LOG_RING_SLOT_MASK (LOG_RING_SLOTS - 1)
+
+// log_parse_spec precision when the specifier has none, or takes it from a '*' arg
+#define LOG_SPEC_PRECISION_NONE (-1)
+#define LOG_SPEC_PRECISION_STAR (-2)
+
+// Longest single conversion specifier we'll rebuild for snprintf, e.g. "%-+#012.8llx" plus resolved '*' widths
+#define LOG_SPEC_MAX_BYTES (24)
+
+// Every other app task runs at idle priority, one above means the ring gets drained as soon as a producer notifies
+// instead of waiting for a busy task to yield, so bursts don't overrun the ring
+#define LOG_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+// Tokenized frame layout, all multi-byte fields little endian. See log_decoder.py at repo root for the host side.
+// [sync 0xA5][sync 0x5A][len][fmt addr u32][timestamp u32][level << 6 | tag][packed args...][checksum]
+// len covers fmt addr through end of args, checksum is the 8 bit sum of the same bytes.
+#define LOG_TOKEN_SYNC_0 (0xA5)
+#define LOG_TOKEN_SYNC_1 (0x5A)
+#define LOG_TOKEN_HEADER_BYTES (3)
+#define LOG_TOKEN_FIXED_BYTES (9)
+
+#define LOG_TOKEN_MAX_FRAME_BYTES (LOG_TOKEN_HEADER_BYTES + LOG_TOKEN_FIXED_BYTES + LOG_RECORD_ARG_BYTES + 1)
+
+// Lines persisted to the post-mortem ring. Debug is too chatty to keep much of a timeline in 4k, and CLI output would
+// just be the ring reading itself back out.
+#define LOG_PERSIST_MAX_LEVEL (LOG_LEVEL_INFO)
+#define LOG_PERSIST_TAG_EXCLUDE_MASK (1UL << SC_TAG_CLI)
+
+// BUILD_LOG_LINE always starts with the time and tag %s's, those get filled by the logger task from the record
+// instead of being passed by the caller
+#define LOG_LINE_PREFIX_ARG_COUNT (2)
+
+typedef enum {
+    LOG_ARG_NONE,  // %% or unsupported specifier, consumes no arg
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LONG_LONG,
+    LOG_ARG_SIZE_T,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LONG_DOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+} log_arg_type_t;
+
+typedef struct {
+    time_t      timestamp;
+    const char *fmt;  // Always a string literal from the log_printf macro so safe to hold onto
+    uint8_t     tag;
+    uint8_t     level;
+    uint8_t     arg_bytes;
+    bool        truncated;
+    uint8_t     args[LOG_RECORD_ARG_BYTES];
+} log_record_t;
+
+// Slot sequence numbers implement a bounded lock-free multi-producer queue. A slot is free for the producer claiming
+// position `pos` when seq == pos, and ready for the consumer when seq == pos + 1.
+typedef struct {
+    atomic_uint  seq;
+    log_record_t record;
+} log_slot_t;
+
+static uart_handle_t *cli_uart_handle;
+static char           log_out_buffer[LOG_OUT_BUFFER_BYTES];
+static log_slot_t     ring[LOG_RING_SLOTS];
+static atomic_uint    enqueue_pos;
+static unsigned int   dequeue_pos;  // only touched by logger task
+static atomic_uint    dropped_count;
+static TaskHandle_t   log_task_handle;
+static StaticTask_t   log_task_buffer;
+static StackType_t    log_task_stack[MEMORY_BUDGET_LOG_STACK_BYTES];
+static log_level_t    max_log_level;
+static bool           tokenized;
+static uint8_t        persist_frame_buffer[LOG_TOKEN_MAX_FRAME_BYTES];
+static uint32_t       tag_blacklist;
+static char           time_str_buffer[20];
+
+/*
+ * Parses the next conversion specifier starting at *fmt_ptr (which must point at the '%'). Advances the pointer past
+ * the specifier, copies the specifier itself into spec if non-null, and returns what kind of arg it consumes. Star
+ * width/precision are reported through star_count since they each consume an extra int arg before the main one.
+ * Precision is reported separately since it bounds how much of a %s string gets read, LOG_SPEC_PRECISION_STAR means
+ * it's the last of the star args.
+ */
+static log_arg_type_t log_parse_spec(const char **fmt_ptr, char *spec, uint8_t *star_count, int *precision) {
+    const char *start = *fmt_ptr;
+    const char *p     = start + 1;
+    *star_count       = 0;
+    *precision        = LOG_SPEC_PRECISION_NONE;
+
+    while (*p && strchr("-+ #0", *p)) {
+        p++;
+    }
+    while (*p && ((*p >= '0' && *p <= '9') || *p == '*')) {
+        if (*p == '*') {
+            (*star_count)++;
+        }
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            (*star_count)++;
+            *precision = LOG_SPEC_PRECISION_STAR;
+            p++;
+        } else {
+            // Bare '.' is a precision of 0
+            *precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                *precision = *precision * 10 + (*p - '0');
+                p++;
+            }
+        }
+    }
+
+    uint8_t long_count = 0;
+    bool    size_mod   = false;
+    bool    long_dbl   = false;
+    while (*p && strchr("hlzjtL", *p)) {
+        if (*p == 'l') {
+            long_count++;
+        } else if (*p == 'j') {
+            long_count = 2;
+        } else if (*p == 'z' || *p == 't') {
+            size_mod = true;
+        } else if (*p == 'L') {
+            long_dbl = true;
+        }
+        p++;
+    }
+
+    char           conversion = *p;
+    log_arg_type_t type       = LOG_ARG_NONE;
+    switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            if (size_mod) {
+                type = LOG_ARG_SIZE_T;
+            } else if (long_count >= 2) {
+                type = LOG_ARG_LONG_LONG;
+            } else if (long_count == 1) {
+                type = LOG_ARG_LONG;
+            } else {
+                type = LOG_ARG_INT;
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            type = long_dbl ? LOG_ARG_LONG_DOUBLE : LOG_ARG_DOUBLE;
+            break;
+        case 'p':
+            type = LOG_ARG_PTR;
+            break;
+        case 's':
+            type = LOG_ARG_STR;
+            break;
+        default:
+            // %% or something we don't support (%n), neither consumes an arg
+            break;
+    }
+
+    if (conversion) {
+        p++;
+    }
+
+    if (spec) {
+        size_t len = MIN((size_t)(p - start), LOG_SPEC_MAX_BYTES - 1);
+        memcpy(spec, start, len);
+        spec[len] = '\0';
+    }
+
+    *fmt_ptr = p;
+    return type;
+}
+
+static bool log_pack_bytes(log_record_t *record, const void *src, size_t len) {
+    if (record->arg_bytes + len > LOG_RECORD_ARG_BYTES) {
+        record->truncated = true;
+        return false;
+    }
+
+    memcpy(&record->args[record->arg_bytes], src, len);
+    record->arg_bytes += len;
+    return true;
+}
+
+/*
+ * Walks the format string on the caller's task just far enough to know the type of each var arg and copies them into
+ * the record. No formatting happens here, that's deferred to the logger task.
+ */
+static void log_pack_args(log_record_t *record, const char *fmt, va_list args) {
+    uint8_t arg_idx = 0;
+    while (*fmt && !record->truncated) {
+        if (*fmt != '%') {
+            fmt++;
+            continue;
+        }
+
+        uint8_t        star_count = 0;
+        int            precision  = LOG_SPEC_PRECISION_NONE;
+        log_arg_type_t type       = log_parse_spec(&fmt, NULL, &star_count, &precision);
+        if (type == LOG_ARG_NONE) {
+            continue;
+        }
+
+        // Time and tag prefix args are supplied by the logger task, skip them
+        if (arg_idx++ < LOG_LINE_PREFIX_ARG_COUNT) {
+            continue;
+        }
+
+        for (uint8_t i = 0; i < star_count; i++) {
+            int star_val = va_arg(args, int);
+            log_pack_bytes(record, &star_val, sizeof(star_val));
+            if (precision == LOG_SPEC_PRECISION_STAR && i == star_count - 1) {
+                // Negative star precision is the same as none
+                precision = star_val < 0 ? LOG_SPEC_PRECISION_NONE : star_val;
+            }
+        }
+
+        switch (type) {
+            case LOG_ARG_INT: {
+                int val = va_arg(args, int);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_LONG: {
+                long val = va_arg(args, long);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_LONG_LONG: {
+                long long val = va_arg(args, long long);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_SIZE_T: {
+                size_t val = va_arg(args, size_t);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_DOUBLE: {
+                double val = va_arg(args, double);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_LONG_DOUBLE: {
+                long double val = va_arg(args, long double);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_PTR: {
+                void *val = va_arg(args, void *);
+                log_pack_bytes(record, &val, sizeof(val));
+                break;
+            }
+            case LOG_ARG_STR: {
+                const char *str = va_arg(args, const char *);
+                if (str == NULL) {
+                    str = "(null)";
+                }
+
+                // Copy as much of the string as fits, always null terminated. Anything after a truncated string is
+                // dropped since we're out of room anyway. A precision means the string doesn't have to be terminated,
+                // so never read past it.
+                size_t space = LOG_RECORD_ARG_BYTES - record->arg_bytes;
+                size_t len   = precision >= 0 ? strnlen(str, precision) : strlen(str);
+                if (space == 0) {
+                    record->truncated = true;
+                } else if (len + 1 > space) {
+                    memcpy(&record->args[record->arg_bytes], str, space - 1);
+                    record->args[LOG_RECORD_ARG_BYTES - 1] = '\0';
+                    record->arg_bytes                      = LOG_RECORD_ARG_BYTES;
+                    record->truncated                      = true;
+                } else {
+                    memcpy(&record->args[record->arg_bytes], str, len);
+                    record->args[record->arg_bytes + len] = '\0';
+                    record->arg_bytes += len + 1;
+                }
+                break;
+            }
+            case LOG_ARG_NONE:
+                break;
+        }
+    }
+}
+
+static bool log_unpack_bytes(const log_record_t *record, size_t *offset, void *dst, size_t len) {
+    if (*offset + len > record->arg_bytes) {
+        return false;
+    }
+
+    memcpy(dst, &record->args[*offset], len);
+    *offset += len;
+    return true;
+}
+
+/*
+ * Formats a single record into the output buffer on the logger task. Literal text is copied straight through and each
+ * specifier is handed to snprintf individually with its unpacked arg. Returns formatted length.
+ */
+static size_t log_format_record(const log_record_t *record, char *out, size_t out_size) {
+    char        prefix_time[sizeof(time_str_buffer)];
+    const char *prefix_args[LOG_LINE_PREFIX_ARG_COUNT] = {prefix_time, tag_strs[record->tag]};
+    struct tm   timestamp_local                        = {0};
+    sntp_time_epoch_to_local(record->timestamp, &timestamp_local);
+    sntp_time_get_time_str(&timestamp_local, prefix_time, NULL);
+
+    const char *fmt        = record->fmt;
+    size_t      len        = 0;
+    size_t      offset     = 0;
+    uint8_t     arg_idx    = 0;
+    bool        out_of_arg = false;
+    char        spec[LOG_SPEC_MAX_BYTES];
+    char        resolved_spec[LOG_SPEC_MAX_BYTES];
+    while (*fmt && len < out_size - 1 && !out_of_arg) {
+        if (*fmt != '%') {
+            out[len++] = *fmt++;
+            continue;
+        }
+
+        uint8_t        star_count = 0;
+        int            precision  = LOG_SPEC_PRECISION_NONE;
+        log_arg_type_t type       = log_parse_spec(&fmt, spec, &star_count, &precision);
+        int            written    = 0;
+        if (type == LOG_ARG_NONE) {
+            // Only %% makes it here in practice, anything unsupported is dropped from the output
+            if (strcmp(spec, "%%") == 0) {
+                out[len++] = '%';
+            }
+        } else if (arg_idx < LOG_LINE_PREFIX_ARG_COUNT) {
+            written = snprintf(&out[len], out_size - len, spec, prefix_args[arg_idx++]);
+        } else {
+            arg_idx++;
+
+            // Resolve any '*' width/precision into literal digits so every snprintf below takes exactly one arg
+            size_t src = 0;
+            size_t dst = 0;
+            while (spec[src] && dst < sizeof(resolved_spec) - 1) {
+                if (spec[src] == '*') {
+                    int star_val = 0;
+                    if (!log_unpack_bytes(record, &offset, &star_val, sizeof(star_val))) {
+                        out_of_arg = true;
+                        break;
+                    }
+                    dst += snprintf(&resolved_spec[dst], sizeof(resolved_spec) - dst, "%d", star_val);
+                    dst = MIN(dst, sizeof(resolved_spec) - 1);
+                } else {
+                    resolved_spec[dst++] = spec[src];
+                }
+                src++;
+            }
+            resolved_spec[dst] = '\0';
+            if (out_of_arg) {
+                break;
+            }
+
+            switch (type) {
+                case LOG_ARG_INT: {
+                    int val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_LONG: {
+                    long val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_LONG_LONG: {
+                    long long val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_SIZE_T: {
+                    size_t val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_DOUBLE: {
+                    double val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_LONG_DOUBLE: {
+                    long double val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_PTR: {
+                    void *val;
+                    out_of_arg = !log_unpack_bytes(record, &offset, &val, sizeof(val));
+                    written    = out_of_arg ? 0 : snprintf(&out[len], out_size - len, resolved_spec, val);
+                    break;
+                }
+                case LOG_ARG_STR: {
+                    // Strings are stored inline and null terminated, point straight into the record
+                    if (offset >= record->arg_bytes) {
+                        out_of_arg = true;
+                        break;
+                    }
+                    const char *str = (const char *)&record->args[offset];
+                    offset += strlen(str) + 1;
+                    written = snprintf(&out[len], out_size - len, resolved_spec, str);
+                    break;
+                }
+                case LOG_ARG_NONE:
+                    break;
+            }
+        }
+
+        if (written > 0) {
+            len = MIN(len + written, out_size - 1);
+        }
+    }
+
+    // Record was truncated on the producer side (or the line overflowed our buffer) and we lost the color reset and
+    // newline at the end of the format string, tack them back on
+    if (out_of_arg || *fmt) {
+        len = MIN(len, out_size - sizeof("[...]" LOG_RESET_COLOR "\n"));
+        len += snprintf(&out[len], out_size - len, "[...]" LOG_RESET_COLOR "\n");
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+/*
+ * Tokenized alternative to log_format_record. Instead of formatting, the format string's address is emitted as its
+ * token (host decoder looks it up in the ELF) along with the already-packed binary args. Returns frame length.
+ */
+static size_t log_encode_record(const log_record_t *record, uint8_t *out, size_t out_size) {
+    size_t payload_len = LOG_TOKEN_FIXED_BYTES + record->arg_bytes;
+    assert(LOG_TOKEN_HEADER_BYTES + payload_len + 1 <= out_size);
+
+    uint32_t fmt_addr  = (uint32_t)(uintptr_t)record->fmt;
+    uint32_t timestamp = (uint32_t)record->timestamp;
+    size_t   idx       = 0;
+    out[idx++]         = LOG_TOKEN_SYNC_0;
+    out[idx++]         = LOG_TOKEN_SYNC_1;
+    out[idx++]         = payload_len;
+    memcpy(&out[idx], &fmt_addr, sizeof(fmt_addr));
+    idx += sizeof(fmt_addr);
+    memcpy(&out[idx], &timestamp, sizeof(timestamp));
+    idx += sizeof(timestamp);
+    out[idx++] = (record->level << 6) | (record->tag & 0x3F);
+    memcpy(&out[idx], record->args, record->arg_bytes);
+    idx += record->arg_bytes;
+
+    uint8_t checksum = 0;
+    for (size_t i = LOG_TOKEN_HEADER_BYTES; i < idx; i++) {
+        checksum += out[i];
+    }
+    out[idx++] = checksum;
+
+    return idx;
+}
+
+/*
+ * Single consumer side of the ring. Pops ready records in order, formats, and writes them out to the uart.
+ */
+static bool log_dequeue_and_write() {
+    log_slot_t  *slot = &ring[dequeue_pos & LOG_RING_SLOT_MASK];
+    unsigned int seq  = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != dequeue_pos + 1) {
+        // Either empty or the producer that claimed this slot hasn't finished filling it yet
+        return false;
+    }
+
+    log_record_t *record         = &slot->record;
+    size_t        formatted_size = tokenized
+                                       ? log_encode_record(record, (uint8_t *)log_out_buffer, LOG_OUT_BUFFER_BYTES)
+                                       : log_format_record(record, log_out_buffer, LOG_OUT_BUFFER_BYTES);
+
+    if (record->level <= LOG_PERSIST_MAX_LEVEL && !(LOG_PERSIST_TAG_EXCLUDE_MASK & (1UL << record->tag))) {
+        if (tokenized) {
+            log_persist_append((uint8_t *)log_out_buffer, formatted_size);
+        } else {
+            size_t frame_size = log_encode_record(record, persist_frame_buffer, sizeof(persist_frame_buffer));
+            log_persist_append(persist_frame_buffer, frame_size);
+        }
+    }
+
+    // Hand slot back to producers before the (possibly slow) uart write
+    atomic_store_explicit(&slot->seq, dequeue_pos + LOG_RING_SLOTS, memory_order_release);
+    dequeue_pos++;
+
+    uart_write_bytes(cli_uart_handle->port, log_out_buffer, formatted_size);
+    return true;
+}
+
+static void log_task(void *args) {
+    while (1) {
+        // Drain before waiting so anything queued before the task was created goes out right away
+        while (log_dequeue_and_write()) {
+        }
+
+        unsigned int dropped = atomic_exchange(&dropped_count, 0);
+        if (dropped) {
+            int len = snprintf(log_out_buffer,
+                               LOG_OUT_BUFFER_BYTES,
+                               LOG_LEVEL_WARN_COLOR "Log ring full, dropped %u lines" LOG_RESET_COLOR "\n",
+                               dropped);
+            uart_write_bytes(cli_uart_handle->port, log_out_buffer, len);
+        }
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
 
 void log_init(uart_handle_t *cli_handle) {
     assert(cli_handle);
 
-    log_out_buffer = pvPortMalloc(LOG_OUT_BUFFER_BYTES * sizeof(uint8_t));
-    assert(log_out_buffer);
+    memory_budget_register_buffer("log out", sizeof(log_out_buffer));
+    memory_budget_register_buffer("log ring", sizeof(ring));
+    memory_budget_register_stack("logger", sizeof(log_task_stack), &log_task_handle);
 
-    mutex_handle = xSemaphoreCreateMutexStatic(&mutex_buffer);
-    assert(mutex_handle);
+    for (unsigned int i = 0; i < LOG_RING_SLOTS; i++) {
+        atomic_init(&ring[i].seq, i);
+    }
+    atomic_init(&enqueue_pos, 0);
+    atomic_init(&dropped_count, 0);
+    dequeue_pos     = 0;
+    log_task_handle = NULL;
 
     cli_uart_handle = cli_handle;
     max_log_level   = LOG_LEVEL_DEBUG;
     tag_blacklist   = 0x00000000;
+#ifdef CONFIG_LOG_TOKENIZED
+    tokenized = true;
+#else
+    tokenized = false;
+#endif
     memset(time_str_buffer, 0x00, sizeof(time_str_buffer));
+
+    // Recover / spill previous boot's persisted log before the logger task starts appending to it. Anything it logs
+    // just sits in the ring until the task is up.
+    log_persist_init();
+
+    // Started here instead of a log_start since everything in init after this wants to log
+    log_task_handle = xTaskCreateStatic(log_task,
+                                        "logger",
+                                        sizeof(log_task_stack),
+                                        NULL,
+                                        LOG_TASK_PRIORITY,
+                                        log_task_stack,
+                                        &log_task_buffer);
+    assert(log_task_handle);
 }
 
-void log_log_line(sc_tag_t tag, log_level_t level, char *fmt, ...) {
+/*
+ * Multi-producer side of the ring, safe to call from any task concurrently without a lock. Claims a slot, packs the
+ * raw args, and wakes the logger task. If the ring is full the line is dropped and counted rather than blocking the
+ * caller.
+ */
+void log_log_line(sc_tag_t tag, log_level_t level, const char *fmt, ...) {
     // Drop log line entirely if max level set less verbose than line verbosity OR there is at least one tag blacklisted
     // (aka don't show) and the bitmask of the tag enum val matches what's in the blacklist
-    if (level > max_log_level || (tag_blacklist > 0 && (tag_blacklist & (1 << tag)))) {
+    if (level > max_log_level || (tag_blacklist > 0 && (tag_blacklist & (1UL << tag)))) {
         return;
     }
 
-    BaseType_t rval = xSemaphoreTake(mutex_handle, pdMS_TO_TICKS(50));
-    // TODO :: could handle this more elegantly
-    assert(rval == pdTRUE);
-
-    // Uncomment following block to printf the literal format string for format specifier debugging
-    /*
-    char     dbg_buffer[LOG_OUT_BUFFER_BYTES];
-    char    *p   = fmt;
-    uint16_t idx = 0;
-    while (*p && idx < LOG_OUT_BUFFER_BYTES) {
-        dbg_buffer[idx++] = *p;
-        if (*p == '%') {
-            dbg_buffer[idx++] = '%';
+    unsigned int pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    log_slot_t  *slot;
+    while (1) {
+        slot             = &ring[pos & LOG_RING_SLOT_MASK];
+        unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int          diff = (int)seq - (int)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Logger task hasn't caught up, full
+            atomic_fetch_add(&dropped_count, 1);
+            if (log_task_handle) {
+                xTaskNotifyGive(log_task_handle);
+            }
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
         }
-
-        p++;
     }
 
-    printf("%s\n", dbg_buffer);
-    */
+    log_record_t *record = &slot->record;
+    record->timestamp    = time(NULL);
+    record->fmt          = fmt;
+    record->tag          = tag;
+    record->level        = level;
+    record->arg_bytes    = 0;
+    record->truncated    = false;
 
     va_list args;
     va_start(args, fmt);
-
-    // vsnprintf subtracts 1 from the max length passed to leave room for the null term
-    size_t formatted_size = vsnprintf(log_out_buffer, LOG_OUT_BUFFER_BYTES, fmt, args);
+    log_pack_args(record, fmt, args);
     va_end(args);
 
-    xSemaphoreGive(mutex_handle);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
 
-    // Let go of the mutex before sending to serial, it'll handle re-entrancy with it's own internal queueing
-    // (maybe?)
-    uart_write_bytes(cli_uart_handle->port, log_out_buffer, formatted_size + 1);
+    // Null only for the few lines logged during log_init before the task exists, they get flushed on its first wake
+    if (log_task_handle) {
+        xTaskNotifyGive(log_task_handle);
+    }
 }
 
 /*
- * FULLY BLOCKING until all messages moved out of the uart TX buffer. Theoretically this is quick but who knows if
- * something goes wrong
+ * FULLY BLOCKING until the log ring is drained by the logger task and all messages moved out of the uart TX buffer.
+ * Theoretically this is quick but who knows if something goes wrong
  */
 void log_wait_until_all_tx() {
+    while (atomic_load(&enqueue_pos) != dequeue_pos) {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+
     uart_wait_tx_done(cli_uart_handle->port, portMAX_DELAY);
 }
 
 void log_set_max_log_level(log_level_t level) {
-    // I don't think we really have to worry about this since it's mostly for re-entrant log calls overwriting the
-    // buffer but why not
-    BaseType_t rval = xSemaphoreTake(mutex_handle, pdMS_TO_TICKS(50));
-    assert(rval == pdTRUE);
-
+    // Single word write, no need for locking now that log_log_line is lock-free
     max_log_level = level;
+}
+
+/*
+ * Switch between human-readable and tokenized binary output. Anything already queued goes out in the new format since
+ * records aren't formatted until the logger task pops them.
+ */
+void log_set_tokenized(bool enabled) {
+    tokenized = enabled;
+}
 
-    xSemaphoreGive(mutex_handle);
+bool log_get_tokenized() {
+    return tokenized;
 }
 
 /*
  * Hide single tag from appearing in log. Turns bit on because logic is inverted, 1s are blacklisted in bitmask
  */
 void log_hide_tag(sc_tag_t tag) {
-    tag_blacklist |= (1 << tag);
+    tag_blacklist |= (1UL << tag);
 }
 
 /*
  * Shows single tag in log if previously hidden. Turns bit off because logic is inverted, 0s are allowed in bitmask
  */
 void log_show_tag(sc_tag_t tag) {
-    tag_blacklist &= ~(1 << tag);
+    tag_blacklist &= ~(1UL << tag);
 }
 
 void log_show_all_tags() {
@@ -125,7 +697,8 @@ uint32_t log_get_tag_blacklist() {
 }
 
 /*
- * Gets time string for log prefix. Doesn't matter if SNTP synced yet, RTC will return time since boot if not.
+ * Gets time string for current time. Doesn't matter if SNTP synced yet, RTC will return time since boot if not. No
+ * longer used for the log line prefix (logger task formats that from the record timestamp) so not re-entrant safe.
  */
 char *log_get_time_str() {
     struct tm now_local = {0};
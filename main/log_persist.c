@@ -0,0 +1,320 @@
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "memfault/components.h"
+
+#include "constants.h"
+#include "flash_partition.h"
+#include "log.h"
+#include "log_persist.h"
+
+#define TAG SC_TAG_LOG_PERSIST
+
+/*
+ * Post-mortem log storage. The logger task appends every persisted line as a tokenized frame (same format as the
+ * tokenized uart output, decode with log_decoder.py) to a ring in RTC slow memory, which survives panics, watchdogs,
+ * and software resets (not power loss). If the partition table has a 'log' partition, the previous boot's ring is
+ * spilled into the next flash sector of it on boot so the last few boots survive power cycles too.
+ *
+ * Readers (CLI, http server, memfault CDR) get one linear byte stream of the flash sectors oldest to newest followed by
+ * the live RTC ring. Reads aren't synchronized with the logger task appending, so a frame at the very end of a read
+ * can be torn. The decoder resyncs on the next frame so that's fine.
+ */
+
+// Matches flash sector size so a full ring spills into exactly one sector (minus the header)
+#define LOG_PERSIST_RTC_BYTES (4096)
+#define LOG_PERSIST_RTC_MAGIC (0x5C106E55)
+#define LOG_PERSIST_FLASH_MAGIC (0x5C10F1A5)
+#define LOG_PERSIST_SECTOR_BYTES (4096)
+#define LOG_PERSIST_MAX_SECTORS (8)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t head;  // next byte written
+    uint32_t used;  // valid bytes, saturates at LOG_PERSIST_RTC_BYTES once wrapped
+    uint8_t  data[LOG_PERSIST_RTC_BYTES];
+} log_persist_rtc_ring_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t len;
+    uint32_t reserved;
+} log_persist_sector_header_t;
+
+#define LOG_PERSIST_SECTOR_DATA_BYTES (LOG_PERSIST_SECTOR_BYTES - sizeof(log_persist_sector_header_t))
+
+// Not zeroed on boot, validated by the magic instead
+static RTC_NOINIT_ATTR log_persist_rtc_ring_t rtc_ring;
+
+static const esp_partition_t *log_partition;
+static uint8_t                sector_count;
+static uint8_t                sector_order[LOG_PERSIST_MAX_SECTORS];  // sector indices oldest to newest
+static uint8_t                valid_sector_count;
+static uint32_t               sector_lens[LOG_PERSIST_MAX_SECTORS];
+static uint32_t               latest_seq;
+static size_t                 flash_bytes;
+static bool                   crash_reboot;
+static bool                   cdr_read;
+static size_t                 cdr_size;
+
+static void log_persist_rtc_reset() {
+    rtc_ring.magic = LOG_PERSIST_RTC_MAGIC;
+    rtc_ring.head  = 0;
+    rtc_ring.used  = 0;
+}
+
+static bool log_persist_rtc_valid() {
+    return rtc_ring.magic == LOG_PERSIST_RTC_MAGIC && rtc_ring.head < LOG_PERSIST_RTC_BYTES &&
+           rtc_ring.used <= LOG_PERSIST_RTC_BYTES;
+}
+
+/*
+ * Reads linearized bytes out of the RTC ring, offset 0 being the oldest valid byte
+ */
+static size_t log_persist_rtc_read(size_t offset, uint8_t *buffer, size_t len) {
+    if (offset >= rtc_ring.used) {
+        return 0;
+    }
+
+    len          = MIN(len, rtc_ring.used - offset);
+    size_t start = (rtc_ring.head + LOG_PERSIST_RTC_BYTES - rtc_ring.used + offset) % LOG_PERSIST_RTC_BYTES;
+    size_t first = MIN(len, LOG_PERSIST_RTC_BYTES - start);
+    memcpy(buffer, &rtc_ring.data[start], first);
+    memcpy(&buffer[first], rtc_ring.data, len - first);
+
+    return len;
+}
+
+/*
+ * Reads every sector header and builds the oldest to newest ordering by sequence number
+ */
+static void log_persist_scan_sectors() {
+    valid_sector_count = 0;
+    flash_bytes        = 0;
+    latest_seq         = 0;
+
+    uint32_t seqs[LOG_PERSIST_MAX_SECTORS];
+    for (uint8_t i = 0; i < sector_count; i++) {
+        log_persist_sector_header_t header;
+        esp_err_t err = esp_partition_read(log_partition, i * LOG_PERSIST_SECTOR_BYTES, &header, sizeof(header));
+        if (err != ESP_OK || header.magic != LOG_PERSIST_FLASH_MAGIC || header.len > LOG_PERSIST_SECTOR_DATA_BYTES) {
+            continue;
+        }
+
+        // Insertion sort by seq, at most 8 entries
+        uint8_t idx = valid_sector_count++;
+        while (idx > 0 && seqs[idx - 1] > header.seq) {
+            seqs[idx]         = seqs[idx - 1];
+            sector_order[idx] = sector_order[idx - 1];
+            sector_lens[idx]  = sector_lens[idx - 1];
+            idx--;
+        }
+        seqs[idx]         = header.seq;
+        sector_order[idx] = i;
+        sector_lens[idx]  = header.len;
+
+        flash_bytes += header.len;
+        latest_seq = MAX(latest_seq, header.seq);
+    }
+}
+
+/*
+ * Writes the whole current RTC ring into the sector after the newest one (or the oldest once all are used) and resets
+ * the ring. Only done once on boot so flash wear is one sector erase per boot.
+ */
+static void log_persist_spill_to_flash() {
+    uint8_t sector = 0;
+    if (valid_sector_count > 0) {
+        sector = (sector_order[valid_sector_count - 1] + 1) % sector_count;
+    }
+
+    esp_err_t err =
+        flash_partition_erase_range(log_partition, sector * LOG_PERSIST_SECTOR_BYTES, LOG_PERSIST_SECTOR_BYTES);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error erasing log partition sector %u: %s", sector, esp_err_to_name(err));
+        return;
+    }
+
+    // Ring is exactly a sector so lose the oldest few bytes to the header, decoder resyncs past any partial frame
+    size_t                      skip   = rtc_ring.used > LOG_PERSIST_SECTOR_DATA_BYTES
+                                             ? rtc_ring.used - LOG_PERSIST_SECTOR_DATA_BYTES
+                                             : 0;
+    log_persist_sector_header_t header = {
+        .magic = LOG_PERSIST_FLASH_MAGIC,
+        .seq   = latest_seq + 1,
+        .len   = rtc_ring.used - skip,
+    };
+
+    // Linearize in chunks through a small stack buffer since ring data wraps
+    uint8_t chunk[256];
+    size_t  written = 0;
+    while (written < header.len) {
+        size_t chunk_len = log_persist_rtc_read(skip + written, chunk, sizeof(chunk));
+        err              = flash_partition_write(log_partition,
+                                    sector * LOG_PERSIST_SECTOR_BYTES + sizeof(header) + written,
+                                    chunk,
+                                    chunk_len);
+        if (err != ESP_OK) {
+            log_printf(LOG_LEVEL_ERROR, "Error writing log partition sector %u: %s", sector, esp_err_to_name(err));
+            return;
+        }
+        written += chunk_len;
+    }
+
+    // Header last so a reset mid-spill leaves the sector invalid instead of half written
+    err = flash_partition_write(log_partition, sector * LOG_PERSIST_SECTOR_BYTES, &header, sizeof(header));
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error writing log partition header %u: %s", sector, esp_err_to_name(err));
+        return;
+    }
+
+    log_printf(LOG_LEVEL_INFO, "Spilled %lu bytes of previous boot log to flash sector %u", header.len, sector);
+    log_persist_rtc_reset();
+}
+
+static bool log_persist_has_cdr(sMemfaultCdrMetadata *metadata) {
+    if (!crash_reboot || cdr_read) {
+        return false;
+    }
+
+    static const char *mimetypes[] = {"application/octet-stream"};
+
+    // Snapshot the size, anything appended during the upload just doesn't make it in
+    cdr_size  = log_persist_get_size();
+    *metadata = (sMemfaultCdrMetadata){
+        .start_time.type   = kMemfaultCurrentTimeType_Unknown,
+        .mimetypes         = mimetypes,
+        .num_mimetypes     = MEMFAULT_ARRAY_SIZE(mimetypes),
+        .data_size_bytes   = cdr_size,
+        .duration_ms       = 0,
+        .collection_reason = "post-mortem tokenized log",
+    };
+
+    return cdr_size > 0;
+}
+
+static bool log_persist_read_cdr(uint32_t offset, void *data, size_t data_len) {
+    if (offset + data_len > cdr_size) {
+        return false;
+    }
+
+    // Pad with zeros if the ring moved underneath us, memfault requires the exact size we promised
+    size_t read = log_persist_read(offset, data, data_len);
+    memset((uint8_t *)data + read, 0x00, data_len - read);
+    return true;
+}
+
+static void log_persist_mark_cdr_read() {
+    cdr_read = true;
+}
+
+static const sMemfaultCdrSourceImpl log_persist_cdr_source = {
+    .has_cdr_cb       = log_persist_has_cdr,
+    .read_data_cb     = log_persist_read_cdr,
+    .mark_cdr_read_cb = log_persist_mark_cdr_read,
+};
+
+void log_persist_init() {
+    bool rtc_valid = log_persist_rtc_valid();
+    if (!rtc_valid) {
+        // Power on or first boot with this FW, nothing to recover
+        log_persist_rtc_reset();
+    }
+
+    esp_reset_reason_t reason = esp_reset_reason();
+    crash_reboot = (reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+                    reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT);
+    cdr_read     = false;
+
+    // Older devices in the field don't have the log partition in their table, RTC ring only for them
+    log_partition = flash_partition_get_log_partition();
+    if (log_partition) {
+        sector_count = MIN(log_partition->size / LOG_PERSIST_SECTOR_BYTES, LOG_PERSIST_MAX_SECTORS);
+        log_persist_scan_sectors();
+
+        if (rtc_valid && rtc_ring.used > 0) {
+            log_persist_spill_to_flash();
+            log_persist_scan_sectors();
+        }
+    }
+
+    memfault_cdr_register_source(&log_persist_cdr_source);
+
+    log_printf(LOG_LEVEL_INFO,
+               "Persistent log: %u bytes recovered in RTC, %u bytes in %u flash sectors%s",
+               rtc_ring.used,
+               flash_bytes,
+               valid_sector_count,
+               crash_reboot ? ", crash reboot so queued for memfault upload" : "");
+}
+
+/*
+ * Only called from the logger task
+ */
+void log_persist_append(const uint8_t *frame, size_t len) {
+    if (len > LOG_PERSIST_RTC_BYTES) {
+        return;
+    }
+
+    size_t first = MIN(len, LOG_PERSIST_RTC_BYTES - rtc_ring.head);
+    memcpy(&rtc_ring.data[rtc_ring.head], frame, first);
+    memcpy(rtc_ring.data, &frame[first], len - first);
+
+    rtc_ring.head = (rtc_ring.head + len) % LOG_PERSIST_RTC_BYTES;
+    rtc_ring.used = MIN(rtc_ring.used + len, LOG_PERSIST_RTC_BYTES);
+}
+
+size_t log_persist_get_size() {
+    return flash_bytes + rtc_ring.used;
+}
+
+/*
+ * Reads from the single linear stream of flash sectors (oldest first) followed by the RTC ring. Returns bytes read,
+ * less than len only at the end of the stream.
+ */
+size_t log_persist_read(size_t offset, uint8_t *buffer, size_t len) {
+    size_t total_read = 0;
+
+    for (uint8_t i = 0; i < valid_sector_count && len > 0; i++) {
+        if (offset >= sector_lens[i]) {
+            offset -= sector_lens[i];
+            continue;
+        }
+
+        size_t    chunk_len = MIN(len, sector_lens[i] - offset);
+        esp_err_t err       = esp_partition_read(log_partition,
+                                           sector_order[i] * LOG_PERSIST_SECTOR_BYTES +
+                                               sizeof(log_persist_sector_header_t) + offset,
+                                           &buffer[total_read],
+                                           chunk_len);
+        if (err != ESP_OK) {
+            return total_read;
+        }
+
+        total_read += chunk_len;
+        len -= chunk_len;
+        offset = 0;
+    }
+
+    if (len > 0) {
+        total_read += log_persist_rtc_read(offset, &buffer[total_read], len);
+    }
+
+    return total_read;
+}
+
+void log_persist_clear() {
+    log_persist_rtc_reset();
+
+    if (log_partition) {
+        esp_err_t err =
+            flash_partition_erase_range(log_partition, 0, sector_count * LOG_PERSIST_SECTOR_BYTES);
+        if (err != ESP_OK) {
+            log_printf(LOG_LEVEL_ERROR, "Error erasing log partition: %s", esp_err_to_name(err));
+        }
+        log_persist_scan_sectors();
+    }
+}
@@ -28,8 +28,11 @@
 #include "i2c.h"
 #include "json.h"
 #include "mdns_local.h"
+#include "memory_budget.h"
 #include "nvs.h"
 #include "ota_task.h"
+#include "power_policy.h"
+#include "push_channel.h"
 #include "scheduler_task.h"
 #include "screen_img_handler.h"
 #include "sleep_handler.h"
@@ -37,6 +40,7 @@
 #include "spot_check.h"
 #include "timer.h"
 #include "uart.h"
+#include "uart_xfer.h"
 #include "wifi.h"
 
 #include "log.h"
@@ -49,12 +53,12 @@
 #define SHIFTREG_STROBE_PIN GPIO_NUM_12
 
 static uart_handle_t cli_uart_handle;
+static char          cli_uart_rx_buffer[CLI_UART_RX_BUFFER_BYTES];
 static i2c_handle_t  bq24196_i2c_handle;
 
 /*
- * Trigger mflt then wait 2 seconds to make sure scheduler begins executing mflt upload. Then trigger ota check so it
- * has to wait until scheduler loops back around to process the new event bit, otherwise the un-locked ota http reqs
- * will break the mflt one. This is a temporary hack until the http req system is refactored.
+ * Kick off the first full memfault upload and OTA check together. Scheduler always runs the upload before starting the
+ * async OTA task in the same round, so they can't step on each other.
  */
 static void special_case_boot_delayed_callback() {
     if (scheduler_get_mode() == SCHEDULER_MODE_INIT) {
@@ -69,8 +73,6 @@ static void special_case_boot_delayed_callback() {
     memfault_packetizer_set_active_sources(kMfltDataSourceMask_All);
 
     scheduler_schedule_mflt_upload();
-    scheduler_trigger();
-    vTaskDelay(pdMS_TO_TICKS(2000));
     scheduler_schedule_ota_check();
     scheduler_trigger();
     log_printf(LOG_LEVEL_DEBUG, "Exiting special case boot delay callback");
@@ -79,14 +81,16 @@ static void special_case_boot_delayed_callback() {
 static void app_init() {
     // ESP_ERROR_CHECK(esp_task_wdt_init());
 
-    // NULL passed for process_char callback, see cli_task_init for reasoning
+    // NULL passed for process_bytes callback, see cli_task_init for reasoning
     uart_init(CLI_UART,
               CLI_UART_RX_RING_BUFFER_BYTES,
               CLI_UART_TX_RING_BUFFER_BYTES,
               CLI_UART_QUEUE_SIZE,
-              CLI_UART_RX_BUFFER_BYTES,
+              cli_uart_rx_buffer,
+              sizeof(cli_uart_rx_buffer),
               NULL,
               &cli_uart_handle);
+    memory_budget_register_buffer("cli uart rx", sizeof(cli_uart_rx_buffer));
     log_init(&cli_uart_handle);
     nvs_init();
     spot_check_init();
@@ -111,10 +115,15 @@ static void app_init() {
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     mdns_local_init();
     wifi_init();
+    power_policy_init();
     http_client_init();
+    memfault_interface_init();
 
     scheduler_task_init();
+    ota_task_init();
+    push_channel_init();
     cli_task_init(&cli_uart_handle);
+    uart_xfer_init(&cli_uart_handle);
     cli_command_register_all();
 }
 
@@ -146,11 +155,18 @@ void app_main(void) {
     info_buffer = NULL;
 
     app_start();
+    memory_budget_print_report();
 
     spot_check_config_t *config = nvs_get_config();
     log_printf(LOG_LEVEL_INFO, "Operating mode: '%s'", spot_check_mode_to_string(config->operating_mode));
     sntp_set_tz_str(config->tz_str);
-    display_render_splash_screen(spot_check_get_fw_version(), spot_check_get_hw_version());
+
+    // If the display restored last boot's screen, leave it up through the connection checks instead of the splash and
+    // connecting screens, the scheduler's first round draws straight over it. Error screens still full clear.
+    bool show_boot_screens = !display_panel_state_restored();
+    if (show_boot_screens) {
+        display_render_splash_screen(spot_check_get_fw_version(), spot_check_get_hw_version());
+    }
 
     // Enable breakout at each connectivity check of boot
     do {
@@ -176,7 +192,8 @@ void app_main(void) {
         while (!wifi_is_connected_to_network() && scheduler_get_mode() == SCHEDULER_MODE_INIT &&
                (current_wait_secs < max_wait_secs)) {
             log_printf(LOG_LEVEL_INFO, "Waiting for connection to wifi network and IP assignment");
-            vTaskDelay(pdMS_TO_TICKS(1000));
+            // Returns as soon as we get an IP instead of sleeping out the rest of the second
+            wifi_block_until_connected_timeout(1000);
 
             // TODO :: I don't think this is actually doing anything, need a way to actually test it
             if (current_wait_secs == 30) {
@@ -206,8 +223,10 @@ void app_main(void) {
         }
 
         // Update splash screen with fetching data text, then check actual internet connection
-        spot_check_show_checking_connection_screen();
-        spot_check_render();
+        if (show_boot_screens) {
+            spot_check_show_checking_connection_screen();
+            spot_check_render();
+        }
         if (!http_client_check_internet()) {
             log_printf(LOG_LEVEL_WARN,
                        "Failed healthcheck after being assigned IP. Waiting 5 seconds then trying again.");
@@ -259,15 +278,17 @@ void app_main(void) {
         // TODO ::show time date and spot name here while other network stuff is fetched
         // All checks passed for full boot. Show fetching conditions screen then switching scheduler to online mode.
         // This will force update everything and thendo one big render.
-        spot_check_clear_checking_connection_screen();
+        if (show_boot_screens) {
+            spot_check_clear_checking_connection_screen();
+        }
         scheduler_set_online_mode();
 
         log_printf(LOG_LEVEL_INFO, "Boot successful, kicking scheduler taks into online mode");
     } while (0);
 
-    // Delay a minute before we run the on-boot delayed actions. This is because both mflt's http client and the
-    // esp ota version header check for the server image use their own internal http_client, so we can't force them to
-    // obey our http_client module request lock. For a normal boot, waiting a minute or two ensures no further network
+    // Delay a minute before we run the on-boot delayed actions. This is because the esp ota image download (only opened
+    // when version_info says an update is needed) uses its own internal http_client, so we can't force it to obey our
+    // http_client module request lock. For a normal boot, waiting a minute or two ensures no further network
     // connections will be running. There's still the risk of edge cases for a late internet connection or provisioning
     // that would force http errors from reqs stommping each other, so this is just a dirtyish fix for now.
     uint8_t       initial_boot_delay_min = 1;
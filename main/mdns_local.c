@@ -1,13 +1,21 @@
+#include <stdio.h>
+
 #include "log.h"
 #include "mdns.h"
 #include "memfault/panics/assert.h"
 
 #include "constants.h"
 #include "mdns_local.h"
+#include "spot_check.h"
 
 #define TAG SC_TAG_MDNS
 
+// Port the http server listens on, advertised in the txt record since the service port predates it
+#define MDNS_LOCAL_HTTP_PORT_STR "80"
+
 static char *hostname = "spot-check";
+// "Spot Check " + serial, e.g. "Spot Check 7c-df-a1-00-11-22"
+static char instance_name[32];
 
 static bool mdns_advertising = false;
 
@@ -21,8 +29,11 @@ void mdns_local_init() {
     // discovered by an external device by querying the _spot-check mDNS service
     mdns_hostname_set(hostname);
 
-    // Instance name is the readable text supplied from the initial mDNS lookup of  _spot-check
-    mdns_instance_name_set("Spot Check");
+    // Instance name is the readable text supplied from the initial mDNS lookup of  _spot-check. Every device shares the
+    // hostname, so the serial here is what lets a browser tell a room full of them apart. Serial must already be set by
+    // spot_check_init.
+    snprintf(instance_name, sizeof(instance_name), "Spot Check %s", spot_check_get_serial());
+    mdns_instance_name_set(instance_name);
 
     log_printf(LOG_LEVEL_INFO, "mDNS initialized");
 }
@@ -33,9 +44,18 @@ void mdns_advertise_tcp_service() {
                    "mdns_advertise_tcp_service re-called after reconnection to wifi, skipping call to add new service "
                    "since previous should still exist");
     } else {
-        unsigned int port = 5207;
-        ESP_ERROR_CHECK(mdns_service_add(NULL, "_spot-check", "_tcp", port, NULL, 0));
+        unsigned int    port  = 5207;
+        mdns_txt_item_t txt[] = {
+            {"serial", spot_check_get_serial()},
+            {"fw", spot_check_get_fw_version()},
+            {"http_port", MDNS_LOCAL_HTTP_PORT_STR},
+        };
+        ESP_ERROR_CHECK(mdns_service_add(NULL, "_spot-check", "_tcp", port, txt, sizeof(txt) / sizeof(txt[0])));
         mdns_advertising = true;
-        log_printf(LOG_LEVEL_INFO, "Advertising _spot-check mDNS service on port %d with hostname %s", port, hostname);
+        log_printf(LOG_LEVEL_INFO,
+                   "Advertising _spot-check mDNS service on port %d with hostname %s as '%s'",
+                   port,
+                   hostname,
+                   instance_name);
     }
 }
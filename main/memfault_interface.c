@@ -4,52 +4,84 @@
 #include "memfault/http/http_client.h"
 
 #include "cli_task.h"
+#include "flash_partition.h"
+#include "http_client.h"
 #include "log.h"
+#include "memory_budget.h"
 #include "ota_task.h"
+#include "power_policy.h"
+#include "push_channel.h"
 #include "scheduler_task.h"
 
 #define TAG SC_TAG_MFLT_INTRFC
 
-#define UPLOAD_TIMEOUT_MS (30 * MS_PER_SEC)
+// Heartbeats and events fit in one chunk, coredumps take a bunch
+#define MEMFAULT_INTERFACE_CHUNK_BYTES (4 * 1024)
+// Caps how long one upload can hold up the scheduler loop. Whatever's left goes out with the next burst.
+#define MEMFAULT_INTERFACE_MAX_CHUNKS_PER_UPLOAD (64)
+
+// Only ever used from one upload at a time, all called from the scheduler task (or main before it starts)
+static uint8_t chunk_buffer[MEMFAULT_INTERFACE_CHUNK_BYTES];
+
+void memfault_interface_init() {
+    memory_budget_register_buffer("memfault chunk", sizeof(chunk_buffer));
+}
 
 /*
- * Returns success
+ * Drains the packetizer through our own http client instead of the memfault one so uploads share the request lock and
+ * go out alongside the scheduler's other requests. Every chunk of an upload goes over one keep-alive connection so the
+ * TLS handshake is only paid once. Returns success.
  */
 bool memfault_interface_post_data() {
+    if (!memfault_packetizer_data_available()) {
+        log_printf(LOG_LEVEL_DEBUG, "No heartbeat or coredump data to upload.");
+        return true;
+    }
+
     log_printf(LOG_LEVEL_INFO, "Executing memfault upload function");
 
-    sMfltHttpClient *http_client = memfault_http_client_create();
-    if (!http_client) {
-        log_printf(LOG_LEVEL_ERROR, "Failed to create memfault http_client");
+    char url[MEMFAULT_HTTP_URL_BUFFER_SIZE];
+    memfault_http_build_url(url, MEMFAULT_HTTP_CHUNKS_API_SUBPATH);
+    query_param headers[] = {
+        {.key = MEMFAULT_HTTP_PROJECT_KEY_HEADER, .value = (char *)g_mflt_http_client_config.api_key},
+    };
+
+    esp_http_client_handle_t client = http_client_open_upload(url, "application/octet-stream", headers, 1);
+    if (!client) {
+        log_printf(LOG_LEVEL_ERROR, "Memfault upload failed to open client, will retry next upload");
         return false;
     }
 
-    bool success = false;
-    int  err     = 0;
-    do {
-        eMfltPostDataStatus post_err = memfault_http_client_post_data(http_client);
-        success = (post_err == kMfltPostDataStatus_NoDataFound || post_err == kMfltPostDataStatus_Success);
-        if (post_err == kMfltPostDataStatus_NoDataFound) {
-            log_printf(LOG_LEVEL_DEBUG, "No heartbeat or coredump data to upload.");
-            break;
-        } else if (post_err < 0) {
-            log_printf(LOG_LEVEL_ERROR, "Error in initial call to memfault post data func: %d", post_err);
+    bool     success     = true;
+    uint32_t chunks_sent = 0;
+    size_t   bytes_sent  = 0;
+    while (chunks_sent < MEMFAULT_INTERFACE_MAX_CHUNKS_PER_UPLOAD) {
+        size_t chunk_len = sizeof(chunk_buffer);
+        if (!memfault_packetizer_get_chunk(chunk_buffer, &chunk_len)) {
             break;
         }
 
-        err     = memfault_http_client_wait_until_requests_completed(http_client, UPLOAD_TIMEOUT_MS);
-        success = (err == 0);
-        if (success) {
-            log_printf(LOG_LEVEL_INFO, "Successfully uploaded all available data to memfault");
-        } else {
-            log_printf(LOG_LEVEL_ERROR, "Error waiting until mflt http req completed: %d", err);
+        if (!http_client_upload(client, (const char *)chunk_buffer, chunk_len)) {
+            // Rewinds to the start of the current message so nothing is lost, it all goes again next upload
+            memfault_packetizer_abort();
+            success = false;
+            break;
         }
-    } while (0);
 
-    err     = memfault_http_client_destroy(http_client);
-    success = (err == 0);
-    if (!success) {
-        log_printf(LOG_LEVEL_ERROR, "Error tearing down memfault http client: %d", err);
+        chunks_sent++;
+        bytes_sent += chunk_len;
+    }
+
+    http_client_close_upload(client);
+
+    if (success) {
+        log_printf(LOG_LEVEL_INFO,
+                   "Uploaded %lu memfault chunks (%u bytes)%s",
+                   chunks_sent,
+                   bytes_sent,
+                   memfault_packetizer_data_available() ? ", more left for next upload" : "");
+    } else {
+        log_printf(LOG_LEVEL_ERROR, "Memfault upload failed after %lu chunks, will retry next upload", chunks_sent);
     }
 
     return success;
@@ -63,18 +95,28 @@ void memfault_metrics_heartbeat_collect_data() {
     size_t      free                  = heap_caps_get_free_size(MALLOC_CAP_8BIT);
     size_t      min_free              = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
     size_t      largest_block         = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
-    UBaseType_t cli_total_words       = cli_task_get_stack_high_water();
-    UBaseType_t ota_total_words       = ota_task_get_stack_high_water();
-    UBaseType_t scheduler_total_words = scheduler_task_get_stack_high_water();
+    // esp-idf stacks are in bytes, so are the high water marks
+    UBaseType_t cli_stack_bytes       = cli_task_get_stack_high_water();
+    UBaseType_t ota_stack_bytes       = ota_task_get_stack_high_water();
+    UBaseType_t scheduler_stack_bytes = scheduler_task_get_stack_high_water();
+    UBaseType_t push_stack_bytes      = push_channel_get_stack_high_water();
+    uint32_t    flash_erase_us        = 0;
+    uint32_t    flash_write_us        = 0;
+    flash_partition_take_timing(&flash_erase_us, &flash_write_us);
 
     memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(total_heap_bytes), total);
     memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(free_heap_bytes), free);
     memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(low_watermark_heap_bytes), min_free);
     memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(largest_free_heap_block_bytes), largest_block);
-    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(cli_task_high_water_stack_bytes),
-                                            cli_total_words * sizeof(uint32_t));
-    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(ota_task_high_water_stack_bytes),
-                                            ota_total_words * sizeof(uint32_t));
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(cli_task_high_water_stack_bytes), cli_stack_bytes);
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(ota_task_high_water_stack_bytes), ota_stack_bytes);
     memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(scheduler_task_high_water_stack_bytes),
-                                            scheduler_total_words * sizeof(uint32_t));
+                                            scheduler_stack_bytes);
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(push_channel_task_high_water_stack_bytes),
+                                            push_stack_bytes);
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(scheduler_loop_max_ms),
+                                            scheduler_task_take_loop_max_ms());
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(power_tier), power_policy_get_tier());
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(flash_erase_us), flash_erase_us);
+    memfault_metrics_heartbeat_set_unsigned(MEMFAULT_METRICS_KEY(flash_write_us), flash_write_us);
 }
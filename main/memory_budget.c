@@ -0,0 +1,116 @@
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "memfault/panics/assert.h"
+
+#include "memory_budget.h"
+
+#include "constants.h"
+#include "log.h"
+
+// No tag of its own, sc_tag_t is at the 32 the log blacklist bitmask can hold. The map is metrics output anyway.
+#define TAG SC_TAG_METRICS
+
+typedef struct {
+    const char   *name;
+    size_t        bytes;
+    TaskHandle_t *task_handle;  // only set for stacks, points at the owning module's handle so it can be NULL
+} memory_budget_region_t;
+
+// Linker symbols for internal dram sections
+extern int _data_start;
+extern int _data_end;
+extern int _bss_start;
+extern int _bss_end;
+
+static memory_budget_region_t regions[MEMORY_BUDGET_MAX_REGIONS];
+static uint8_t                num_regions;
+
+static void memory_budget_register(const char *name, size_t bytes, TaskHandle_t *task_handle) {
+    MEMFAULT_ASSERT(num_regions < MEMORY_BUDGET_MAX_REGIONS);
+
+    regions[num_regions].name        = name;
+    regions[num_regions].bytes       = bytes;
+    regions[num_regions].task_handle = task_handle;
+    num_regions++;
+}
+
+static void memory_budget_print_heap(const char *name, uint32_t caps) {
+    size_t total = heap_caps_get_total_size(caps);
+    if (total == 0) {
+        return;
+    }
+
+    log_printf(LOG_LEVEL_INFO,
+               "  heap %-8s %7zu total, %7zu free, %7zu min free, %7zu largest block",
+               name,
+               total,
+               heap_caps_get_free_size(caps),
+               heap_caps_get_minimum_free_size(caps),
+               heap_caps_get_largest_free_block(caps));
+}
+
+/*
+ * Regions are only registered from module init functions during boot, so there's no locking on the table
+ */
+void memory_budget_register_buffer(const char *name, size_t bytes) {
+    memory_budget_register(name, bytes, NULL);
+}
+
+void memory_budget_register_stack(const char *name, size_t bytes, TaskHandle_t *task_handle) {
+    MEMFAULT_ASSERT(task_handle);
+    memory_budget_register(name, bytes, task_handle);
+}
+
+/*
+ * Dumps every registered static region, the dram sections they're linked into, and the state of each heap. Stack high
+ * water marks are only as good as how long the task has been running, run it again from the cli after some uptime.
+ */
+void memory_budget_print_report() {
+    size_t stack_total  = 0;
+    size_t buffer_total = 0;
+
+    log_printf(LOG_LEVEL_INFO, "Memory map (bytes):");
+    for (uint8_t i = 0; i < num_regions; i++) {
+        memory_budget_region_t *region = &regions[i];
+        if (region->task_handle == NULL) {
+            buffer_total += region->bytes;
+            log_printf(LOG_LEVEL_INFO, "  buffer %-20s %7zu", region->name, region->bytes);
+            continue;
+        }
+
+        stack_total += region->bytes;
+        if (*region->task_handle == NULL) {
+            log_printf(LOG_LEVEL_INFO, "  stack  %-20s %7zu (not running)", region->name, region->bytes);
+        } else {
+            // esp-idf stacks are in bytes, so is the high water mark
+            UBaseType_t never_used = uxTaskGetStackHighWaterMark(*region->task_handle);
+            if (never_used < MEMORY_BUDGET_STACK_HEADROOM_BYTES) {
+                log_printf(LOG_LEVEL_WARN,
+                           "  stack  %-20s %7zu (%u never used, into the %u headroom)",
+                           region->name,
+                           region->bytes,
+                           never_used,
+                           MEMORY_BUDGET_STACK_HEADROOM_BYTES);
+            } else {
+                log_printf(LOG_LEVEL_INFO,
+                           "  stack  %-20s %7zu (%u never used)",
+                           region->name,
+                           region->bytes,
+                           never_used);
+            }
+        }
+    }
+
+    log_printf(LOG_LEVEL_INFO,
+               "  static total %zu (%zu stacks, %zu buffers)",
+               stack_total + buffer_total,
+               stack_total,
+               buffer_total);
+    log_printf(LOG_LEVEL_INFO,
+               "  dram .data %u, .bss %u",
+               (uintptr_t)&_data_end - (uintptr_t)&_data_start,
+               (uintptr_t)&_bss_end - (uintptr_t)&_bss_start);
+    memory_budget_print_heap("internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    memory_budget_print_heap("psram", MALLOC_CAP_SPIRAM);
+}
@@ -0,0 +1,252 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_heap_caps.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "metrics.h"
+
+#include "cli_task.h"
+#include "constants.h"
+#include "http_client.h"
+#include "log.h"
+#include "ota_task.h"
+#include "power_policy.h"
+#include "push_channel.h"
+#include "scheduler_task.h"
+#include "wifi.h"
+
+#define TAG SC_TAG_METRICS
+
+/*
+ * Prometheus text exposition (format version 0.0.4) of the same kind of stuff we send in memfault heartbeats, plus
+ * timings and scheduler state that are handy to scrape from a lab/fleet prometheus without waiting on an upload. Every
+ * value is read at scrape time except the durations, which are pushed in here by whatever does the work.
+ */
+
+#define METRICS_LINE_BUFFER_BYTES (160)
+
+typedef struct {
+    uint32_t last_ms;
+    uint32_t max_ms;
+    uint32_t count;
+    uint64_t sum_ms;
+} metrics_duration_stats_t;
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t    err;
+} metrics_writer_t;
+
+static const char *const duration_names[METRICS_DURATION_COUNT] = {
+    [METRICS_DURATION_RENDER]              = "render",
+    [METRICS_DURATION_SCREEN_IMG_DOWNLOAD] = "screen_img_download",
+    [METRICS_DURATION_OTA_DOWNLOAD]        = "ota_download",
+};
+
+static metrics_duration_stats_t durations[METRICS_DURATION_COUNT];
+static portMUX_TYPE             durations_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * Formats one line and sends it as its own chunk. Once a send fails every following call is a no-op so the caller
+ * can write all its lines and check the error once at the end.
+ */
+static void metrics_write_line(metrics_writer_t *writer, const char *fmt, ...) {
+    if (writer->err != ESP_OK) {
+        return;
+    }
+
+    char    line[METRICS_LINE_BUFFER_BYTES];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+
+    if (len < 0) {
+        return;
+    }
+
+    // Truncated lines still get their newline so the next one isn't mangled into it
+    len         = MIN(len, (int)sizeof(line) - 2);
+    line[len++] = '\n';
+    writer->err = httpd_resp_send_chunk(writer->req, line, len);
+}
+
+static void metrics_write_header(metrics_writer_t *writer, const char *name, const char *type, const char *help) {
+    metrics_write_line(writer, "# HELP spot_check_%s %s", name, help);
+    metrics_write_line(writer, "# TYPE spot_check_%s %s", name, type);
+}
+
+static void metrics_write_heap(metrics_writer_t *writer) {
+    metrics_write_header(writer, "heap_total_bytes", "gauge", "Total 8-bit capable heap");
+    metrics_write_line(writer, "spot_check_heap_total_bytes %zu", heap_caps_get_total_size(MALLOC_CAP_8BIT));
+    metrics_write_header(writer, "heap_free_bytes", "gauge", "Free 8-bit capable heap");
+    metrics_write_line(writer, "spot_check_heap_free_bytes %zu", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    metrics_write_header(writer, "heap_min_free_bytes", "gauge", "Lowest free 8-bit capable heap since boot");
+    metrics_write_line(writer, "spot_check_heap_min_free_bytes %zu", heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    metrics_write_header(writer, "heap_largest_free_block_bytes", "gauge", "Largest free 8-bit capable heap block");
+    metrics_write_line(writer,
+                       "spot_check_heap_largest_free_block_bytes %zu",
+                       heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+static void metrics_write_stacks(metrics_writer_t *writer) {
+    metrics_write_header(writer,
+                         "task_stack_high_water_bytes",
+                         "gauge",
+                         "Minimum free stack seen for the task, 0 if it isn't running");
+    metrics_write_line(writer,
+                       "spot_check_task_stack_high_water_bytes{task=\"cli\"} %u",
+                       cli_task_get_stack_high_water());
+    metrics_write_line(writer,
+                       "spot_check_task_stack_high_water_bytes{task=\"ota\"} %u",
+                       ota_task_get_stack_high_water());
+    metrics_write_line(writer,
+                       "spot_check_task_stack_high_water_bytes{task=\"scheduler\"} %u",
+                       scheduler_task_get_stack_high_water());
+    metrics_write_line(writer,
+                       "spot_check_task_stack_high_water_bytes{task=\"push_channel\"} %u",
+                       push_channel_get_stack_high_water());
+}
+
+static void metrics_write_durations(metrics_writer_t *writer) {
+    metrics_duration_stats_t snapshot[METRICS_DURATION_COUNT];
+    taskENTER_CRITICAL(&durations_lock);
+    memcpy(snapshot, durations, sizeof(snapshot));
+    taskEXIT_CRITICAL(&durations_lock);
+
+    metrics_write_header(writer, "duration_seconds", "summary", "Time taken by render/download/OTA operations");
+    for (int i = 0; i < METRICS_DURATION_COUNT; i++) {
+        metrics_write_line(writer,
+                           "spot_check_duration_seconds_sum{op=\"%s\"} %llu.%03llu",
+                           duration_names[i],
+                           snapshot[i].sum_ms / MS_PER_SEC,
+                           snapshot[i].sum_ms % MS_PER_SEC);
+        metrics_write_line(writer,
+                           "spot_check_duration_seconds_count{op=\"%s\"} %lu",
+                           duration_names[i],
+                           snapshot[i].count);
+    }
+
+    metrics_write_header(writer, "duration_last_seconds", "gauge", "Time taken by the most recent operation");
+    for (int i = 0; i < METRICS_DURATION_COUNT; i++) {
+        metrics_write_line(writer,
+                           "spot_check_duration_last_seconds{op=\"%s\"} %lu.%03lu",
+                           duration_names[i],
+                           snapshot[i].last_ms / MS_PER_SEC,
+                           snapshot[i].last_ms % MS_PER_SEC);
+    }
+
+    metrics_write_header(writer, "duration_max_seconds", "gauge", "Longest operation since boot");
+    for (int i = 0; i < METRICS_DURATION_COUNT; i++) {
+        metrics_write_line(writer,
+                           "spot_check_duration_max_seconds{op=\"%s\"} %lu.%03lu",
+                           duration_names[i],
+                           snapshot[i].max_ms / MS_PER_SEC,
+                           snapshot[i].max_ms % MS_PER_SEC);
+    }
+}
+
+static void metrics_write_http_failures(metrics_writer_t *writer) {
+    uint16_t get_failures;
+    uint16_t post_failures;
+    http_client_get_failures(&get_failures, &post_failures);
+
+    metrics_write_header(writer, "http_failures_total", "counter", "Failed http client requests since boot");
+    metrics_write_line(writer, "spot_check_http_failures_total{method=\"get\"} %u", get_failures);
+    metrics_write_line(writer, "spot_check_http_failures_total{method=\"post\"} %u", post_failures);
+}
+
+static void metrics_write_scheduler(metrics_writer_t *writer) {
+    metrics_write_header(writer,
+                         "scheduler_last_update_timestamp_seconds",
+                         "gauge",
+                         "Epoch time each scheduler update last executed, 0 if it hasn't this boot");
+
+    const char *name;
+    time_t      last_executed;
+    for (uint8_t i = 0; i < scheduler_get_update_count(); i++) {
+        if (!scheduler_get_update_last_executed(i, &name, &last_executed)) {
+            break;
+        }
+
+        metrics_write_line(writer,
+                           "spot_check_scheduler_last_update_timestamp_seconds{update=\"%s\"} %lld",
+                           name,
+                           (long long)last_executed);
+    }
+}
+
+static void metrics_write_radio(metrics_writer_t *writer) {
+    uint64_t radio_on_ms = power_policy_get_radio_on_ms();
+    metrics_write_header(writer, "radio_on_seconds_total", "counter", "Time the wifi radio has been on since boot");
+    metrics_write_line(writer,
+                       "spot_check_radio_on_seconds_total %llu.%03llu",
+                       radio_on_ms / MS_PER_SEC,
+                       radio_on_ms % MS_PER_SEC);
+}
+
+static void metrics_write_power(metrics_writer_t *writer) {
+    power_tier_t tier = power_policy_get_tier();
+    metrics_write_header(writer, "power_tier", "gauge", "1 for the current power tier, 0 for the others");
+    for (power_tier_t i = POWER_TIER_USB; i < POWER_TIER_COUNT; i++) {
+        metrics_write_line(writer,
+                           "spot_check_power_tier{tier=\"%s\"} %d",
+                           power_policy_tier_to_string(i),
+                           i == tier);
+    }
+}
+
+static void metrics_write_wifi(metrics_writer_t *writer) {
+    // Leave the series out entirely when disconnected rather than reporting a made up rssi
+    wifi_ap_record_t ap_info;
+    if (!wifi_is_connected_to_network() || esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+
+    metrics_write_header(writer, "wifi_rssi_dbm", "gauge", "RSSI of the connected AP");
+    metrics_write_line(writer, "spot_check_wifi_rssi_dbm %d", ap_info.rssi);
+}
+
+void metrics_record_duration(metrics_duration_t duration, uint32_t ms) {
+    if (duration >= METRICS_DURATION_COUNT) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&durations_lock);
+    metrics_duration_stats_t *stats = &durations[duration];
+    stats->last_ms                  = ms;
+    stats->max_ms                   = MAX(stats->max_ms, ms);
+    stats->count++;
+    stats->sum_ms += ms;
+    taskEXIT_CRITICAL(&durations_lock);
+}
+
+esp_err_t metrics_send_prometheus(httpd_req_t *req) {
+    metrics_writer_t writer = {
+        .req = req,
+        .err = ESP_OK,
+    };
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    metrics_write_heap(&writer);
+    metrics_write_stacks(&writer);
+    metrics_write_durations(&writer);
+    metrics_write_http_failures(&writer);
+    metrics_write_scheduler(&writer);
+    metrics_write_radio(&writer);
+    metrics_write_power(&writer);
+    metrics_write_wifi(&writer);
+
+    if (writer.err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error sending metrics: %s", esp_err_to_name(writer.err));
+        return writer.err;
+    }
+
+    // Zero length chunk ends the response
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
@@ -31,6 +31,7 @@ static char _tz_str[MAX_LENGTH_TZ_STR_PARAM + 1]                       = {0};
 static char _tz_display_name[MAX_LENGTH_TZ_DISPLAY_NAME_PARAM + 1]     = {0};
 static char _operating_mode[MAX_LENGTH_OPERATING_MODE_PARAM + 1]       = {0};
 static char _custom_screen_url[MAX_LENGTH_CUSTOM_SCREEN_URL_PARAM + 1] = {0};
+static char _custom_push_url[MAX_LENGTH_CUSTOM_PUSH_URL_PARAM + 1]     = {0};
 
 static spot_check_config_t current_config;
 
@@ -70,6 +71,9 @@ static spot_check_config_t *nvs_load_config() {
                    &max_bytes_to_write,
                    "https://spotcheck.brianteam.com/custom_screen_test_image");
 
+    max_bytes_to_write = MAX_LENGTH_CUSTOM_PUSH_URL_PARAM;
+    nvs_get_string("custom_push_url", _custom_push_url, &max_bytes_to_write, "");
+
     uint32_t temp_custom_update_interval_secs = 0;
     nvs_get_uint32("custom_ui_secs", &temp_custom_update_interval_secs, 900);
 
@@ -104,6 +108,7 @@ static spot_check_config_t *nvs_load_config() {
     current_config.tz_display_name             = _tz_display_name;
     current_config.operating_mode              = spot_check_string_to_mode(_operating_mode);
     current_config.custom_screen_url           = _custom_screen_url;
+    current_config.custom_push_url             = _custom_push_url;
     current_config.custom_update_interval_secs = temp_custom_update_interval_secs;
     current_config.active_chart_1              = active_chart_1;
     current_config.active_chart_2              = active_chart_2;
@@ -298,6 +303,7 @@ void nvs_print_config(log_level_t level) {
             log_printf(LOG_LEVEL_INFO, "tz_display_name: %s", current_config.tz_display_name);
             log_printf(LOG_LEVEL_INFO, "operating_mode: %s", spot_check_mode_to_string(current_config.operating_mode));
             log_printf(LOG_LEVEL_INFO, "custom_scrn_url: %s", current_config.custom_screen_url);
+            log_printf(LOG_LEVEL_INFO, "custom_push_url: %s", current_config.custom_push_url);
             log_printf(LOG_LEVEL_INFO, "custom_ui_secs: %lu", current_config.custom_update_interval_secs);
             log_printf(LOG_LEVEL_INFO, "active_chart_1: %u", current_config.active_chart_1);
             log_printf(LOG_LEVEL_INFO, "active_chart_2: %u", current_config.active_chart_2);
@@ -312,6 +318,7 @@ void nvs_print_config(log_level_t level) {
             log_printf(LOG_LEVEL_DEBUG, "tz_display_name: %s", current_config.tz_display_name);
             log_printf(LOG_LEVEL_DEBUG, "operating_mode: %s", spot_check_mode_to_string(current_config.operating_mode));
             log_printf(LOG_LEVEL_DEBUG, "custom_scrn_url: %s", current_config.custom_screen_url);
+            log_printf(LOG_LEVEL_DEBUG, "custom_push_url: %s", current_config.custom_push_url);
             log_printf(LOG_LEVEL_DEBUG, "custom_ui_secs: %lu", current_config.custom_update_interval_secs);
             log_printf(LOG_LEVEL_DEBUG, "active_chart_1: %u", current_config.active_chart_1);
             log_printf(LOG_LEVEL_DEBUG, "active_chart_2: %u", current_config.active_chart_2);
@@ -345,6 +352,7 @@ void nvs_save_config(spot_check_config_t *config) {
     MEMFAULT_ASSERT(nvs_set_string("tz_display_name", config->tz_display_name));
     MEMFAULT_ASSERT(nvs_set_string("operating_mode", (char *)spot_check_mode_to_string(config->operating_mode)));
     MEMFAULT_ASSERT(nvs_set_string("custom_scrn_url", config->custom_screen_url));
+    MEMFAULT_ASSERT(nvs_set_string("custom_push_url", config->custom_push_url));
     MEMFAULT_ASSERT(nvs_set_uint32("custom_ui_secs", config->custom_update_interval_secs));
     MEMFAULT_ASSERT(nvs_set_string("chart_1", (char *)chart_strings_by_enum[config->active_chart_1]));
     MEMFAULT_ASSERT(nvs_set_string("chart_2", (char *)chart_strings_by_enum[config->active_chart_2]));
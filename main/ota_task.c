@@ -6,8 +6,11 @@
 #include "esp_http_client.h"
 #include "esp_https_ota.h"
 #include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "mbedtls/sha256.h"
 #include "memfault/panics/assert.h"
 #include "sdkconfig.h"
 
@@ -15,7 +18,11 @@
 #include "http_client.h"
 #include "json.h"
 #include "log.h"
+#include "memory_budget.h"
+#include "metrics.h"
 #include "ota_task.h"
+#include "power_policy.h"
+#include "push_channel.h"
 #include "scheduler_task.h"
 #include "screen_img_handler.h"
 #include "sleep_handler.h"
@@ -24,6 +31,10 @@
 
 #define TAG SC_TAG_OTA
 
+#define OTA_VERSION_STR_BYTES (32)
+#define OTA_SHA256_HEX_STR_BYTES (64 + 1)
+#define OTA_SHA256_READ_CHUNK_BYTES (4096)
+
 typedef enum {
     OTA_RESULT_NOT_STARTED,  // Any reason we bail before actual download of image (version compare the same, ota
                              // disabled, even any failures that occur before we actually start/draw start text)
@@ -31,11 +42,24 @@ typedef enum {
     OTA_RESULT_SUCCESS,      // Download and validate of new image successful, full process succeeded
 } ota_result_t;
 
+// Everything returned from the single version_info round trip needed to decide on and verify an update
+typedef struct {
+    char     version[OTA_VERSION_STR_BYTES];
+    uint32_t image_size;  // 0 if server didn't report it
+    char     image_sha256[OTA_SHA256_HEX_STR_BYTES];  // of the .bin file served, empty if server didn't report it
+    bool     delta_available;
+    bool     force_update;  // server override for forced upgrades/downgrades regardless of version compare
+} ota_version_info_t;
+
 // Global OTA and task handles
 // TODO :: these should all be in our own OTA handle I'm just being lazy
 static esp_https_ota_handle_t ota_handle;
 static TaskHandle_t           ota_task_handle    = NULL;
 static scheduler_mode_t       mode_at_task_start = SCHEDULER_MODE_INIT;
+static volatile bool          ota_running        = false;  // set by ota_task_start, cleared once the check finishes
+
+static StaticTask_t ota_task_buffer;
+static StackType_t  ota_task_stack[MEMORY_BUDGET_OTA_STACK_BYTES];
 
 static esp_err_t http_client_init_callback(esp_http_client_handle_t http_client) {
     esp_err_t err = ESP_OK;
@@ -59,15 +83,18 @@ static void ota_task_revert_scheduler_mode() {
     }
 }
 
-// Sets up  OTA binary URL and queries to see if OTA image accessible (no version checking)
-static bool ota_start_ota(char *binary_url) {
+/*
+ * Opens the OTA image connection for a specific server version. Only called once the version_info endpoint has told us
+ * an update is actually needed, so this is the only time the second TLS session to the image server is opened.
+ */
+static bool ota_start_ota(char *target_version) {
     // Have to manually build query params here since ota uses it's own internal http client
-    char url_with_params[strlen(binary_url) + 128];
-    strcpy(url_with_params, CONFIG_OTA_URL);
-    strcat(url_with_params, "?");
-    strcat(url_with_params, "device_id");
-    strcat(url_with_params, "=");
-    strcat(url_with_params, spot_check_get_serial());
+    char url_with_params[strlen(CONFIG_OTA_URL) + 128];
+    sprintf(url_with_params,
+            "%s?device_id=%s&version=%s",
+            CONFIG_OTA_URL,
+            spot_check_get_serial(),
+            target_version);
 
     esp_http_client_config_t http_config = {
         .url               = url_with_params,
@@ -80,6 +107,7 @@ static bool ota_start_ota(char *binary_url) {
         .http_client_init_cb = http_client_init_callback,
     };
 
+    log_printf(LOG_LEVEL_INFO, "Starting OTA with image url: %s", url_with_params);
     esp_err_t error = esp_https_ota_begin(&ota_config, &ota_handle);
     if (error != ESP_OK) {
         log_printf(LOG_LEVEL_ERROR, "OTA failed at esp_https_ota_begin: %s", esp_err_to_name(error));
@@ -89,57 +117,56 @@ static bool ota_start_ota(char *binary_url) {
 }
 
 /*
- * Return ESP_FAIL if no update needed, ESP_OK if update should proceed
+ * Returns true if the version reported by the server is newer than the running version. Server is the source of truth
+ * for forced upgrades/downgrades (see force_update in version info), this is only the basic semver comparison.
  */
-static esp_err_t ota_validate_image_header(esp_app_desc_t *new_image_info, esp_app_desc_t *current_image_info) {
-    if (new_image_info == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
-
+static bool ota_server_version_is_newer(char *current_version, char *server_version) {
     log_printf(LOG_LEVEL_INFO,
-               "Running firmware version: %s - server get_binary endpoint returned version: %s",
-               current_image_info->version,
-               new_image_info->version);
-
-    uint32_t current_major;
-    uint32_t current_minor;
-    uint32_t current_dot;
-    sscanf(current_image_info->version, "%lu.%lu.%lu", &current_major, &current_minor, &current_dot);
-    uint32_t new_major;
-    uint32_t new_minor;
-    uint32_t new_dot;
-    sscanf(new_image_info->version, "%lu.%lu.%lu", &new_major, &new_minor, &new_dot);
+               "Running firmware version: %s - server version_info endpoint returned version: %s",
+               current_version,
+               server_version);
+
+    uint32_t current_major = 0;
+    uint32_t current_minor = 0;
+    uint32_t current_dot   = 0;
+    sscanf(current_version, "%lu.%lu.%lu", &current_major, &current_minor, &current_dot);
+    uint32_t new_major = 0;
+    uint32_t new_minor = 0;
+    uint32_t new_dot   = 0;
+    sscanf(server_version, "%lu.%lu.%lu", &new_major, &new_minor, &new_dot);
 
     if (current_major == new_major && current_minor == new_minor && current_dot == new_dot) {
         log_printf(LOG_LEVEL_INFO, "OTA image version same as current version, no update needed");
-        return ESP_FAIL;
+        return false;
     } else if (current_major < new_major) {
-        log_printf(LOG_LEVEL_WARN, "OTA image version has lower major, starting OTA update...");
-        return ESP_OK;
+        log_printf(LOG_LEVEL_WARN, "OTA image version has higher major, starting OTA update...");
+        return true;
     } else if (current_major == new_major && current_minor < new_minor) {
-        log_printf(LOG_LEVEL_WARN, "OTA image version has same major but lower minor, starting OTA update...");
-        return ESP_OK;
+        log_printf(LOG_LEVEL_WARN, "OTA image version has same major but higher minor, starting OTA update...");
+        return true;
     } else if (current_major == new_major && current_minor == new_minor && current_dot < new_dot) {
         log_printf(LOG_LEVEL_WARN,
-                   "OTA image version has same major and minor but lower dot version, starting OTA update...");
-        return ESP_OK;
-    } else {
-        // This means at least one of the current versions was greater than the new versions. That should never happen
-        // unless server version is mistakenly saved OR the server is trying to force downgrade due to an issue. The
-        // secondary manual version check should handle those
-        log_printf(LOG_LEVEL_ERROR,
-                   "Current version greater than OTA image version, something is wrong!!",
-                   new_image_info->version);
-
-        return ESP_FAIL;
+                   "OTA image version has same major and minor but higher dot version, starting OTA update...");
+        return true;
     }
 
-    // Satisfy the compiler, will never be executed with above if/else
-    return ESP_FAIL;
+    // This means at least one of the current versions was greater than the new versions. That should never happen
+    // unless server version is mistakenly saved OR the server is trying to force downgrade due to an issue. The
+    // force_update flag from the server handles the latter.
+    log_printf(LOG_LEVEL_ERROR,
+               "Current version greater than OTA image version %s, something is wrong!!",
+               server_version);
+    return false;
 }
 
-static bool check_forced_update(esp_app_desc_t *current_image_info, char *version_to_download) {
-    // Send a request to our custom FW endpoint to determine if we need to force a downgrade
+/*
+ * Single lightweight request to our custom FW endpoint that returns everything needed to decide on an update (target
+ * version, image size and hash, delta availability, and whether the server is forcing an upgrade/downgrade). This
+ * replaces opening the image connection just to read the app header for a version compare.
+ *
+ * Returns success of the request and parse, version info returned through last arg.
+ */
+static bool ota_get_version_info(esp_app_desc_t *current_image_info, ota_version_info_t *version_info) {
     char post_data[100];
     int  err = sprintf(post_data,
                       "{\"current_version\": \"%s\", \"device_id\": \"%s\"}",
@@ -147,43 +174,63 @@ static bool check_forced_update(esp_app_desc_t *current_image_info, char *versio
                       spot_check_get_serial());
     if (err < 0) {
         log_printf(LOG_LEVEL_ERROR, "Error sprintfing version string into version_info endpoint post body");
-        return ESP_FAIL;
+        return false;
     }
 
     char           version_info_path[] = "ota/version_info";
     char           url[strlen(URL_BASE) + strlen(version_info_path) + 1];
     http_request_t request_obj = http_client_build_post_request(version_info_path, url, post_data, strlen(post_data));
 
-    char                    *response_data;
-    size_t                   response_data_size;
+    char                    *response_data      = NULL;
+    size_t                   response_data_size = 0;
     esp_http_client_handle_t client;
     int                      content_length = 0;
     bool                     http_success = http_client_perform_with_retries(&request_obj, 1, &client, &content_length);
     if (!http_success) {
-        log_printf(LOG_LEVEL_ERROR,
-                   "Error in http perform request checking to see if need forced update, defaulting to no update");
+        log_printf(LOG_LEVEL_ERROR, "Error in http perform request for OTA version info, defaulting to no update");
         return false;
     }
 
     esp_err_t http_err =
         http_client_read_response_to_buffer(&client, content_length, &response_data, &response_data_size);
     if (http_err != ESP_OK) {
-        log_printf(LOG_LEVEL_ERROR,
-                   "Error in http request readout checking to see if need forced update, defaulting to no update");
+        log_printf(LOG_LEVEL_ERROR, "Error in http request readout for OTA version info, defaulting to no update");
         return false;
     }
 
-    log_printf(LOG_LEVEL_INFO, "%s", response_data);
-    bool   force_update      = false;
-    cJSON *response_json     = parse_json(response_data);
-    cJSON *needs_update_json = cJSON_GetObjectItem(response_json, "needs_update");
-    if (cJSON_IsTrue(needs_update_json)) {
-        // This will break if server gives us a string larger than pre-alloced buf passed in. Right now it's 10 bytes
-        cJSON *version_to_download_json = cJSON_GetObjectItem(response_json, "server_version");
-        char  *temp_version             = cJSON_GetStringValue(version_to_download_json);
-        strcpy(version_to_download, temp_version);
-        force_update = true;
-    }
+    log_printf(LOG_LEVEL_DEBUG, "%s", response_data);
+    bool   success       = false;
+    cJSON *response_json = parse_json(response_data);
+    do {
+        if (response_json == NULL) {
+            break;
+        }
+
+        cJSON *server_version_json = cJSON_GetObjectItem(response_json, "server_version");
+        char  *server_version      = cJSON_GetStringValue(server_version_json);
+        if (server_version == NULL || strlen(server_version) >= sizeof(version_info->version)) {
+            log_printf(LOG_LEVEL_ERROR, "Missing or invalid server_version in OTA version info response");
+            break;
+        }
+        strcpy(version_info->version, server_version);
+
+        cJSON *image_size_json = cJSON_GetObjectItem(response_json, "image_size");
+        version_info->image_size =
+            cJSON_IsNumber(image_size_json) ? (uint32_t)cJSON_GetNumberValue(image_size_json) : 0;
+
+        // Hash is optional, if server doesn't send it we just rely on the esp_https_ota_finish image validation
+        cJSON *image_sha256_json = cJSON_GetObjectItem(response_json, "image_sha256");
+        char  *image_sha256      = cJSON_GetStringValue(image_sha256_json);
+        if (image_sha256 && strlen(image_sha256) == OTA_SHA256_HEX_STR_BYTES - 1) {
+            strcpy(version_info->image_sha256, image_sha256);
+        } else {
+            version_info->image_sha256[0] = '\0';
+        }
+
+        version_info->delta_available = cJSON_IsTrue(cJSON_GetObjectItem(response_json, "delta_available"));
+        version_info->force_update    = cJSON_IsTrue(cJSON_GetObjectItem(response_json, "needs_update"));
+        success                       = true;
+    } while (0);
 
     // Clean up request and json mem
     if (response_data_size && response_data) {
@@ -191,16 +238,77 @@ static bool check_forced_update(esp_app_desc_t *current_image_info, char *versio
     }
     cJSON_Delete(response_json);
 
-    return force_update;
+    return success;
 }
 
 /*
- * Proper task teardown depending on how it went
+ * Compare the sha256 of the downloaded image against what the version info endpoint reported. Runs before
+ * esp_https_ota_finish so a mismatched image never gets set as the boot partition.
+ *
+ * The server publishes the hash of the .bin file it serves, which esp_https_ota writes verbatim to the start of the
+ * update partition, so exactly the image_len bytes written are hashed back. esp_partition_get_sha256 can't be used, for
+ * an app partition it returns the digest esp-idf appends inside the image instead of one over the whole file.
+ */
+static bool ota_verify_image_sha256(ota_version_info_t *version_info, uint32_t image_len) {
+    if (version_info->image_sha256[0] == '\0') {
+        log_printf(LOG_LEVEL_INFO, "No image hash received from version info, skipping sha256 check");
+        return true;
+    }
+
+    uint8_t *chunk = malloc(OTA_SHA256_READ_CHUNK_BYTES);
+    if (chunk == NULL) {
+        log_printf(LOG_LEVEL_ERROR, "Couldn't alloc %d bytes to hash update image", OTA_SHA256_READ_CHUNK_BYTES);
+        return false;
+    }
+
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    mbedtls_sha256_context sha_ctx;
+    mbedtls_sha256_init(&sha_ctx);
+    esp_err_t err = ESP_OK;
+    int       ret = mbedtls_sha256_starts(&sha_ctx, 0);
+    for (uint32_t offset = 0; offset < image_len && err == ESP_OK && ret == 0; offset += OTA_SHA256_READ_CHUNK_BYTES) {
+        size_t len = MIN(OTA_SHA256_READ_CHUNK_BYTES, image_len - offset);
+        err        = esp_partition_read(update_partition, offset, chunk, len);
+        if (err == ESP_OK) {
+            ret = mbedtls_sha256_update(&sha_ctx, chunk, len);
+        }
+    }
+
+    uint8_t sha256[32];
+    if (err == ESP_OK && ret == 0) {
+        ret = mbedtls_sha256_finish(&sha_ctx, sha256);
+    }
+    mbedtls_sha256_free(&sha_ctx);
+    free(chunk);
+
+    if (err != ESP_OK || ret != 0) {
+        log_printf(LOG_LEVEL_ERROR, "Error hashing update image: %s (mbedtls %d)", esp_err_to_name(err), ret);
+        return false;
+    }
+
+    char sha256_str[OTA_SHA256_HEX_STR_BYTES];
+    for (size_t i = 0; i < sizeof(sha256); i++) {
+        sprintf(&sha256_str[i * 2], "%02x", sha256[i]);
+    }
+
+    if (strcasecmp(sha256_str, version_info->image_sha256) != 0) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Downloaded image sha256 %s does not match expected %s",
+                   sha256_str,
+                   version_info->image_sha256);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Cleanup after a check depending on how it went. The task itself stays around for the next check.
  */
 static void ota_task_stop(ota_result_t result) {
     switch (result) {
         case OTA_RESULT_NOT_STARTED:
-            log_printf(LOG_LEVEL_INFO, "OTA task exiting before any download occurred, no screen changes needed");
+            log_printf(LOG_LEVEL_INFO, "OTA check ending before any download occurred, no screen changes needed");
             break;
         case OTA_RESULT_FAIL:
             // TODO :: write failure text? It would persist until next OTA check or reboot
@@ -217,13 +325,15 @@ static void ota_task_stop(ota_result_t result) {
 
     // Common actions whether OTA was not needed or failed. Success case won't reach here with the restart)
     ota_task_revert_scheduler_mode();
+    push_channel_resume();
+    power_policy_radio_release();
     sleep_handler_set_idle(SYSTEM_IDLE_OTA_BIT);
-    ota_task_handle = NULL;
-    vTaskDelete(NULL);
+    ota_running = false;
 }
 
-static void check_ota_update_task(void *args) {
+static void ota_check_for_update() {
     sleep_handler_set_busy(SYSTEM_IDLE_OTA_BIT);
+    power_policy_radio_acquire();
     log_printf(LOG_LEVEL_INFO, "Starting OTA task to check update status");
 
     // Store mode so we can properly revert once OTA is done no matter what state it finishes in
@@ -248,68 +358,48 @@ static void check_ota_update_task(void *args) {
         log_printf(LOG_LEVEL_INFO, "Got connection, continuing with OTA check");
     }
 
-    // Start our OTA process with the default binary URL first
-    bool success = ota_start_ota(CONFIG_OTA_URL);
-    if (!success) {
-        ota_task_stop(OTA_RESULT_NOT_STARTED);
-    }
-
     // Get our current version
     const esp_partition_t *current_partition = esp_ota_get_running_partition();
     esp_app_desc_t         current_image_info;
     esp_ota_get_partition_description(current_partition, &current_image_info);
 
-    // Download the servers inital binary header
-    esp_app_desc_t ota_image_desc;
-    esp_err_t      error = esp_https_ota_get_img_desc(ota_handle, &ota_image_desc);
-    if (error != ESP_OK) {
-        log_printf(LOG_LEVEL_ERROR, "OTA failed at esp_https_ota_get_img_desc: %s", esp_err_to_name(error));
-        ota_task_stop(OTA_RESULT_FAIL);
+    // One small request to decide whether we need an update at all, so the image server connection is only ever
+    // opened when we're actually going to download
+    ota_version_info_t version_info;
+    if (!ota_get_version_info(&current_image_info, &version_info)) {
+        ota_task_stop(OTA_RESULT_NOT_STARTED);
         return;
     }
 
-    // Check to see if a basic version comparison results in an update from a newer version on the server
-    error = ota_validate_image_header(&ota_image_desc, &current_image_info);
-    if (error != ESP_OK) {
+    bool needs_update = ota_server_version_is_newer(current_image_info.version, version_info.version);
+    if (!needs_update && version_info.force_update && strcmp(current_image_info.version, version_info.version) != 0) {
         log_printf(LOG_LEVEL_INFO,
-                   "Image validation resulted in no go-ahead for update. Now checking custom endpoint for forced "
-                   "upgrades/downgrades...");
+                   "Received force_update command from server for version %s, getting now",
+                   version_info.version);
+        needs_update = true;
+    }
 
-        error = esp_https_ota_abort(ota_handle);
-        if (error != ESP_OK) {
-            log_printf(LOG_LEVEL_ERROR,
-                       "Error cleaning up OTA handle to manually check our force endpoint. Giving up on OTA right now "
-                       "and deleting task, but socket lock from ota internal http_client in unknown state, rest of app "
-                       "might be broken.");
-            ota_task_stop(OTA_RESULT_FAIL);
-            return;
-        }
+    if (!needs_update) {
+        log_printf(LOG_LEVEL_INFO, "No go-ahead for update from version info, ending OTA check");
+        ota_task_stop(OTA_RESULT_NOT_STARTED);
+        return;
+    }
 
-        // If we get anything other than success, we don't do our basic upgrade. Check our force upgrade/downgrade
-        // endpoint for us to manually apply a specific version
-        char version_to_download[10];
-        bool force_download = check_forced_update(&current_image_info, version_to_download);
-        if (force_download) {
-            log_printf(LOG_LEVEL_INFO,
-                       "Received force_download command from server for version %s, getting now",
-                       version_to_download);
-            size_t ota_url_size = strlen(CONFIG_OTA_URL);
-            char   forced_version_url[ota_url_size + 25];
-            char   query_str[] = "?version=";
-            memcpy(forced_version_url, CONFIG_OTA_URL, ota_url_size);
-            memcpy(forced_version_url + ota_url_size, query_str, strlen(query_str));
-            strcpy(forced_version_url + ota_url_size + strlen(query_str), version_to_download);
-
-            // Restart OTA process with new url specific to forced version
-            log_printf(LOG_LEVEL_INFO, "Attempting to restart OTA with specific version url: %s", forced_version_url);
-            ota_start_ota(forced_version_url);
-        } else {
-            log_printf(LOG_LEVEL_INFO, "Still got no go-ahead from force OTA endpoint, deleting OTA task");
-            ota_task_stop(OTA_RESULT_NOT_STARTED);
-            return;
-        }
+    // Delta availability is only reported for the server's bookkeeping, the device has no patcher so it always pulls
+    // the full image
+    if (version_info.delta_available) {
+        log_printf(LOG_LEVEL_INFO, "Server has delta image available, downloading full image");
     }
 
+    // Don't hold a second TLS session open next to the image download
+    push_channel_pause();
+    if (!ota_start_ota(version_info.version)) {
+        ota_task_stop(OTA_RESULT_NOT_STARTED);
+        return;
+    }
+
+    esp_err_t error;
+
     // Notify user on screen and kick scheduler into OTA mode so time updates continue but no other network requests are
     // made (that would fail anyway since ota is monopolizing http client)
     scheduler_set_ota_mode();
@@ -318,6 +408,7 @@ static void check_ota_update_task(void *args) {
 
     uint32_t iter_counter = 0;
     uint32_t bytes_received;
+    int64_t  download_start_us = esp_timer_get_time();
     while (1) {
         error = esp_https_ota_perform(ota_handle);
         if (error != ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
@@ -339,9 +430,29 @@ static void check_ota_update_task(void *args) {
         iter_counter++;
     }
 
+    metrics_record_duration(METRICS_DURATION_OTA_DOWNLOAD, (esp_timer_get_time() - download_start_us) / 1000);
+
     bool received_full_image = esp_https_ota_is_complete_data_received(ota_handle);
     if (!received_full_image) {
         log_printf(LOG_LEVEL_ERROR, "Did not receive full image package from server, aborting.");
+        esp_https_ota_abort(ota_handle);
+        ota_task_stop(OTA_RESULT_FAIL);
+        return;
+    }
+
+    uint32_t image_len = esp_https_ota_get_image_len_read(ota_handle);
+    if (version_info.image_size != 0 && image_len != version_info.image_size) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Received image size %lu does not match version info size %lu, aborting.",
+                   image_len,
+                   version_info.image_size);
+        esp_https_ota_abort(ota_handle);
+        ota_task_stop(OTA_RESULT_FAIL);
+        return;
+    }
+
+    if (!ota_verify_image_sha256(&version_info, image_len)) {
+        esp_https_ota_abort(ota_handle);
         ota_task_stop(OTA_RESULT_FAIL);
         return;
     }
@@ -355,32 +466,52 @@ static void check_ota_update_task(void *args) {
                        "Error in esp_https_ota_finish, OTA update unsuccessful: %s",
                        esp_err_to_name(error));
         }
+        ota_task_stop(OTA_RESULT_FAIL);
+        return;
     }
 
     // Catch-all to clear OTA text and clean up task
     ota_task_stop(OTA_RESULT_SUCCESS);
 }
 
+/*
+ * Lives for the whole runtime and runs one check per ota_task_start. Deleting it after each check and creating it again
+ * on the same static TCB and stack could race the idle task still cleaning up the old one.
+ */
+static void check_ota_update_task(void *args) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ota_check_for_update();
+    }
+}
+
 UBaseType_t ota_task_get_stack_high_water() {
-    // OTA task is usually not running
     return ota_task_handle == NULL ? 0 : uxTaskGetStackHighWaterMark(ota_task_handle);
 }
 
+void ota_task_init() {
+    // Created up front and left blocked until the first ota_task_start
+    ota_task_handle = xTaskCreateStatic(&check_ota_update_task,
+                                        "check-ota-update",
+                                        sizeof(ota_task_stack),
+                                        NULL,
+                                        tskIDLE_PRIORITY,
+                                        ota_task_stack,
+                                        &ota_task_buffer);
+    MEMFAULT_ASSERT(ota_task_handle);
+    memory_budget_register_stack("ota", sizeof(ota_task_stack), &ota_task_handle);
+}
+
 void ota_task_start() {
-    if (ota_task_handle != NULL) {
+    if (ota_running) {
         log_printf(LOG_LEVEL_WARN,
-                   "%s called when ota task handle not null. This means the task wasn't torn down correctly after last "
-                   "check, or it is somehow being called from somewhere it shouldn't (OTA should only run on set "
-                   "schedule far apart). This is a bug, it should never happen.",
+                   "%s called while an OTA check is still running. This means the last check never finished, or it is "
+                   "somehow being called from somewhere it shouldn't (OTA should only run on set schedule far apart). "
+                   "This is a bug, it should never happen.",
                    __func__);
         return;
     }
 
-    // minimal * 3 is the smallest we can go w/o SO
-    xTaskCreate(&check_ota_update_task,
-                "check-ota-update",
-                SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 5,
-                NULL,
-                tskIDLE_PRIORITY,
-                &ota_task_handle);
+    ota_running = true;
+    xTaskNotifyGive(ota_task_handle);
 }
@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "packbits.h"
+
+#include "constants.h"
+
+#define PACKBITS_MAX_RUN_BYTES (128)
+
+void packbits_decoder_init(packbits_decoder_t *decoder, packbits_output_func output, void *ctx) {
+    decoder->output    = output;
+    decoder->ctx       = ctx;
+    decoder->remaining = 0;
+    decoder->repeat    = false;
+}
+
+bool packbits_decode(packbits_decoder_t *decoder, const uint8_t *bytes, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (decoder->remaining == 0) {
+            int8_t header = (int8_t)bytes[i++];
+            if (header == -128) {
+                continue;
+            }
+
+            decoder->repeat    = header < 0;
+            decoder->remaining = header < 0 ? (1 - header) : (header + 1);
+            continue;
+        }
+
+        if (decoder->repeat) {
+            uint8_t run[PACKBITS_MAX_RUN_BYTES];
+            memset(run, bytes[i++], decoder->remaining);
+            if (!decoder->output(run, decoder->remaining, decoder->ctx)) {
+                return false;
+            }
+
+            decoder->remaining = 0;
+            continue;
+        }
+
+        // Literal run, pass through as much of it as this chunk holds
+        size_t literal_len = MIN(decoder->remaining, len - i);
+        if (!decoder->output(&bytes[i], literal_len, decoder->ctx)) {
+            return false;
+        }
+
+        i += literal_len;
+        decoder->remaining -= literal_len;
+    }
+
+    return true;
+}
+
+/*
+ * True if the stream ended on a run boundary. Anything else means the input was truncated.
+ */
+bool packbits_decoder_is_complete(packbits_decoder_t *decoder) {
+    return decoder->remaining == 0;
+}
+
+/*
+ * Encodes an in-memory buffer, handing output to the callback a header or a run's data at a time. Repeats of 3 or
+ * more become repeat runs, shorter ones stay in the surrounding literal since a 2 byte repeat saves nothing. Worst case
+ * output is len + len / 128 + 1 bytes.
+ */
+bool packbits_encode(const uint8_t *bytes, size_t len, packbits_output_func output, void *ctx) {
+    size_t i = 0;
+    while (i < len) {
+        size_t repeat_len = 1;
+        while (i + repeat_len < len && repeat_len < PACKBITS_MAX_RUN_BYTES && bytes[i + repeat_len] == bytes[i]) {
+            repeat_len++;
+        }
+
+        if (repeat_len >= 3) {
+            uint8_t run[2] = {(uint8_t)(1 - (int)repeat_len), bytes[i]};
+            if (!output(run, sizeof(run), ctx)) {
+                return false;
+            }
+
+            i += repeat_len;
+            continue;
+        }
+
+        // Literal runs until the next repeat worth encoding starts
+        size_t literal_start = i;
+        while (i < len && i - literal_start < PACKBITS_MAX_RUN_BYTES) {
+            if (i + 2 < len && bytes[i] == bytes[i + 1] && bytes[i] == bytes[i + 2]) {
+                break;
+            }
+            i++;
+        }
+
+        uint8_t header = i - literal_start - 1;
+        if (!output(&header, 1, ctx) || !output(&bytes[literal_start], i - literal_start, ctx)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,440 @@
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_crt_bundle.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "memfault/panics/assert.h"
+#include "nvs_flash.h"
+#include "spi_flash_mmap.h"
+
+#include "constants.h"
+#include "display.h"
+#include "epd_driver.h"
+#include "flash_partition.h"
+#include "http_client.h"
+#include "http_server.h"
+#include "log.h"
+#include "perf.h"
+#include "screen_img_handler.h"
+
+#define TAG SC_TAG_PERF
+
+#define PERF_FB_BYTES (EPD_WIDTH / 2 * EPD_HEIGHT)
+#define PERF_INTERLACED_BYTES (EPD_WIDTH * EPD_HEIGHT)
+#define PERF_LUT_BYTES (1 << 10)
+
+// Same temp display_render_mode hands to epdiy
+#define PERF_EPD_TEMPERATURE_C (25)
+
+#define PERF_TEXT "The quick brown fox jumps over the lazy dog 0123456789"
+#define PERF_TEXT_X_PX (10)
+#define PERF_TEXT_Y_PX (300)
+
+// Standard 700x200 chart at 2 px per byte, blitted from wherever the tide chart lives in flash
+#define PERF_CHART_X_PX (50)
+#define PERF_CHART_WIDTH_PX (700)
+#define PERF_CHART_HEIGHT_PX (200)
+#define PERF_CHART_BYTES (PERF_CHART_WIDTH_PX * PERF_CHART_HEIGHT_PX / 2)
+
+// Roughly the size of a conditions line re-render
+#define PERF_PARTIAL_X_PX (0)
+#define PERF_PARTIAL_Y_PX (0)
+#define PERF_PARTIAL_WIDTH_PX (400)
+#define PERF_PARTIAL_HEIGHT_PX (100)
+
+// Reserved in the screen_img layout, the images and the framebuffer snapshot all stop short of it
+#define PERF_FLASH_SCRATCH_OFFSET SCREEN_IMG_PERF_SCRATCH_OFFSET
+#define PERF_FLASH_SCRATCH_BYTES SCREEN_IMG_PERF_SCRATCH_BYTES
+#define PERF_FLASH_WRITE_CHUNK_BYTES (4096)
+
+#define PERF_TLS_TIMEOUT_MS (10 * MS_PER_SEC)
+
+// Own namespace so the benchmark never touches the "storage" config or the buffers nvs_get_config hands out
+#define PERF_NVS_NAMESPACE "perf"
+#define PERF_NVS_VALUE_BYTES (MAX_LENGTH_CUSTOM_SCREEN_URL_PARAM + 1)
+
+typedef bool (*perf_bench_func_t)();
+
+typedef struct {
+    const char       *name;
+    uint32_t          default_iterations;
+    perf_bench_func_t func;
+} perf_bench_def_t;
+
+typedef struct {
+    perf_bench_t   bench;
+    uint32_t       iterations;
+    perf_result_t *result;
+    TaskHandle_t   caller;
+} perf_run_args_t;
+
+/*
+ * Buffers shared by all benchmarks, only allocated for the length of a single perf_run call. Framebuffers go in PSRAM
+ * same as the real epdiy ones so the numbers are representative.
+ */
+static struct {
+    uint8_t *fb_to;
+    uint8_t *fb_from;
+    uint8_t *interlaced;
+    bool    *dirty_lines;
+    uint8_t *lut;
+    uint8_t *write_chunk;
+} scratch;
+
+static bool perf_bench_fb_diff() {
+    epd_difference_image(scratch.fb_to, scratch.fb_from, scratch.interlaced, scratch.dirty_lines);
+    return true;
+}
+
+static bool perf_bench_lut_build() {
+    enum EpdDrawError err =
+        epd_build_lut(MODE_GC16, PERF_EPD_TEMPERATURE_C, EPD_BUILTIN_WAVEFORM, scratch.lut, PERF_LUT_BYTES);
+    if (err != EPD_DRAW_SUCCESS) {
+        log_printf(LOG_LEVEL_ERROR, "epd_build_lut failed with err 0x%x", err);
+        return false;
+    }
+
+    return true;
+}
+
+static bool perf_bench_glyph_draw() {
+    display_draw_text_to_fb(scratch.fb_to,
+                            PERF_TEXT,
+                            PERF_TEXT_X_PX,
+                            PERF_TEXT_Y_PX,
+                            DISPLAY_FONT_SIZE_MEDIUM,
+                            DISPLAY_FONT_ALIGN_LEFT);
+    return true;
+}
+
+/*
+ * mmap + copy + unmap of a full chart, same path as screen_img_handler_retrieve_and_render but into the scratch fb so the
+ * screen isn't touched. Flash contents don't matter for timing, so this works even if no chart has been downloaded.
+ */
+static bool perf_bench_chart_blit() {
+    const uint8_t          *mapped_flash = NULL;
+    spi_flash_mmap_handle_t spi_flash_handle;
+    const esp_partition_t  *screen_img_partition = flash_partition_get_screen_img_partition();
+
+    esp_err_t err = esp_partition_mmap(screen_img_partition,
+                                       SCREEN_IMG_TIDE_CHART_OFFSET,
+                                       PERF_CHART_BYTES,
+                                       SPI_FLASH_MMAP_DATA,
+                                       (const void **)&mapped_flash,
+                                       &spi_flash_handle);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to mmap chart from flash: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    EpdRect rect = {
+        .x      = PERF_CHART_X_PX,
+        .y      = 0,
+        .width  = PERF_CHART_WIDTH_PX,
+        .height = PERF_CHART_HEIGHT_PX,
+    };
+    epd_copy_to_framebuffer(rect, mapped_flash, scratch.fb_to);
+    spi_flash_munmap(spi_flash_handle);
+
+    return true;
+}
+
+/*
+ * Both refresh benchmarks re-render what's already in the framebuffer by forcing the region dirty, so they're
+ * non-destructive to what's on screen (minus the flashing).
+ */
+static bool perf_bench_gc16_partial() {
+    display_mark_rect_dirty(PERF_PARTIAL_X_PX, PERF_PARTIAL_Y_PX, PERF_PARTIAL_WIDTH_PX, PERF_PARTIAL_HEIGHT_PX);
+    display_render();
+    return true;
+}
+
+static bool perf_bench_gc16_full() {
+    display_mark_all_lines_dirty();
+    display_render();
+    return true;
+}
+
+/*
+ * Same keys and default values nvs_load_config reads, seeded into the scratch namespace the first time the benchmark
+ * runs and left there after so later runs only read
+ */
+static const struct {
+    const char *key;
+    const char *value;
+} perf_nvs_config_strings[] = {
+    {"spot_name", "Wedge"},
+    {"spot_lat", "33.5930302087"},
+    {"spot_lon", "-117.8819918632"},
+    {"spot_uid", "5842041f4e65fad6a770882b"},
+    {"tz_str", "CET-1CEST,M3.5.0/2,M10.5.0/2"},
+    {"tz_display_name", "Europe/Berlin"},
+    {"operating_mode", "weather"},
+    {"custom_scrn_url", "https://spotcheck.brianteam.com/custom_screen_test_image"},
+    {"custom_push_url", ""},
+    {"chart_1", "tide"},
+    {"chart_2", "swell"},
+};
+
+static esp_err_t perf_nvs_seed(nvs_handle_t nvs) {
+    for (size_t i = 0; i < sizeof(perf_nvs_config_strings) / sizeof(perf_nvs_config_strings[0]); i++) {
+        esp_err_t err = nvs_set_str(nvs, perf_nvs_config_strings[i].key, perf_nvs_config_strings[i].value);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    esp_err_t err = nvs_set_u32(nvs, "custom_ui_secs", 900);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    return nvs_commit(nvs);
+}
+
+/*
+ * A full config load's worth of reads through its own handle on a scratch namespace, so the live config buffers other
+ * tasks are reading from are never reloaded underneath them. The open and close are timed too, config load reuses the
+ * handle opened at boot so that's a few us more than the real thing.
+ */
+static bool perf_bench_nvs_config_load() {
+    nvs_handle_t nvs;
+    esp_err_t    err = nvs_open(PERF_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to open nvs namespace '%s': %s", PERF_NVS_NAMESPACE, esp_err_to_name(err));
+        return false;
+    }
+
+    // Seeded last, so once it's there everything else is too
+    uint32_t custom_update_interval_secs = 0;
+
+    err = nvs_get_u32(nvs, "custom_ui_secs", &custom_update_interval_secs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // First run on this device, this iteration's time includes the writes
+        err = perf_nvs_seed(nvs);
+    }
+
+    char value[PERF_NVS_VALUE_BYTES];
+    for (size_t i = 0; i < sizeof(perf_nvs_config_strings) / sizeof(perf_nvs_config_strings[0]) && err == ESP_OK;
+         i++) {
+        size_t value_size = sizeof(value);
+        err               = nvs_get_str(nvs, perf_nvs_config_strings[i].key, value, &value_size);
+    }
+
+    nvs_close(nvs);
+
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Failed reading nvs namespace '%s': %s", PERF_NVS_NAMESPACE, esp_err_to_name(err));
+        return false;
+    }
+
+    return true;
+}
+
+static bool perf_bench_flash_erase_write() {
+    const esp_partition_t *screen_img_partition = flash_partition_get_screen_img_partition();
+    if (screen_img_partition->size < PERF_FLASH_SCRATCH_OFFSET + PERF_FLASH_SCRATCH_BYTES) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "screen_img partition too small (%lu bytes) for flash scratch area, skipping",
+                   screen_img_partition->size);
+        return false;
+    }
+
+    esp_err_t err =
+        flash_partition_erase_range(screen_img_partition, PERF_FLASH_SCRATCH_OFFSET, PERF_FLASH_SCRATCH_BYTES);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to erase flash scratch area: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    for (size_t offset = 0; offset < PERF_FLASH_SCRATCH_BYTES; offset += PERF_FLASH_WRITE_CHUNK_BYTES) {
+        err = flash_partition_write(screen_img_partition,
+                                    PERF_FLASH_SCRATCH_OFFSET + offset,
+                                    scratch.write_chunk,
+                                    PERF_FLASH_WRITE_CHUNK_BYTES);
+        if (err != ESP_OK) {
+            log_printf(LOG_LEVEL_ERROR, "Failed to write flash scratch area: %s", esp_err_to_name(err));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Full connection to the API host with the same cert bundle the http client uses, so DNS + TCP connect are included.
+ * Nothing is sent, connection is torn down right after the handshake.
+ */
+static bool perf_bench_tls_handshake() {
+    esp_tls_t *tls = esp_tls_init();
+    if (tls == NULL) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to allocate esp_tls handle");
+        return false;
+    }
+
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms        = PERF_TLS_TIMEOUT_MS,
+    };
+    int rval = esp_tls_conn_http_new_sync(URL_BASE, &cfg, tls);
+    esp_tls_conn_destroy(tls);
+
+    if (rval != 1) {
+        log_printf(LOG_LEVEL_ERROR, "TLS handshake with %s failed, is wifi connected?", URL_BASE);
+        return false;
+    }
+
+    return true;
+}
+
+static const perf_bench_def_t bench_defs[PERF_BENCH_COUNT] = {
+    [PERF_BENCH_FB_DIFF]           = {"fb", 10, perf_bench_fb_diff},
+    [PERF_BENCH_LUT_BUILD]         = {"lut", 10, perf_bench_lut_build},
+    [PERF_BENCH_GLYPH_DRAW]        = {"glyph", 10, perf_bench_glyph_draw},
+    [PERF_BENCH_CHART_BLIT]        = {"chart", 10, perf_bench_chart_blit},
+    [PERF_BENCH_GC16_PARTIAL]      = {"gc16p", 3, perf_bench_gc16_partial},
+    [PERF_BENCH_GC16_FULL]         = {"gc16", 1, perf_bench_gc16_full},
+    [PERF_BENCH_NVS_CONFIG_LOAD]   = {"nvs", 10, perf_bench_nvs_config_load},
+    [PERF_BENCH_FLASH_ERASE_WRITE] = {"flash", 1, perf_bench_flash_erase_write},
+    [PERF_BENCH_TLS_HANDSHAKE]     = {"tls", 1, perf_bench_tls_handshake},
+};
+
+static void perf_free_scratch() {
+    heap_caps_free(scratch.fb_to);
+    heap_caps_free(scratch.fb_from);
+    heap_caps_free(scratch.interlaced);
+    heap_caps_free(scratch.dirty_lines);
+    heap_caps_free(scratch.lut);
+    heap_caps_free(scratch.write_chunk);
+    memset(&scratch, 0x0, sizeof(scratch));
+}
+
+static bool perf_alloc_scratch() {
+    scratch.fb_to       = heap_caps_malloc(PERF_FB_BYTES, MALLOC_CAP_SPIRAM);
+    scratch.fb_from     = heap_caps_malloc(PERF_FB_BYTES, MALLOC_CAP_SPIRAM);
+    scratch.interlaced  = heap_caps_malloc(PERF_INTERLACED_BYTES, MALLOC_CAP_SPIRAM);
+    scratch.dirty_lines = heap_caps_malloc(EPD_HEIGHT * sizeof(bool), MALLOC_CAP_8BIT);
+    scratch.lut         = heap_caps_malloc(PERF_LUT_BYTES, MALLOC_CAP_8BIT);
+    scratch.write_chunk = heap_caps_malloc(PERF_FLASH_WRITE_CHUNK_BYTES, MALLOC_CAP_8BIT);
+
+    if (!scratch.fb_to || !scratch.fb_from || !scratch.interlaced || !scratch.dirty_lines || !scratch.lut ||
+        !scratch.write_chunk) {
+        perf_free_scratch();
+        return false;
+    }
+
+    // Make every line differ so the diff can't early-out anywhere
+    memset(scratch.fb_from, 0xFF, PERF_FB_BYTES);
+    for (size_t i = 0; i < PERF_FB_BYTES; i++) {
+        scratch.fb_to[i] = i & 0xFF;
+    }
+    for (size_t i = 0; i < PERF_FLASH_WRITE_CHUNK_BYTES; i++) {
+        scratch.write_chunk[i] = i & 0xFF;
+    }
+
+    return true;
+}
+
+/*
+ * Runs in its own task pinned to a single core so the cycle counter (per-core CCOUNT) stays valid across blocking calls.
+ * CCOUNT is 32 bits so cycles wrap after ~17s at 240MHz, nothing in here comes close to that per iteration.
+ */
+static void perf_task(void *args) {
+    perf_run_args_t        *run_args = (perf_run_args_t *)args;
+    const perf_bench_def_t *def      = &bench_defs[run_args->bench];
+    perf_result_t          *result   = run_args->result;
+
+    uint64_t total_us     = 0;
+    uint64_t total_cycles = 0;
+    result->ran           = true;
+    result->min_us        = UINT32_MAX;
+    result->max_us        = 0;
+
+    for (uint32_t i = 0; i < run_args->iterations; i++) {
+        int64_t  start_us     = esp_timer_get_time();
+        uint32_t start_cycles = esp_cpu_get_cycle_count();
+        bool     success      = def->func();
+        uint32_t cycles       = esp_cpu_get_cycle_count() - start_cycles;
+        uint32_t elapsed_us   = esp_timer_get_time() - start_us;
+
+        if (!success) {
+            result->ran = false;
+            break;
+        }
+
+        total_us += elapsed_us;
+        total_cycles += cycles;
+        result->min_us = MIN(result->min_us, elapsed_us);
+        result->max_us = MAX(result->max_us, elapsed_us);
+    }
+
+    if (result->ran) {
+        result->iterations = run_args->iterations;
+        result->avg_us     = total_us / run_args->iterations;
+        result->avg_cycles = total_cycles / run_args->iterations;
+    }
+
+    xTaskNotifyGive(run_args->caller);
+    vTaskDelete(NULL);
+}
+
+const char *perf_bench_to_string(perf_bench_t bench) {
+    MEMFAULT_ASSERT(bench < PERF_BENCH_COUNT);
+    return bench_defs[bench].name;
+}
+
+bool perf_string_to_bench(const char *str, size_t len, perf_bench_t *bench_out) {
+    for (perf_bench_t bench = 0; bench < PERF_BENCH_COUNT; bench++) {
+        if (strlen(bench_defs[bench].name) == len && strncmp(str, bench_defs[bench].name, len) == 0) {
+            *bench_out = bench;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Blocking, runs `iterations` back to back executions of the benchmark (or its default count if 0) and fills result.
+ * Returns false if the benchmark couldn't run, in which case result->ran is also false.
+ */
+bool perf_run(perf_bench_t bench, uint32_t iterations, perf_result_t *result) {
+    MEMFAULT_ASSERT(bench < PERF_BENCH_COUNT);
+    memset(result, 0x0, sizeof(perf_result_t));
+
+    if (!perf_alloc_scratch()) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to allocate scratch buffers for perf benchmark");
+        return false;
+    }
+
+    perf_run_args_t run_args = {
+        .bench      = bench,
+        .iterations = iterations == 0 ? bench_defs[bench].default_iterations : iterations,
+        .result     = result,
+        .caller     = xTaskGetCurrentTaskHandle(),
+    };
+
+    // Extra stack for mbedtls handshake
+    BaseType_t rval = xTaskCreatePinnedToCore(perf_task,
+                                              "perf",
+                                              SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 8,
+                                              &run_args,
+                                              uxTaskPriorityGet(NULL),
+                                              NULL,
+                                              xPortGetCoreID());
+    if (rval != pdPASS) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to create perf task");
+        perf_free_scratch();
+        return false;
+    }
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    perf_free_scratch();
+
+    return result->ran;
+}
@@ -0,0 +1,194 @@
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "memfault/metrics/metrics.h"
+#include "memfault/panics/assert.h"
+
+#include "power_policy.h"
+
+#include "bq24196.h"
+#include "constants.h"
+#include "log.h"
+#include "nvs.h"
+#include "scheduler_task.h"
+#include "wifi.h"
+
+#define TAG SC_TAG_POWER
+
+// Enough for a fast connect to fail and fall back to a full scan + DHCP
+#define POWER_POLICY_RADIO_ON_TIMEOUT_MS (15 * MS_PER_SEC)
+
+static SemaphoreHandle_t lock;
+static uint8_t           holders;
+
+static portMUX_TYPE radio_time_lock   = portMUX_INITIALIZER_UNLOCKED;
+static int64_t      radio_on_since_us = 0;  // 0 while radio is stopped
+static uint64_t     radio_on_total_us = 0;
+
+// Assume usb until the first charger read so nothing gets throttled on a read error at boot
+static volatile power_tier_t current_tier = POWER_TIER_USB;
+
+static const char *const tier_names[POWER_TIER_COUNT] = {
+    [POWER_TIER_USB]     = "usb",
+    [POWER_TIER_BATTERY] = "battery",
+};
+
+// How much longer stretchable scheduler updates wait between runs in each tier
+static const uint8_t tier_interval_multipliers[POWER_TIER_COUNT] = {
+    [POWER_TIER_USB]     = 1,
+    [POWER_TIER_BATTERY] = 2,
+};
+
+/*
+ * Tracks radio on time off the driver's own start/stop events so it counts every path that starts the radio (boot,
+ * provisioning, the policy here), not just ours
+ */
+static void power_policy_wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *data) {
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&radio_time_lock);
+    if (event_id == WIFI_EVENT_STA_START && radio_on_since_us == 0) {
+        radio_on_since_us = now_us;
+    } else if (event_id == WIFI_EVENT_STA_STOP && radio_on_since_us != 0) {
+        radio_on_total_us += now_us - radio_on_since_us;
+        radio_on_since_us = 0;
+    }
+    taskEXIT_CRITICAL(&radio_time_lock);
+
+    if (event_id == WIFI_EVENT_STA_START) {
+        memfault_metrics_heartbeat_timer_start(MEMFAULT_METRICS_KEY(radio_on_time_ms));
+    } else {
+        memfault_metrics_heartbeat_timer_stop(MEMFAULT_METRICS_KEY(radio_on_time_ms));
+    }
+}
+
+static bool power_policy_radio_off_allowed() {
+    spot_check_config_t *config = nvs_get_config();
+    bool                 push_channel_configured =
+        config->operating_mode == SPOT_CHECK_MODE_CUSTOM && config->custom_push_url[0] != '\0';
+
+    // Offline mode needs the radio to poll for the network coming back
+    return scheduler_get_mode() == SCHEDULER_MODE_ONLINE && !push_channel_configured && current_tier != POWER_TIER_USB;
+}
+
+/*
+ * Must be called after wifi_init and before the radio is first started so the on time starts counting from boot
+ */
+void power_policy_init() {
+    lock = xSemaphoreCreateMutex();
+    MEMFAULT_ASSERT(lock);
+    holders = 0;
+
+    ESP_ERROR_CHECK(
+        esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_START, power_policy_wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(
+        esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_STOP, power_policy_wifi_event_handler, NULL));
+
+    // Boot is nothing but network requests up through the scheduler's first round of updates, the first release drops
+    // us into idle
+    esp_wifi_set_ps(WIFI_PS_NONE);
+}
+
+/*
+ * Call before any burst of network requests. Brings the radio back up if it was turned off (blocking until connected
+ * or timed out) and turns power save off until the matching release.
+ */
+void power_policy_radio_acquire() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    holders++;
+    if (holders == 1) {
+        if (!wifi_is_radio_on()) {
+            log_printf(LOG_LEVEL_INFO, "Turning radio back on for network requests");
+            wifi_radio_on();
+            if (!wifi_block_until_connected_timeout(POWER_POLICY_RADIO_ON_TIMEOUT_MS)) {
+                log_printf(LOG_LEVEL_WARN,
+                           "Radio didn't reconnect within %ums, requests will fail",
+                           POWER_POLICY_RADIO_ON_TIMEOUT_MS);
+            }
+        }
+
+        esp_wifi_set_ps(WIFI_PS_NONE);
+        log_printf(LOG_LEVEL_DEBUG, "Radio in performance mode");
+    }
+    xSemaphoreGive(lock);
+}
+
+/*
+ * Once the last holder releases the radio goes to max modem sleep, or all the way off if we're on battery and nothing
+ * else needs it
+ */
+void power_policy_radio_release() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (holders == 0) {
+        log_printf(LOG_LEVEL_WARN, "Radio released more times than acquired, ignoring");
+        xSemaphoreGive(lock);
+        return;
+    }
+
+    holders--;
+    if (holders == 0) {
+        if (power_policy_radio_off_allowed()) {
+            log_printf(LOG_LEVEL_INFO, "On battery with nothing needing the network, turning radio off");
+            wifi_radio_off();
+        } else {
+            esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+            log_printf(LOG_LEVEL_DEBUG, "Radio in idle mode");
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+/*
+ * Total time the sta radio has been started since boot, including the current stretch if it's on now
+ */
+uint64_t power_policy_get_radio_on_ms() {
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&radio_time_lock);
+    uint64_t total_us = radio_on_total_us + (radio_on_since_us ? now_us - radio_on_since_us : 0);
+    taskEXIT_CRITICAL(&radio_time_lock);
+
+    return total_us / 1000;
+}
+
+/*
+ * Reads the charger status and moves to the matching tier. Blocks on i2c so call from a task, not a timer callback.
+ * Read errors leave the tier where it was. Returns true if the tier changed.
+ */
+bool power_policy_update_tier() {
+    bool on_battery;
+    if (bq24196_read_on_battery(&on_battery) != ESP_OK) {
+        log_printf(LOG_LEVEL_WARN,
+                   "Failed to read charger status, staying in '%s' power tier",
+                   tier_names[current_tier]);
+        return false;
+    }
+
+    power_tier_t new_tier = on_battery ? POWER_TIER_BATTERY : POWER_TIER_USB;
+
+    if (new_tier == current_tier) {
+        return false;
+    }
+
+    log_printf(LOG_LEVEL_INFO, "Power tier changed from '%s' to '%s'", tier_names[current_tier], tier_names[new_tier]);
+    current_tier = new_tier;
+    return true;
+}
+
+power_tier_t power_policy_get_tier() {
+    return current_tier;
+}
+
+const char *power_policy_tier_to_string(power_tier_t tier) {
+    if (tier >= POWER_TIER_COUNT) {
+        return "unknown";
+    }
+
+    return tier_names[tier];
+}
+
+uint8_t power_policy_get_interval_multiplier() {
+    return tier_interval_multipliers[current_tier];
+}
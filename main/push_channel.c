@@ -0,0 +1,276 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "push_channel.h"
+
+#include "constants.h"
+#include "http_server.h"
+#include "log.h"
+#include "memory_budget.h"
+#include "nvs.h"
+#include "scheduler_task.h"
+#include "spot_check.h"
+#include "wifi.h"
+
+#define TAG SC_TAG_PUSH
+
+#define PUSH_CHANNEL_WAIT_SECS (60)
+// Give the server some slack past the wait it was asked for before calling the connection dead
+#define PUSH_CHANNEL_TIMEOUT_MS ((PUSH_CHANNEL_WAIT_SECS + 15) * MS_PER_SEC)
+// Floor on time between polls so a server that doesn't hold requests doesn't turn this into a busy loop
+#define PUSH_CHANNEL_MIN_POLL_MS (5 * MS_PER_SEC)
+#define PUSH_CHANNEL_MIN_BACKOFF_SECS (5)
+#define PUSH_CHANNEL_MAX_BACKOFF_SECS (5 * SECS_PER_MIN)
+#define PUSH_CHANNEL_VERSION_BYTES (64 + 1)
+#define PUSH_CHANNEL_URL_BYTES (MAX_LENGTH_CUSTOM_PUSH_URL_PARAM + 128)
+
+typedef enum {
+    PUSH_POLL_NO_CHANGE,
+    PUSH_POLL_CHANGED,
+    PUSH_POLL_ERROR,
+} push_poll_result_t;
+
+static TaskHandle_t  push_channel_task_handle = NULL;
+static StaticTask_t  push_channel_task_buffer;
+static StackType_t   push_channel_task_stack[MEMORY_BUDGET_PUSH_CHANNEL_STACK_BYTES];
+static volatile bool connected                = false;
+static volatile bool paused                   = false;
+static char          last_version[PUSH_CHANNEL_VERSION_BYTES];
+
+// Given by the task once it has closed its connection in response to a pause
+static SemaphoreHandle_t parked_smphr;
+static StaticSemaphore_t parked_smphr_buffer;
+
+/*
+ * Token goes straight back into the next request's query string so only allow chars that don't need escaping
+ */
+static bool push_channel_version_is_valid(const char *version) {
+    if (version[0] == '\0') {
+        return false;
+    }
+
+    for (const char *c = version; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_' && *c != '.') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static push_poll_result_t push_channel_poll(esp_http_client_handle_t client, const char *push_url) {
+    char url[PUSH_CHANNEL_URL_BYTES];
+    snprintf(url,
+             sizeof(url),
+             "%s%cdevice_id=%s&version=%s&wait=%u",
+             push_url,
+             strchr(push_url, '?') ? '&' : '?',
+             spot_check_get_serial(),
+             last_version,
+             PUSH_CHANNEL_WAIT_SECS);
+    esp_http_client_set_url(client, url);
+
+    // Reuses the kept-alive connection from the last poll if the server didn't close it
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_WARN, "Error opening push channel connection: %s", esp_err_to_name(err));
+        return PUSH_POLL_ERROR;
+    }
+
+    // Blocks for the server's hold time
+    if (esp_http_client_fetch_headers(client) < 0) {
+        log_printf(LOG_LEVEL_WARN, "Push channel request timed out or dropped");
+        return PUSH_POLL_ERROR;
+    }
+
+    int status = esp_http_client_get_status_code(client);
+    if (status == 204 || status == 304) {
+        esp_http_client_flush_response(client, NULL);
+        return PUSH_POLL_NO_CHANGE;
+    }
+
+    if (status != 200) {
+        log_printf(LOG_LEVEL_WARN, "Push channel server returned status %d", status);
+        return PUSH_POLL_ERROR;
+    }
+
+    char version[PUSH_CHANNEL_VERSION_BYTES];
+    int  bytes_read = esp_http_client_read_response(client, version, sizeof(version) - 1);
+    esp_http_client_flush_response(client, NULL);
+    if (bytes_read < 0) {
+        log_printf(LOG_LEVEL_WARN, "Error reading push channel version body");
+        return PUSH_POLL_ERROR;
+    }
+
+    // Strip any trailing newline/whitespace from the server
+    version[bytes_read] = '\0';
+    while (bytes_read > 0 && isspace((unsigned char)version[bytes_read - 1])) {
+        version[--bytes_read] = '\0';
+    }
+
+    if (!push_channel_version_is_valid(version)) {
+        log_printf(LOG_LEVEL_WARN, "Push channel server sent invalid version token '%s'", version);
+        return PUSH_POLL_ERROR;
+    }
+
+    if (strcmp(version, last_version) == 0) {
+        return PUSH_POLL_NO_CHANGE;
+    }
+
+    // First token after boot just syncs us up, transition to online mode already forced a download
+    bool first_sync = last_version[0] == '\0';
+    strcpy(last_version, version);
+    if (first_sync) {
+        log_printf(LOG_LEVEL_INFO, "Push channel synced to version '%s'", last_version);
+        return PUSH_POLL_NO_CHANGE;
+    }
+
+    log_printf(LOG_LEVEL_INFO, "Push channel notified of new custom screen version '%s'", last_version);
+    return PUSH_POLL_CHANGED;
+}
+
+static void push_channel_task(void *args) {
+    // Config is only ever changed with a reboot, safe to hold onto this for the life of the task
+    const char *push_url = nvs_get_config()->custom_push_url;
+
+    esp_http_client_config_t http_config = {
+        .url               = push_url,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms        = PUSH_CHANNEL_TIMEOUT_MS,
+        .keep_alive_enable = true,
+    };
+    esp_http_client_handle_t client = NULL;
+
+    uint32_t backoff_secs = PUSH_CHANNEL_MIN_BACKOFF_SECS;
+    while (1) {
+        if (paused) {
+            connected = false;
+            if (client) {
+                esp_http_client_close(client);
+            }
+            log_printf(LOG_LEVEL_INFO, "Push channel paused, connection closed");
+            xSemaphoreGive(parked_smphr);
+            while (paused) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            log_printf(LOG_LEVEL_INFO, "Push channel resumed");
+        }
+
+        // Never exits on failure, the interval poll covers for it until the client can be created
+        if (client == NULL) {
+            client = esp_http_client_init(&http_config);
+            if (client == NULL) {
+                log_printf(LOG_LEVEL_ERROR,
+                           "Error initing push channel http client, retrying in %lu secs",
+                           backoff_secs);
+                vTaskDelay(pdMS_TO_TICKS(backoff_secs * MS_PER_SEC));
+                backoff_secs = MIN(backoff_secs * 2, PUSH_CHANNEL_MAX_BACKOFF_SECS);
+                continue;
+            }
+        }
+
+        if (!wifi_is_connected_to_network()) {
+            connected = false;
+            esp_http_client_close(client);
+            wifi_block_until_connected();
+        }
+
+        int64_t            start_us = esp_timer_get_time();
+        push_poll_result_t result   = push_channel_poll(client, push_url);
+        if (result == PUSH_POLL_ERROR) {
+            connected = false;
+            esp_http_client_close(client);
+            log_printf(LOG_LEVEL_INFO, "Push channel down, retrying in %lu secs", backoff_secs);
+            vTaskDelay(pdMS_TO_TICKS(backoff_secs * MS_PER_SEC));
+            backoff_secs = MIN(backoff_secs * 2, PUSH_CHANNEL_MAX_BACKOFF_SECS);
+            continue;
+        }
+
+        if (!connected) {
+            log_printf(LOG_LEVEL_INFO, "Push channel connected, pausing interval polling for custom screen");
+        }
+        connected    = true;
+        backoff_secs = PUSH_CHANNEL_MIN_BACKOFF_SECS;
+
+        if (result == PUSH_POLL_CHANGED) {
+            scheduler_schedule_custom_screen_update();
+            scheduler_trigger();
+        }
+
+        uint32_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+        if (elapsed_ms < PUSH_CHANNEL_MIN_POLL_MS) {
+            vTaskDelay(pdMS_TO_TICKS(PUSH_CHANNEL_MIN_POLL_MS - elapsed_ms));
+        }
+    }
+}
+
+void push_channel_init() {
+    parked_smphr = xSemaphoreCreateBinaryStatic(&parked_smphr_buffer);
+    memory_budget_register_stack("push channel", sizeof(push_channel_task_stack), &push_channel_task_handle);
+}
+
+/*
+ * Starts the long-poll task if there's a push url configured, otherwise does nothing. Safe to call multiple times. The
+ * task never exits once started, so its static TCB and stack are never reused.
+ */
+void push_channel_start() {
+    if (push_channel_task_handle != NULL) {
+        return;
+    }
+
+    spot_check_config_t *config = nvs_get_config();
+    if (config->operating_mode != SPOT_CHECK_MODE_CUSTOM || config->custom_push_url[0] == '\0') {
+        return;
+    }
+
+    log_printf(LOG_LEVEL_INFO, "Starting push channel to '%s'", config->custom_push_url);
+    push_channel_task_handle = xTaskCreateStatic(&push_channel_task,
+                                                 "push-channel",
+                                                 sizeof(push_channel_task_stack),
+                                                 NULL,
+                                                 tskIDLE_PRIORITY,
+                                                 push_channel_task_stack,
+                                                 &push_channel_task_buffer);
+}
+
+UBaseType_t push_channel_get_stack_high_water() {
+    return push_channel_task_handle == NULL ? 0 : uxTaskGetStackHighWaterMark(push_channel_task_handle);
+}
+
+bool push_channel_is_connected() {
+    return connected;
+}
+
+/*
+ * Closes the channel's connection so its TLS session isn't holding heap next to something bigger (OTA download) and
+ * keeps it closed until push_channel_resume. A poll in flight can't be interrupted, so this blocks until the task
+ * finishes it and parks, at most one server hold time. Returns immediately if the task isn't running.
+ */
+void push_channel_pause() {
+    if (push_channel_task_handle == NULL) {
+        return;
+    }
+
+    // Clear a park left over from a previous pause that timed out while the task was backing off
+    xSemaphoreTake(parked_smphr, 0);
+    paused = true;
+    if (!xSemaphoreTake(parked_smphr, pdMS_TO_TICKS(PUSH_CHANNEL_TIMEOUT_MS))) {
+        // Only way to get here is the task sleeping in backoff, which already closed the connection
+        log_printf(LOG_LEVEL_WARN, "Push channel didn't park within %dms, continuing", PUSH_CHANNEL_TIMEOUT_MS);
+    }
+}
+
+void push_channel_resume() {
+    paused = false;
+    if (push_channel_task_handle != NULL) {
+        xTaskNotifyGive(push_channel_task_handle);
+    }
+}
@@ -1,9 +1,11 @@
 #include <string.h>
 #include <time.h>
 
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "memfault/metrics/metrics.h"
 #include "memfault/panics/assert.h"
 #include "memfault_interface.h"
 
@@ -13,8 +15,11 @@
 #include "gpio.h"
 #include "http_client.h"
 #include "log.h"
+#include "memory_budget.h"
 #include "nvs.h"
 #include "ota_task.h"
+#include "power_policy.h"
+#include "push_channel.h"
 #include "screen_img_handler.h"
 #include "sleep_handler.h"
 #include "sntp_time.h"
@@ -24,13 +29,16 @@
 
 #define TAG SC_TAG_SCHEDULER
 
-#define NUM_DIFFERENTIAL_UPDATES 5
+#define NUM_DIFFERENTIAL_UPDATES 6
 #define NUM_DISCRETE_UPDATES 9
 
 #define OTA_CHECK_INTERVAL_SECONDS (CONFIG_OTA_CHECK_INTERVAL_HOURS * MINS_PER_HOUR * SECS_PER_MIN)
 #define NETWORK_CHECK_INTERVAL_SECONDS (30)
 #define MFLT_UPLOAD_INTERVAL_SECONDS (30 * SECS_PER_MIN)
+// Periodic uploads wait for another network request to ride along with, up to this long
+#define MFLT_UPLOAD_MAX_DEFER_SECONDS (2 * MINS_PER_HOUR * SECS_PER_MIN)
 #define SCREEN_DIRTY_INTERVAL_SECONDS (30 * SECS_PER_MIN)
+#define POWER_CHECK_INTERVAL_SECONDS (SECS_PER_MIN)
 
 #define UPDATE_CONDITIONS_BIT (1 << 0)
 #define UPDATE_TIDE_CHART_BIT (1 << 1)
@@ -44,12 +52,25 @@
 #define MARK_SCREEN_DIRTY_BIT (1 << 9)
 #define CUSTOM_SCREEN_UPDATE_BIT (1 << 10)
 #define UPDATE_WIND_CHART_BIT (1 << 11)
+#define CUSTOM_SCREEN_REDRAW_BIT (1 << 12)
+#define PUSHED_IMAGE_RENDER_BIT (1 << 13)
+#define CHECK_POWER_BIT (1 << 14)
 
 // Anything that causes a draw to the  screen needs to be added here. This exists so scheduler doesn't re-render screen
 // for logical update structs like memfault or ota check
 #define BITS_NEEDING_RENDER                                                                           \
     (UPDATE_CONDITIONS_BIT | UPDATE_TIDE_CHART_BIT | UPDATE_SWELL_CHART_BIT | UPDATE_WIND_CHART_BIT | \
-     UPDATE_TIME_BIT | UPDATE_SPOT_NAME_BIT | UPDATE_DATE_BIT | CUSTOM_SCREEN_UPDATE_BIT)
+     UPDATE_TIME_BIT | UPDATE_SPOT_NAME_BIT | UPDATE_DATE_BIT | CUSTOM_SCREEN_UPDATE_BIT |            \
+     CUSTOM_SCREEN_REDRAW_BIT | PUSHED_IMAGE_RENDER_BIT)
+
+// Anything that makes a network request. Radio is held in performance mode (and turned back on if the power policy
+// had it off) for the whole network section when any of these are set
+#define BITS_NEEDING_NETWORK                                                                           \
+    (UPDATE_CONDITIONS_BIT | UPDATE_TIDE_CHART_BIT | UPDATE_SWELL_CHART_BIT | UPDATE_WIND_CHART_BIT | \
+     SEND_MFLT_DATA_BIT | CHECK_OTA_BIT | CHECK_NETWORK_BIT | CUSTOM_SCREEN_UPDATE_BIT)
+
+// Render bits that only touch part of the screen and rely on the framebuffer diff instead of marking everything dirty
+#define BITS_PARTIAL_RENDER (UPDATE_TIME_BIT | PUSHED_IMAGE_RENDER_BIT)
 
 /*
  * Exists only to easily index into the discrete/diff update struct arrays in order to perform special handling for
@@ -75,6 +96,7 @@ typedef enum {
     DIFFERENTIAL_UPDATE_INDEX_MFLT_UPLOAD,
     DIFFERENTIAL_UPDATE_INDEX_DIRTY_SCREEN,
     DIFFERENTIAL_UPDATE_INDEX_CUSTOM_SCREEN_UPDATE,
+    DIFFERENTIAL_UPDATE_INDEX_POWER_CHECK,
 
     DIFFERENTIAL_UPDATE_INDEX_COUNT,
 } differential_update_index_t;
@@ -85,6 +107,7 @@ typedef struct {
     time_t            last_executed_epoch_secs;
     bool              force_next_update;  // mutable flag at runtime to indicate whether this should be run next trigger
     bool              force_on_transition_to_online;  // set at compile time, should not be changed ever
+    bool              stretch_on_battery;  // interval multiplied by the power tier's multiplier when off usb
     bool              active;
     spot_check_mode_t active_operating_mode;
     void (*execute)(void);
@@ -100,13 +123,24 @@ typedef struct {
     void (*execute)(void);
     bool force_next_update;              // mutable flag at runtime to indicate whether this should be run next trigger
     bool force_on_transition_to_online;  // set at compile time, should not be changed ever
+    bool stretch_on_battery;             // wildcard hours only run every power tier multiplier'th hour when off usb
 } discrete_update_t;
 
 static TaskHandle_t          scheduler_task_handle;
+static StaticTask_t          scheduler_task_buffer;
+static StackType_t           scheduler_task_stack[MEMORY_BUDGET_SCHEDULER_STACK_BYTES];
 static scheduler_mode_t      scheduler_mode;
 static volatile unsigned int seconds_elapsed;
 static conditions_t          last_retrieved_conditions;
 static uint32_t              scheduled_bits;
+static volatile uint32_t     loop_max_ms;  // since last heartbeat
+static volatile bool         mflt_upload_pending;
+static time_t                mflt_upload_pending_since_epoch_secs;
+static bool                  ota_check_deferred;  // only touched from scheduler task
+
+static void scheduler_poll_custom_screen();
+static void scheduler_queue_mflt_upload();
+static void scheduler_schedule_power_check();
 
 // Execute function cannot be blocking! Will execute from 1 sec timer interrupt callback
 static differential_update_t differential_updates[NUM_DIFFERENTIAL_UPDATES] = {
@@ -115,6 +149,7 @@ static differential_update_t differential_updates[NUM_DIFFERENTIAL_UPDATES] = {
             .debug_name                    = "ota",
             .force_next_update             = false,
             .force_on_transition_to_online = false,
+            .stretch_on_battery            = false,  // deferred entirely until back on usb instead
             .update_interval_secs          = OTA_CHECK_INTERVAL_SECONDS,
             .active                        = false,
             .active_operating_mode         = 0xFF,
@@ -125,6 +160,7 @@ static differential_update_t differential_updates[NUM_DIFFERENTIAL_UPDATES] = {
             .debug_name                    = "network_check",
             .force_next_update             = false,
             .force_on_transition_to_online = false,
+            .stretch_on_battery            = false,
             .update_interval_secs          = NETWORK_CHECK_INTERVAL_SECONDS,
             .active                        = false,
             .active_operating_mode         = 0xFF,
@@ -136,19 +172,19 @@ static differential_update_t differential_updates[NUM_DIFFERENTIAL_UPDATES] = {
             .force_next_update = false,
             .force_on_transition_to_online =
                 false,  // do not set this true - it will run immediately on transition from init->online mode at boot,
-                        // and if it has a large payload to upload, it will break any subsequent network requests (like
-                        // custom screen download) because we can't block on the upload, it just triggers the internal
-                        // http client in memfault code
+                        // and a large payload (coredump) would hold up the first round of screen updates
+            .stretch_on_battery    = true,
             .update_interval_secs  = MFLT_UPLOAD_INTERVAL_SECONDS,
             .active                = false,
             .active_operating_mode = 0xFF,
-            .execute               = scheduler_schedule_mflt_upload,
+            .execute               = scheduler_queue_mflt_upload,
         },
     [DIFFERENTIAL_UPDATE_INDEX_DIRTY_SCREEN] =
         {
             .debug_name                    = "dirty_screen",
             .force_next_update             = false,
             .force_on_transition_to_online = false,
+            .stretch_on_battery            = true,
             .update_interval_secs          = SCREEN_DIRTY_INTERVAL_SECONDS,
             .active                        = false,
             .active_operating_mode         = SPOT_CHECK_MODE_WEATHER,
@@ -159,11 +195,23 @@ static differential_update_t differential_updates[NUM_DIFFERENTIAL_UPDATES] = {
             .debug_name        = "custom_screen_update",
             .force_next_update = false,
             .force_on_transition_to_online =
-                true,                    // mostly need it to force run immediately on init->online transition
+                true,  // mostly need it to force run immediately on init->online transition
+            .stretch_on_battery    = true,
             .update_interval_secs  = 0,  // set from config value in scheduler start fun
             .active                = false,
             .active_operating_mode = SPOT_CHECK_MODE_CUSTOM,
-            .execute               = scheduler_schedule_custom_screen_update,
+            .execute               = scheduler_poll_custom_screen,
+        },
+    [DIFFERENTIAL_UPDATE_INDEX_POWER_CHECK] =
+        {
+            .debug_name                    = "power_check",
+            .force_next_update             = false,
+            .force_on_transition_to_online = true,  // pick the tier before the first round's network requests
+            .stretch_on_battery            = false,
+            .update_interval_secs          = POWER_CHECK_INTERVAL_SECONDS,
+            .active                        = false,
+            .active_operating_mode         = 0xFF,
+            .execute                       = scheduler_schedule_power_check,
         },
 };
 
@@ -174,6 +222,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "time",
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = false,
             .hour                          = 0xFF,  // wildcards, should update every minute every hour
             .minute                        = 0xFF,
             .last_executed                 = {0},
@@ -186,6 +235,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "date",
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = false,
             .hour                          = 0,
             .minute                        = 1,
             .last_executed                 = {0},
@@ -198,6 +248,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "conditions",
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = true,
             .hour                          = 0xFF,  // wildcard, runs on 5th minute of every hours
             .minute                        = 5,
             .last_executed                 = {0},
@@ -210,6 +261,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "tide",
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = false,
             .hour                          = 3,
             .minute                        = 0,
             .last_executed                 = {0},
@@ -222,6 +274,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "swell_morning",
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = false,
             .hour                          = 3,
             .minute                        = 0,
             .last_executed                 = {0},
@@ -234,6 +287,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "swell_midday",
             .force_next_update             = false,
             .force_on_transition_to_online = false,
+            .stretch_on_battery            = false,
             .hour                          = 12,
             .minute                        = 0,
             .last_executed                 = {0},
@@ -246,6 +300,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "swell_evening",
             .force_next_update             = false,
             .force_on_transition_to_online = false,
+            .stretch_on_battery            = false,
             .hour                          = 17,
             .minute                        = 0,
             .last_executed                 = {0},
@@ -259,6 +314,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
                                         // spot name on first transition from boot offline mode into online mode
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = false,
             .hour                          = 0xEE,  // this hour will obviously never be hit
             .minute                        = 0xEE,  // this minute will obviously never be hit
             .last_executed                 = {0},
@@ -271,6 +327,7 @@ static discrete_update_t discrete_updates[NUM_DISCRETE_UPDATES] = {
             .debug_name                    = "wind",
             .force_next_update             = false,
             .force_on_transition_to_online = true,
+            .stretch_on_battery            = true,
             .hour                          = 0xFF,  // wildcard, runs on 5th minute of every hours
             .minute                        = 5,
             .last_executed                 = {0},
@@ -318,6 +375,15 @@ static inline bool discrete_time_not_yet_executed_today(struct tm now, struct tm
            now.tm_min != last_executed.tm_min;
 }
 
+/*
+ * Stretched discrete updates with a wildcard hour only run every multiplier'th hour while off usb, so with a 2x
+ * multiplier an hourly update runs on even hours. Fixed hour updates are already at most daily and always run.
+ */
+static inline bool discrete_hour_in_power_stride(int current_hour, discrete_update_t *update) {
+    return !update->stretch_on_battery || update->hour != 0xFF ||
+           (current_hour % power_policy_get_interval_multiplier()) == 0;
+}
+
 static inline bool active_chart_matches(spot_check_config_t *config, discrete_update_index_t index) {
     screen_img_t screen_img_to_compare;
     switch (index) {
@@ -350,6 +416,21 @@ static inline bool update_struct_is_chart(discrete_update_index_t index) {
            index == DISCRETE_UPDATE_INDEX_WIND_CHART;
 }
 
+/*
+ * Interval execute for the custom screen. Skipped while the push channel is up since the server tells us when there's
+ * something new and interval polling is only the fallback. Forced runs (transition to online) always go through since
+ * the screen was just cleared and needs redrawing.
+ */
+static void scheduler_poll_custom_screen() {
+    if (!differential_updates[DIFFERENTIAL_UPDATE_INDEX_CUSTOM_SCREEN_UPDATE].force_next_update &&
+        push_channel_is_connected()) {
+        log_printf(LOG_LEVEL_DEBUG, "Push channel connected, skipping interval custom screen update");
+        return;
+    }
+
+    scheduler_schedule_custom_screen_update();
+}
+
 /*
  * Polling function that runs every 1 second. Responsible for checking all differential/discrete time update structs
  * and if any have reached their elapsed time, execute and update them. No execute functions for the update structs
@@ -358,18 +439,23 @@ static inline bool update_struct_is_chart(discrete_update_index_t index) {
  */
 static void scheduler_polling_timer_callback(void *timer_args) {
     struct tm now_local;
-    sntp_time_get_local_time(&now_local);
-    time_t now_epoch_secs = mktime(&now_local);
+    time_t    now_epoch_secs = sntp_time_get_local_time(&now_local);
 
-    differential_update_t *diff_check = NULL;
+    uint8_t                interval_multiplier = power_policy_get_interval_multiplier();
+    differential_update_t *diff_check          = NULL;
     for (int i = 0; i < NUM_DIFFERENTIAL_UPDATES; i++) {
         diff_check = &differential_updates[i];
         if (!diff_check->active) {
             continue;
         }
 
+        time_t interval_secs = diff_check->update_interval_secs;
+        if (diff_check->stretch_on_battery) {
+            interval_secs *= interval_multiplier;
+        }
+
         // If time differential has passed OR force execute flag set, execute and bring up to date.
-        if (((now_epoch_secs - diff_check->last_executed_epoch_secs) > diff_check->update_interval_secs) ||
+        if (((now_epoch_secs - diff_check->last_executed_epoch_secs) > interval_secs) ||
             diff_check->force_next_update) {
             // Printing time_t is fucked, have to convert to double with difftime
             log_printf(LOG_LEVEL_DEBUG,
@@ -377,7 +463,7 @@ static void scheduler_polling_timer_callback(void *timer_args) {
                        diff_check->debug_name,
                        difftime(diff_check->last_executed_epoch_secs, 0),
                        difftime(now_epoch_secs, 0),
-                       difftime(diff_check->update_interval_secs, 0),
+                       difftime(interval_secs, 0),
                        diff_check->force_next_update);
 
             diff_check->execute();
@@ -397,7 +483,8 @@ static void scheduler_polling_timer_callback(void *timer_args) {
         // multiple executions in the same minute)) OR force execute flag set, execute.
         if ((discrete_time_matches(now_local.tm_hour, discrete_check->hour) &&
              discrete_time_matches(now_local.tm_min, discrete_check->minute) &&
-             discrete_time_not_yet_executed_today(now_local, discrete_check->last_executed)) ||
+             discrete_time_not_yet_executed_today(now_local, discrete_check->last_executed) &&
+             discrete_hour_in_power_stride(now_local.tm_hour, discrete_check)) ||
             discrete_check->force_next_update) {
             log_printf(LOG_LEVEL_DEBUG,
                        "Executing discrete update '%s' (curr hr: %u, curr min: %u, check hr: %u, check min: %u, "
@@ -429,17 +516,36 @@ static void scheduler_task(void *args) {
 
     uint32_t update_bits        = 0;
     bool     full_clear         = false;
+    bool     redraw_restored    = false;
     bool     scheduler_success  = false;
     bool     force_screen_dirty = false;
     while (1) {
         // Wait forever until a notification received. Clears all bits on exit since we'll handle every set bit in one
         // go
         xTaskNotifyWait(0x0, UINT32_MAX, &update_bits, portMAX_DELAY);
+        int64_t loop_start_us = esp_timer_get_time();
 
         log_printf(LOG_LEVEL_DEBUG,
                    "scheduler task received task notification of value 0x%02X, updating accordingly",
                    update_bits);
 
+        // Power tier goes first so everything below is budgeted off the current charger state
+        if (update_bits & CHECK_POWER_BIT) {
+            if (power_policy_update_tier() && power_policy_get_tier() == POWER_TIER_USB && ota_check_deferred) {
+                log_printf(LOG_LEVEL_INFO, "Back on usb power, running deferred OTA check");
+                ota_check_deferred = false;
+                update_bits |= CHECK_OTA_BIT;
+            }
+        }
+
+        // OTA downloads are the most expensive thing we do, hold them until there's usb power. Dropping the bit here
+        // also keeps a lone OTA check from waking the radio.
+        if (update_bits & CHECK_OTA_BIT && power_policy_get_tier() != POWER_TIER_USB) {
+            log_printf(LOG_LEVEL_INFO, "On battery, deferring OTA check until back on usb power");
+            ota_check_deferred = true;
+            update_bits &= ~CHECK_OTA_BIT;
+        }
+
         spot_check_config_t *config = nvs_get_config();
         switch (config->operating_mode) {
             case SPOT_CHECK_MODE_WEATHER:
@@ -462,6 +568,11 @@ static void scheduler_task(void *args) {
          * Gate every network request block with a check for scheduler mode so one failed request will short circuit any
          * remaining ones if their update bits are also set
          **************************************/
+        bool needs_network = update_bits & BITS_NEEDING_NETWORK;
+        if (needs_network) {
+            power_policy_radio_acquire();
+        }
+
         if (update_bits & UPDATE_CONDITIONS_BIT && scheduler_get_mode() != SCHEDULER_MODE_OFFLINE) {
             sleep_handler_set_busy(SYSTEM_IDLE_CONDITIONS_BIT);
             conditions_t new_conditions = {0};
@@ -490,14 +601,14 @@ static void scheduler_task(void *args) {
             sleep_handler_set_idle(SYSTEM_IDLE_WIND_CHART_BIT);
         }
 
-        // Note: MUST come before OTA bit right now. Special case timer on boot where we delay first memfault and ota
-        // run triggers both ota task and memfault upload simultaneously. If order is reversed, async ota task will be
-        // running http reqs and memfault upload http req will fail. Will be fixed with refactor / improvement of http
-        // req queueing
-        if (update_bits & SEND_MFLT_DATA_BIT) {
-            // TODO :: brutally blocking right now for big coredump uploads
-            // Don't care about return value, all error-handling internal
-            (void)memfault_interface_post_data();
+        // Pending periodic uploads piggyback on any round that's already using the network. Comes before the OTA bit
+        // so the upload is done before the async OTA task starts making its own requests.
+        bool mflt_piggyback = mflt_upload_pending && needs_network && scheduler_get_mode() == SCHEDULER_MODE_ONLINE;
+        if (update_bits & SEND_MFLT_DATA_BIT || mflt_piggyback) {
+            // Blocking, but capped at a max number of chunks per upload
+            if (memfault_interface_post_data()) {
+                mflt_upload_pending = false;
+            }
         }
 
         if (update_bits & CHECK_OTA_BIT && scheduler_get_mode() != SCHEDULER_MODE_OFFLINE) {
@@ -531,10 +642,21 @@ static void scheduler_task(void *args) {
             sleep_handler_set_idle(SYSTEM_IDLE_CUSTOM_SCREEN_BIT);
         }
 
+        if (needs_network) {
+            power_policy_radio_release();
+        }
+
         /***************************************
          * Framebuffer update section
          **************************************/
-        if (full_clear) {
+        // First full redraw after a boot that restored the screen. Framebuffer matches the panel, so clearing it only
+        // in memory and rendering once takes the panel straight from last boot's content to the new content, no
+        // flashing.
+        redraw_restored = full_clear && spot_check_screen_restored();
+        if (redraw_restored) {
+            log_printf(LOG_LEVEL_DEBUG, "Redrawing over restored screen from scheduler_task");
+            spot_check_clear_framebuffer();
+        } else if (full_clear) {
             log_printf(LOG_LEVEL_DEBUG, "Performing full screen clear from scheduler_task");
             spot_check_full_clear();
         }
@@ -641,21 +763,43 @@ static void scheduler_task(void *args) {
             screen_img_handler_draw_screen_img(SCREEN_IMG_CUSTOM_SCREEN);
             log_printf(LOG_LEVEL_INFO, "scheduler task updated custom screen");
             sleep_handler_set_idle(SYSTEM_IDLE_CUSTOM_SCREEN_BIT);
+        } else if (update_bits & CUSTOM_SCREEN_REDRAW_BIT) {
+            // Image was already written to flash by someone else (local push), skip the clear so the update is a single
+            // refresh instead of a flash to white first
+            sleep_handler_set_busy(SYSTEM_IDLE_CUSTOM_SCREEN_BIT);
+            screen_img_handler_draw_screen_img(SCREEN_IMG_CUSTOM_SCREEN);
+            log_printf(LOG_LEVEL_INFO, "scheduler task redrew custom screen from flash");
+            sleep_handler_set_idle(SYSTEM_IDLE_CUSTOM_SCREEN_BIT);
         }
 
         /***************************************
          * Render section
          **************************************/
         if (update_bits & BITS_NEEDING_RENDER) {
-            // If either the force dirty flag is set or ANY bits requiring a screen render besides time are set, mark
-            // entire framebuffer as dirty
-            if (force_screen_dirty || (update_bits & ~UPDATE_TIME_BIT)) {
+            // Off usb, rounds that only redraw the time use the fast black/white waveform. Antialiased glyph edges come
+            // out a little hard until the next full redraw (dirty screen interval) cleans them up.
+            bool render_fast = (update_bits & BITS_NEEDING_RENDER) == UPDATE_TIME_BIT && !force_screen_dirty &&
+                               power_policy_get_tier() != POWER_TIER_USB;
+
+            // If either the force dirty flag is set or ANY bits requiring a screen render besides the partial ones are
+            // set, mark entire framebuffer as dirty
+            // Except for a redraw over a restored screen, which needs the framebuffer diff to stay intact
+            if (!redraw_restored && (force_screen_dirty || (update_bits & ~BITS_PARTIAL_RENDER))) {
                 force_screen_dirty = false;
                 spot_check_mark_all_lines_dirty();
             }
 
-            spot_check_render();
+            if (render_fast) {
+                spot_check_render_fast();
+            } else {
+                spot_check_render();
+            }
         }
+
+        uint32_t loop_ms = (esp_timer_get_time() - loop_start_us) / 1000;
+        loop_max_ms      = MAX(loop_max_ms, loop_ms);
+        memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(scheduler_loop_count), 1);
+        memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(scheduler_loop_total_ms), loop_ms);
     }
 }
 
@@ -749,6 +893,29 @@ void scheduler_schedule_ota_check() {
     scheduled_bits |= CHECK_OTA_BIT;
 }
 
+static void scheduler_schedule_power_check() {
+    log_printf(LOG_LEVEL_DEBUG, "Scheduling bit 0x%08X (power check)", CHECK_POWER_BIT);
+    scheduled_bits |= CHECK_POWER_BIT;
+}
+
+/*
+ * Periodic memfault upload doesn't get its own network round, it just marks data pending so it goes out with the next
+ * round that's already making requests. Only forces its own round if nothing else has gone out for a while, which is
+ * stretched along with the interval when off usb.
+ */
+static void scheduler_queue_mflt_upload() {
+    time_t now = time(NULL);
+    if (!mflt_upload_pending) {
+        mflt_upload_pending                  = true;
+        mflt_upload_pending_since_epoch_secs = now;
+        log_printf(LOG_LEVEL_DEBUG, "Memfault upload pending until next network round");
+    } else if (now - mflt_upload_pending_since_epoch_secs >=
+               MFLT_UPLOAD_MAX_DEFER_SECONDS * power_policy_get_interval_multiplier()) {
+        log_printf(LOG_LEVEL_DEBUG, "Memfault upload pending too long, forcing");
+        scheduler_schedule_mflt_upload();
+    }
+}
+
 void scheduler_schedule_mflt_upload() {
     log_printf(LOG_LEVEL_DEBUG, "Scheduling bit 0x%08X (memfault)", SEND_MFLT_DATA_BIT);
     scheduled_bits |= SEND_MFLT_DATA_BIT;
@@ -764,6 +931,16 @@ void scheduler_schedule_custom_screen_update() {
     scheduled_bits |= CUSTOM_SCREEN_UPDATE_BIT;
 }
 
+void scheduler_schedule_custom_screen_redraw() {
+    log_printf(LOG_LEVEL_DEBUG, "Scheduling bit 0x%08X (custom screen redraw)", CUSTOM_SCREEN_REDRAW_BIT);
+    scheduled_bits |= CUSTOM_SCREEN_REDRAW_BIT;
+}
+
+void scheduler_schedule_pushed_image_render() {
+    log_printf(LOG_LEVEL_DEBUG, "Scheduling bit 0x%08X (pushed image render)", PUSHED_IMAGE_RENDER_BIT);
+    scheduled_bits |= PUSHED_IMAGE_RENDER_BIT;
+}
+
 scheduler_mode_t scheduler_get_mode() {
     return scheduler_mode;
 }
@@ -856,6 +1033,9 @@ void scheduler_set_online_mode() {
         // a short blip, so this prevents running all the forces for discrete/diff structs after popping into OTA for
         // max a minute or so.
         respect_force_flags = false;
+    } else if (spot_check_screen_restored()) {
+        // Booted straight into last boot's screen, leave it up until the forced updates redraw over it
+        respect_force_flags = true;
     } else {
         // Who knows what error or random state screen was in from init/offline mode. Full clear, show fetching
         // conditions, and kick everything off.
@@ -866,8 +1046,7 @@ void scheduler_set_online_mode() {
     }
 
     struct tm now_local;
-    sntp_time_get_local_time(&now_local);
-    time_t now_epoch_secs = mktime(&now_local);
+    time_t    now_epoch_secs = sntp_time_get_local_time(&now_local);
 
     spot_check_config_t *config = nvs_get_config();
     for (int i = 0; i < NUM_DIFFERENTIAL_UPDATES; i++) {
@@ -925,6 +1104,36 @@ void scheduler_set_online_mode() {
     }
 
     scheduler_mode = SCHEDULER_MODE_ONLINE;
+
+    // No-op unless in custom mode with a push url configured, or if it's already running from a previous transition
+    push_channel_start();
+}
+
+uint8_t scheduler_get_update_count() {
+    return NUM_DIFFERENTIAL_UPDATES + NUM_DISCRETE_UPDATES;
+}
+
+/*
+ * Indexes across both update struct arrays, differential first then discrete. last_executed_epoch_secs is 0 if the
+ * update has never run this boot. Reads aren't synchronized with the polling timer, only meant for reporting.
+ */
+bool scheduler_get_update_last_executed(uint8_t index, const char **name, time_t *last_executed_epoch_secs) {
+    if (index < NUM_DIFFERENTIAL_UPDATES) {
+        *name                     = differential_updates[index].debug_name;
+        *last_executed_epoch_secs = differential_updates[index].last_executed_epoch_secs;
+        return true;
+    }
+
+    index -= NUM_DIFFERENTIAL_UPDATES;
+    if (index >= NUM_DISCRETE_UPDATES) {
+        return false;
+    }
+
+    // Zeroed tm (year 1900) means it's never run, mktime would happily turn that into a big negative number
+    struct tm last_executed   = discrete_updates[index].last_executed;
+    *name                     = discrete_updates[index].debug_name;
+    *last_executed_epoch_secs = last_executed.tm_year == 0 ? 0 : mktime(&last_executed);
+    return true;
 }
 
 UBaseType_t scheduler_task_get_stack_high_water() {
@@ -932,9 +1141,20 @@ UBaseType_t scheduler_task_get_stack_high_water() {
     return uxTaskGetStackHighWaterMark(scheduler_task_handle);
 }
 
+/*
+ * Longest single round of updates since the last call, resets the max. Only meant for the heartbeat collection.
+ */
+uint32_t scheduler_task_take_loop_max_ms() {
+    uint32_t max_ms = loop_max_ms;
+    loop_max_ms     = 0;
+    return max_ms;
+}
+
 void scheduler_task_init() {
     scheduler_mode = SCHEDULER_MODE_INIT;
     scheduled_bits = 0x0;
+
+    memory_budget_register_stack("scheduler", sizeof(scheduler_task_stack), &scheduler_task_handle);
 }
 
 void scheduler_task_start() {
@@ -978,10 +1198,12 @@ void scheduler_task_start() {
                    config->custom_update_interval_secs);
     }
 
-    xTaskCreate(&scheduler_task,
-                "scheduler-update",
-                SPOT_CHECK_MINIMAL_STACK_SIZE_BYTES * 4,
-                NULL,
-                tskIDLE_PRIORITY,
-                &scheduler_task_handle);
+    scheduler_task_handle = xTaskCreateStatic(&scheduler_task,
+                                              "scheduler-update",
+                                              sizeof(scheduler_task_stack),
+                                              NULL,
+                                              tskIDLE_PRIORITY,
+                                              scheduler_task_stack,
+                                              &scheduler_task_buffer);
+    MEMFAULT_ASSERT(scheduler_task_handle);
 }
@@ -1,6 +1,8 @@
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "esp_partition.h"
+#include "esp_timer.h"
 #include "esp_sntp.h"
 #include "memfault/panics/assert.h"
 #include "spi_flash_mmap.h"
@@ -11,6 +13,7 @@
 #include "http_client.h"
 #include "json.h"
 #include "log.h"
+#include "metrics.h"
 #include "nvs.h"
 #include "screen_img_handler.h"
 #include "spot_check.h"
@@ -21,6 +24,9 @@
 #define WEATHER_CHART_1_Y_COORD_PX (190)  // make sure this doesn't run into the lowest conditions render line
 #define WEATHER_CHART_2_Y_COORD_PX (400)  // keep this at 400 to separate top axis title and bottom main title by 10px
 
+// Downloads are bounded by the http client timeouts, a local push would rather fail fast and let the sender retry
+#define SCREEN_IMG_STREAM_FLASH_LOCK_WAIT_MS (5000)
+
 typedef struct {
     screen_img_t screen_img;
     char        *screen_img_size_key;
@@ -33,6 +39,21 @@ typedef struct {
     char        *endpoint;
 } screen_img_metadata_t;
 
+// State for a screen img being written piece by piece from somewhere other than the http client (e.g. the local push
+// endpoint). Only one at a time.
+typedef struct {
+    bool                  active;
+    screen_img_metadata_t metadata;
+    uint32_t              expected_bytes;
+    uint32_t              written_bytes;
+} screen_img_stream_t;
+
+static screen_img_stream_t stream;
+
+// Serializes erase/write of the screen_img partition between scheduler downloads and local pushes from the httpd task
+static SemaphoreHandle_t flash_lock;
+static StaticSemaphore_t flash_lock_buffer;
+
 static void screen_img_handler_get_metadata(screen_img_t screen_img, screen_img_metadata_t *metadata) {
     switch (screen_img) {
         case SCREEN_IMG_TIDE_CHART:
@@ -127,7 +148,7 @@ static int screen_img_handler_save(esp_http_client_handle_t *client,
         uint32_t size_to_erase =
             alignment_remainder ? (metadata->screen_img_size + (4096 - alignment_remainder)) : metadata->screen_img;
 
-        esp_err_t err = esp_partition_erase_range(part, metadata->screen_img_offset, size_to_erase);
+        esp_err_t err = flash_partition_erase_range(part, metadata->screen_img_offset, size_to_erase);
         if (err != ESP_OK) {
             log_printf(LOG_LEVEL_ERROR, "Error erasing partition range: %s", esp_err_to_name(err));
             return 0;
@@ -215,6 +236,8 @@ static void screen_img_handler_retrieve_and_render(uint32_t x,
 }
 
 void screen_img_handler_init() {
+    flash_lock = xSemaphoreCreateMutexStatic(&flash_lock_buffer);
+    MEMFAULT_ASSERT(flash_lock);
 }
 
 /*
@@ -287,6 +310,111 @@ bool screen_img_handler_draw_chart(screen_img_t screen_img) {
     return true;
 }
 
+/*
+ * Start writing a new screen_img of the given dimensions (2 pixels per byte) in chunks with
+ * screen_img_handler_stream_write. Erases enough of the partition for both the old and new image up front. Stored
+ * metadata is zeroed until screen_img_handler_stream_end commits it, so a half-written image is never drawn. Holds the
+ * partition's flash lock until screen_img_handler_stream_end, which must be called from the same task.
+ */
+bool screen_img_handler_stream_begin(screen_img_t screen_img, uint32_t width, uint32_t height) {
+    if (stream.active) {
+        log_printf(LOG_LEVEL_ERROR, "Screen img stream already in progress, can't start another");
+        return false;
+    }
+
+    if (!xSemaphoreTake(flash_lock, pdMS_TO_TICKS(SCREEN_IMG_STREAM_FLASH_LOCK_WAIT_MS))) {
+        log_printf(LOG_LEVEL_ERROR, "Screen img partition busy with a download, can't start stream");
+        return false;
+    }
+
+    screen_img_handler_get_metadata(screen_img, &stream.metadata);
+    stream.metadata.screen_img_width  = width;
+    stream.metadata.screen_img_height = height;
+    stream.expected_bytes             = (width * height) / 2;
+    stream.written_bytes              = 0;
+
+    const esp_partition_t *part          = flash_partition_get_screen_img_partition();
+    uint32_t               size_to_erase = MAX(stream.expected_bytes, stream.metadata.screen_img_size);
+    size_to_erase                        = (size_to_erase + 4095) & ~4095;
+    if (stream.metadata.screen_img_offset + size_to_erase > part->size) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Screen img of %lu bytes at offset 0x%lX won't fit in screen_img partition",
+                   stream.expected_bytes,
+                   stream.metadata.screen_img_offset);
+        xSemaphoreGive(flash_lock);
+        return false;
+    }
+
+    nvs_set_uint32(stream.metadata.screen_img_size_key, 0);
+    nvs_set_uint32(stream.metadata.screen_img_width_key, 0);
+    nvs_set_uint32(stream.metadata.screen_img_height_key, 0);
+
+    esp_err_t err = flash_partition_erase_range(part, stream.metadata.screen_img_offset, size_to_erase);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error erasing partition range: %s", esp_err_to_name(err));
+        xSemaphoreGive(flash_lock);
+        return false;
+    }
+
+    stream.active = true;
+    return true;
+}
+
+bool screen_img_handler_stream_write(const uint8_t *data, size_t len) {
+    if (!stream.active) {
+        return false;
+    }
+
+    if (stream.written_bytes + len > stream.expected_bytes) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Screen img stream overrun, %lu bytes expected but got %lu",
+                   stream.expected_bytes,
+                   (uint32_t)(stream.written_bytes + len));
+        return false;
+    }
+
+    const esp_partition_t *part   = flash_partition_get_screen_img_partition();
+    uint32_t               offset = stream.metadata.screen_img_offset + stream.written_bytes;
+    esp_err_t              err    = flash_partition_write(part, offset, data, len);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error writing screen img stream to flash: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    stream.written_bytes += len;
+    return true;
+}
+
+/*
+ * Finishes a stream. If commit is true and the full image was written, the metadata is saved and the image can be
+ * drawn. Returns true only in that case.
+ */
+bool screen_img_handler_stream_end(bool commit) {
+    if (!stream.active) {
+        return false;
+    }
+
+    stream.active = false;
+    if (!commit || stream.written_bytes != stream.expected_bytes) {
+        xSemaphoreGive(flash_lock);
+        log_printf(LOG_LEVEL_WARN,
+                   "Screen img stream ended with %lu / %lu bytes written, discarding",
+                   stream.written_bytes,
+                   stream.expected_bytes);
+        return false;
+    }
+
+    nvs_set_uint32(stream.metadata.screen_img_size_key, stream.written_bytes);
+    nvs_set_uint32(stream.metadata.screen_img_width_key, stream.metadata.screen_img_width);
+    nvs_set_uint32(stream.metadata.screen_img_height_key, stream.metadata.screen_img_height);
+    xSemaphoreGive(flash_lock);
+    log_printf(LOG_LEVEL_INFO,
+               "Saved %lu byte streamed screen img to flash at 0x%lX offset",
+               stream.written_bytes,
+               stream.metadata.screen_img_offset);
+    return true;
+}
+
 bool screen_img_handler_download_and_save(screen_img_t screen_img) {
     screen_img_metadata_t metadata = {0};
     screen_img_handler_get_metadata(screen_img, &metadata);
@@ -306,6 +434,7 @@ bool screen_img_handler_download_and_save(screen_img_t screen_img) {
         req = http_client_build_get_request(metadata.endpoint, config, url, params, num_params);
     }
 
+    int64_t                  start_us       = esp_timer_get_time();
     esp_http_client_handle_t client;
     int                      content_length = 0;
     success                                 = http_client_perform_with_retries(&req, 1, &client, &content_length);
@@ -314,11 +443,16 @@ bool screen_img_handler_download_and_save(screen_img_t screen_img) {
         return false;
     }
 
+    // A local push may have replaced the stored image while we waited, re-read what's there so the erase covers it
+    xSemaphoreTake(flash_lock, portMAX_DELAY);
+    screen_img_handler_get_metadata(screen_img, &metadata);
     success = screen_img_handler_save(&client, screen_img, &metadata, content_length);
+    xSemaphoreGive(flash_lock);
     if (!success) {
         log_printf(LOG_LEVEL_ERROR, "Error saving screen img");
         return false;
     }
 
+    metrics_record_duration(METRICS_DURATION_SCREEN_IMG_DOWNLOAD, (esp_timer_get_time() - start_us) / 1000);
     return success;
 }
@@ -1,23 +1,303 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "esp_attr.h"
 #include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "memfault/panics/assert.h"
 
 #include "constants.h"
 #include "log.h"
 #include "sntp_time.h"
+#include "timer.h"
 
 #define TAG SC_TAG_SNTP
 
+#define SECS_PER_DAY (24 * MINS_PER_HOUR * SECS_PER_MIN)
+// Every real rule set transitions at least once a year, anything without a transition in this window has no DST and
+// just gets re-checked when the window runs out
+#define SNTP_TIME_TRANSITION_SEARCH_DAYS (400)
+
+// Poll interval doubles every time a sync lands close to where the drift model said it would, halves when it doesn't
+#define SNTP_TIME_MIN_POLL_SECS (MINS_PER_HOUR * SECS_PER_MIN)
+#define SNTP_TIME_MAX_POLL_SECS (SECS_PER_DAY)
+#define SNTP_TIME_GOOD_RESIDUAL_MS (250)
+#define SNTP_TIME_BAD_RESIDUAL_MS (1000)
+// NTP timestamps are only good to tens of ms over wifi, anything shorter than this is mostly measuring that noise
+#define SNTP_TIME_MIN_DRIFT_SAMPLE_SECS (30 * SECS_PER_MIN)
+// Way past any real crystal, anything bigger is a manual time set or a bad server response
+#define SNTP_TIME_MAX_DRIFT_PPM (500.0f)
+#define SNTP_TIME_DRIFT_WEIGHT (0.25f)
+#define SNTP_TIME_DRIFT_CORRECTION_PERIOD_MS (10 * SECS_PER_MIN * MS_PER_SEC)
+#define SNTP_TIME_DRIFT_MAGIC (0x5D21F701)
+
+/*
+ * Learned drift of our clock against NTP. Survives soft resets (same as the RTC time itself) so a reboot keeps the
+ * model and the stretched poll interval instead of starting over.
+ */
+typedef struct {
+    uint32_t magic;
+    float    drift_ppm;  // positive means NTP runs faster than us
+    uint32_t drift_samples;
+    uint32_t poll_interval_secs;
+    int64_t  last_sync_epoch_secs;
+} sntp_time_drift_state_t;
+
+// Not zeroed on boot, validated by the magic instead
+static RTC_NOINIT_ATTR sntp_time_drift_state_t drift_state;
+
+/*
+ * Server time + monotonic time at the last sync on this boot, the drift model is applied forward from here. Only
+ * counts as a drift measurement point if it came from NTP, not a trusted RTC time after reset or a manual set.
+ */
+static portMUX_TYPE      drift_anchor_lock     = portMUX_INITIALIZER_UNLOCKED;
+static bool              drift_anchor_valid    = false;
+static bool              drift_anchor_from_ntp = false;
+static int64_t           drift_anchor_epoch_us = 0;
+static int64_t           drift_anchor_mono_us  = 0;
+static timer_info_handle drift_correction_timer_handle;
+
+/*
+ * Offset from UTC that's in effect for every epoch second in [valid_from, valid_until). Lets local time conversions
+ * skip the full newlib TZ rule evaluation (which recomputes the year's transition dates on every call) for everything
+ * but the first call after a transition, a tz change, or the clock jumping out of the window.
+ */
+typedef struct {
+    bool    valid;
+    time_t  valid_from;
+    time_t  valid_until;
+    int32_t utc_offset_secs;
+    int     is_dst;
+} sntp_time_tz_cache_t;
+
+static portMUX_TYPE         tz_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+static sntp_time_tz_cache_t tz_cache      = {0};
+
+/*
+ * Inverse of gmtime, newlib doesn't provide timegm. Days from civil date algorithm from
+ * http://howardhinnant.github.io/date_algorithms.html
+ */
+static time_t sntp_time_tm_to_secs(const struct tm *tm) {
+    int64_t  year            = tm->tm_year + 1900 - (tm->tm_mon < 2 ? 1 : 0);
+    int64_t  era             = (year >= 0 ? year : year - 399) / 400;
+    uint32_t year_of_era     = year - era * 400;
+    uint32_t month           = tm->tm_mon + 1;
+    uint32_t day_of_year     = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + tm->tm_mday - 1;
+    uint32_t day_of_era      = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    int64_t  days_since_1970 = era * 146097 + (int64_t)day_of_era - 719468;
+
+    return days_since_1970 * SECS_PER_DAY + tm->tm_hour * MINS_PER_HOUR * SECS_PER_MIN + tm->tm_min * SECS_PER_MIN +
+           tm->tm_sec;
+}
+
+/*
+ * Full TZ rule evaluation through newlib, this is the expensive part the cache avoids
+ */
+static int32_t sntp_time_eval_utc_offset(time_t epoch_secs, int *is_dst_out) {
+    struct tm local = {0};
+    localtime_r(&epoch_secs, &local);
+    if (is_dst_out) {
+        *is_dst_out = local.tm_isdst;
+    }
+
+    return sntp_time_tm_to_secs(&local) - epoch_secs;
+}
+
+/*
+ * Walks forward a day at a time until the offset changes, then binary searches that day down to the exact second the
+ * new offset starts. Worst case a few hundred localtime calls, but only runs once per transition.
+ */
+static int32_t sntp_time_refresh_tz_cache(time_t now, int *is_dst_out) {
+    int     is_dst      = 0;
+    int32_t offset      = sntp_time_eval_utc_offset(now, &is_dst);
+    time_t  valid_until = now + SNTP_TIME_TRANSITION_SEARCH_DAYS * SECS_PER_DAY;
+
+    time_t same = now;
+    for (uint32_t day = 1; day <= SNTP_TIME_TRANSITION_SEARCH_DAYS; day++) {
+        time_t probe = now + (time_t)day * SECS_PER_DAY;
+        if (sntp_time_eval_utc_offset(probe, NULL) == offset) {
+            same = probe;
+            continue;
+        }
+
+        time_t changed = probe;
+        while (changed - same > 1) {
+            time_t mid = same + (changed - same) / 2;
+            if (sntp_time_eval_utc_offset(mid, NULL) == offset) {
+                same = mid;
+            } else {
+                changed = mid;
+            }
+        }
+        valid_until = changed;
+        break;
+    }
+
+    taskENTER_CRITICAL(&tz_cache_lock);
+    tz_cache.valid           = true;
+    tz_cache.valid_from      = now;
+    tz_cache.valid_until     = valid_until;
+    tz_cache.utc_offset_secs = offset;
+    tz_cache.is_dst          = is_dst;
+    taskEXIT_CRITICAL(&tz_cache_lock);
+
+    log_printf(LOG_LEVEL_DEBUG,
+               "Cached UTC offset %ld secs (dst: %d), next transition in %lld secs",
+               offset,
+               is_dst,
+               (int64_t)(valid_until - now));
+
+    *is_dst_out = is_dst;
+    return offset;
+}
+
+static void sntp_time_invalidate_tz_cache() {
+    taskENTER_CRITICAL(&tz_cache_lock);
+    tz_cache.valid = false;
+    taskEXIT_CRITICAL(&tz_cache_lock);
+}
+
+static bool sntp_time_drift_state_is_valid() {
+    return drift_state.magic == SNTP_TIME_DRIFT_MAGIC && fabsf(drift_state.drift_ppm) <= SNTP_TIME_MAX_DRIFT_PPM &&
+           drift_state.poll_interval_secs >= SNTP_TIME_MIN_POLL_SECS &&
+           drift_state.poll_interval_secs <= SNTP_TIME_MAX_POLL_SECS;
+}
+
+static void sntp_time_drift_state_reset() {
+    drift_state.magic                = SNTP_TIME_DRIFT_MAGIC;
+    drift_state.drift_ppm            = 0.0f;
+    drift_state.drift_samples        = 0;
+    drift_state.poll_interval_secs   = SNTP_TIME_MIN_POLL_SECS;
+    drift_state.last_sync_epoch_secs = 0;
+}
+
+static int64_t sntp_time_get_epoch_us() {
+    struct timeval now = {0};
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/*
+ * Where the drift model says NTP time is right now. Returns false if there's nothing to extrapolate from.
+ */
+static bool sntp_time_predict_epoch_us(int64_t mono_us, int64_t *predicted_epoch_us_out) {
+    taskENTER_CRITICAL(&drift_anchor_lock);
+    bool    valid     = drift_anchor_valid;
+    int64_t epoch_us  = drift_anchor_epoch_us;
+    int64_t anchor_us = drift_anchor_mono_us;
+    taskEXIT_CRITICAL(&drift_anchor_lock);
+
+    if (!valid) {
+        return false;
+    }
+
+    int64_t elapsed_us      = mono_us - anchor_us;
+    *predicted_epoch_us_out = epoch_us + elapsed_us + (int64_t)(elapsed_us * (double)drift_state.drift_ppm / 1e6);
+    return true;
+}
+
+static void sntp_time_set_drift_anchor(int64_t epoch_us, int64_t mono_us, bool from_ntp) {
+    taskENTER_CRITICAL(&drift_anchor_lock);
+    drift_anchor_valid    = true;
+    drift_anchor_from_ntp = from_ntp;
+    drift_anchor_epoch_us = epoch_us;
+    drift_anchor_mono_us  = mono_us;
+    taskEXIT_CRITICAL(&drift_anchor_lock);
+}
+
+/*
+ * Slews the system clock toward the drift model's prediction between syncs so everything reading time() (display,
+ * scheduler, log timestamps) gets the correction, and an offline device's clock stays right.
+ */
+static void sntp_time_drift_correction_timer_callback(void *args) {
+    int64_t predicted_epoch_us;
+    if (!sntp_time_predict_epoch_us(esp_timer_get_time(), &predicted_epoch_us)) {
+        return;
+    }
+
+    int64_t correction_us = predicted_epoch_us - sntp_time_get_epoch_us();
+    if (correction_us == 0) {
+        return;
+    }
+
+    const struct timeval delta = {.tv_sec = correction_us / 1000000, .tv_usec = correction_us % 1000000};
+    if (adjtime(&delta, NULL) != 0) {
+        log_printf(LOG_LEVEL_WARN, "Failed to apply drift correction of %lldus", correction_us);
+    }
+}
+
+/*
+ * Compares the new NTP time against what the model predicted for it, folds the measured drift into the model, and
+ * stretches or shrinks the poll interval depending on how far off the prediction was.
+ */
+static void sntp_time_update_drift_model(const struct timeval *tv) {
+    int64_t mono_us  = esp_timer_get_time();
+    int64_t epoch_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+    taskENTER_CRITICAL(&drift_anchor_lock);
+    bool    measurable      = drift_anchor_valid && drift_anchor_from_ntp;
+    int64_t anchor_epoch_us = drift_anchor_epoch_us;
+    int64_t anchor_mono_us  = drift_anchor_mono_us;
+    taskEXIT_CRITICAL(&drift_anchor_lock);
+
+    int64_t predicted_epoch_us;
+    bool    have_prediction = measurable && sntp_time_predict_epoch_us(mono_us, &predicted_epoch_us);
+    sntp_time_set_drift_anchor(epoch_us, mono_us, true);
+    drift_state.last_sync_epoch_secs = tv->tv_sec;
+
+    int64_t mono_elapsed_us = mono_us - anchor_mono_us;
+    if (!have_prediction || mono_elapsed_us < (int64_t)SNTP_TIME_MIN_DRIFT_SAMPLE_SECS * 1000000) {
+        return;
+    }
+
+    int64_t residual_ms  = (epoch_us - predicted_epoch_us) / 1000;
+    float   measured_ppm = (float)((double)(epoch_us - anchor_epoch_us - mono_elapsed_us) * 1e6 / mono_elapsed_us);
+    if (fabsf(measured_ppm) > SNTP_TIME_MAX_DRIFT_PPM) {
+        log_printf(LOG_LEVEL_WARN, "Measured drift of %.1fppm is out of range, ignoring sample", measured_ppm);
+        return;
+    }
+
+    if (drift_state.drift_samples == 0) {
+        drift_state.drift_ppm = measured_ppm;
+    } else {
+        drift_state.drift_ppm += SNTP_TIME_DRIFT_WEIGHT * (measured_ppm - drift_state.drift_ppm);
+    }
+    drift_state.drift_samples++;
+
+    uint32_t previous_interval_secs = drift_state.poll_interval_secs;
+    if (llabs(residual_ms) <= SNTP_TIME_GOOD_RESIDUAL_MS) {
+        drift_state.poll_interval_secs = MIN(drift_state.poll_interval_secs * 2, SNTP_TIME_MAX_POLL_SECS);
+    } else if (llabs(residual_ms) >= SNTP_TIME_BAD_RESIDUAL_MS) {
+        drift_state.poll_interval_secs = MAX(drift_state.poll_interval_secs / 2, SNTP_TIME_MIN_POLL_SECS);
+    }
+
+    if (drift_state.poll_interval_secs != previous_interval_secs) {
+        // Takes effect after the sync that's in progress, which is exactly when we want it
+        sntp_set_sync_interval(drift_state.poll_interval_secs * MS_PER_SEC);
+    }
+
+    log_printf(LOG_LEVEL_INFO,
+               "Sync landed %lldms from prediction, measured %.2fppm, model now %.2fppm over %lu samples, polling "
+               "every %lu secs",
+               residual_ms,
+               measured_ppm,
+               drift_state.drift_ppm,
+               drift_state.drift_samples,
+               drift_state.poll_interval_secs);
+}
+
 /*
  * Callback that fires every time the SNTP service syncs system time with received rmeote value. Superfluous with the
  * sntp_time_is_synced function below unless we wanted this to set a flag so we didn't have to poll that function
  */
 static void sntp_time_sync_notification_cb(struct timeval *tv) {
-    (void)tv;
+    // Time may have jumped anywhere
+    sntp_time_invalidate_tz_cache();
+    sntp_time_update_drift_model(tv);
 
-    time_t    now      = 0;
     struct tm timeinfo = {0};
-    time(&now);
-    localtime_r(&now, &timeinfo);
+    sntp_time_get_local_time(&timeinfo);
     char time_string[64];
     strftime(time_string, 64, "%c", &timeinfo);
     log_printf(LOG_LEVEL_DEBUG, "SNTP updated current time to %s", time_string);
@@ -34,6 +314,28 @@ void sntp_time_init() {
     sntp_setservername(2, "time.nist.gov");
     sntp_set_time_sync_notification_cb(sntp_time_sync_notification_cb);
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
+
+    if (!sntp_time_drift_state_is_valid()) {
+        sntp_time_drift_state_reset();
+    }
+    sntp_set_sync_interval(drift_state.poll_interval_secs * MS_PER_SEC);
+
+    // RTC time carries through a soft reset, pick the model back up from it. It can't be measured against since we
+    // don't know how long we were in reset.
+    if (sntp_time_has_trusted_rtc_time()) {
+        sntp_time_set_drift_anchor(sntp_time_get_epoch_us(), esp_timer_get_time(), false);
+    }
+
+    drift_correction_timer_handle = timer_local_init("sntp-drift-correction",
+                                                     sntp_time_drift_correction_timer_callback,
+                                                     NULL,
+                                                     SNTP_TIME_DRIFT_CORRECTION_PERIOD_MS);
+
+    log_printf(LOG_LEVEL_INFO,
+               "Drift model at %.2fppm over %lu samples, polling every %lu secs",
+               drift_state.drift_ppm,
+               drift_state.drift_samples,
+               drift_state.poll_interval_secs);
 }
 
 void sntp_time_start() {
@@ -42,6 +344,8 @@ void sntp_time_start() {
     if (!sntp_restart()) {
         sntp_init();
     }
+
+    timer_reset(drift_correction_timer_handle, true);
 }
 
 void sntp_time_stop() {
@@ -49,7 +353,21 @@ void sntp_time_stop() {
 }
 
 /*
- * Returns success if at least one time value has been received from remote
+ * True if the RTC time survived a reset and the last real sync was recent enough that we wouldn't have polled again
+ * yet anyway
+ */
+bool sntp_time_has_trusted_rtc_time() {
+    if (!sntp_time_drift_state_is_valid() || drift_state.last_sync_epoch_secs == 0) {
+        return false;
+    }
+
+    int64_t secs_since_sync = time(NULL) - drift_state.last_sync_epoch_secs;
+    return secs_since_sync >= 0 && secs_since_sync < drift_state.poll_interval_secs;
+}
+
+/*
+ * Returns success if at least one time value has been received from remote, or the RTC time from before a reset can
+ * still be trusted
  */
 bool sntp_time_is_synced() {
     sntp_sync_status_t status = sntp_get_sync_status();
@@ -59,6 +377,11 @@ bool sntp_time_is_synced() {
         return true;
     }
 
+    if (sntp_time_has_trusted_rtc_time()) {
+        log_printf(LOG_LEVEL_DEBUG, "SNTP not synced yet this boot but RTC time from last sync is still trusted");
+        return true;
+    }
+
     time_t    now      = 0;
     struct tm timeinfo = {0};
     time(&now);
@@ -92,15 +415,48 @@ void sntp_time_status_str(char *out_str) {
     }
 }
 
+/*
+ * Converts any epoch timestamp to local time using the cached offset, only falling back to full TZ evaluation if the
+ * timestamp is outside the cached window. Re-entrant safe.
+ */
+void sntp_time_epoch_to_local(time_t epoch_secs, struct tm *local_out) {
+    bool    hit    = false;
+    int32_t offset = 0;
+    int     is_dst = 0;
+
+    taskENTER_CRITICAL(&tz_cache_lock);
+    if (tz_cache.valid && epoch_secs >= tz_cache.valid_from && epoch_secs < tz_cache.valid_until) {
+        hit    = true;
+        offset = tz_cache.utc_offset_secs;
+        is_dst = tz_cache.is_dst;
+    }
+    taskEXIT_CRITICAL(&tz_cache_lock);
+
+    if (!hit) {
+        // Old timestamps (queued log records) shouldn't throw away the window for current time, only re-center the
+        // cache when time has moved past it or jumped backwards
+        if (epoch_secs < time(NULL) - SECS_PER_MIN) {
+            localtime_r(&epoch_secs, local_out);
+            return;
+        }
+
+        offset = sntp_time_refresh_tz_cache(epoch_secs, &is_dst);
+    }
+
+    // gmtime is plain arithmetic, no TZ lookup
+    time_t local_secs = epoch_secs + offset;
+    gmtime_r(&local_secs, local_out);
+    local_out->tm_isdst = is_dst;
+}
+
 /*
  * Pull the local time from the RTC and return in the tm struct. Assumes SNTP has already synced to an accurate value.
+ * Returns the epoch secs the tm struct was built from so callers don't need to mktime it back.
  */
-void sntp_time_get_local_time(struct tm *now_local_out) {
-    time_t    now            = 0;
-    struct tm now_local_temp = {0};
-    time(&now);
-    localtime_r(&now, &now_local_temp);
-    memcpy(now_local_out, &now_local_temp, sizeof(struct tm));
+time_t sntp_time_get_local_time(struct tm *now_local_out) {
+    time_t now = time(NULL);
+    sntp_time_epoch_to_local(now, now_local_out);
+    return now;
 }
 
 /*
@@ -122,6 +478,10 @@ void sntp_set_time(uint32_t epoch_secs) {
 
     const struct timeval time = {.tv_sec = epoch_secs, .tv_usec = 0};
     MEMFAULT_ASSERT(settimeofday(&time, NULL) == 0);
+    sntp_time_invalidate_tz_cache();
+
+    // Only good to the second and who knows how stale, fine to keep correcting drift from but not to measure it
+    sntp_time_set_drift_anchor((int64_t)epoch_secs * 1000000, esp_timer_get_time(), false);
 }
 
 void sntp_set_tz_str(char *new_tz_str) {
@@ -134,4 +494,5 @@ void sntp_set_tz_str(char *new_tz_str) {
     // https://www.gnu.org/software/libc/manual/html_node/TZ-Variable.html
     setenv("TZ", new_tz_str, 1);
     tzset();
+    sntp_time_invalidate_tz_cache();
 }
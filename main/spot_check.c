@@ -541,6 +541,14 @@ void spot_check_full_clear() {
     display_full_clear();
 }
 
+bool spot_check_screen_restored() {
+    return display_panel_state_restored();
+}
+
+void spot_check_clear_framebuffer() {
+    display_clear_framebuffer();
+}
+
 void spot_check_mark_all_lines_dirty() {
     display_mark_all_lines_dirty();
 }
@@ -549,6 +557,10 @@ void spot_check_render() {
     display_render();
 }
 
+void spot_check_render_fast() {
+    display_render_fast();
+}
+
 /*
  * Wrapper function for any module to call when device transitions to offline. Handles both updating the scheduler and
  * drawing necessary updates to the display.
@@ -16,15 +16,18 @@ typedef struct timer_info_t {
     void              *callback;
 } timer_info_t;
 
-// Used for button debounce, conditions re-fetch, and display splash screen callback
-static timer_info_t timer_infos[3];
+// Currently scheduler polling, wifi dhcp handoff, and sntp drift correction. Left with headroom so adding a timer
+// doesn't trip the assert at boot, bump this if it does.
+#define TIMER_MAX_TIMERS (6)
+
+static timer_info_t timer_infos[TIMER_MAX_TIMERS];
 static unsigned int next_timer_info_idx = 0;
 
 timer_info_handle timer_local_init(char        *timer_name,
                                    void        *timer_expired_callback,
                                    void        *callback_args,
                                    unsigned int timeout_milliseconds) {
-    MEMFAULT_ASSERT(next_timer_info_idx < sizeof(timer_infos) / sizeof(timer_info_t));
+    MEMFAULT_ASSERT(next_timer_info_idx < TIMER_MAX_TIMERS);
 
     timer_info_t *next_info = &timer_infos[next_timer_info_idx];
     next_timer_info_idx++;
@@ -8,13 +8,16 @@
 
 #define TAG SC_TAG_UART
 
-void uart_init(uart_port_t       port,
-               uint16_t          rx_ring_buffer_size,
-               uint16_t          tx_ring_buffer_size,
-               uint8_t           event_queue_size,
-               uint16_t          rx_buffer_size,
-               process_char_func process_char_cb,
-               uart_handle_t    *handle) {
+#define UART_RX_IDLE_TICK_MS (100)
+
+void uart_init(uart_port_t        port,
+               uint16_t           rx_ring_buffer_size,
+               uint16_t           tx_ring_buffer_size,
+               uint8_t            event_queue_size,
+               char              *rx_buffer,
+               uint16_t           rx_buffer_size,
+               process_bytes_func process_bytes_cb,
+               uart_handle_t     *handle) {
     handle->config.baud_rate = 115200;
     handle->config.data_bits = UART_DATA_8_BITS;
     handle->config.parity    = UART_PARITY_DISABLE;
@@ -40,33 +43,73 @@ void uart_init(uart_port_t       port,
                                         &handle->queue,
                                         0));
 
-    handle->rx_buffer = pvPortMalloc(sizeof(char) * rx_buffer_size);
-    assert(handle->rx_buffer);
+    // Line end detection so the rx task gets an event as soon as a full CLI line is in, instead of waiting for the rx
+    // fifo threshold / timeout. Positions aren't used, rx task drains everything buffered on any data event and the
+    // driver drops stale positions as they're read past.
+    ESP_ERROR_CHECK(uart_enable_pattern_det_baud_intr(handle->port, '\r', 1, 9, 0, 0));
+    ESP_ERROR_CHECK(uart_pattern_queue_reset(handle->port, event_queue_size));
+
+    assert(rx_buffer);
+    handle->rx_buffer      = rx_buffer;
+    handle->rx_buffer_size = rx_buffer_size;
+
+    handle->process_bytes = process_bytes_cb;
+}
+
+/*
+ * Read out everything currently in the driver rx ring in rx_buffer sized chunks and hand each off to the handler.
+ */
+static void uart_drain_rx(uart_handle_t *handle) {
+    size_t buffered_len = 0;
+    uart_get_buffered_data_len(handle->port, &buffered_len);
+
+    while (buffered_len > 0) {
+        const int bytes_read =
+            uart_read_bytes(handle->port, handle->rx_buffer, MIN(buffered_len, handle->rx_buffer_size), 0);
+        if (bytes_read <= 0) {
+            break;
+        }
+
+        if (handle->process_bytes) {
+            handle->process_bytes((uint8_t *)handle->rx_buffer, bytes_read);
+        } else {
+            char msg[80];
+            int  msg_len = sprintf(msg, "uart_generic_rx_task RX %d bytes, no process_bytes handler\r\n", bytes_read);
+            uart_write_bytes(handle->port, msg, msg_len);
+        }
 
-    handle->process_char = process_char_cb;
+        buffered_len -= MIN(buffered_len, (size_t)bytes_read);
+    }
 }
 
 void uart_generic_rx_task(void *args) {
     uart_handle_t *handle = args;
     assert(handle);
 
+    uart_event_t event;
     while (1) {
-        // Underlying impl uses esp-freertos xRingBufferReceive which I'm pretty sure used a freertos primitive below
-        // it, so this portMAX_DELAY should do our regular yield like we want instead of spinning
-        const int bytes_read = uart_read_bytes(handle->port, handle->rx_buffer, 1, portMAX_DELAY);
-        if (bytes_read) {
-            if (handle->process_char) {
-                handle->process_char(handle->rx_buffer[0]);
-            } else {
-                char  *base     = "uart_generic_rx_task RX byte, no process_byte handler:";
-                size_t base_len = strlen(base);
-                char   full[base_len + 3];
-                sprintf(full, "%s %c", base, handle->rx_buffer[0]);
-                uart_write_bytes(handle->port, full, base_len + 2);
+        if (!xQueueReceive(handle->queue, &event, pdMS_TO_TICKS(UART_RX_IDLE_TICK_MS))) {
+            if (handle->process_bytes) {
+                handle->process_bytes(NULL, 0);
             }
-        } else {
-            log_printf(LOG_LEVEL_ERROR,
-                       "uart_read_bytes returned with no bytes read, but we should yield forever until bytes exist");
+            continue;
+        }
+
+        switch (event.type) {
+            case UART_DATA:
+            case UART_PATTERN_DET:
+                uart_drain_rx(handle);
+                break;
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // Driver stops pushing into the ring once it's full, have to flush to get it going again. Anything
+                // partially received is lost, CLI line gets cut and uart_xfer will NAK and resend.
+                log_printf(LOG_LEVEL_WARN, "UART rx overflow (event %d), flushing input", event.type);
+                uart_flush_input(handle->port);
+                xQueueReset(handle->queue);
+                break;
+            default:
+                break;
         }
     }
 }
@@ -0,0 +1,333 @@
+#include <string.h>
+
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "memfault/panics/assert.h"
+
+#include "constants.h"
+#include "flash_partition.h"
+#include "log.h"
+#include "sleep_handler.h"
+#include "uart.h"
+#include "uart_xfer.h"
+
+#define TAG SC_TAG_UART_XFER
+
+#define UART_XFER_SECTOR_BYTES (4096)
+#define UART_XFER_IDLE_TIMEOUT_MS (5 * MS_PER_SEC)
+#define UART_XFER_VERIFY_CHUNK_BYTES (256)
+
+// seq + len
+#define UART_XFER_HEADER_BYTES (4)
+#define UART_XFER_CRC_BYTES (4)
+
+typedef enum {
+    RX_STATE_SYNC_0,
+    RX_STATE_SYNC_1,
+    RX_STATE_HEADER,
+    RX_STATE_BODY,
+} rx_state_t;
+
+static uart_handle_t     *handle;
+static process_bytes_func prev_process_bytes;
+
+static const esp_partition_t *partition;
+static uint32_t               base_offset;
+static uint32_t               total_len;
+static uint32_t               expected_crc32;
+static uint32_t               bytes_written;
+static uint16_t               expected_seq;
+static bool                   nak_sent;
+static TickType_t             last_rx_ticks;
+
+// Frame is buffered starting from seq, sync bytes are never stored
+static rx_state_t rx_state;
+static uint8_t    frame_buffer[UART_XFER_HEADER_BYTES + UART_XFER_MAX_PAYLOAD_BYTES + UART_XFER_CRC_BYTES];
+static size_t     frame_idx;
+static size_t     frame_len;
+
+static uint16_t uart_xfer_read_u16(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8);
+}
+
+static uint32_t uart_xfer_read_u32(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static void uart_xfer_send_ack(uart_xfer_ack_type_t type, uart_xfer_status_t status) {
+    uint8_t ack[10] = {
+        UART_XFER_ACK_SYNC_0,
+        UART_XFER_ACK_SYNC_1,
+        type,
+        expected_seq & 0xFF,
+        expected_seq >> 8,
+        status,
+    };
+
+    uint32_t crc = esp_rom_crc32_le(0, &ack[2], 4);
+    ack[6]       = crc & 0xFF;
+    ack[7]       = (crc >> 8) & 0xFF;
+    ack[8]       = (crc >> 16) & 0xFF;
+    ack[9]       = crc >> 24;
+
+    uart_write_bytes(handle->port, ack, sizeof(ack));
+}
+
+/*
+ * Only NAK once per expected seq. Host rewinds on the first one, everything else still in flight from the old window
+ * is going to be out of order too and doesn't need its own NAK.
+ */
+static void uart_xfer_send_nak(uart_xfer_status_t status) {
+    if (nak_sent) {
+        return;
+    }
+
+    uart_xfer_send_ack(UART_XFER_ACK_TYPE_NAK, status);
+    nak_sent = true;
+}
+
+static uart_xfer_status_t uart_xfer_verify() {
+    uint8_t  buf[UART_XFER_VERIFY_CHUNK_BYTES];
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < total_len; offset += UART_XFER_VERIFY_CHUNK_BYTES) {
+        uint32_t  chunk_len = MIN(UART_XFER_VERIFY_CHUNK_BYTES, total_len - offset);
+        esp_err_t err       = esp_partition_read(partition, base_offset + offset, buf, chunk_len);
+        if (err != ESP_OK) {
+            log_printf(LOG_LEVEL_ERROR, "Error reading back flash to verify: %s", esp_err_to_name(err));
+            return UART_XFER_STATUS_FLASH_ERR;
+        }
+
+        crc = esp_rom_crc32_le(crc, buf, chunk_len);
+    }
+
+    if (crc != expected_crc32) {
+        log_printf(LOG_LEVEL_ERROR, "CRC mismatch after xfer, expected 0x%08lx got 0x%08lx", expected_crc32, crc);
+        return UART_XFER_STATUS_VERIFY_ERR;
+    }
+
+    return UART_XFER_STATUS_OK;
+}
+
+/*
+ * Always runs in the uart rx task. Makes sure the DONE frame is out at the xfer baud before switching back to normal.
+ */
+static void uart_xfer_finish(uart_xfer_status_t status) {
+    uart_xfer_send_ack(UART_XFER_ACK_TYPE_DONE, status);
+    uart_wait_tx_done(handle->port, pdMS_TO_TICKS(100));
+
+    handle->process_bytes = prev_process_bytes;
+    uart_set_baudrate(handle->port, handle->config.baud_rate);
+    sleep_handler_set_idle(SYSTEM_IDLE_CLI_BIT);
+
+    if (status == UART_XFER_STATUS_OK) {
+        log_printf(LOG_LEVEL_INFO,
+                   "xfer of %lu bytes into '%s' @ 0x%lx complete",
+                   total_len,
+                   partition->label,
+                   base_offset);
+    } else {
+        log_printf(LOG_LEVEL_ERROR,
+                   "xfer into '%s' failed with status %d after %lu/%lu bytes",
+                   partition->label,
+                   status,
+                   bytes_written,
+                   total_len);
+    }
+
+    partition = NULL;
+}
+
+/*
+ * Returns false if the xfer was finished (successfully or not) and any remaining rx bytes should be dropped.
+ */
+static bool uart_xfer_handle_frame() {
+    uint16_t seq         = uart_xfer_read_u16(&frame_buffer[0]);
+    uint16_t payload_len = uart_xfer_read_u16(&frame_buffer[2]);
+    uint32_t frame_crc   = uart_xfer_read_u32(&frame_buffer[UART_XFER_HEADER_BYTES + payload_len]);
+
+    if (esp_rom_crc32_le(0, frame_buffer, UART_XFER_HEADER_BYTES + payload_len) != frame_crc) {
+        uart_xfer_send_nak(UART_XFER_STATUS_CRC_ERR);
+        return true;
+    }
+
+    if (seq != expected_seq) {
+        // Re-sent frame we already have because our ack got lost, re-ack so the host moves its window forward
+        if ((uint16_t)(expected_seq - seq) <= UART_XFER_WINDOW_FRAMES) {
+            uart_xfer_send_ack(UART_XFER_ACK_TYPE_ACK, UART_XFER_STATUS_OK);
+        } else {
+            uart_xfer_send_nak(UART_XFER_STATUS_SEQ_ERR);
+        }
+        return true;
+    }
+
+    if (bytes_written + payload_len > total_len) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "Frame %u overruns xfer length (%lu + %u > %lu)",
+                   seq,
+                   bytes_written,
+                   payload_len,
+                   total_len);
+        uart_xfer_finish(UART_XFER_STATUS_SEQ_ERR);
+        return false;
+    }
+
+    esp_err_t err = flash_partition_write(partition,
+                                          base_offset + bytes_written,
+                                          &frame_buffer[UART_XFER_HEADER_BYTES],
+                                          payload_len);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error writing xfer frame %u to flash: %s", seq, esp_err_to_name(err));
+        uart_xfer_finish(UART_XFER_STATUS_FLASH_ERR);
+        return false;
+    }
+
+    bytes_written += payload_len;
+    expected_seq++;
+    nak_sent = false;
+
+    if (bytes_written == total_len) {
+        uart_xfer_finish(uart_xfer_verify());
+        return false;
+    }
+
+    uart_xfer_send_ack(UART_XFER_ACK_TYPE_ACK, UART_XFER_STATUS_OK);
+    return true;
+}
+
+static void uart_xfer_process_bytes(const uint8_t *bytes, size_t len) {
+    TickType_t now_ticks = xTaskGetTickCount();
+    if (len == 0) {
+        if (now_ticks - last_rx_ticks > pdMS_TO_TICKS(UART_XFER_IDLE_TIMEOUT_MS)) {
+            uart_xfer_finish(UART_XFER_STATUS_TIMEOUT);
+        }
+        return;
+    }
+    last_rx_ticks = now_ticks;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = bytes[i];
+        switch (rx_state) {
+            case RX_STATE_SYNC_0:
+                if (byte == UART_XFER_DATA_SYNC_0) {
+                    rx_state = RX_STATE_SYNC_1;
+                }
+                break;
+            case RX_STATE_SYNC_1:
+                if (byte == UART_XFER_DATA_SYNC_1) {
+                    rx_state  = RX_STATE_HEADER;
+                    frame_idx = 0;
+                } else if (byte != UART_XFER_DATA_SYNC_0) {
+                    rx_state = RX_STATE_SYNC_0;
+                }
+                break;
+            case RX_STATE_HEADER:
+                frame_buffer[frame_idx++] = byte;
+                if (frame_idx == UART_XFER_HEADER_BYTES) {
+                    uint16_t payload_len = uart_xfer_read_u16(&frame_buffer[2]);
+                    if (payload_len == 0 || payload_len > UART_XFER_MAX_PAYLOAD_BYTES) {
+                        // Garbage or a sync pattern in the middle of a payload we lost the start of, resync
+                        uart_xfer_send_nak(UART_XFER_STATUS_CRC_ERR);
+                        rx_state = RX_STATE_SYNC_0;
+                        break;
+                    }
+
+                    frame_len = UART_XFER_HEADER_BYTES + payload_len + UART_XFER_CRC_BYTES;
+                    rx_state  = RX_STATE_BODY;
+                }
+                break;
+            case RX_STATE_BODY:
+                frame_buffer[frame_idx++] = byte;
+                if (frame_idx == frame_len) {
+                    rx_state = RX_STATE_SYNC_0;
+                    if (!uart_xfer_handle_frame()) {
+                        return;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+void uart_xfer_init(uart_handle_t *uart_handle) {
+    MEMFAULT_ASSERT(uart_handle);
+    handle    = uart_handle;
+    partition = NULL;
+}
+
+bool uart_xfer_is_active() {
+    return partition != NULL;
+}
+
+/*
+ * Called from the CLI task. Erases the destination range up front (can take a few seconds for big images) so the rx
+ * path only ever has to write, then hands the UART over to the xfer rx handler at the new baud.
+ */
+bool uart_xfer_start(const char *partition_label, uint32_t offset, uint32_t len, uint32_t crc32, uint32_t baud) {
+    if (uart_xfer_is_active()) {
+        log_printf(LOG_LEVEL_ERROR, "xfer already in progress");
+        return false;
+    }
+
+    const esp_partition_t *dest =
+        esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (dest == NULL) {
+        log_printf(LOG_LEVEL_ERROR, "No partition found with label '%s'", partition_label);
+        return false;
+    }
+
+    if (dest == esp_ota_get_running_partition()) {
+        log_printf(LOG_LEVEL_ERROR, "Refusing to xfer into the currently running app partition");
+        return false;
+    }
+
+    if (offset % UART_XFER_SECTOR_BYTES != 0) {
+        log_printf(LOG_LEVEL_ERROR, "xfer offset 0x%lx must be %d byte aligned", offset, UART_XFER_SECTOR_BYTES);
+        return false;
+    }
+
+    if (len == 0 || offset + len > dest->size) {
+        log_printf(LOG_LEVEL_ERROR,
+                   "xfer of %lu bytes @ 0x%lx doesn't fit in '%s' (%lu bytes)",
+                   len,
+                   offset,
+                   partition_label,
+                   dest->size);
+        return false;
+    }
+
+    uint32_t  erase_len = (len + UART_XFER_SECTOR_BYTES - 1) & ~(UART_XFER_SECTOR_BYTES - 1);
+    esp_err_t err       = flash_partition_erase_range(dest, offset, erase_len);
+    if (err != ESP_OK) {
+        log_printf(LOG_LEVEL_ERROR, "Error erasing xfer destination: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    base_offset    = offset;
+    total_len      = len;
+    expected_crc32 = crc32;
+    bytes_written  = 0;
+    expected_seq   = 0;
+    nak_sent       = false;
+    rx_state       = RX_STATE_SYNC_0;
+    partition      = dest;
+
+    // Host waits for this line before switching its own baud, so it has to be fully out before we switch
+    log_printf(LOG_LEVEL_INFO,
+               "xfer ready for %lu bytes into '%s' @ 0x%lx, switching to %lu baud",
+               len,
+               partition_label,
+               offset,
+               baud);
+    log_wait_until_all_tx();
+
+    sleep_handler_set_busy(SYSTEM_IDLE_CLI_BIT);
+    uart_set_baudrate(handle->port, baud);
+    last_rx_ticks         = xTaskGetTickCount();
+    prev_process_bytes    = handle->process_bytes;
+    handle->process_bytes = uart_xfer_process_bytes;
+
+    return true;
+}
@@ -1,13 +1,18 @@
 #include "constants.h"
 
 #include <string.h>
+#include <time.h>
 #include <wifi_provisioning/manager.h>
 #include <wifi_provisioning/scheme_softap.h>
 
+#include "esp_attr.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
+#include "memfault/metrics/metrics.h"
 #include "memfault/panics/assert.h"
 
 #include "lwip/err.h"
@@ -19,6 +24,7 @@
 #include "mdns_local.h"
 #include "scheduler_task.h"
 #include "spot_check.h"
+#include "timer.h"
 #include "wifi.h"
 
 #define TAG SC_TAG_WIFI
@@ -32,12 +38,161 @@
 // This can be really bad on boot sometimes
 #define PROVISIONED_NETWORK_CONNECTION_MAXIMUM_RETRY 6
 
+// AP beacons are ~100ms apart so this is about a second of sleep between wakes when in max modem sleep
+#define WIFI_STA_LISTEN_INTERVAL_BEACONS (10)
+
+#define WIFI_FAST_CONNECT_MAGIC (0x57464331)  // 'WFC1'
+// Only reuse a lease this young without asking DHCP, well under any lease time a router would realistically hand out
+// so the address can't have gone to anyone else. Also how long a session on a reused lease runs before going to DHCP.
+#define WIFI_FAST_CONNECT_MAX_LEASE_AGE_SECS (60 * SECS_PER_MIN)
+
+/*
+ * Everything needed to skip the scan and DHCP on the next connect to the same network. Lives in RTC memory so it
+ * survives deep sleep and soft reboots (config change, OTA, crash), a cold boot takes the full path and refills it.
+ */
+typedef struct {
+    uint32_t            magic;
+    uint8_t             ssid[32];
+    uint8_t             bssid[6];
+    uint8_t             channel;
+    esp_netif_ip_info_t ip_info;
+    esp_ip4_addr_t      dns;
+    time_t              lease_saved_epoch_secs;
+} wifi_fast_connect_cache_t;
+
 static bool wifi_is_provisioning_inited = false;
 
 static esp_event_handler_instance_t provisioning_manager_event_handler;
 static EventGroupHandle_t           wifi_event_group;
 static volatile int                 sta_connect_attempts = 0;
 
+// Not zeroed on boot, validated by the magic instead
+static RTC_NOINIT_ATTR wifi_fast_connect_cache_t fast_connect_cache;
+
+static esp_netif_t      *sta_netif;
+static timer_info_handle dhcp_handoff_timer_handle;
+static volatile bool     fast_connect_in_progress = false;
+static volatile bool     fast_connect_config_set  = false;
+static volatile bool     static_lease_in_use      = false;
+static volatile bool     radio_stopped            = false;
+static int64_t           sta_start_us             = 0;
+
+static bool wifi_fast_connect_cache_valid(wifi_config_t *sta_config) {
+    return fast_connect_cache.magic == WIFI_FAST_CONNECT_MAGIC && fast_connect_cache.channel > 0 &&
+           memcmp(fast_connect_cache.ssid, sta_config->sta.ssid, sizeof(fast_connect_cache.ssid)) == 0;
+}
+
+static bool wifi_fast_connect_lease_valid() {
+    time_t age_secs = time(NULL) - fast_connect_cache.lease_saved_epoch_secs;
+    return fast_connect_cache.ip_info.ip.addr != 0 && age_secs >= 0 &&
+           age_secs < WIFI_FAST_CONNECT_MAX_LEASE_AGE_SECS;
+}
+
+/*
+ * Called on every DHCP assigned IP so the cache always holds the latest AP and lease
+ */
+static void wifi_fast_connect_save(ip_event_got_ip_t *event) {
+    wifi_ap_record_t ap_info;
+    wifi_config_t    sta_config;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &sta_config) != ESP_OK) {
+        return;
+    }
+
+    esp_netif_dns_info_t dns_info = {0};
+    esp_netif_get_dns_info(event->esp_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+
+    memcpy(fast_connect_cache.ssid, sta_config.sta.ssid, sizeof(fast_connect_cache.ssid));
+    memcpy(fast_connect_cache.bssid, ap_info.bssid, sizeof(fast_connect_cache.bssid));
+    fast_connect_cache.channel                = ap_info.primary;
+    fast_connect_cache.ip_info                = event->ip_info;
+    fast_connect_cache.dns                    = dns_info.ip.u_addr.ip4;
+    fast_connect_cache.lease_saved_epoch_secs = time(NULL);
+    fast_connect_cache.magic                  = WIFI_FAST_CONNECT_MAGIC;
+}
+
+/*
+ * Puts the sta config back to a normal scan of any AP on the network so reconnects can still roam, and hands the
+ * address back to DHCP if we were running on a reused lease. Safe to call when fast connect wasn't used.
+ */
+static void wifi_fast_connect_restore_config() {
+    if (fast_connect_config_set) {
+        wifi_config_t sta_config;
+        esp_wifi_get_config(WIFI_IF_STA, &sta_config);
+        sta_config.sta.bssid_set   = false;
+        sta_config.sta.channel     = 0;
+        sta_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+        fast_connect_config_set = false;
+    }
+
+    if (static_lease_in_use) {
+        esp_netif_dhcpc_start(sta_netif);
+        static_lease_in_use = false;
+    }
+}
+
+static void wifi_dhcp_handoff_timer_callback(void *args) {
+    log_printf(LOG_LEVEL_INFO, "Reused lease hit max age, handing address back to DHCP");
+    if (static_lease_in_use) {
+        esp_netif_dhcpc_start(sta_netif);
+        static_lease_in_use = false;
+    }
+}
+
+/*
+ * Points the sta config at the cached AP so the driver skips the full scan, and if the lease is still fresh sets it as
+ * a static address so IP_EVENT_STA_GOT_IP fires right on association instead of after DHCP
+ */
+static void wifi_fast_connect_apply() {
+    wifi_config_t sta_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_config) != ESP_OK || !wifi_fast_connect_cache_valid(&sta_config)) {
+        log_printf(LOG_LEVEL_INFO, "No cached AP for this network, doing full connect");
+        return;
+    }
+
+    memcpy(sta_config.sta.bssid, fast_connect_cache.bssid, sizeof(sta_config.sta.bssid));
+    sta_config.sta.bssid_set   = true;
+    sta_config.sta.channel     = fast_connect_cache.channel;
+    sta_config.sta.scan_method = WIFI_FAST_SCAN;
+    if (esp_wifi_set_config(WIFI_IF_STA, &sta_config) != ESP_OK) {
+        return;
+    }
+    fast_connect_config_set  = true;
+    fast_connect_in_progress = true;
+
+    if (wifi_fast_connect_lease_valid() && esp_netif_dhcpc_stop(sta_netif) == ESP_OK) {
+        esp_netif_dns_info_t dns_info = {.ip.type = ESP_IPADDR_TYPE_V4, .ip.u_addr.ip4 = fast_connect_cache.dns};
+        esp_netif_set_ip_info(sta_netif, &fast_connect_cache.ip_info);
+        esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+        static_lease_in_use = true;
+
+        uint32_t remaining_secs = WIFI_FAST_CONNECT_MAX_LEASE_AGE_SECS -
+                                  (time(NULL) - fast_connect_cache.lease_saved_epoch_secs);
+        timer_change_period(dhcp_handoff_timer_handle, remaining_secs * MS_PER_SEC);
+        timer_reset(dhcp_handoff_timer_handle, false);
+    }
+
+    log_printf(LOG_LEVEL_INFO,
+               "Fast connecting to cached AP " MACSTR " on channel %u",
+               MAC2STR(fast_connect_cache.bssid),
+               fast_connect_cache.channel);
+    if (static_lease_in_use) {
+        log_printf(LOG_LEVEL_INFO, "Reusing cached lease " IPSTR, IP2STR(&fast_connect_cache.ip_info.ip));
+    }
+}
+
+/*
+ * Directed connect didn't work (AP moved channel, different AP, creds changed), drop the cache and fall back to the
+ * full scan + DHCP. Doesn't count against the normal retries.
+ */
+static void wifi_fast_connect_fall_back() {
+    log_printf(LOG_LEVEL_WARN, "Fast connect to cached AP failed, falling back to full scan and DHCP");
+    fast_connect_in_progress = false;
+    fast_connect_cache.magic = 0;
+    wifi_fast_connect_restore_config();
+    esp_wifi_connect();
+}
+
 /*
  * Main event handler function for setting whether we're connected or not and printing out statuses
  */
@@ -52,12 +207,28 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
                 log_printf(LOG_LEVEL_INFO, "Got STA_CONN event");
                 break;
             case WIFI_EVENT_STA_DISCONNECTED: {
+                memfault_metrics_heartbeat_timer_stop(MEMFAULT_METRICS_KEY(wifi_connected_time_ms));
+
+                // Expected from wifi_radio_off, nothing to retry and the scheduler shouldn't go offline for it
+                if (radio_stopped) {
+                    fast_connect_in_progress = false;
+                    wifi_fast_connect_restore_config();
+                    break;
+                }
+
+                if (fast_connect_in_progress) {
+                    wifi_fast_connect_fall_back();
+                    break;
+                }
+                wifi_fast_connect_restore_config();
+
                 // This case occurs both when we can't connect to previously provisioned network on startup (because it
                 // no longer exists) or temporary discons from network that is still present. Hand off to scheduler to
                 // poll.
                 if (sta_connect_attempts < PROVISIONED_NETWORK_CONNECTION_MAXIMUM_RETRY) {
                     esp_wifi_connect();
                     sta_connect_attempts++;
+                    memfault_metrics_heartbeat_add(MEMFAULT_METRICS_KEY(wifi_reconnect_count), 1);
                 } else {
                     scheduler_mode_t mode = scheduler_get_mode();
                     if (mode == SCHEDULER_MODE_INIT) {
@@ -94,8 +265,17 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
         switch (event_id) {
             case IP_EVENT_STA_GOT_IP: {
                 ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-                log_printf(LOG_LEVEL_INFO, "Setting CONNECTED bit, got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-                sta_connect_attempts = 0;
+                log_printf(LOG_LEVEL_INFO,
+                           "Setting CONNECTED bit, got ip:" IPSTR " %lldms after sta start%s",
+                           IP2STR(&event->ip_info.ip),
+                           (esp_timer_get_time() - sta_start_us) / 1000,
+                           static_lease_in_use ? " (reused lease)" : "");
+                sta_connect_attempts     = 0;
+                fast_connect_in_progress = false;
+                memfault_metrics_heartbeat_timer_start(MEMFAULT_METRICS_KEY(wifi_connected_time_ms));
+                if (!static_lease_in_use) {
+                    wifi_fast_connect_save(event);
+                }
                 mdns_advertise_tcp_service();
 
                 // Signal to any tasks blocking on an internet connection that they're good to go
@@ -163,9 +343,51 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
 
 void wifi_start_sta() {
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+
+    // Only takes effect at association, lets the power policy stretch modem sleep out when idle
+    wifi_config_t sta_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &sta_config) == ESP_OK) {
+        sta_config.sta.listen_interval = WIFI_STA_LISTEN_INTERVAL_BEACONS;
+        esp_wifi_set_config(WIFI_IF_STA, &sta_config);
+    }
+
+    wifi_fast_connect_apply();
+    sta_start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
 }
 
+/*
+ * Stops the radio entirely without the disconnect being treated as a lost connection. Scheduler mode is left alone,
+ * caller is responsible for bringing it back with wifi_radio_on before any network request.
+ */
+void wifi_radio_off() {
+    if (radio_stopped) {
+        return;
+    }
+
+    radio_stopped = true;
+    xEventGroupClearBits(wifi_event_group, WIFI_EVENT_GROUP_CONNECTED_TO_NETWORK_BIT);
+    esp_wifi_stop();
+}
+
+/*
+ * Restarts the radio after wifi_radio_off and kicks off a (fast) connect. Doesn't wait for the connection, block on
+ * wifi_block_until_connected_timeout for that.
+ */
+void wifi_radio_on() {
+    if (!radio_stopped) {
+        return;
+    }
+
+    radio_stopped        = false;
+    sta_connect_attempts = 0;
+    wifi_start_sta();
+}
+
+bool wifi_is_radio_on() {
+    return !radio_stopped;
+}
+
 void wifi_init(void *event_handler) {
     wifi_event_group = xEventGroupCreate();
     MEMFAULT_ASSERT(wifi_event_group);
@@ -178,7 +400,11 @@ void wifi_init(void *event_handler) {
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL));
 
     esp_netif_create_default_wifi_ap();
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
+    dhcp_handoff_timer_handle = timer_local_init("wifi-dhcp-handoff",
+                                                 wifi_dhcp_handoff_timer_callback,
+                                                 NULL,
+                                                 WIFI_FAST_CONNECT_MAX_LEASE_AGE_SECS * MS_PER_SEC);
 
     wifi_init_config_t default_config = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&default_config));
@@ -0,0 +1,81 @@
+#! /usr/bin/env python3
+#
+# Pushes a raw 4bpp image (2 pixels per byte, same format the API serves for custom screens / charts) straight to a
+# device on the LAN with POST /screen. Packbits compresses by default, see main/include/packbits.h.
+#
+# usage:
+#   python3 screen_push.py spot-check.local dashboard.raw
+#   python3 screen_push.py spot-check.local --region 100 200 300 80 --encoding raw status_box.raw
+#
+# Only needs the python stdlib.
+
+import argparse
+import sys
+import time
+import urllib.error
+import urllib.request
+
+SCREEN_WIDTH_PX = 800
+SCREEN_HEIGHT_PX = 600
+
+
+def packbits_encode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        # Repeat run of at least 2 identical bytes, up to 128
+        run = 1
+        while i + run < len(data) and run < 128 and data[i + run] == data[i]:
+            run += 1
+        if run > 1:
+            out.append((1 - run) & 0xFF)
+            out.append(data[i])
+            i += run
+            continue
+
+        # Literal run until the next pair of repeated bytes, up to 128
+        start = i
+        while i < len(data) and i - start < 128:
+            if i + 1 < len(data) and data[i] == data[i + 1]:
+                break
+            i += 1
+        out.append(i - start - 1)
+        out += data[start:i]
+
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Push a 4bpp image to a Spot Check over the LAN")
+    parser.add_argument("host", help="device hostname or ip, e.g. spot-check.local")
+    parser.add_argument("file", help="raw 4bpp image file, 2 pixels per byte")
+    parser.add_argument("--region", type=int, nargs=4, metavar=("X", "Y", "W", "H"),
+                        help="screen region the image covers, x and w must be even. Defaults to full screen")
+    parser.add_argument("--encoding", choices=["packbits", "raw"], default="packbits")
+    args = parser.parse_args()
+
+    x, y, w, h = args.region if args.region else (0, 0, SCREEN_WIDTH_PX, SCREEN_HEIGHT_PX)
+    with open(args.file, "rb") as f:
+        data = f.read()
+
+    if len(data) != w * h // 2:
+        print("Image is %d bytes but a %dx%d region needs %d" % (len(data), w, h, w * h // 2))
+        sys.exit(1)
+
+    body = packbits_encode(data) if args.encoding == "packbits" else data
+    url = "http://%s/screen?x=%d&y=%d&w=%d&h=%d&encoding=%s" % (args.host, x, y, w, h, args.encoding)
+    req = urllib.request.Request(url, data=body, method="POST",
+                                 headers={"Content-Type": "application/octet-stream"})
+
+    start = time.time()
+    try:
+        urllib.request.urlopen(req, timeout=30)
+    except urllib.error.HTTPError as e:
+        print("Push failed: %d %s" % (e.code, e.read().decode(errors="replace")))
+        sys.exit(1)
+
+    print("Pushed %d bytes (%d on the wire) in %.2fs" % (len(data), len(body), time.time() - start))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,181 @@
+#! /usr/bin/env python3
+#
+# Streams a file into a flash partition over the CLI UART using the device's 'xfer' command. Way faster than going
+# through the API for loading test images / fonts in the lab or at the factory. Protocol details are in
+# main/include/uart_xfer.h.
+#
+# usage:
+#   python3 uart_xfer.py --port /dev/cu.usbserial-0001 screen_img 0x0 test_image.bin
+#   python3 uart_xfer.py --port /dev/cu.usbserial-0001 --baud 2000000 screen_img 0x12000 swell_chart.bin
+#
+# Needs pyserial, comes with the esp-idf python env.
+
+import argparse
+import re
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+# Must match uart_xfer.h
+DATA_SYNC = b"\xa5\xc3"
+ACK_SYNC = b"\x5a\x3c"
+ACK_FRAME_BYTES = 10
+MAX_PAYLOAD_BYTES = 512
+WINDOW_FRAMES = 4
+DEFAULT_BAUD = 921600
+
+ACK_TYPE_ACK = 0x01
+ACK_TYPE_NAK = 0x02
+ACK_TYPE_DONE = 0x03
+STATUS_STRS = {
+    0x00: "ok",
+    0x01: "crc error",
+    0x02: "sequence error",
+    0x03: "flash error",
+    0x04: "verify error",
+    0x05: "timeout",
+}
+
+CLI_BAUD = 115200
+READY_TIMEOUT_SECS = 30
+ACK_TIMEOUT_SECS = 1.0
+MAX_RETRIES = 10
+
+
+def build_frame(seq, payload):
+    body = struct.pack("<HH", seq, len(payload)) + payload
+    return DATA_SYNC + body + struct.pack("<I", zlib.crc32(body))
+
+
+class AckReader:
+    def __init__(self, port):
+        self.port = port
+        self.buffer = b""
+
+    def read(self, timeout):
+        deadline = time.time() + timeout
+        while True:
+            sync_idx = self.buffer.find(ACK_SYNC)
+            if sync_idx >= 0:
+                self.buffer = self.buffer[sync_idx:]
+                if len(self.buffer) >= ACK_FRAME_BYTES:
+                    frame = self.buffer[:ACK_FRAME_BYTES]
+                    ack_type, seq, status, crc = struct.unpack_from("<BHBI", frame, 2)
+                    if zlib.crc32(frame[2:6]) == crc:
+                        self.buffer = self.buffer[ACK_FRAME_BYTES:]
+                        return ack_type, seq, status
+
+                    # Sync pattern in the middle of log output, skip past it
+                    self.buffer = self.buffer[1:]
+                    continue
+            else:
+                # Anything else is log output at the xfer baud, keep a possible partial sync byte
+                self.buffer = self.buffer[-1:]
+
+            if time.time() > deadline:
+                return None
+
+            self.buffer += self.port.read(max(1, self.port.in_waiting))
+
+
+def wait_for_ready(port, cmd):
+    port.reset_input_buffer()
+    port.write((cmd + "\r").encode())
+
+    line_buffer = ""
+    deadline = time.time() + READY_TIMEOUT_SECS
+    while time.time() < deadline:
+        line_buffer += port.read(max(1, port.in_waiting)).decode("utf-8", errors="replace")
+        match = re.search(r"switching to (\d+) baud", line_buffer)
+        if match:
+            return int(match.group(1))
+        if "Failed to start xfer" in line_buffer:
+            break
+
+    sys.stdout.write(line_buffer)
+    return None
+
+
+def send(port, data):
+    frames = [data[i:i + MAX_PAYLOAD_BYTES] for i in range(0, len(data), MAX_PAYLOAD_BYTES)]
+    acks = AckReader(port)
+
+    # Go-back-N. base is the oldest unacked frame, next is the next one to put on the wire.
+    base = 0
+    next_seq = 0
+    retries = 0
+    start = time.time()
+    while True:
+        while next_seq < len(frames) and next_seq < base + WINDOW_FRAMES:
+            port.write(build_frame(next_seq, frames[next_seq]))
+            next_seq += 1
+
+        ack = acks.read(ACK_TIMEOUT_SECS)
+        if ack is None:
+            retries += 1
+            if retries > MAX_RETRIES:
+                print("\nNo response from device, giving up")
+                return False
+            next_seq = base
+            continue
+
+        ack_type, seq, status = ack
+        if ack_type == ACK_TYPE_DONE:
+            elapsed = time.time() - start
+            print("\n%s after %d bytes in %.1fs (%.1f KB/s)" %
+                  (STATUS_STRS.get(status, "unknown status %d" % status), len(data), elapsed,
+                   len(data) / elapsed / 1024))
+            return status == 0
+
+        if ack_type == ACK_TYPE_NAK:
+            retries += 1
+            if retries > MAX_RETRIES:
+                print("\nToo many NAKs (last: %s), giving up" % STATUS_STRS.get(status, status))
+                return False
+            next_seq = seq
+        else:
+            retries = 0
+
+        base = max(base, seq)
+        sys.stdout.write("\r%d / %d bytes" % (min(base * MAX_PAYLOAD_BYTES, len(data)), len(data)))
+        sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Stream a file into a Spot Check flash partition over UART")
+    parser.add_argument("label", help="destination partition label, e.g. screen_img")
+    parser.add_argument("offset", help="offset into the partition, must be 4k aligned")
+    parser.add_argument("file", help="file to send")
+    parser.add_argument("--port", required=True, help="serial port the CLI is on")
+    parser.add_argument("--baud", type=int, default=DEFAULT_BAUD, help="baud to switch to for the transfer")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        data = f.read()
+
+    offset = int(args.offset, 0)
+    cmd = "xfer %s 0x%x %d 0x%08x %d" % (args.label, offset, len(data), zlib.crc32(data), args.baud)
+
+    port = serial.Serial(args.port, CLI_BAUD, timeout=0.05)
+    print("Erasing and waiting for device to be ready...")
+    baud = wait_for_ready(port, cmd)
+    if baud is None:
+        print("Device never signaled ready")
+        sys.exit(1)
+
+    port.baudrate = baud
+    # Small delay so the device has definitely switched over before the first frame
+    time.sleep(0.05)
+    port.reset_input_buffer()
+
+    success = send(port, data)
+    port.baudrate = CLI_BAUD
+    port.close()
+    sys.exit(0 if success else 1)
+
+
+if __name__ == "__main__":
+    main()